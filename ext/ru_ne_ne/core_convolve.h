@@ -11,12 +11,47 @@
 #include <ruby.h>
 #include <xmmintrin.h>
 #include "core_narray.h"
+#include "core_parallel.h"
+#include "core_gemm.h"
+#include "core_fft.h"
 
 #define LARGEST_RANK 16
 
-void core_convole(
+// Multiply-adds below which a convolution runs on the calling thread only
+#define CONVOLVE_PARALLEL_MIN_WORK 65536
+
+// im2col is used instead of convolving with each kernel in turn for banks of at least
+// CONVOLVE_IM2COL_MIN_KERNELS kernels, each of at least CONVOLVE_IM2COL_MIN_KERNEL_SIZE
+#define CONVOLVE_IM2COL_MIN_KERNELS 16
+#define CONVOLVE_IM2COL_MIN_KERNEL_SIZE 64
+
+// FFT is used when it is estimated to be faster. Each transform is assumed to cost as much as
+// CONVOLVE_FFT_COST_FACTOR * size * log2( size ) multiply-adds of the other engines. Kernels
+// smaller than CONVOLVE_FFT_MIN_KERNEL_SIZE never use FFT, as the estimate is least reliable.
+#define CONVOLVE_FFT_COST_FACTOR 12.0
+#define CONVOLVE_FFT_MIN_KERNEL_SIZE 64
+
+// Size of each pool thread's buffer of copied input patches, so that it stays in L2 cache
+#define CONVOLVE_IM2COL_BLOCK_FLOATS 32768
+
+// Convolves with a single kernel, directly. These run without the GVL, and return 0, or -1 if
+// there was not enough memory for their scratch buffers.
+int core_convole(
     int in_rank, int *in_shape, float *in_ptr,
     int kernel_rank, int *kernel_shape, float *kernel_ptr,
     int out_rank, int *out_shape, float *out_ptr );
 
+// Convolves with num_kernels kernels of the same shape, stored one after another, by im2col and
+// matrix multiply. Outputs for each kernel are stored one after another.
+int core_convolve_im2col( int rank, int *in_shape, float *in_ptr,
+    int *kernel_shape, int num_kernels, float *kernel_ptr, int *out_shape, float *out_ptr );
+
+// As core_convolve_im2col, using products of FFTs
+int core_convolve_fft( int rank, int *in_shape, float *in_ptr,
+    int *kernel_shape, int num_kernels, float *kernel_ptr, int *out_shape, float *out_ptr );
+
+// As core_convolve_im2col, choosing whichever engine is fastest for the sizes
+int core_convolve_bank( int rank, int *in_shape, float *in_ptr,
+    int *kernel_shape, int num_kernels, float *kernel_ptr, int *out_shape, float *out_ptr );
+
 #endif
@@ -0,0 +1,344 @@
+// ext/ru_ne_ne/core_fft.c
+
+#include "core_fft.h"
+
+static int fft_is_good_size( int n ) {
+  while ( n % 2 == 0 ) { n /= 2; }
+  while ( n % 3 == 0 ) { n /= 3; }
+  while ( n % 5 == 0 ) { n /= 5; }
+  return n == 1;
+}
+
+int fft_good_size( int n, int even ) {
+  if ( n < 1 ) {
+    n = 1;
+  }
+  while ( ! fft_is_good_size( n ) || ( even && n % 2 ) ) {
+    n++;
+  }
+  return n;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Plans, and their cache. Radix 4 is used where possible, as it needs fewest multiplies.
+//
+
+static pthread_mutex_t fft_plan_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FFTPlan *fft_plan_cache[FFT_PLAN_CACHE_SIZE];
+static int fft_num_cached = 0;
+
+static void fft_plan_factor( FFTPlan *plan ) {
+  int n = plan->n, i = 0, p;
+
+  for ( p = 4; n > 1; ) {
+    while ( n % p ) {
+      switch ( p ) {
+        case 4: p = 2; break;
+        case 2: p = 3; break;
+        default: p += 2;
+      }
+    }
+    n /= p;
+    plan->factors[i++] = p;
+    plan->factors[i++] = n;
+  }
+
+  // A transform of size 1 is a copy
+  if ( i == 0 ) {
+    plan->factors[0] = 1;
+    plan->factors[1] = 1;
+  }
+
+  return;
+}
+
+static void fft_plan_destroy( FFTPlan *plan ) {
+  free( plan->twiddles );
+  free( plan->inv_twiddles );
+  free( plan->real_twiddles );
+  free( plan );
+  return;
+}
+
+static FFTPlan *fft_plan_create( int n ) {
+  int i;
+  double phase;
+  FFTPlan *plan = malloc( sizeof(FFTPlan) );
+
+  if ( ! plan ) {
+    return NULL;
+  }
+  plan->n = n;
+  plan->cached = 0;
+  fft_plan_factor( plan );
+
+  plan->twiddles = malloc( n * sizeof(FFTComplex) );
+  plan->inv_twiddles = malloc( n * sizeof(FFTComplex) );
+  plan->real_twiddles = malloc( ( n + 1 ) * sizeof(FFTComplex) );
+  if ( ! plan->twiddles || ! plan->inv_twiddles || ! plan->real_twiddles ) {
+    fft_plan_destroy( plan );
+    return NULL;
+  }
+
+  for ( i = 0; i < n; i++ ) {
+    phase = -2.0 * M_PI * i / n;
+    plan->twiddles[i].re = plan->inv_twiddles[i].re = cos( phase );
+    plan->twiddles[i].im = sin( phase );
+    plan->inv_twiddles[i].im = -plan->twiddles[i].im;
+  }
+
+  for ( i = 0; i <= n; i++ ) {
+    phase = -M_PI * i / n;
+    plan->real_twiddles[i].re = cos( phase );
+    plan->real_twiddles[i].im = sin( phase );
+  }
+
+  return plan;
+}
+
+FFTPlan *fft_plan_acquire( int n ) {
+  int i;
+  FFTPlan *plan;
+
+  pthread_mutex_lock( &fft_plan_mutex );
+  for ( i = 0; i < fft_num_cached; i++ ) {
+    if ( fft_plan_cache[i]->n == n ) {
+      plan = fft_plan_cache[i];
+      pthread_mutex_unlock( &fft_plan_mutex );
+      return plan;
+    }
+  }
+  pthread_mutex_unlock( &fft_plan_mutex );
+
+  // Twiddles are made without holding the lock, so another thread may make the same plan. Only
+  // the first one to be added is kept.
+  plan = fft_plan_create( n );
+  if ( ! plan ) {
+    return NULL;
+  }
+
+  pthread_mutex_lock( &fft_plan_mutex );
+  for ( i = 0; i < fft_num_cached; i++ ) {
+    if ( fft_plan_cache[i]->n == n ) {
+      pthread_mutex_unlock( &fft_plan_mutex );
+      fft_plan_destroy( plan );
+      return fft_plan_cache[i];
+    }
+  }
+  if ( fft_num_cached < FFT_PLAN_CACHE_SIZE ) {
+    plan->cached = 1;
+    fft_plan_cache[ fft_num_cached++ ] = plan;
+  }
+  pthread_mutex_unlock( &fft_plan_mutex );
+
+  return plan;
+}
+
+void fft_plan_release( FFTPlan *plan ) {
+  if ( ! plan->cached ) {
+    fft_plan_destroy( plan );
+  }
+  return;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Complex transform, by recursive decimation in time
+//
+
+static inline FFTComplex fft_mul( FFTComplex a, FFTComplex b ) {
+  FFTComplex c;
+  c.re = a.re * b.re - a.im * b.im;
+  c.im = a.re * b.im + a.im * b.re;
+  return c;
+}
+
+static void fft_butterfly_2( FFTComplex *out, int fstride, FFTComplex *tw, int m ) {
+  int k;
+  FFTComplex t;
+
+  for ( k = 0; k < m; k++ ) {
+    t = fft_mul( out[m + k], tw[k * fstride] );
+    out[m + k].re = out[k].re - t.re;
+    out[m + k].im = out[k].im - t.im;
+    out[k].re += t.re;
+    out[k].im += t.im;
+  }
+
+  return;
+}
+
+static void fft_butterfly_4( FFTComplex *out, int fstride, FFTComplex *tw, int m, int inverse ) {
+  int k;
+  FFTComplex s0, s1, s2, s3, s4, s5;
+
+  for ( k = 0; k < m; k++ ) {
+    s0 = fft_mul( out[k + m], tw[k * fstride] );
+    s1 = fft_mul( out[k + 2 * m], tw[2 * k * fstride] );
+    s2 = fft_mul( out[k + 3 * m], tw[3 * k * fstride] );
+
+    s5.re = out[k].re - s1.re;  s5.im = out[k].im - s1.im;
+    out[k].re += s1.re;         out[k].im += s1.im;
+    s3.re = s0.re + s2.re;      s3.im = s0.im + s2.im;
+    s4.re = s0.re - s2.re;      s4.im = s0.im - s2.im;
+
+    out[k + 2 * m].re = out[k].re - s3.re;
+    out[k + 2 * m].im = out[k].im - s3.im;
+    out[k].re += s3.re;
+    out[k].im += s3.im;
+
+    if ( inverse ) {
+      out[k + m].re = s5.re - s4.im;      out[k + m].im = s5.im + s4.re;
+      out[k + 3 * m].re = s5.re + s4.im;  out[k + 3 * m].im = s5.im - s4.re;
+    } else {
+      out[k + m].re = s5.re + s4.im;      out[k + m].im = s5.im - s4.re;
+      out[k + 3 * m].re = s5.re - s4.im;  out[k + 3 * m].im = s5.im + s4.re;
+    }
+  }
+
+  return;
+}
+
+// Used for radix 3 and 5
+static void fft_butterfly_generic( FFTComplex *out, int fstride, FFTComplex *tw, int n, int m, int p ) {
+  int u, q, q1, k, tw_idx;
+  FFTComplex scratch[5], t;
+
+  for ( u = 0; u < m; u++ ) {
+    for ( q1 = 0, k = u; q1 < p; q1++, k += m ) {
+      scratch[q1] = out[k];
+    }
+
+    for ( q1 = 0, k = u; q1 < p; q1++, k += m ) {
+      tw_idx = 0;
+      out[k] = scratch[0];
+      for ( q = 1; q < p; q++ ) {
+        tw_idx += fstride * k;
+        if ( tw_idx >= n ) {
+          tw_idx -= n;
+        }
+        t = fft_mul( scratch[q], tw[tw_idx] );
+        out[k].re += t.re;
+        out[k].im += t.im;
+      }
+    }
+  }
+
+  return;
+}
+
+static void fft_work( FFTPlan *plan, FFTComplex *tw, int inverse, FFTComplex *out, FFTComplex *in,
+    int fstride, int *factors ) {
+  int p = factors[0], m = factors[1];
+  FFTComplex *out_begin = out, *out_end = out + p * m;
+
+  if ( m == 1 ) {
+    do {
+      *out = *in;
+      in += fstride;
+    } while ( ++out != out_end );
+  } else {
+    do {
+      fft_work( plan, tw, inverse, out, in, fstride * p, factors + 2 );
+      in += fstride;
+    } while ( ( out += m ) != out_end );
+  }
+
+  out = out_begin;
+  switch ( p ) {
+    case 1:
+      break;
+    case 2:
+      fft_butterfly_2( out, fstride, tw, m );
+      break;
+    case 4:
+      fft_butterfly_4( out, fstride, tw, m, inverse );
+      break;
+    default:
+      fft_butterfly_generic( out, fstride, tw, plan->n, m, p );
+  }
+
+  return;
+}
+
+void fft_complex( FFTPlan *plan, int inverse, FFTComplex *in, FFTComplex *out ) {
+  fft_work( plan, inverse ? plan->inv_twiddles : plan->twiddles, inverse, out, in, 1, plan->factors );
+  return;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Real transforms, as a complex transform of half the size. With Z the transform of values
+//  packed in pairs, bin k of the real transform is
+//    ( Z[k] + conj(Z[n-k]) ) / 2 + w^k ( Z[k] - conj(Z[n-k]) ) / 2i, where w = exp( -i pi / n )
+//  Bins k and n - k depend on the same two values, so are found together in place.
+//
+
+void fft_real_forward( FFTPlan *plan, FFTComplex *packed, FFTComplex *out ) {
+  int k, j, n = plan->n;
+  FFTComplex zk, zj, even, odd, w;
+
+  fft_complex( plan, 0, packed, out );
+
+  zk = out[0];
+  out[0].re = zk.re + zk.im;
+  out[0].im = 0.0;
+  out[n].re = zk.re - zk.im;
+  out[n].im = 0.0;
+
+  for ( k = 1; k <= n / 2; k++ ) {
+    j = n - k;
+    zk = out[k];
+    zj = out[j];
+
+    // Bin k
+    even.re = 0.5 * ( zk.re + zj.re );  even.im = 0.5 * ( zk.im - zj.im );
+    odd.re = 0.5 * ( zk.im + zj.im );   odd.im = -0.5 * ( zk.re - zj.re );
+    w = fft_mul( plan->real_twiddles[k], odd );
+    out[k].re = even.re + w.re;
+    out[k].im = even.im + w.im;
+
+    // Bin j, where the roles of zk and zj swap
+    even.im = -even.im;
+    odd.im = -odd.im;
+    w = fft_mul( plan->real_twiddles[j], odd );
+    out[j].re = even.re + w.re;
+    out[j].im = even.im + w.im;
+  }
+
+  return;
+}
+
+void fft_real_inverse( FFTPlan *plan, FFTComplex *spectrum, FFTComplex *out ) {
+  int k, j, n = plan->n;
+  FFTComplex xk, xj, even, odd, w;
+
+  for ( k = 0; k <= n / 2; k++ ) {
+    j = n - k;
+    xk = spectrum[k];
+    xj = spectrum[j];
+
+    // Bin k of the packed transform is even + i * odd
+    even.re = xk.re + xj.re;  even.im = xk.im - xj.im;
+    odd.re = xk.re - xj.re;   odd.im = xk.im + xj.im;
+    w.re = plan->real_twiddles[k].re;
+    w.im = -plan->real_twiddles[k].im;
+    odd = fft_mul( odd, w );
+    spectrum[k].re = even.re - odd.im;
+    spectrum[k].im = even.im + odd.re;
+
+    if ( j < n && j != k ) {
+      even.im = -even.im;
+      odd.re = xj.re - xk.re;  odd.im = xj.im + xk.im;
+      w.re = plan->real_twiddles[j].re;
+      w.im = -plan->real_twiddles[j].im;
+      odd = fft_mul( odd, w );
+      spectrum[j].re = even.re - odd.im;
+      spectrum[j].im = even.im + odd.re;
+    }
+  }
+
+  fft_complex( plan, 1, spectrum, out );
+  return;
+}
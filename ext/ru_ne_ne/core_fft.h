@@ -0,0 +1,60 @@
+// ext/ru_ne_ne/core_fft.h
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Declarations of fast Fourier transform functions, for sizes that are products of 2, 3 and 5
+//
+
+#ifndef CORE_FFT_H
+#define CORE_FFT_H
+
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+
+// Most plans kept for re-use. Plans made once the cache is full are freed after use.
+#define FFT_PLAN_CACHE_SIZE 32
+
+#define FFT_MAX_FACTORS 32
+
+typedef struct _fft_complex {
+    double re;
+    double im;
+  } FFTComplex;
+
+// Factors and twiddle tables for complex transforms of size n, and real transforms of size 2n.
+// Plans do not change once made, so may be shared by many threads.
+typedef struct _fft_plan {
+    int n;
+    int cached;
+    int factors[2 * FFT_MAX_FACTORS];
+    FFTComplex *twiddles;
+    FFTComplex *inv_twiddles;
+    FFTComplex *real_twiddles;
+  } FFTPlan;
+
+// Smallest size at least n that has no prime factors other than 2, 3 and 5, and is even if
+// even is set
+int fft_good_size( int n, int even );
+
+// Finds a cached plan for size n, or makes one. The size must have no prime factors other than
+// 2, 3 and 5. Safe to call without the GVL, and from many threads. Returns NULL if there is not
+// enough memory to make the plan.
+FFTPlan *fft_plan_acquire( int n );
+
+// Must be called once for each call to fft_plan_acquire
+void fft_plan_release( FFTPlan *plan );
+
+// Transforms n values from in to out, which must not overlap. The inverse is not scaled, so
+// applying both multiplies by n.
+void fft_complex( FFTPlan *plan, int inverse, FFTComplex *in, FFTComplex *out );
+
+// Transforms 2n real values, given packed in pairs as n complex values, to the first n + 1
+// complex values of their spectrum, in out
+void fft_real_forward( FFTPlan *plan, FFTComplex *packed, FFTComplex *out );
+
+// Inverse of fft_real_forward, from the first n + 1 values of a spectrum, which are overwritten,
+// to 2n real values packed in pairs in out. Not scaled, so values are multiplied by 2n.
+void fft_real_inverse( FFTPlan *plan, FFTComplex *spectrum, FFTComplex *out );
+
+#endif
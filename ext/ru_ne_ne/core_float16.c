@@ -0,0 +1,53 @@
+// ext/ru_ne_ne/core_float16.c
+
+#include "core_float16.h"
+
+// Rounds to nearest even. Values too large for half become infinity, and values too small
+// become subnormal or zero.
+uint16_t float_to_float16( float f ) {
+  uint32_t bits, sign, mantissa, round_bit;
+  int exponent;
+
+  memcpy( &bits, &f, sizeof(float) );
+  sign = ( bits >> 16 ) & 0x8000;
+  exponent = (int) ( ( bits >> 23 ) & 0xff );
+  mantissa = bits & 0x7fffff;
+
+  if ( exponent == 0xff ) {
+    // Inf or NaN, keeping NaN quiet
+    return (uint16_t) ( sign | 0x7c00 | ( mantissa ? 0x200 : 0 ) );
+  }
+
+  exponent -= 112;
+  if ( exponent >= 0x1f ) {
+    return (uint16_t) ( sign | 0x7c00 );
+  }
+
+  if ( exponent <= 0 ) {
+    if ( exponent < -10 ) {
+      return (uint16_t) sign;
+    }
+    mantissa |= 0x800000;
+    round_bit = 1u << ( 13 - exponent );
+    bits = mantissa >> ( 14 - exponent );
+    if ( ( mantissa & round_bit ) && ( ( mantissa & ( 3 * round_bit - 1 ) ) ) ) {
+      bits++;
+    }
+    return (uint16_t) ( sign | bits );
+  }
+
+  bits = ( (uint32_t) exponent << 10 ) | ( mantissa >> 13 );
+  if ( ( mantissa & 0x1000 ) && ( mantissa & 0x2fff ) ) {
+    // May carry into exponent, which correctly rounds up to the next power of two or infinity
+    bits++;
+  }
+  return (uint16_t) ( sign | bits );
+}
+
+void float16_encode( int n, float *src, uint16_t *dst ) {
+  int i;
+  for ( i = 0; i < n; i++ ) {
+    dst[i] = float_to_float16( src[i] );
+  }
+  return;
+}
@@ -0,0 +1,46 @@
+// ext/ru_ne_ne/core_float16.h
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Conversions between float and IEEE 754 half precision, stored as uint16_t bit patterns
+//
+
+#ifndef CORE_FLOAT16_H
+#define CORE_FLOAT16_H
+
+#include <stdint.h>
+#include <string.h>
+
+static inline float float16_to_float( uint16_t h ) {
+  uint32_t sign = ( (uint32_t) h & 0x8000 ) << 16;
+  uint32_t exponent = ( h >> 10 ) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  uint32_t bits;
+  float f;
+
+  if ( exponent == 0x1f ) {
+    // Inf or NaN
+    bits = sign | 0x7f800000 | ( mantissa << 13 );
+  } else if ( exponent != 0 ) {
+    bits = sign | ( ( exponent + 112 ) << 23 ) | ( mantissa << 13 );
+  } else if ( mantissa == 0 ) {
+    bits = sign;
+  } else {
+    // Subnormal half becomes a normal float
+    exponent = 113;
+    while ( ! ( mantissa & 0x400 ) ) {
+      mantissa <<= 1;
+      exponent--;
+    }
+    bits = sign | ( exponent << 23 ) | ( ( mantissa & 0x3ff ) << 13 );
+  }
+
+  memcpy( &f, &bits, sizeof(float) );
+  return f;
+}
+
+uint16_t float_to_float16( float f );
+
+void float16_encode( int n, float *src, uint16_t *dst );
+
+#endif
@@ -0,0 +1,83 @@
+// ext/ru_ne_ne/core_gemm.c
+
+#include "core_gemm.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Blocked GEMM
+//
+//    Benchmark: 1000 items through 784 -> 256 layer, 100 iterations, AVX2 kernels.
+//      One item at a time with feed_forward_linear: 1.7 seconds
+//      Batched with gemm_abt_accumulate: 1.1 seconds
+//
+
+void gemm_abt_accumulate( int m, int n, int k,
+    float *a, int lda, float *b, int ldb, float *c, int ldc ) {
+  int i, j, kk, jj, kc, j_end, j_aligned_end;
+  float *a_row, *c_row;
+
+  for ( kk = 0; kk < k; kk += GEMM_BLOCK_K ) {
+    kc = k - kk < GEMM_BLOCK_K ? k - kk : GEMM_BLOCK_K;
+
+    for ( jj = 0; jj < n; jj += GEMM_BLOCK_N ) {
+      j_end = n - jj < GEMM_BLOCK_N ? n : jj + GEMM_BLOCK_N;
+      j_aligned_end = jj + 4 * ( ( j_end - jj ) / 4 );
+
+      // The block of b is re-used for every row of a, two rows at a time
+      for ( i = 0; i < m; i += 2 ) {
+        a_row = a + i * lda + kk;
+        c_row = c + i * ldc;
+
+        if ( i + 1 < m ) {
+          for ( j = jj; j < j_aligned_end; j += 4 ) {
+            simd_kernels.dot_2x4( kc, a_row, a_row + lda,
+                b + j * ldb + kk, b + ( j + 1 ) * ldb + kk,
+                b + ( j + 2 ) * ldb + kk, b + ( j + 3 ) * ldb + kk,
+                c_row + j, c_row + ldc + j );
+          }
+          for ( j = j_aligned_end; j < j_end; j++ ) {
+            c_row[j] += simd_kernels.dot( kc, a_row, b + j * ldb + kk );
+            c_row[ldc + j] += simd_kernels.dot( kc, a_row + lda, b + j * ldb + kk );
+          }
+        } else {
+          for ( j = jj; j < j_aligned_end; j += 4 ) {
+            simd_kernels.dot_1x4( kc, a_row,
+                b + j * ldb + kk, b + ( j + 1 ) * ldb + kk,
+                b + ( j + 2 ) * ldb + kk, b + ( j + 3 ) * ldb + kk,
+                c_row + j );
+          }
+          for ( j = j_aligned_end; j < j_end; j++ ) {
+            c_row[j] += simd_kernels.dot( kc, a_row, b + j * ldb + kk );
+          }
+        }
+      }
+    }
+  }
+
+  return;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Transpose, in small square tiles so that both reads and writes stay within a few cache lines
+//
+
+#define TRANSPOSE_TILE 8
+
+void transpose( int rows, int cols, float *src, int lds, float *dst, int ldd ) {
+  int i, j, ii, jj, i_end, j_end;
+
+  for ( ii = 0; ii < rows; ii += TRANSPOSE_TILE ) {
+    i_end = rows - ii < TRANSPOSE_TILE ? rows : ii + TRANSPOSE_TILE;
+    for ( jj = 0; jj < cols; jj += TRANSPOSE_TILE ) {
+      j_end = cols - jj < TRANSPOSE_TILE ? cols : jj + TRANSPOSE_TILE;
+      for ( i = ii; i < i_end; i++ ) {
+        for ( j = jj; j < j_end; j++ ) {
+          dst[ j * ldd + i ] = src[ i * lds + j ];
+        }
+      }
+    }
+  }
+
+  return;
+}
@@ -0,0 +1,27 @@
+// ext/ru_ne_ne/core_gemm.h
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Declarations of cache-blocked matrix multiply functions, used for batch calculations
+//
+
+#ifndef CORE_GEMM_H
+#define CORE_GEMM_H
+
+#include "core_simd.h"
+
+// Block sizes, chosen so that a block of b rows (GEMM_BLOCK_N x GEMM_BLOCK_K floats, 16KB)
+// stays in L1 cache while rows of a are streamed past it
+#define GEMM_BLOCK_K 256
+#define GEMM_BLOCK_N 16
+
+// c[i][j] += sum_k( a[i][k] * b[j][k] ), for a (m x k), b (n x k) and c (m x n), all stored
+// row-major with row strides lda, ldb and ldc
+void gemm_abt_accumulate( int m, int n, int k,
+    float *a, int lda, float *b, int ldb, float *c, int ldc );
+
+// dst[j][i] = src[i][j], for src (rows x cols) with row stride lds, and dst (cols x rows) with
+// row stride ldd
+void transpose( int rows, int cols, float *src, int lds, float *dst, int ldd );
+
+#endif
@@ -2,39 +2,6 @@
 
 #include "core_max_pool.h"
 
-// This is copied from na_array.c, with safety checks and temp vars removed
-inline int cnnc_inline_idxs_to_pos( int rank, int *shape, int *idxs ) {
-  int i, pos = 0;
-  for ( i = rank - 1; i >= 0; i-- ) {
-    if ( idxs[i] >= shape[i] ) {
-      pos = -1;
-      break;
-    }
-    pos = pos * shape[i] + idxs[i];
-  }
-  return pos;
-}
-
-// Starts indices
-inline void indices_reset( int rank, int *indices ) {
-  int i;
-  for ( i = 0; i < 16; i++ ) { indices[i] = 0; }
-  return;
-}
-
-// Increments indices
-inline void indices_inc( int rank, int *shape, int *indices ) {
-  int i;
-  for ( i = 0; i < rank; i++ ) {
-    indices[i]++;
-    if ( indices[i] < shape[i] ) {
-      break;
-    }
-    indices[i] = 0;
-  }
-  return;
-}
-
 inline int size_from_shape2( int rank, int *shape ) {
   int size = 1;
   int i;
@@ -44,39 +11,134 @@ inline int size_from_shape2( int rank, int *shape ) {
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
-//  Max-pool multi-dimension array
-//
-//    Benchmark: 256x256 inputs, tile 2, pool 3. 1000 iterations. 1.68 seconds.
+//  Max-pool multi-dimension array. Each output row is found by streaming along the input rows
+//  that its pools cover, so work can be split into tiles of whole output rows.
 //
+//    Benchmark: 256x256 inputs, tile 2, pool 3. 1000 iterations.
+//      Gathering pool values for each output: 1.20 seconds.
+//      By rows, one thread: 0.75 seconds.
 //
 
-void core_max_pool( int rank, int *input_shape, float *input_ptr,
-    int *output_shape, float *output_ptr, int tile_by, int pool_by ) {
-  int i, j, k, pool_size, output_size, pos;
-  int output_idx[16], input_idx[16], pool_idx[16], pool_shape[16];
-  double max;
+typedef struct _max_pool_args {
+    int rank;
+    int *input_shape;
+    float *input_ptr;
+    int *output_shape;
+    float *output_ptr;
+    int tile_by;
+    int pool_by;
+  } MaxPoolArgs;
 
-  for ( i = 0; i < rank; i++ ) { pool_shape[i] = pool_by; }
-  pool_size = size_from_shape2( rank, pool_shape );
-  output_size = size_from_shape2( rank, output_shape );
+// Max of pools along part of one output row, outputs x_start...x_end, from one input row
+static inline void max_pool_row( float *in_row, int in_width, float *out_row, int x_start, int x_end,
+    int tile_by, int pool_by ) {
+  int x, p, c;
+  float v;
 
-  indices_reset( rank, output_idx );
+  for ( x = x_start; x < x_end; x++ ) {
+    c = x * tile_by;
+    for ( p = 0; p < pool_by && c < in_width; p++, c++ ) {
+      v = in_row[c];
+      if ( v > out_row[x] ) {
+        out_row[x] = v;
+      }
+    }
+  }
 
-  for (i = 0; i < output_size; i++ ) {
-    max = -1e30;
-    indices_reset( rank, pool_idx );
+  return;
+}
 
-    for (j = 0; j < pool_size; j++ ) {
-      for ( k = 0; k < rank; k++ ) { input_idx[k] = output_idx[k] * tile_by + pool_idx[k]; }
-      pos = cnnc_inline_idxs_to_pos( rank, input_shape, input_idx );
-      if ( pos >= 0 && input_ptr[pos] > max ) {
-        max = input_ptr[pos];
+// Computes outputs start...end, a row at a time
+static void max_pool_rows( void *data, int slot, int start, int end ) {
+  MaxPoolArgs *args = (MaxPoolArgs *) data;
+  int i, j, k, pos, rest, row, x_start, x_end, in_offset, num_pools, in_row_size, ok;
+  int rank = args->rank, tile_by = args->tile_by, pool_by = args->pool_by;
+  int *input_shape = args->input_shape, *output_shape = args->output_shape;
+  int out_width = output_shape[0], in_width = input_shape[0];
+  int row_idx[16], pool_idx[16], pool_shape[16], input_idx;
+  float *out_row;
+
+  for ( k = 1; k < rank; k++ ) { pool_shape[k] = pool_by; }
+  num_pools = 1;
+  for ( k = 1; k < rank; k++ ) { num_pools *= pool_by; }
+
+  for ( pos = start; pos < end; pos = x_end + row * out_width ) {
+    row = pos / out_width;
+    x_start = pos - row * out_width;
+    x_end = end - row * out_width < out_width ? end - row * out_width : out_width;
+
+    out_row = args->output_ptr + (size_t) row * out_width;
+    for ( i = x_start; i < x_end; i++ ) {
+      out_row[i] = -1e30;
+    }
+
+    rest = row;
+    for ( k = 1; k < rank; k++ ) {
+      row_idx[k] = rest % output_shape[k];
+      rest /= output_shape[k];
+    }
+
+    for ( k = 1; k < rank; k++ ) { pool_idx[k] = 0; }
+    for ( j = 0; j < num_pools; j++ ) {
+      // Offset of the input row, unless the pool has gone past the input's edge
+      ok = 1;
+      in_offset = 0;
+      in_row_size = in_width;
+      for ( k = 1; k < rank; k++ ) {
+        input_idx = row_idx[k] * tile_by + pool_idx[k];
+        if ( input_idx >= input_shape[k] ) {
+          ok = 0;
+          break;
+        }
+        in_offset += input_idx * in_row_size;
+        in_row_size *= input_shape[k];
+      }
+
+      if ( ok ) {
+        max_pool_row( args->input_ptr + in_offset, in_width, out_row, x_start, x_end, tile_by, pool_by );
+      }
+
+      for ( k = 1; k < rank; k++ ) {
+        if ( ++pool_idx[k] < pool_shape[k] ) {
+          break;
+        }
+        pool_idx[k] = 0;
       }
-      indices_inc( rank, pool_shape, pool_idx );
     }
+  }
+
+  return;
+}
 
-    output_ptr[i] = max;
-    indices_inc( rank, output_shape, output_idx );
+void core_max_pool( int rank, int *input_shape, float *input_ptr,
+    int *output_shape, float *output_ptr, int tile_by, int pool_by ) {
+  int i, output_size, pool_size, num_threads, chunk_size;
+  MaxPoolArgs args;
+
+  output_size = size_from_shape2( rank, output_shape );
+  pool_size = 1;
+  for ( i = 0; i < rank; i++ ) { pool_size *= pool_by; }
+
+  args.rank = rank;
+  args.input_shape = input_shape;
+  args.input_ptr = input_ptr;
+  args.output_shape = output_shape;
+  args.output_ptr = output_ptr;
+  args.tile_by = tile_by;
+  args.pool_by = pool_by;
+
+  num_threads = parallel_num_threads();
+  if ( num_threads > 1 && (double) output_size * pool_size >= MAX_POOL_PARALLEL_MIN_WORK ) {
+    if ( rank > 1 ) {
+      // A tile's output rows read pool_by input rows each
+      chunk_size = parallel_tile_size( output_size, output_shape[0],
+          (size_t) ( pool_by * input_shape[0] + output_shape[0] ) * sizeof(float) );
+    } else {
+      chunk_size = parallel_tile_size( output_size, 1, ( tile_by + 1 ) * sizeof(float) );
+    }
+    parallel_for( output_size, chunk_size, num_threads, max_pool_rows, &args );
+  } else {
+    max_pool_rows( &args, 0, 0, output_size );
   }
 
   return;
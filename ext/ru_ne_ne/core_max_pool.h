@@ -9,6 +9,10 @@
 #define CORE_MAX_POOL_H
 
 #include <xmmintrin.h>
+#include "core_parallel.h"
+
+// Input values compared, below which a max-pool runs on the calling thread only
+#define MAX_POOL_PARALLEL_MIN_WORK 65536
 
 void core_max_pool( int rank, int *input_shape, float *input_ptr,
     int *output_shape, float *output_ptr, int tile_by, int pool_by );
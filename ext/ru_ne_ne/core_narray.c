@@ -29,3 +29,73 @@ void na_sfloat_set( int size, float *ptr, float new_value ) {
   }
   return;
 }
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Arenas
+//
+
+int na_arena_block_size( int num_floats ) {
+  return NA_ARENA_ALIGN_FLOATS * ( ( num_floats + NA_ARENA_ALIGN_FLOATS - 1 ) / NA_ARENA_ALIGN_FLOATS );
+}
+
+// The NArray is over-allocated, so that data can start from an aligned address
+VALUE na_arena_create( int num_floats ) {
+  int shape[1];
+  struct NARRAY *narr;
+  volatile VALUE narr_arena;
+
+  shape[0] = num_floats + NA_ARENA_ALIGN_FLOATS;
+  narr_arena = na_make_object( NA_SFLOAT, 1, shape, cNArray );
+  GetNArray( narr_arena, narr );
+  na_sfloat_set( narr->total, (float*) narr->ptr, (float) 0.0 );
+
+  return narr_arena;
+}
+
+float *na_arena_ptr( VALUE narr_arena ) {
+  struct NARRAY *narr;
+  GetNArray( narr_arena, narr );
+  return (float*) ( ( (size_t) narr->ptr + NA_ARENA_ALIGN - 1 ) & ~( (size_t) NA_ARENA_ALIGN - 1 ) );
+}
+
+// Views do not own their data, but must keep the arena from being collected
+static void na_arena_view_mark( struct NARRAY *narr ) {
+  rb_gc_mark( narr->ref );
+  return;
+}
+
+static void na_arena_view_free( struct NARRAY *narr ) {
+  xfree( narr->shape );
+  xfree( narr );
+  return;
+}
+
+// Creates an sfloat NArray that shares memory with the arena, starting offset floats in
+VALUE na_arena_view( VALUE narr_arena, int offset, int rank, int *shape ) {
+  int i;
+  struct NARRAY *narr = ALLOC( struct NARRAY );
+
+  narr->rank = rank;
+  narr->type = NA_SFLOAT;
+  narr->shape = ALLOC_N( int, rank );
+  narr->total = 1;
+  for ( i = 0; i < rank; i++ ) {
+    narr->shape[i] = shape[i];
+    narr->total *= shape[i];
+  }
+  narr->ptr = (char*) ( na_arena_ptr( narr_arena ) + offset );
+  narr->ref = narr_arena;
+
+  return Data_Wrap_Struct( cNArray, na_arena_view_mark, na_arena_view_free, narr );
+}
+
+// Copies contents of narr_orig into the arena, and returns a view of the copy with same shape
+VALUE na_arena_move( VALUE narr_arena, int offset, VALUE narr_orig ) {
+  struct NARRAY *narr;
+  GetNArray( narr_orig, narr );
+
+  memcpy( na_arena_ptr( narr_arena ) + offset, narr->ptr, narr->total * sizeof(float) );
+
+  return na_arena_view( narr_arena, offset, narr->rank, narr->shape );
+}
@@ -19,4 +19,21 @@ void na_quick_pos_to_idxs( int rank, int *shape, int pos, int *idxs );
 
 void na_sfloat_set( int size, float *idxs, float new_value );
 
+// An arena is an sfloat NArray used as one block of memory for many smaller arrays, which are
+// views into it. Each view starts on a NA_ARENA_ALIGN byte boundary.
+#define NA_ARENA_ALIGN 32
+#define NA_ARENA_ALIGN_FLOATS ( NA_ARENA_ALIGN / sizeof(float) )
+
+// Number of floats that an array of num_floats uses in an arena, including padding
+int na_arena_block_size( int num_floats );
+
+VALUE na_arena_create( int num_floats );
+
+// Aligned start of arena data
+float *na_arena_ptr( VALUE narr_arena );
+
+VALUE na_arena_view( VALUE narr_arena, int offset, int rank, int *shape );
+
+VALUE na_arena_move( VALUE narr_arena, int offset, VALUE narr_orig );
+
 #endif
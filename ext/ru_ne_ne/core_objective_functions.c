@@ -35,75 +35,36 @@ void obj_mse_tr_linear_de_dz( int n, float* predictions, float* targets, float*
 }
 
 void obj_mse_tr_sigmoid_de_dz( int n, float* predictions, float* targets, float* output_de_dz ) {
-  // This two-step process is typical of a non-optimised calculation of de_dz given by
-  // chain rule:  de_dz = de_da * da_dz
+  // Chain rule:  de_dz = de_da * da_dz, and da_dz is diagonal for element-wise transfer functions
   int i;
-  // TODO: Initialise and re-use this for a whole training run?
-  float *da_dz = xmalloc( sizeof(float) * n );
 
   raw_mse_delta_loss( n, predictions, targets, output_de_dz );
-  raw_sigmoid_bulk_derivative_at( n, predictions, da_dz );
-
   for ( i = 0; i < n ; i++ ) {
-    output_de_dz[i] *= da_dz[i];
+    output_de_dz[i] *= raw_sigmoid_derivative_at( predictions[i] );
   }
-
-  xfree( da_dz );
 }
 
 void obj_mse_tr_tanh_de_dz( int n, float* predictions, float* targets, float* output_de_dz ) {
   int i;
-  // TODO: Initialise and re-use this for a whole training run?
-  float *da_dz = xmalloc( sizeof(float) * n );
 
   raw_mse_delta_loss( n, predictions, targets, output_de_dz );
-  raw_tanh_bulk_derivative_at( n, predictions, da_dz );
-
   for ( i = 0; i < n ; i++ ) {
-    output_de_dz[i] *= da_dz[i];
+    output_de_dz[i] *= raw_tanh_derivative_at( predictions[i] );
   }
-
-  xfree( da_dz );
 }
 
 void obj_mse_tr_softmax_de_dz( int n, float* predictions, float* targets, float* output_de_dz ) {
-  int i, k;
-  float t;
-  // TODO: Initialise and re-use this for a whole training run?
-  float *da_dz = xmalloc( sizeof(float) * n * n );
-  float *tmp_de_dz = xmalloc( sizeof(float) * n );
-
   raw_mse_delta_loss( n, predictions, targets, output_de_dz );
-
-  raw_softmax_bulk_derivative_at( n, predictions, da_dz );
-
-  for ( i = 0; i < n ; i++ ) {
-    t = 0.0;
-    for ( k = 0; k < n ; k++ ) {
-      t += output_de_dz[k] * da_dz[i * n + k];
-    }
-    tmp_de_dz[i] = t;
-  }
-
-  memcpy( output_de_dz, tmp_de_dz, n * sizeof(float) );
-
-  xfree( da_dz );
-  xfree( tmp_de_dz );
+  raw_softmax_de_dz_from_de_da( n, predictions, output_de_dz, output_de_dz );
 }
 
 void obj_mse_tr_relu_de_dz( int n, float* predictions, float* targets, float* output_de_dz ) {
   int i;
-  // TODO: Initialise and re-use this for a whole training run?
-  float *da_dz = xmalloc( sizeof(float) * n );
 
   raw_mse_delta_loss( n, predictions, targets, output_de_dz );
-  raw_relu_bulk_derivative_at( n, predictions, da_dz );
-
   for ( i = 0; i < n ; i++ ) {
-    output_de_dz[i] *= da_dz[i];
+    output_de_dz[i] *= raw_relu_derivative_at( predictions[i] );
   }
-
-  xfree( da_dz );
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -168,28 +129,8 @@ void obj_logloss_tr_tanh_de_dz( int n, float* predictions, float* targets, float
 }
 
 void obj_logloss_tr_softmax_de_dz( int n, float* predictions, float* targets, float* output_de_dz ) {
-  int i, k;
-  float t;
-  // TODO: Initialise and re-use this for a whole training run?
-  float *da_dz = xmalloc( sizeof(float) * n * n );
-  float *tmp_de_dz = xmalloc( sizeof(float) * n );
-
   raw_delta_logloss( n, predictions, targets, output_de_dz, 1e-15 );
-
-  raw_softmax_bulk_derivative_at( n, predictions, da_dz );
-
-  for ( i = 0; i < n ; i++ ) {
-    t = 0.0;
-    for ( k = 0; k < n ; k++ ) {
-      t += output_de_dz[k] * da_dz[i * n + k];
-    }
-    tmp_de_dz[i] = t;
-  }
-
-  memcpy( output_de_dz, tmp_de_dz, n * sizeof(float) );
-
-  xfree( da_dz );
-  xfree( tmp_de_dz );
+  raw_softmax_de_dz_from_de_da( n, predictions, output_de_dz, output_de_dz );
 }
 
 void obj_logloss_tr_relu_de_dz( int n, float* predictions, float* targets, float* output_de_dz ) {
@@ -237,18 +178,10 @@ void obj_mlogloss_tr_linear_de_dz( int n, float* predictions, float* targets, fl
 void obj_mlogloss_tr_sigmoid_de_dz( int n, float* predictions, float* targets, float* output_de_dz ) {
   int i;
 
-  // TODO: Initialise and re-use this for a whole training run?
-  float *da_dz = xmalloc( sizeof(float) * n );
-
   raw_delta_mlogloss( n, predictions, targets, output_de_dz, 1e-15 );
-  raw_sigmoid_bulk_derivative_at( n, predictions, da_dz );
-
   for ( i = 0; i < n ; i++ ) {
-    output_de_dz[i] *= da_dz[i];
+    output_de_dz[i] *= raw_sigmoid_derivative_at( predictions[i] );
   }
-
-  xfree( da_dz );
-  return;
 }
 
 void obj_mlogloss_tr_tanh_de_dz( int n, float* predictions, float* targets, float* output_de_dz ) {
@@ -256,8 +189,7 @@ void obj_mlogloss_tr_tanh_de_dz( int n, float* predictions, float* targets, floa
 }
 
 void obj_mlogloss_tr_softmax_de_dz( int n, float* predictions, float* targets, float* output_de_dz ) {
-  int i,k,n_ones=0,n_zeros=0,is_simple = 1;
-  float t;
+  int i,n_ones=0,n_zeros=0,is_simple = 1;
 
   // There is an optimised case for mclass-logloss plus softmax, when there is a single target class
   // Annoyingly, detecting it takes some effort (but still worthwhile)
@@ -285,26 +217,9 @@ void obj_mlogloss_tr_softmax_de_dz( int n, float* predictions, float* targets, f
     return;
   }
 
-  // Sadly this cannot be fully optimised, and we have to create more complex temporary measurements
-  float *da_dz = xmalloc( sizeof(float) * n * n );
-  float *tmp_de_dz = xmalloc( sizeof(float) * n );
-
+  // Sadly this cannot be fully optimised, and we need the general softmax chain rule
   raw_delta_mlogloss( n, predictions, targets, output_de_dz, 1e-15 );
-
-  raw_softmax_bulk_derivative_at( n, predictions, da_dz );
-
-  for ( i = 0; i < n ; i++ ) {
-    t = 0.0;
-    for ( k = 0; k < n ; k++ ) {
-      t += output_de_dz[k] * da_dz[i * n + k];
-    }
-    tmp_de_dz[i] = t;
-  }
-
-  memcpy( output_de_dz, tmp_de_dz, n * sizeof(float) );
-
-  xfree( da_dz );
-  xfree( tmp_de_dz );
+  raw_softmax_de_dz_from_de_da( n, predictions, output_de_dz, output_de_dz );
 }
 
 void obj_mlogloss_tr_relu_de_dz( int n, float* predictions, float* targets, float* output_de_dz ) {
@@ -317,6 +232,14 @@ void obj_mlogloss_tr_relu_de_dz( int n, float* predictions, float* targets, floa
 //  Combined de_dz function across all objectibe and transfer type combinations
 //
 
+// Returns 0 for combinations where de_dz function would raise an error
+int objective_supports_transfer( objective_type obj, transfer_type t ) {
+  if ( obj == MSE ) {
+    return 1;
+  }
+  return ( t == SIGMOID || t == SOFTMAX );
+}
+
 void de_dz_from_objective_and_transfer( objective_type obj, transfer_type t, int n, float* predictions, float* targets, float* output_de_dz ) {
   switch( t ) {
     case SIGMOID:
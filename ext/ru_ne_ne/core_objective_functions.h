@@ -44,6 +44,8 @@ void obj_mlogloss_tr_relu_de_dz( int n, float* predictions, float* targets, floa
 // Potentially change this to resolve to correct function to call and make an "engine descriptor" . . .
 float objective_function_loss( objective_type obj, int n, float* predictions, float* targets );
 
+int objective_supports_transfer( objective_type obj, transfer_type t );
+
 void de_dz_from_objective_and_transfer( objective_type obj, transfer_type t, int n, float* predictions, float* targets, float* output_de_dz );
 
 #endif
@@ -0,0 +1,221 @@
+// ext/ru_ne_ne/core_optimiser.c
+
+#include "core_optimiser.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  SSE kernels, 4 floats wide. These are memory bound, so wider variants would not gain much
+//
+
+static inline float optimiser_hsum( __m128 simd_t ) {
+  simd_t = _mm_add_ps( simd_t, _mm_movehl_ps( simd_t, simd_t ) );
+  simd_t = _mm_add_ss( simd_t, _mm_shuffle_ps( simd_t, simd_t, 1 ) );
+  return _mm_cvtss_f32( simd_t );
+}
+
+float optimiser_sgd_step( int n, float *params, float *gradients, float lr, float weight_decay ) {
+  int i, n_aligned = 4 * ( n / 4 );
+  float p, g, sum_squares = 0.0;
+  __m128 simd_p, simd_g, simd_sum_squares = _mm_setzero_ps();
+  __m128 simd_lr = _mm_set1_ps( lr );
+  __m128 simd_wd = _mm_set1_ps( weight_decay );
+
+  for ( i = 0; i < n_aligned; i += 4 ) {
+    simd_p = _mm_loadu_ps( params + i );
+    simd_g = _mm_add_ps( _mm_loadu_ps( gradients + i ), _mm_mul_ps( simd_wd, simd_p ) );
+    simd_p = _mm_sub_ps( simd_p, _mm_mul_ps( simd_lr, simd_g ) );
+    _mm_storeu_ps( gradients + i, simd_g );
+    _mm_storeu_ps( params + i, simd_p );
+    simd_sum_squares = _mm_add_ps( simd_sum_squares, _mm_mul_ps( simd_p, simd_p ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    g = gradients[i] + weight_decay * params[i];
+    p = params[i] - lr * g;
+    gradients[i] = g;
+    params[i] = p;
+    sum_squares += p * p;
+  }
+
+  return optimiser_hsum( simd_sum_squares ) + sum_squares;
+}
+
+float optimiser_nag_step( int n, float *params, float *gradients, float *velocity,
+    float lr, float weight_decay ) {
+  int i, n_aligned = 4 * ( n / 4 );
+  float p, g, sum_squares = 0.0;
+  __m128 simd_p, simd_g, simd_u, simd_sum_squares = _mm_setzero_ps();
+  __m128 simd_lr = _mm_set1_ps( lr );
+  __m128 simd_wd = _mm_set1_ps( weight_decay );
+
+  for ( i = 0; i < n_aligned; i += 4 ) {
+    simd_p = _mm_loadu_ps( params + i );
+    simd_g = _mm_add_ps( _mm_loadu_ps( gradients + i ), _mm_mul_ps( simd_wd, simd_p ) );
+    simd_u = _mm_mul_ps( simd_lr, simd_g );
+    simd_p = _mm_sub_ps( simd_p, simd_u );
+    _mm_storeu_ps( gradients + i, simd_g );
+    _mm_storeu_ps( velocity + i, _mm_sub_ps( _mm_loadu_ps( velocity + i ), simd_u ) );
+    _mm_storeu_ps( params + i, simd_p );
+    simd_sum_squares = _mm_add_ps( simd_sum_squares, _mm_mul_ps( simd_p, simd_p ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    g = gradients[i] + weight_decay * params[i];
+    p = params[i] - lr * g;
+    gradients[i] = g;
+    velocity[i] -= lr * g;
+    params[i] = p;
+    sum_squares += p * p;
+  }
+
+  return optimiser_hsum( simd_sum_squares ) + sum_squares;
+}
+
+// Uses the approximate reciprocal square root instruction, refined with one Newton-Raphson
+// step y = y * ( 1.5 - 0.5 * x * y * y ), which gives close to full float precision
+float optimiser_rmsprop_step( int n, float *params, float *gradients, float *av_squared_grads,
+    float lr, float weight_decay, float decay, float epsilon ) {
+  int i, n_aligned = 4 * ( n / 4 );
+  float p, g, s, sum_squares = 0.0;
+  __m128 simd_p, simd_g, simd_s, simd_x, simd_y, simd_sum_squares = _mm_setzero_ps();
+  __m128 simd_lr = _mm_set1_ps( lr );
+  __m128 simd_wd = _mm_set1_ps( weight_decay );
+  __m128 simd_decay = _mm_set1_ps( decay );
+  __m128 simd_u = _mm_set1_ps( 1.0 - decay );
+  __m128 simd_epsilon = _mm_set1_ps( epsilon );
+  __m128 simd_half = _mm_set1_ps( 0.5 );
+  __m128 simd_three_halves = _mm_set1_ps( 1.5 );
+
+  for ( i = 0; i < n_aligned; i += 4 ) {
+    simd_p = _mm_loadu_ps( params + i );
+    simd_g = _mm_add_ps( _mm_loadu_ps( gradients + i ), _mm_mul_ps( simd_wd, simd_p ) );
+    simd_s = _mm_add_ps( _mm_mul_ps( simd_decay, _mm_loadu_ps( av_squared_grads + i ) ),
+        _mm_mul_ps( simd_u, _mm_mul_ps( simd_g, simd_g ) ) );
+
+    simd_x = _mm_add_ps( simd_s, simd_epsilon );
+    simd_y = _mm_rsqrt_ps( simd_x );
+    simd_y = _mm_mul_ps( simd_y, _mm_sub_ps( simd_three_halves,
+        _mm_mul_ps( _mm_mul_ps( simd_half, simd_x ), _mm_mul_ps( simd_y, simd_y ) ) ) );
+
+    simd_p = _mm_sub_ps( simd_p, _mm_mul_ps( simd_lr, _mm_mul_ps( simd_g, simd_y ) ) );
+    _mm_storeu_ps( gradients + i, simd_g );
+    _mm_storeu_ps( av_squared_grads + i, simd_s );
+    _mm_storeu_ps( params + i, simd_p );
+    simd_sum_squares = _mm_add_ps( simd_sum_squares, _mm_mul_ps( simd_p, simd_p ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    g = gradients[i] + weight_decay * params[i];
+    s = decay * av_squared_grads[i] + ( 1.0 - decay ) * g * g;
+    p = params[i] - lr * g / sqrt( s + epsilon );
+    gradients[i] = g;
+    av_squared_grads[i] = s;
+    params[i] = p;
+    sum_squares += p * p;
+  }
+
+  return optimiser_hsum( simd_sum_squares ) + sum_squares;
+}
+
+// Same reciprocal square root refinement as RMSProp, with a running sum in place of the average
+float optimiser_adagrad_step( int n, float *params, float *gradients, float *sum_squared_grads,
+    float lr, float weight_decay, float epsilon ) {
+  int i, n_aligned = 4 * ( n / 4 );
+  float p, g, s, sum_squares = 0.0;
+  __m128 simd_p, simd_g, simd_s, simd_x, simd_y, simd_sum_squares = _mm_setzero_ps();
+  __m128 simd_lr = _mm_set1_ps( lr );
+  __m128 simd_wd = _mm_set1_ps( weight_decay );
+  __m128 simd_epsilon = _mm_set1_ps( epsilon );
+  __m128 simd_half = _mm_set1_ps( 0.5 );
+  __m128 simd_three_halves = _mm_set1_ps( 1.5 );
+
+  for ( i = 0; i < n_aligned; i += 4 ) {
+    simd_p = _mm_loadu_ps( params + i );
+    simd_g = _mm_add_ps( _mm_loadu_ps( gradients + i ), _mm_mul_ps( simd_wd, simd_p ) );
+    simd_s = _mm_add_ps( _mm_loadu_ps( sum_squared_grads + i ), _mm_mul_ps( simd_g, simd_g ) );
+
+    simd_x = _mm_add_ps( simd_s, simd_epsilon );
+    simd_y = _mm_rsqrt_ps( simd_x );
+    simd_y = _mm_mul_ps( simd_y, _mm_sub_ps( simd_three_halves,
+        _mm_mul_ps( _mm_mul_ps( simd_half, simd_x ), _mm_mul_ps( simd_y, simd_y ) ) ) );
+
+    simd_p = _mm_sub_ps( simd_p, _mm_mul_ps( simd_lr, _mm_mul_ps( simd_g, simd_y ) ) );
+    _mm_storeu_ps( gradients + i, simd_g );
+    _mm_storeu_ps( sum_squared_grads + i, simd_s );
+    _mm_storeu_ps( params + i, simd_p );
+    simd_sum_squares = _mm_add_ps( simd_sum_squares, _mm_mul_ps( simd_p, simd_p ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    g = gradients[i] + weight_decay * params[i];
+    s = sum_squared_grads[i] + g * g;
+    p = params[i] - lr * g / sqrt( s + epsilon );
+    gradients[i] = g;
+    sum_squared_grads[i] = s;
+    params[i] = p;
+    sum_squares += p * p;
+  }
+
+  return optimiser_hsum( simd_sum_squares ) + sum_squares;
+}
+
+// Epsilon is added outside the square root, as in the Adam paper, so the exact square root is
+// used here. The learning rate passed in should already include the bias corrections.
+float optimiser_adam_step( int n, float *params, float *gradients, float *first_moment,
+    float *second_moment, float lr, float weight_decay, float beta1, float beta2, float epsilon ) {
+  int i, n_aligned = 4 * ( n / 4 );
+  float p, g, m, v, sum_squares = 0.0;
+  __m128 simd_p, simd_g, simd_m, simd_v, simd_sum_squares = _mm_setzero_ps();
+  __m128 simd_lr = _mm_set1_ps( lr );
+  __m128 simd_wd = _mm_set1_ps( weight_decay );
+  __m128 simd_beta1 = _mm_set1_ps( beta1 );
+  __m128 simd_u1 = _mm_set1_ps( 1.0 - beta1 );
+  __m128 simd_beta2 = _mm_set1_ps( beta2 );
+  __m128 simd_u2 = _mm_set1_ps( 1.0 - beta2 );
+  __m128 simd_epsilon = _mm_set1_ps( epsilon );
+
+  for ( i = 0; i < n_aligned; i += 4 ) {
+    simd_p = _mm_loadu_ps( params + i );
+    simd_g = _mm_add_ps( _mm_loadu_ps( gradients + i ), _mm_mul_ps( simd_wd, simd_p ) );
+    simd_m = _mm_add_ps( _mm_mul_ps( simd_beta1, _mm_loadu_ps( first_moment + i ) ),
+        _mm_mul_ps( simd_u1, simd_g ) );
+    simd_v = _mm_add_ps( _mm_mul_ps( simd_beta2, _mm_loadu_ps( second_moment + i ) ),
+        _mm_mul_ps( simd_u2, _mm_mul_ps( simd_g, simd_g ) ) );
+
+    simd_p = _mm_sub_ps( simd_p, _mm_div_ps( _mm_mul_ps( simd_lr, simd_m ),
+        _mm_add_ps( _mm_sqrt_ps( simd_v ), simd_epsilon ) ) );
+    _mm_storeu_ps( gradients + i, simd_g );
+    _mm_storeu_ps( first_moment + i, simd_m );
+    _mm_storeu_ps( second_moment + i, simd_v );
+    _mm_storeu_ps( params + i, simd_p );
+    simd_sum_squares = _mm_add_ps( simd_sum_squares, _mm_mul_ps( simd_p, simd_p ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    g = gradients[i] + weight_decay * params[i];
+    m = beta1 * first_moment[i] + ( 1.0 - beta1 ) * g;
+    v = beta2 * second_moment[i] + ( 1.0 - beta2 ) * g * g;
+    p = params[i] - lr * m / ( sqrtf( v ) + epsilon );
+    gradients[i] = g;
+    first_moment[i] = m;
+    second_moment[i] = v;
+    params[i] = p;
+    sum_squares += p * p;
+  }
+
+  return optimiser_hsum( simd_sum_squares ) + sum_squares;
+}
+
+void optimiser_scale( int n, float *params, float factor ) {
+  int i, n_aligned = 4 * ( n / 4 );
+  __m128 simd_factor = _mm_set1_ps( factor );
+
+  for ( i = 0; i < n_aligned; i += 4 ) {
+    _mm_storeu_ps( params + i, _mm_mul_ps( simd_factor, _mm_loadu_ps( params + i ) ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    params[i] *= factor;
+  }
+  return;
+}
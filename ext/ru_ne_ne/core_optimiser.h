@@ -0,0 +1,43 @@
+// ext/ru_ne_ne/core_optimiser.h
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Declarations of fused gradient descent kernels. Each one makes a single pass over a block
+// of params, adding weight decay to the gradients, applying the update rule, and returning
+// the sum of squares of the updated params so that max norm can be applied without another
+// pass over memory.
+//
+
+#ifndef CORE_OPTIMISER_H
+#define CORE_OPTIMISER_H
+
+#include <math.h>
+#include <xmmintrin.h>
+
+// gradients[i] += weight_decay * params[i], params[i] -= lr * gradients[i]
+float optimiser_sgd_step( int n, float *params, float *gradients, float lr, float weight_decay );
+
+// As SGD, also velocity[i] -= lr * gradients[i]
+float optimiser_nag_step( int n, float *params, float *gradients, float *velocity,
+    float lr, float weight_decay );
+
+// av_squared_grads[i] = decay * av_squared_grads[i] + ( 1 - decay ) * gradients[i]^2,
+// params[i] -= lr * gradients[i] / sqrt( av_squared_grads[i] + epsilon )
+float optimiser_rmsprop_step( int n, float *params, float *gradients, float *av_squared_grads,
+    float lr, float weight_decay, float decay, float epsilon );
+
+// sum_squared_grads[i] += gradients[i]^2,
+// params[i] -= lr * gradients[i] / sqrt( sum_squared_grads[i] + epsilon )
+float optimiser_adagrad_step( int n, float *params, float *gradients, float *sum_squared_grads,
+    float lr, float weight_decay, float epsilon );
+
+// first_moment[i] = beta1 * first_moment[i] + ( 1 - beta1 ) * gradients[i],
+// second_moment[i] = beta2 * second_moment[i] + ( 1 - beta2 ) * gradients[i]^2,
+// params[i] -= lr * first_moment[i] / ( sqrt( second_moment[i] ) + epsilon )
+float optimiser_adam_step( int n, float *params, float *gradients, float *first_moment,
+    float *second_moment, float lr, float weight_decay, float beta1, float beta2, float epsilon );
+
+// params[i] *= factor
+void optimiser_scale( int n, float *params, float factor );
+
+#endif
@@ -0,0 +1,226 @@
+// ext/ru_ne_ne/core_parallel.c
+
+#include "core_parallel.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  The pool. Jobs waiting for help are kept in a list, and idle pool threads join the first one
+//  that has ranges left and a free slot. Ranges are claimed with an atomic counter, so a thread
+//  that finishes early takes more of them. A job's caller only waits for ranges that have been
+//  claimed, so nested jobs cannot deadlock even when every pool thread is busy.
+//
+
+typedef struct _parallel_job {
+    void (*fn)( void *data, int slot, int start, int end );
+    void *data;
+    int num_items;
+    int chunk_size;
+    int num_chunks;
+    int next_chunk;
+    int max_slots;
+    int num_slots;
+    int num_helpers;
+    struct _parallel_job *next;
+  } ParallelJob;
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t pool_threads[PARALLEL_MAX_THREADS];
+static int pool_num_threads = 1;
+static int pool_num_started = 0;
+static int pool_shutdown = 0;
+static ParallelJob *pool_jobs = NULL;
+
+static void parallel_job_work( ParallelJob *job, int slot ) {
+  int c, start, end;
+
+  while ( ( c = __sync_fetch_and_add( &job->next_chunk, 1 ) ) < job->num_chunks ) {
+    start = c * job->chunk_size;
+    end = start + job->chunk_size < job->num_items ? start + job->chunk_size : job->num_items;
+    job->fn( job->data, slot, start, end );
+  }
+
+  return;
+}
+
+// Must be called with pool_mutex held
+static ParallelJob *pool_find_job() {
+  ParallelJob *job;
+  for ( job = pool_jobs; job; job = job->next ) {
+    if ( job->next_chunk < job->num_chunks && job->num_slots < job->max_slots ) {
+      return job;
+    }
+  }
+  return NULL;
+}
+
+static void *pool_thread_main( void *unused ) {
+  ParallelJob *job;
+  int slot;
+
+  pthread_mutex_lock( &pool_mutex );
+  while ( ! pool_shutdown ) {
+    job = pool_find_job();
+    if ( ! job ) {
+      pthread_cond_wait( &pool_work_cond, &pool_mutex );
+      continue;
+    }
+    slot = job->num_slots++;
+    job->num_helpers++;
+    pthread_mutex_unlock( &pool_mutex );
+
+    parallel_job_work( job, slot );
+
+    pthread_mutex_lock( &pool_mutex );
+    if ( --job->num_helpers == 0 ) {
+      pthread_cond_broadcast( &pool_done_cond );
+    }
+  }
+  pthread_mutex_unlock( &pool_mutex );
+
+  return NULL;
+}
+
+// Must be called with pool_mutex held. If a thread cannot be started, the pool is left smaller.
+static void pool_start_threads() {
+  while ( ! pool_shutdown && pool_num_started < pool_num_threads - 1 ) {
+    if ( pthread_create( &pool_threads[pool_num_started], NULL, pool_thread_main, NULL ) != 0 ) {
+      pool_num_threads = pool_num_started + 1;
+      return;
+    }
+    pool_num_started++;
+  }
+  return;
+}
+
+// Threads do not survive fork, so a child process starts again with an empty pool
+static void pool_after_fork_child() {
+  pthread_mutex_init( &pool_mutex, NULL );
+  pthread_cond_init( &pool_work_cond, NULL );
+  pthread_cond_init( &pool_done_cond, NULL );
+  pool_num_started = 0;
+  pool_shutdown = 0;
+  pool_jobs = NULL;
+  return;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void parallel_init() {
+  long num_cpus = sysconf( _SC_NPROCESSORS_ONLN );
+  pool_num_threads = num_cpus < 1 ? 1 : ( num_cpus > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : (int) num_cpus );
+  pthread_atfork( NULL, NULL, pool_after_fork_child );
+  return;
+}
+
+int parallel_num_threads() {
+  return pool_num_threads;
+}
+
+void parallel_set_num_threads( int num_threads ) {
+  int i, num_started;
+
+  pthread_mutex_lock( &pool_mutex );
+  pool_shutdown = 1;
+  pthread_cond_broadcast( &pool_work_cond );
+  num_started = pool_num_started;
+  pthread_mutex_unlock( &pool_mutex );
+
+  for ( i = 0; i < num_started; i++ ) {
+    pthread_join( pool_threads[i], NULL );
+  }
+
+  pthread_mutex_lock( &pool_mutex );
+  pool_num_started = 0;
+  pool_shutdown = 0;
+  pool_num_threads = num_threads;
+  pthread_mutex_unlock( &pool_mutex );
+
+  return;
+}
+
+void parallel_for( int num_items, int chunk_size, int max_slots,
+    void (*fn)( void *data, int slot, int start, int end ), void *data ) {
+  ParallelJob job, **link;
+
+  if ( num_items < 1 ) {
+    return;
+  }
+  if ( chunk_size < 1 ) {
+    chunk_size = 1;
+  }
+
+  job.fn = fn;
+  job.data = data;
+  job.num_items = num_items;
+  job.chunk_size = chunk_size;
+  job.num_chunks = ( num_items + chunk_size - 1 ) / chunk_size;
+  job.next_chunk = 0;
+  job.max_slots = max_slots < job.num_chunks ? max_slots : job.num_chunks;
+  job.num_slots = 1;
+  job.num_helpers = 0;
+
+  if ( job.max_slots <= 1 || pool_num_threads <= 1 ) {
+    parallel_job_work( &job, 0 );
+    return;
+  }
+
+  pthread_mutex_lock( &pool_mutex );
+  pool_start_threads();
+  job.next = pool_jobs;
+  pool_jobs = &job;
+  pthread_cond_broadcast( &pool_work_cond );
+  pthread_mutex_unlock( &pool_mutex );
+
+  parallel_job_work( &job, 0 );
+
+  pthread_mutex_lock( &pool_mutex );
+  for ( link = &pool_jobs; *link != &job; link = &(*link)->next );
+  *link = job.next;
+  while ( job.num_helpers > 0 ) {
+    pthread_cond_wait( &pool_done_cond, &pool_mutex );
+  }
+  pthread_mutex_unlock( &pool_mutex );
+
+  return;
+}
+
+int parallel_tile_size( int num_items, int row_size, size_t row_bytes ) {
+  int num_rows = num_items / row_size, rows_per_tile, max_rows;
+
+  rows_per_tile = row_bytes < PARALLEL_TILE_BYTES ? (int) ( PARALLEL_TILE_BYTES / row_bytes ) : 1;
+  max_rows = ( num_rows + 4 * pool_num_threads - 1 ) / ( 4 * pool_num_threads );
+  if ( rows_per_tile > max_rows ) {
+    rows_per_tile = max_rows;
+  }
+  if ( rows_per_tile < 1 ) {
+    rows_per_tile = 1;
+  }
+
+  return rows_per_tile * row_size;
+}
+
+typedef struct _parallel_run_data {
+    void *(*fn)( void * );
+    char *tasks;
+    size_t task_size;
+  } ParallelRunData;
+
+static void parallel_run_task( void *data, int slot, int start, int end ) {
+  ParallelRunData *run_data = (ParallelRunData *) data;
+  int i;
+  for ( i = start; i < end; i++ ) {
+    run_data->fn( run_data->tasks + i * run_data->task_size );
+  }
+  return;
+}
+
+void parallel_run( int num_tasks, void *(*fn)( void * ), void *tasks, size_t task_size ) {
+  ParallelRunData run_data;
+  run_data.fn = fn;
+  run_data.tasks = (char *) tasks;
+  run_data.task_size = task_size;
+  parallel_for( num_tasks, 1, num_tasks, parallel_run_task, &run_data );
+  return;
+}
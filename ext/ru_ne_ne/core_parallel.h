@@ -0,0 +1,50 @@
+// ext/ru_ne_ne/core_parallel.h
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Declarations of helpers for splitting work across native threads. All of RuNeNe shares one
+// pool of worker threads, started when first needed, so that kernels running at the same time
+// do not start more threads than there are CPUs.
+//
+
+#ifndef CORE_PARALLEL_H
+#define CORE_PARALLEL_H
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define PARALLEL_MAX_THREADS 256
+
+// Memory that one tile of work from parallel_tile_size should need, so that it stays in L2 cache
+#define PARALLEL_TILE_BYTES 131072
+
+// Sets up the pool, called once when the extension is loaded. No threads are started.
+void parallel_init();
+
+// Number of threads that can work on a job at once, including the calling thread
+int parallel_num_threads();
+
+// Stops any pool threads, waiting for them to finish work they have started, and sets the size
+// for when they are next needed. Must not be called from inside a job.
+void parallel_set_num_threads( int num_threads );
+
+// Calls fn( data, slot, start, end ) for consecutive ranges of at most chunk_size items,
+// covering 0...num_items, and returns when all are complete. Each range is taken by whichever
+// thread in the pool is free next, and the calling thread always takes part. Each thread
+// working on the job has its own slot, in 0...max_slots, so that it can use buffers of its own.
+// This may be called from inside another job.
+void parallel_for( int num_items, int chunk_size, int max_slots,
+    void (*fn)( void *data, int slot, int start, int end ), void *data );
+
+// Chunk size for parallel_for over num_items items, in rows of row_size, where each row needs
+// row_bytes of memory. Chunks are a whole number of rows, needing around PARALLEL_TILE_BYTES in
+// all, but are made smaller if that would not give each thread several.
+int parallel_tile_size( int num_items, int row_size, size_t row_bytes );
+
+// Calls fn( tasks + i * task_size ) for each i in 0...num_tasks, and returns when all are
+// complete. Tasks run on pool threads where available, so they may or may not run at the same
+// time as each other. The value of num_tasks must not be more than PARALLEL_MAX_THREADS.
+void parallel_run( int num_tasks, void *(*fn)( void * ), void *tasks, size_t task_size );
+
+#endif
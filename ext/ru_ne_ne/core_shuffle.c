@@ -15,3 +15,37 @@ void shuffle_ints( int n, int *array ) {
   }
   return;
 }
+
+// Fills array with 0 .. n-1, in blocks of block_size consecutive values (the last may be
+// smaller). The order of blocks is shuffled, then the values within each block. This may run
+// without the GVL, so the shuffled block numbers are kept at the start of array, and each is
+// expanded in place, working back from the end. Block j of the order starts at or after
+// position j, so expanding it never overwrites a block number that is still needed.
+void shuffle_ints_in_blocks( int n, int *array, int block_size ) {
+  int b, i, j, size, start, short_pos;
+  int num_blocks = ( n + block_size - 1 ) / block_size;
+  int last_size = n - ( num_blocks - 1 ) * block_size;
+
+  for ( j = 0; j < num_blocks; j++ ) {
+    array[j] = j;
+  }
+  shuffle_ints( num_blocks, array );
+
+  for ( short_pos = 0; array[short_pos] != num_blocks - 1; short_pos++ );
+
+  for ( j = num_blocks - 1; j >= 0; j-- ) {
+    b = array[j];
+    start = j * block_size - ( short_pos < j ? block_size - last_size : 0 );
+    size = b == num_blocks - 1 ? last_size : block_size;
+    for ( i = size - 1; i >= 0; i-- ) {
+      array[start + i] = b * block_size + i;
+    }
+  }
+
+  for ( start = 0; start < n; start += size ) {
+    size = array[start] / block_size == num_blocks - 1 ? last_size : block_size;
+    shuffle_ints( size, array + start );
+  }
+
+  return;
+}
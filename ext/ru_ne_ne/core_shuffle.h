@@ -12,4 +12,6 @@
 
 void shuffle_ints( int n, int *array );
 
+void shuffle_ints_in_blocks( int n, int *array, int block_size );
+
 #endif
@@ -0,0 +1,578 @@
+// ext/ru_ne_ne/core_simd.c
+
+#include "core_simd.h"
+
+SimdKernels simd_kernels;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  SSE2 kernels. These are always available on x86_64, so are the default
+//
+
+inline float hsum_sse( __m128 simd_t ) {
+  float v[4];
+  _mm_storeu_ps( v, simd_t );
+  return v[0] + v[1] + v[2] + v[3];
+}
+
+float dot_sse( int n, float *a, float *b ) {
+  int i, n_aligned = 4 * ( n / 4 );
+  __m128 simd_t = _mm_setzero_ps();
+  float t = 0.0;
+
+  for ( i = 0; i < n_aligned; i += 4 ) {
+    simd_t = _mm_add_ps( simd_t, _mm_mul_ps( _mm_loadu_ps( a + i ), _mm_loadu_ps( b + i ) ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    t += a[i] * b[i];
+  }
+
+  return hsum_sse( simd_t ) + t;
+}
+
+void dot_1x4_sse( int n, float *a, float *b0, float *b1, float *b2, float *b3, float *c ) {
+  int i, n_aligned = 4 * ( n / 4 );
+  __m128 simd_a, simd_t0, simd_t1, simd_t2, simd_t3;
+  float t0 = 0.0, t1 = 0.0, t2 = 0.0, t3 = 0.0;
+
+  simd_t0 = _mm_setzero_ps();
+  simd_t1 = _mm_setzero_ps();
+  simd_t2 = _mm_setzero_ps();
+  simd_t3 = _mm_setzero_ps();
+
+  // Each load from a is used four times
+  for ( i = 0; i < n_aligned; i += 4 ) {
+    simd_a = _mm_loadu_ps( a + i );
+    simd_t0 = _mm_add_ps( simd_t0, _mm_mul_ps( simd_a, _mm_loadu_ps( b0 + i ) ) );
+    simd_t1 = _mm_add_ps( simd_t1, _mm_mul_ps( simd_a, _mm_loadu_ps( b1 + i ) ) );
+    simd_t2 = _mm_add_ps( simd_t2, _mm_mul_ps( simd_a, _mm_loadu_ps( b2 + i ) ) );
+    simd_t3 = _mm_add_ps( simd_t3, _mm_mul_ps( simd_a, _mm_loadu_ps( b3 + i ) ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    t0 += a[i] * b0[i];
+    t1 += a[i] * b1[i];
+    t2 += a[i] * b2[i];
+    t3 += a[i] * b3[i];
+  }
+
+  c[0] += hsum_sse( simd_t0 ) + t0;
+  c[1] += hsum_sse( simd_t1 ) + t1;
+  c[2] += hsum_sse( simd_t2 ) + t2;
+  c[3] += hsum_sse( simd_t3 ) + t3;
+  return;
+}
+
+void dot_2x4_sse( int n, float *a0, float *a1, float *b0, float *b1, float *b2, float *b3,
+    float *c0, float *c1 ) {
+  int i, n_aligned = 4 * ( n / 4 );
+  __m128 simd_a0, simd_a1, simd_b;
+  __m128 simd_t00, simd_t01, simd_t02, simd_t03, simd_t10, simd_t11, simd_t12, simd_t13;
+  float t;
+
+  simd_t00 = _mm_setzero_ps(); simd_t01 = _mm_setzero_ps();
+  simd_t02 = _mm_setzero_ps(); simd_t03 = _mm_setzero_ps();
+  simd_t10 = _mm_setzero_ps(); simd_t11 = _mm_setzero_ps();
+  simd_t12 = _mm_setzero_ps(); simd_t13 = _mm_setzero_ps();
+
+  // Each load from a is used four times, and each load from b twice
+  for ( i = 0; i < n_aligned; i += 4 ) {
+    simd_a0 = _mm_loadu_ps( a0 + i );
+    simd_a1 = _mm_loadu_ps( a1 + i );
+    simd_b = _mm_loadu_ps( b0 + i );
+    simd_t00 = _mm_add_ps( simd_t00, _mm_mul_ps( simd_a0, simd_b ) );
+    simd_t10 = _mm_add_ps( simd_t10, _mm_mul_ps( simd_a1, simd_b ) );
+    simd_b = _mm_loadu_ps( b1 + i );
+    simd_t01 = _mm_add_ps( simd_t01, _mm_mul_ps( simd_a0, simd_b ) );
+    simd_t11 = _mm_add_ps( simd_t11, _mm_mul_ps( simd_a1, simd_b ) );
+    simd_b = _mm_loadu_ps( b2 + i );
+    simd_t02 = _mm_add_ps( simd_t02, _mm_mul_ps( simd_a0, simd_b ) );
+    simd_t12 = _mm_add_ps( simd_t12, _mm_mul_ps( simd_a1, simd_b ) );
+    simd_b = _mm_loadu_ps( b3 + i );
+    simd_t03 = _mm_add_ps( simd_t03, _mm_mul_ps( simd_a0, simd_b ) );
+    simd_t13 = _mm_add_ps( simd_t13, _mm_mul_ps( simd_a1, simd_b ) );
+  }
+
+  c0[0] += hsum_sse( simd_t00 ); c0[1] += hsum_sse( simd_t01 );
+  c0[2] += hsum_sse( simd_t02 ); c0[3] += hsum_sse( simd_t03 );
+  c1[0] += hsum_sse( simd_t10 ); c1[1] += hsum_sse( simd_t11 );
+  c1[2] += hsum_sse( simd_t12 ); c1[3] += hsum_sse( simd_t13 );
+
+  for ( i = n_aligned; i < n; i++ ) {
+    t = a0[i]; c0[0] += t * b0[i]; c0[1] += t * b1[i]; c0[2] += t * b2[i]; c0[3] += t * b3[i];
+    t = a1[i]; c1[0] += t * b0[i]; c1[1] += t * b1[i]; c1[2] += t * b2[i]; c1[3] += t * b3[i];
+  }
+  return;
+}
+
+void axpy_sse( int n, float alpha, float *x, float *y ) {
+  int i, n_aligned = 4 * ( n / 4 );
+  __m128 simd_alpha = _mm_set1_ps( alpha );
+
+  for ( i = 0; i < n_aligned; i += 4 ) {
+    _mm_storeu_ps( y + i, _mm_add_ps( _mm_loadu_ps( y + i ),
+        _mm_mul_ps( simd_alpha, _mm_loadu_ps( x + i ) ) ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    y[i] += alpha * x[i];
+  }
+  return;
+}
+
+void axpy_pair_sse( int n, float alpha, float *x, float *y, float *w, float *z ) {
+  int i, n_aligned = 4 * ( n / 4 );
+  __m128 simd_alpha = _mm_set1_ps( alpha );
+
+  for ( i = 0; i < n_aligned; i += 4 ) {
+    _mm_storeu_ps( y + i, _mm_add_ps( _mm_loadu_ps( y + i ),
+        _mm_mul_ps( simd_alpha, _mm_loadu_ps( x + i ) ) ) );
+    _mm_storeu_ps( z + i, _mm_add_ps( _mm_loadu_ps( z + i ),
+        _mm_mul_ps( simd_alpha, _mm_loadu_ps( w + i ) ) ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    y[i] += alpha * x[i];
+    z[i] += alpha * w[i];
+  }
+  return;
+}
+
+void widen_u8_sse( int n, uint8_t *x, float *scale, float *offset, float *y ) {
+  int i;
+  for ( i = 0; i < n; i++ ) {
+    y[i] = (float) x[i] * scale[i] + offset[i];
+  }
+  return;
+}
+
+void widen_f16_sse( int n, uint16_t *x, float *scale, float *offset, float *y ) {
+  int i;
+  for ( i = 0; i < n; i++ ) {
+    y[i] = float16_to_float( x[i] ) * scale[i] + offset[i];
+  }
+  return;
+}
+
+#ifdef SIMD_DISPATCH_ENABLED
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  AVX2 + FMA kernels, 8 floats wide
+//
+
+__attribute__((target("avx2,fma")))
+static inline float hsum_avx( __m256 simd_t ) {
+  __m128 simd_s = _mm_add_ps( _mm256_castps256_ps128( simd_t ), _mm256_extractf128_ps( simd_t, 1 ) );
+  return hsum_sse( simd_s );
+}
+
+__attribute__((target("avx2,fma")))
+float dot_avx2( int n, float *a, float *b ) {
+  int i, n_aligned = 8 * ( n / 8 );
+  __m256 simd_t = _mm256_setzero_ps();
+  float t = 0.0;
+
+  for ( i = 0; i < n_aligned; i += 8 ) {
+    simd_t = _mm256_fmadd_ps( _mm256_loadu_ps( a + i ), _mm256_loadu_ps( b + i ), simd_t );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    t += a[i] * b[i];
+  }
+
+  return hsum_avx( simd_t ) + t;
+}
+
+__attribute__((target("avx2,fma")))
+void dot_1x4_avx2( int n, float *a, float *b0, float *b1, float *b2, float *b3, float *c ) {
+  int i, n_aligned = 8 * ( n / 8 );
+  __m256 simd_a, simd_t0, simd_t1, simd_t2, simd_t3;
+  float t0 = 0.0, t1 = 0.0, t2 = 0.0, t3 = 0.0;
+
+  simd_t0 = _mm256_setzero_ps();
+  simd_t1 = _mm256_setzero_ps();
+  simd_t2 = _mm256_setzero_ps();
+  simd_t3 = _mm256_setzero_ps();
+
+  for ( i = 0; i < n_aligned; i += 8 ) {
+    simd_a = _mm256_loadu_ps( a + i );
+    simd_t0 = _mm256_fmadd_ps( simd_a, _mm256_loadu_ps( b0 + i ), simd_t0 );
+    simd_t1 = _mm256_fmadd_ps( simd_a, _mm256_loadu_ps( b1 + i ), simd_t1 );
+    simd_t2 = _mm256_fmadd_ps( simd_a, _mm256_loadu_ps( b2 + i ), simd_t2 );
+    simd_t3 = _mm256_fmadd_ps( simd_a, _mm256_loadu_ps( b3 + i ), simd_t3 );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    t0 += a[i] * b0[i];
+    t1 += a[i] * b1[i];
+    t2 += a[i] * b2[i];
+    t3 += a[i] * b3[i];
+  }
+
+  c[0] += hsum_avx( simd_t0 ) + t0;
+  c[1] += hsum_avx( simd_t1 ) + t1;
+  c[2] += hsum_avx( simd_t2 ) + t2;
+  c[3] += hsum_avx( simd_t3 ) + t3;
+  return;
+}
+
+__attribute__((target("avx2,fma")))
+void dot_2x4_avx2( int n, float *a0, float *a1, float *b0, float *b1, float *b2, float *b3,
+    float *c0, float *c1 ) {
+  int i, n_aligned = 8 * ( n / 8 );
+  __m256 simd_a0, simd_a1, simd_b;
+  __m256 simd_t00, simd_t01, simd_t02, simd_t03, simd_t10, simd_t11, simd_t12, simd_t13;
+  float t;
+
+  simd_t00 = _mm256_setzero_ps(); simd_t01 = _mm256_setzero_ps();
+  simd_t02 = _mm256_setzero_ps(); simd_t03 = _mm256_setzero_ps();
+  simd_t10 = _mm256_setzero_ps(); simd_t11 = _mm256_setzero_ps();
+  simd_t12 = _mm256_setzero_ps(); simd_t13 = _mm256_setzero_ps();
+
+  for ( i = 0; i < n_aligned; i += 8 ) {
+    simd_a0 = _mm256_loadu_ps( a0 + i );
+    simd_a1 = _mm256_loadu_ps( a1 + i );
+    simd_b = _mm256_loadu_ps( b0 + i );
+    simd_t00 = _mm256_fmadd_ps( simd_a0, simd_b, simd_t00 );
+    simd_t10 = _mm256_fmadd_ps( simd_a1, simd_b, simd_t10 );
+    simd_b = _mm256_loadu_ps( b1 + i );
+    simd_t01 = _mm256_fmadd_ps( simd_a0, simd_b, simd_t01 );
+    simd_t11 = _mm256_fmadd_ps( simd_a1, simd_b, simd_t11 );
+    simd_b = _mm256_loadu_ps( b2 + i );
+    simd_t02 = _mm256_fmadd_ps( simd_a0, simd_b, simd_t02 );
+    simd_t12 = _mm256_fmadd_ps( simd_a1, simd_b, simd_t12 );
+    simd_b = _mm256_loadu_ps( b3 + i );
+    simd_t03 = _mm256_fmadd_ps( simd_a0, simd_b, simd_t03 );
+    simd_t13 = _mm256_fmadd_ps( simd_a1, simd_b, simd_t13 );
+  }
+
+  c0[0] += hsum_avx( simd_t00 ); c0[1] += hsum_avx( simd_t01 );
+  c0[2] += hsum_avx( simd_t02 ); c0[3] += hsum_avx( simd_t03 );
+  c1[0] += hsum_avx( simd_t10 ); c1[1] += hsum_avx( simd_t11 );
+  c1[2] += hsum_avx( simd_t12 ); c1[3] += hsum_avx( simd_t13 );
+
+  for ( i = n_aligned; i < n; i++ ) {
+    t = a0[i]; c0[0] += t * b0[i]; c0[1] += t * b1[i]; c0[2] += t * b2[i]; c0[3] += t * b3[i];
+    t = a1[i]; c1[0] += t * b0[i]; c1[1] += t * b1[i]; c1[2] += t * b2[i]; c1[3] += t * b3[i];
+  }
+  return;
+}
+
+__attribute__((target("avx2,fma")))
+void axpy_avx2( int n, float alpha, float *x, float *y ) {
+  int i, n_aligned = 8 * ( n / 8 );
+  __m256 simd_alpha = _mm256_set1_ps( alpha );
+
+  for ( i = 0; i < n_aligned; i += 8 ) {
+    _mm256_storeu_ps( y + i, _mm256_fmadd_ps( simd_alpha, _mm256_loadu_ps( x + i ),
+        _mm256_loadu_ps( y + i ) ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    y[i] += alpha * x[i];
+  }
+  return;
+}
+
+__attribute__((target("avx2,fma")))
+void axpy_pair_avx2( int n, float alpha, float *x, float *y, float *w, float *z ) {
+  int i, n_aligned = 8 * ( n / 8 );
+  __m256 simd_alpha = _mm256_set1_ps( alpha );
+
+  for ( i = 0; i < n_aligned; i += 8 ) {
+    _mm256_storeu_ps( y + i, _mm256_fmadd_ps( simd_alpha, _mm256_loadu_ps( x + i ),
+        _mm256_loadu_ps( y + i ) ) );
+    _mm256_storeu_ps( z + i, _mm256_fmadd_ps( simd_alpha, _mm256_loadu_ps( w + i ),
+        _mm256_loadu_ps( z + i ) ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    y[i] += alpha * x[i];
+    z[i] += alpha * w[i];
+  }
+  return;
+}
+
+__attribute__((target("avx2,fma")))
+void widen_u8_avx2( int n, uint8_t *x, float *scale, float *offset, float *y ) {
+  int i, n_aligned = 8 * ( n / 8 );
+  __m256 simd_x;
+
+  for ( i = 0; i < n_aligned; i += 8 ) {
+    simd_x = _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( _mm_loadl_epi64( (__m128i *) ( x + i ) ) ) );
+    _mm256_storeu_ps( y + i, _mm256_fmadd_ps( simd_x, _mm256_loadu_ps( scale + i ), _mm256_loadu_ps( offset + i ) ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    y[i] = (float) x[i] * scale[i] + offset[i];
+  }
+  return;
+}
+
+__attribute__((target("avx2,fma,f16c")))
+void widen_f16_avx2( int n, uint16_t *x, float *scale, float *offset, float *y ) {
+  int i, n_aligned = 8 * ( n / 8 );
+  __m256 simd_x;
+
+  for ( i = 0; i < n_aligned; i += 8 ) {
+    simd_x = _mm256_cvtph_ps( _mm_loadu_si128( (__m128i *) ( x + i ) ) );
+    _mm256_storeu_ps( y + i, _mm256_fmadd_ps( simd_x, _mm256_loadu_ps( scale + i ), _mm256_loadu_ps( offset + i ) ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    y[i] = float16_to_float( x[i] ) * scale[i] + offset[i];
+  }
+  return;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  AVX-512 kernels, 16 floats wide. Masked loads handle the tail, so there is no scalar loop
+//
+
+__attribute__((target("avx512f")))
+static inline __mmask16 load_mask( int n, int i ) {
+  return n - i >= 16 ? (__mmask16) 0xffff : (__mmask16) ( ( 1u << ( n - i ) ) - 1 );
+}
+
+__attribute__((target("avx512f")))
+float dot_avx512( int n, float *a, float *b ) {
+  int i;
+  __mmask16 m;
+  __m512 simd_t = _mm512_setzero_ps();
+
+  for ( i = 0; i < n; i += 16 ) {
+    m = load_mask( n, i );
+    simd_t = _mm512_fmadd_ps( _mm512_maskz_loadu_ps( m, a + i ), _mm512_maskz_loadu_ps( m, b + i ), simd_t );
+  }
+
+  return _mm512_reduce_add_ps( simd_t );
+}
+
+__attribute__((target("avx512f")))
+void dot_1x4_avx512( int n, float *a, float *b0, float *b1, float *b2, float *b3, float *c ) {
+  int i;
+  __mmask16 m;
+  __m512 simd_a, simd_t0, simd_t1, simd_t2, simd_t3;
+
+  simd_t0 = _mm512_setzero_ps();
+  simd_t1 = _mm512_setzero_ps();
+  simd_t2 = _mm512_setzero_ps();
+  simd_t3 = _mm512_setzero_ps();
+
+  for ( i = 0; i < n; i += 16 ) {
+    m = load_mask( n, i );
+    simd_a = _mm512_maskz_loadu_ps( m, a + i );
+    simd_t0 = _mm512_fmadd_ps( simd_a, _mm512_maskz_loadu_ps( m, b0 + i ), simd_t0 );
+    simd_t1 = _mm512_fmadd_ps( simd_a, _mm512_maskz_loadu_ps( m, b1 + i ), simd_t1 );
+    simd_t2 = _mm512_fmadd_ps( simd_a, _mm512_maskz_loadu_ps( m, b2 + i ), simd_t2 );
+    simd_t3 = _mm512_fmadd_ps( simd_a, _mm512_maskz_loadu_ps( m, b3 + i ), simd_t3 );
+  }
+
+  c[0] += _mm512_reduce_add_ps( simd_t0 );
+  c[1] += _mm512_reduce_add_ps( simd_t1 );
+  c[2] += _mm512_reduce_add_ps( simd_t2 );
+  c[3] += _mm512_reduce_add_ps( simd_t3 );
+  return;
+}
+
+__attribute__((target("avx512f")))
+void dot_2x4_avx512( int n, float *a0, float *a1, float *b0, float *b1, float *b2, float *b3,
+    float *c0, float *c1 ) {
+  int i;
+  __mmask16 m;
+  __m512 simd_a0, simd_a1, simd_b;
+  __m512 simd_t00, simd_t01, simd_t02, simd_t03, simd_t10, simd_t11, simd_t12, simd_t13;
+
+  simd_t00 = _mm512_setzero_ps(); simd_t01 = _mm512_setzero_ps();
+  simd_t02 = _mm512_setzero_ps(); simd_t03 = _mm512_setzero_ps();
+  simd_t10 = _mm512_setzero_ps(); simd_t11 = _mm512_setzero_ps();
+  simd_t12 = _mm512_setzero_ps(); simd_t13 = _mm512_setzero_ps();
+
+  for ( i = 0; i < n; i += 16 ) {
+    m = load_mask( n, i );
+    simd_a0 = _mm512_maskz_loadu_ps( m, a0 + i );
+    simd_a1 = _mm512_maskz_loadu_ps( m, a1 + i );
+    simd_b = _mm512_maskz_loadu_ps( m, b0 + i );
+    simd_t00 = _mm512_fmadd_ps( simd_a0, simd_b, simd_t00 );
+    simd_t10 = _mm512_fmadd_ps( simd_a1, simd_b, simd_t10 );
+    simd_b = _mm512_maskz_loadu_ps( m, b1 + i );
+    simd_t01 = _mm512_fmadd_ps( simd_a0, simd_b, simd_t01 );
+    simd_t11 = _mm512_fmadd_ps( simd_a1, simd_b, simd_t11 );
+    simd_b = _mm512_maskz_loadu_ps( m, b2 + i );
+    simd_t02 = _mm512_fmadd_ps( simd_a0, simd_b, simd_t02 );
+    simd_t12 = _mm512_fmadd_ps( simd_a1, simd_b, simd_t12 );
+    simd_b = _mm512_maskz_loadu_ps( m, b3 + i );
+    simd_t03 = _mm512_fmadd_ps( simd_a0, simd_b, simd_t03 );
+    simd_t13 = _mm512_fmadd_ps( simd_a1, simd_b, simd_t13 );
+  }
+
+  c0[0] += _mm512_reduce_add_ps( simd_t00 ); c0[1] += _mm512_reduce_add_ps( simd_t01 );
+  c0[2] += _mm512_reduce_add_ps( simd_t02 ); c0[3] += _mm512_reduce_add_ps( simd_t03 );
+  c1[0] += _mm512_reduce_add_ps( simd_t10 ); c1[1] += _mm512_reduce_add_ps( simd_t11 );
+  c1[2] += _mm512_reduce_add_ps( simd_t12 ); c1[3] += _mm512_reduce_add_ps( simd_t13 );
+  return;
+}
+
+__attribute__((target("avx512f")))
+void axpy_avx512( int n, float alpha, float *x, float *y ) {
+  int i;
+  __mmask16 m;
+  __m512 simd_alpha = _mm512_set1_ps( alpha );
+
+  for ( i = 0; i < n; i += 16 ) {
+    m = load_mask( n, i );
+    _mm512_mask_storeu_ps( y + i, m, _mm512_fmadd_ps( simd_alpha, _mm512_maskz_loadu_ps( m, x + i ),
+        _mm512_maskz_loadu_ps( m, y + i ) ) );
+  }
+  return;
+}
+
+__attribute__((target("avx512f")))
+void axpy_pair_avx512( int n, float alpha, float *x, float *y, float *w, float *z ) {
+  int i, n_aligned = 32 * ( n / 32 );
+  __mmask16 m;
+  __m512 simd_alpha = _mm512_set1_ps( alpha );
+  __m512 y0, y1, z0, z1;
+
+  for ( i = 0; i < n_aligned; i += 32 ) {
+    y0 = _mm512_fmadd_ps( simd_alpha, _mm512_loadu_ps( x + i ), _mm512_loadu_ps( y + i ) );
+    y1 = _mm512_fmadd_ps( simd_alpha, _mm512_loadu_ps( x + i + 16 ), _mm512_loadu_ps( y + i + 16 ) );
+    z0 = _mm512_fmadd_ps( simd_alpha, _mm512_loadu_ps( w + i ), _mm512_loadu_ps( z + i ) );
+    z1 = _mm512_fmadd_ps( simd_alpha, _mm512_loadu_ps( w + i + 16 ), _mm512_loadu_ps( z + i + 16 ) );
+    _mm512_storeu_ps( y + i, y0 );
+    _mm512_storeu_ps( y + i + 16, y1 );
+    _mm512_storeu_ps( z + i, z0 );
+    _mm512_storeu_ps( z + i + 16, z1 );
+  }
+
+  for ( i = n_aligned; i < n; i += 16 ) {
+    m = load_mask( n, i );
+    _mm512_mask_storeu_ps( y + i, m, _mm512_fmadd_ps( simd_alpha, _mm512_maskz_loadu_ps( m, x + i ),
+        _mm512_maskz_loadu_ps( m, y + i ) ) );
+    _mm512_mask_storeu_ps( z + i, m, _mm512_fmadd_ps( simd_alpha, _mm512_maskz_loadu_ps( m, w + i ),
+        _mm512_maskz_loadu_ps( m, z + i ) ) );
+  }
+  return;
+}
+
+// Masked byte and 16-bit loads need AVX-512BW, so these widening kernels have a scalar tail
+__attribute__((target("avx512f")))
+void widen_u8_avx512( int n, uint8_t *x, float *scale, float *offset, float *y ) {
+  int i, n_aligned = 16 * ( n / 16 );
+  __m512 simd_x;
+
+  for ( i = 0; i < n_aligned; i += 16 ) {
+    simd_x = _mm512_cvtepi32_ps( _mm512_cvtepu8_epi32( _mm_loadu_si128( (__m128i *) ( x + i ) ) ) );
+    _mm512_storeu_ps( y + i, _mm512_fmadd_ps( simd_x, _mm512_loadu_ps( scale + i ), _mm512_loadu_ps( offset + i ) ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    y[i] = (float) x[i] * scale[i] + offset[i];
+  }
+  return;
+}
+
+__attribute__((target("avx512f")))
+void widen_f16_avx512( int n, uint16_t *x, float *scale, float *offset, float *y ) {
+  int i, n_aligned = 16 * ( n / 16 );
+  __m512 simd_x;
+
+  for ( i = 0; i < n_aligned; i += 16 ) {
+    simd_x = _mm512_cvtph_ps( _mm256_loadu_si256( (__m256i *) ( x + i ) ) );
+    _mm512_storeu_ps( y + i, _mm512_fmadd_ps( simd_x, _mm512_loadu_ps( scale + i ), _mm512_loadu_ps( offset + i ) ) );
+  }
+
+  for ( i = n_aligned; i < n; i++ ) {
+    y[i] = float16_to_float( x[i] ) * scale[i] + offset[i];
+  }
+  return;
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Kernel selection
+//
+
+void simd_kernels_set( simd_level_type level ) {
+  simd_kernels.level = level;
+
+  switch ( level ) {
+#ifdef SIMD_DISPATCH_ENABLED
+    case SIMD_AVX512:
+      simd_kernels.dot = dot_avx512;
+      simd_kernels.dot_1x4 = dot_1x4_avx512;
+      simd_kernels.dot_2x4 = dot_2x4_avx512;
+      simd_kernels.axpy = axpy_avx512;
+      simd_kernels.axpy_pair = axpy_pair_avx512;
+      simd_kernels.widen_u8 = widen_u8_avx512;
+      simd_kernels.widen_f16 = widen_f16_avx512;
+      break;
+
+    case SIMD_AVX2:
+      simd_kernels.dot = dot_avx2;
+      simd_kernels.dot_1x4 = dot_1x4_avx2;
+      simd_kernels.dot_2x4 = dot_2x4_avx2;
+      simd_kernels.axpy = axpy_avx2;
+      simd_kernels.axpy_pair = axpy_pair_avx2;
+      simd_kernels.widen_u8 = widen_u8_avx2;
+      // F16C is a separate feature from AVX2, so may be missing
+      simd_kernels.widen_f16 = __builtin_cpu_supports( "f16c" ) ? widen_f16_avx2 : widen_f16_sse;
+      break;
+#endif
+
+    default:
+      simd_kernels.level = SIMD_SSE2;
+      simd_kernels.dot = dot_sse;
+      simd_kernels.dot_1x4 = dot_1x4_sse;
+      simd_kernels.dot_2x4 = dot_2x4_sse;
+      simd_kernels.axpy = axpy_sse;
+      simd_kernels.axpy_pair = axpy_pair_sse;
+      simd_kernels.widen_u8 = widen_u8_sse;
+      simd_kernels.widen_f16 = widen_f16_sse;
+  }
+  return;
+}
+
+// The environment variable RU_NE_NE_SIMD can be set to "sse2" or "avx2" to use a lower level
+// than the CPU supports, e.g. to compare results
+void simd_kernels_init() {
+  simd_level_type level = SIMD_SSE2;
+  const char *env_level = getenv( "RU_NE_NE_SIMD" );
+
+#ifdef SIMD_DISPATCH_ENABLED
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) ) {
+    level = SIMD_AVX2;
+  }
+  if ( __builtin_cpu_supports( "avx512f" ) ) {
+    level = SIMD_AVX512;
+  }
+#endif
+
+  if ( env_level ) {
+    if ( strcmp( env_level, "sse2" ) == 0 ) {
+      level = SIMD_SSE2;
+    } else if ( strcmp( env_level, "avx2" ) == 0 && level > SIMD_AVX2 ) {
+      level = SIMD_AVX2;
+    }
+  }
+
+  simd_kernels_set( level );
+  return;
+}
+
+const char *simd_level_name( simd_level_type level ) {
+  switch ( level ) {
+    case SIMD_AVX512:
+      return "avx512";
+    case SIMD_AVX2:
+      return "avx2";
+    default:
+      return "sse2";
+  }
+}
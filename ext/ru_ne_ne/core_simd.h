@@ -0,0 +1,58 @@
+// ext/ru_ne_ne/core_simd.h
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Declarations of vector maths kernels, with variants for different CPU instruction sets.
+//  The best variant supported by the CPU is chosen once, when the extension is loaded.
+//
+
+#ifndef CORE_SIMD_H
+#define CORE_SIMD_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <xmmintrin.h>
+#include "core_float16.h"
+
+// Only GCC-compatible compilers targeting x86 can build and detect the wider variants
+#if ( defined(__GNUC__) || defined(__clang__) ) && ( defined(__x86_64__) || defined(__i386__) )
+#define SIMD_DISPATCH_ENABLED 1
+#include <immintrin.h>
+#endif
+
+typedef enum {SIMD_SSE2, SIMD_AVX2, SIMD_AVX512} simd_level_type;
+
+typedef struct _simd_kernels_raw {
+    simd_level_type level;
+
+    // Returns sum_i( a[i] * b[i] )
+    float (*dot)( int n, float *a, float *b );
+
+    // c[j] += sum_i( a[i] * bj[i] ) for j in 0..3
+    void (*dot_1x4)( int n, float *a, float *b0, float *b1, float *b2, float *b3, float *c );
+
+    // c0[j] += sum_i( a0[i] * bj[i] ), c1[j] += sum_i( a1[i] * bj[i] ) for j in 0..3
+    void (*dot_2x4)( int n, float *a0, float *a1, float *b0, float *b1, float *b2, float *b3,
+        float *c0, float *c1 );
+
+    // y[i] += alpha * x[i]
+    void (*axpy)( int n, float alpha, float *x, float *y );
+
+    // y[i] += alpha * x[i], z[i] += alpha * w[i], in a single pass
+    void (*axpy_pair)( int n, float alpha, float *x, float *y, float *w, float *z );
+
+    // y[i] = x[i] * scale[i] + offset[i], for bytes x
+    void (*widen_u8)( int n, uint8_t *x, float *scale, float *offset, float *y );
+
+    // y[i] = x[i] * scale[i] + offset[i], for float16 bit patterns x
+    void (*widen_f16)( int n, uint16_t *x, float *scale, float *offset, float *y );
+  } SimdKernels;
+
+extern SimdKernels simd_kernels;
+
+void simd_kernels_init();
+
+const char *simd_level_name( simd_level_type level );
+
+#endif
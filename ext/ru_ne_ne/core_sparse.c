@@ -0,0 +1,43 @@
+// ext/ru_ne_ne/core_sparse.c
+
+#include "core_sparse.h"
+
+void csr_buffer_init( CSRBuffer *buffer ) {
+  buffer->rows.row_ptr = NULL;
+  buffer->rows.col_idx = NULL;
+  buffer->rows.values = NULL;
+  buffer->row_capacity = 0;
+  buffer->nnz_capacity = 0;
+  return;
+}
+
+// Makes room for num_rows rows holding nnz values in total, keeping existing contents. Grows by
+// at least half again each time, so that rows can be appended one at a time.
+void csr_buffer_reserve( CSRBuffer *buffer, int num_rows, int nnz ) {
+  int capacity;
+
+  if ( num_rows > buffer->row_capacity ) {
+    capacity = buffer->row_capacity + buffer->row_capacity / 2;
+    capacity = capacity > num_rows ? capacity : num_rows;
+    REALLOC_N( buffer->rows.row_ptr, int, capacity + 1 );
+    buffer->row_capacity = capacity;
+  }
+
+  if ( nnz > buffer->nnz_capacity ) {
+    capacity = buffer->nnz_capacity + buffer->nnz_capacity / 2;
+    capacity = capacity > nnz ? capacity : nnz;
+    REALLOC_N( buffer->rows.col_idx, int, capacity );
+    REALLOC_N( buffer->rows.values, float, capacity );
+    buffer->nnz_capacity = capacity;
+  }
+
+  return;
+}
+
+void csr_buffer_free( CSRBuffer *buffer ) {
+  xfree( buffer->rows.row_ptr );
+  xfree( buffer->rows.col_idx );
+  xfree( buffer->rows.values );
+  csr_buffer_init( buffer );
+  return;
+}
@@ -0,0 +1,42 @@
+// ext/ru_ne_ne/core_sparse.h
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Compressed sparse row (CSR) matrices, used for inputs that are mostly zero
+//
+
+#ifndef CORE_SPARSE_H
+#define CORE_SPARSE_H
+
+#include <ruby.h>
+
+// Row i has non-zero values values[row_ptr[i]] .. values[row_ptr[i+1]-1], in columns given by
+// col_idx at the same positions. Entries in row_ptr are absolute, so a later set of rows can be
+// referred to just by moving row_ptr along.
+typedef struct _csr_rows {
+    int *row_ptr;
+    int *col_idx;
+    float *values;
+  } CSRRows;
+
+// CSRRows in a growable buffer. It is only grown with the GVL held, so rows can be written
+// without the GVL once csr_buffer_reserve has made room for them.
+typedef struct _csr_buffer {
+    CSRRows rows;
+    int row_capacity;
+    int nnz_capacity;
+  } CSRBuffer;
+
+static inline CSRRows csr_rows_from( CSRRows *rows, int first_row ) {
+  CSRRows later = *rows;
+  later.row_ptr += first_row;
+  return later;
+}
+
+void csr_buffer_init( CSRBuffer *buffer );
+
+void csr_buffer_reserve( CSRBuffer *buffer, int num_rows, int nnz );
+
+void csr_buffer_free( CSRBuffer *buffer );
+
+#endif
@@ -146,6 +146,19 @@ void raw_softmax_bulk_derivative_at( int n, float *func_ptr, float *deriv_ptr )
   }
 }
 
+// The softmax Jacobian da_i/dz_k = a_i * ( delta_ik - a_k ), so
+// de_dz_i = a_i * ( de_da_i - sum_k( de_da_k * a_k ) )
+void raw_softmax_de_dz_from_de_da( int n, float *func_ptr, float *de_da, float *de_dz ) {
+  int i;
+  float t = 0.0;
+  for ( i = 0; i < n; i++ ) {
+    t += de_da[i] * func_ptr[i];
+  }
+  for ( i = 0; i < n; i++ ) {
+    de_dz[i] = func_ptr[i] * ( de_da[i] - t );
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
 //  These intended to be called from neural-net routines in C
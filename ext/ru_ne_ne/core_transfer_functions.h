@@ -45,4 +45,8 @@ void raw_linear_bulk_derivative_at( int n, float *func_ptr, float *deriv_ptr );
 void raw_softmax_bulk_apply_function( int n, float *ptr );
 void raw_softmax_bulk_derivative_at( int n, float *func_ptr, float *deriv_ptr );
 
+// Chain rule through softmax, without building the n * n matrix from raw_softmax_bulk_derivative_at.
+// Writing de_dz over de_da is allowed.
+void raw_softmax_de_dz_from_de_da( int n, float *func_ptr, float *de_da, float *de_dz );
+
 #endif
@@ -23,5 +23,11 @@ if /cygwin|mingw/ =~ RUBY_PLATFORM
    have_library("narray") || raise("ERROR: narray library is not found")
 end
 
+# Training and other long-running methods release the GVL where possible
+have_header("ruby/thread.h")
+
+# DataSet files are memory-mapped where possible
+have_header("sys/mman.h")
+
 $CFLAGS << ' -O3 -funroll-loops'
 create_makefile( 'ru_ne_ne/ru_ne_ne' )
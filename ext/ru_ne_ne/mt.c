@@ -50,8 +50,11 @@
 static unsigned long mt[N]; /* the array for the state vector  */
 static int mti=N+1; /* mti==N+1 means mt[N] is not initialized */
 
+/* state is shared by all threads, some of which may not hold Ruby's GVL */
+static pthread_mutex_t mt_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /* initializes mt[N] with a seed */
-void init_genrand(unsigned long s)
+static void init_genrand_unlocked(unsigned long s)
 {
     mt[0]= s & 0xffffffffUL;
     for (mti=1; mti<N; mti++) {
@@ -66,6 +69,13 @@ void init_genrand(unsigned long s)
     }
 }
 
+void init_genrand(unsigned long s)
+{
+    pthread_mutex_lock(&mt_mutex);
+    init_genrand_unlocked(s);
+    pthread_mutex_unlock(&mt_mutex);
+}
+
 /* initialize by an array with array-length */
 /* init_key is the array for initializing keys */
 /* key_length is its length */
@@ -73,7 +83,8 @@ void init_genrand(unsigned long s)
 void init_by_array(unsigned long init_key[], int key_length)
 {
     int i, j, k;
-    init_genrand(19650218UL);
+    pthread_mutex_lock(&mt_mutex);
+    init_genrand_unlocked(19650218UL);
     i=1; j=0;
     k = (N>key_length ? N : key_length);
     for (; k; k--) {
@@ -93,6 +104,7 @@ void init_by_array(unsigned long init_key[], int key_length)
     }
 
     mt[0] = 0x80000000UL; /* MSB is 1; assuring non-zero initial array */
+    pthread_mutex_unlock(&mt_mutex);
 }
 
 /* generates a random number on [0,0xffffffff]-interval */
@@ -102,11 +114,12 @@ unsigned long genrand_int32(void)
     static unsigned long mag01[2]={0x0UL, MATRIX_A};
     /* mag01[x] = x * MATRIX_A  for x=0,1 */
 
+    pthread_mutex_lock(&mt_mutex);
     if (mti >= N) { /* generate N words at one time */
         int kk;
 
         if (mti == N+1)   /* if init_genrand() has not been called, */
-            init_genrand(5489UL); /* a default initial seed is used */
+            init_genrand_unlocked(5489UL); /* a default initial seed is used */
 
         for (kk=0;kk<N-M;kk++) {
             y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
@@ -123,6 +136,7 @@ unsigned long genrand_int32(void)
     }
 
     y = mt[mti++];
+    pthread_mutex_unlock(&mt_mutex);
 
     /* Tempering */
     y ^= (y >> 11);
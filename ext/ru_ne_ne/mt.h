@@ -53,6 +53,7 @@
 
 #include <ruby.h>
 #include <sys/time.h>
+#include <pthread.h>
 
 void init_genrand(unsigned long s);
 void init_by_array(unsigned long init_key[], int key_length);
@@ -24,5 +24,7 @@
 */
 
 void Init_ru_ne_ne() {
+  simd_kernels_init();
+  parallel_init();
   init_module_ru_ne_ne();
 }
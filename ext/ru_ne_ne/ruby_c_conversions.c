@@ -114,6 +114,10 @@ gradient_descent_type symbol_to_gradient_descent_type( VALUE rv_gdaccel_symbol )
     return GD_TYPE_NAG;
   } else if ( rb_intern("rmsprop") == accel_id ) {
     return GD_TYPE_RMSPROP;
+  } else if ( rb_intern("adagrad") == accel_id ) {
+    return GD_TYPE_ADAGRAD;
+  } else if ( rb_intern("adam") == accel_id ) {
+    return GD_TYPE_ADAM;
   } else {
     rb_raise( rb_eArgError, "gradient_descent_type %s not recognised", rb_id2name(accel_id) );
   }
@@ -127,6 +131,10 @@ VALUE gradient_descent_type_to_symbol( gradient_descent_type g ) {
       return ID2SYM( rb_intern("nag") );
     case GD_TYPE_RMSPROP:
       return ID2SYM( rb_intern("rmsprop") );
+    case GD_TYPE_ADAGRAD:
+      return ID2SYM( rb_intern("adagrad") );
+    case GD_TYPE_ADAM:
+      return ID2SYM( rb_intern("adam") );
     default:
       rb_raise( rb_eRuntimeError, "gradient_descent_type not valid, internal error");
   }
@@ -140,7 +148,47 @@ VALUE gradient_descent_type_to_class( gradient_descent_type g ) {
       return RuNeNe_GradientDescent_NAG;
     case GD_TYPE_RMSPROP:
       return RuNeNe_GradientDescent_RMSProp;
+    case GD_TYPE_ADAGRAD:
+      return RuNeNe_GradientDescent_AdaGrad;
+    case GD_TYPE_ADAM:
+      return RuNeNe_GradientDescent_Adam;
     default:
       rb_raise( rb_eRuntimeError, "gradient_descent_type not valid, internal error");
   }
-}
\ No newline at end of file
+}
+
+dataset_input_type symbol_to_dataset_input_type( VALUE rv_input_type ) {
+  ID input_type_id;
+
+  if ( TYPE(rv_input_type) != T_SYMBOL ) {
+    rb_raise( rb_eTypeError, "Input type must be a Symbol" );
+  }
+  input_type_id = SYM2ID(rv_input_type);
+
+  if ( rb_intern("sfloat") == input_type_id ) {
+    return DATASET_INPUT_SFLOAT;
+  } else if ( rb_intern("byte") == input_type_id ) {
+    return DATASET_INPUT_BYTE;
+  } else if ( rb_intern("float16") == input_type_id ) {
+    return DATASET_INPUT_FLOAT16;
+  } else if ( rb_intern("csr") == input_type_id ) {
+    return DATASET_INPUT_CSR;
+  } else {
+    rb_raise( rb_eArgError, "input_type %s not recognised", rb_id2name(input_type_id) );
+  }
+}
+
+VALUE dataset_input_type_to_symbol( dataset_input_type t ) {
+  switch( t ) {
+    case DATASET_INPUT_SFLOAT:
+      return ID2SYM( rb_intern("sfloat") );
+    case DATASET_INPUT_BYTE:
+      return ID2SYM( rb_intern("byte") );
+    case DATASET_INPUT_FLOAT16:
+      return ID2SYM( rb_intern("float16") );
+    case DATASET_INPUT_CSR:
+      return ID2SYM( rb_intern("csr") );
+    default:
+      rb_raise( rb_eRuntimeError, "dataset_input_type not valid, internal error");
+  }
+}
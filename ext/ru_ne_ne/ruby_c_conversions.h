@@ -9,6 +9,7 @@
 #include "core_objective_functions.h"
 #include "core_transfer_functions.h"
 #include "struct_mbgd_layer.h"
+#include "struct_dataset.h"
 
 transfer_type symbol_to_transfer_type( VALUE rv_transfer_type );
 VALUE transfer_type_to_module( transfer_type t );
@@ -22,4 +23,7 @@ gradient_descent_type symbol_to_gradient_descent_type( VALUE rv_gdaccel_symbol )
 VALUE gradient_descent_type_to_symbol( gradient_descent_type g );
 VALUE gradient_descent_type_to_class( gradient_descent_type g );
 
+dataset_input_type symbol_to_dataset_input_type( VALUE rv_input_type );
+VALUE dataset_input_type_to_symbol( dataset_input_type t );
+
 #endif
@@ -34,6 +34,12 @@ DataSet *safe_get_dataset_struct( VALUE obj ) {
   return get_dataset_struct( obj );
 }
 
+void assert_dataset_not_streaming( DataSet *dataset, const char *action ) {
+  if ( dataset->stream ) {
+    rb_raise( rb_eTypeError, "Cannot %s a streaming DataSet", action );
+  }
+}
+
 /* Document-class:  RuNeNe::DataSet
  *
  * A DataSet represents numeric data used for training, cross-validation, testing or prediction.
@@ -44,20 +50,105 @@ DataSet *safe_get_dataset_struct( VALUE obj ) {
 //  DataSet method definitions
 //
 
-/* @overload initialize( inputs, targets )
- * Creates a new dataset from example data.
- * @param [NArray<sfloat>] inputs the input examples that a nn_model will process
+// Converts inputs to the NArray type used to store them. Float16 values are stored as sint
+// bit patterns, so an sint NArray is assumed to hold those already.
+static VALUE dataset_cast_inputs( VALUE rv_inputs, dataset_input_type input_type ) {
+  volatile VALUE val_inputs, val_floats;
+  struct NARRAY *na_floats, *na_halfs;
+
+  switch ( input_type ) {
+    case DATASET_INPUT_BYTE:
+      return na_cast_object( rv_inputs, NA_BYTE );
+    case DATASET_INPUT_FLOAT16:
+      if ( IsNArray( rv_inputs ) ) {
+        GetNArray( rv_inputs, na_halfs );
+        if ( na_halfs->type == NA_SINT ) {
+          return rv_inputs;
+        }
+      }
+      val_floats = na_cast_object( rv_inputs, NA_SFLOAT );
+      GetNArray( val_floats, na_floats );
+      val_inputs = na_make_object( NA_SINT, na_floats->rank, na_floats->shape, cNArray );
+      GetNArray( val_inputs, na_halfs );
+      float16_encode( na_floats->total, (float*) na_floats->ptr, (uint16_t*) na_halfs->ptr );
+      return val_inputs;
+    default:
+      return na_cast_object( rv_inputs, NA_SFLOAT );
+  }
+}
+
+// Fills values from a Float, or an NArray with one value per input feature
+static void dataset_input_transform_param( VALUE rv_param, const char *name, int size, float *values ) {
+  volatile VALUE val_param;
+  struct NARRAY *narr;
+  int i;
+
+  if ( IsNArray( rv_param ) ) {
+    val_param = na_cast_object( rv_param, NA_SFLOAT );
+    GetNArray( val_param, narr );
+    if ( narr->total != size ) {
+      rb_raise( rb_eArgError, "%s has %d values, but items have %d input features", name, narr->total, size );
+    }
+    memcpy( values, (float*) narr->ptr, size * sizeof(float) );
+  } else {
+    for ( i = 0; i < size; i++ ) {
+      values[i] = NUM2FLT( rv_param );
+    }
+  }
+  return;
+}
+
+/* @overload initialize( inputs, targets, opts = {} )
+ * Creates a new dataset from example data. Inputs may be stored as bytes or half-precision
+ * floats, to save memory and bandwidth, and are then converted to float as items are read, with
+ * an optional scale and offset per input feature: input_value * input_scale + input_offset.
+ * @param [NArray] inputs the input examples that a nn_model will process
  * @param [NArray<sfloat>] targets known outputs that can be used to train or assess a nn_model
+ * @param [Hash] opts
+ * @option opts [Symbol] :input_type :sfloat, :byte or :float16, default :byte for a byte NArray,
+ *   otherwise :sfloat. For :float16, an sint NArray is taken to hold float16 bit patterns already.
+ * @option opts [Float,NArray<sfloat>] :input_scale default 1.0, not allowed for :sfloat
+ * @option opts [Float,NArray<sfloat>] :input_offset default 0.0, not allowed for :sfloat
  * @return [RuNeNe::DataSet] new dataset
  */
-VALUE dataset_class_initialize( VALUE self, VALUE rv_inputs, VALUE rv_targets ) {
+VALUE dataset_class_initialize( int argc, VALUE* argv, VALUE self ) {
+  volatile VALUE rv_inputs, rv_targets, rv_opts, rv_scale, rv_offset, rv_var;
   volatile VALUE val_inputs;
   volatile VALUE val_targets;
   struct NARRAY *na_inputs;
   struct NARRAY *na_targets;
+  dataset_input_type input_type = DATASET_INPUT_SFLOAT;
+  float *scale, *offset;
   DataSet *dataset = get_dataset_struct( self );
 
-  val_inputs = na_cast_object( rv_inputs, NA_SFLOAT );
+  rb_scan_args( argc, argv, "21", &rv_inputs, &rv_targets, &rv_opts );
+  rv_scale = Qnil;
+  rv_offset = Qnil;
+
+  if ( IsNArray( rv_inputs ) ) {
+    GetNArray( rv_inputs, na_inputs );
+    if ( na_inputs->type == NA_BYTE ) {
+      input_type = DATASET_INPUT_BYTE;
+    }
+  }
+
+  if ( !NIL_P( rv_opts ) ) {
+    Check_Type( rv_opts, T_HASH );
+    rv_var = ValAtSymbol( rv_opts, "input_type" );
+    if ( !NIL_P( rv_var ) ) {
+      input_type = symbol_to_dataset_input_type( rv_var );
+      if ( input_type == DATASET_INPUT_CSR ) {
+        rb_raise( rb_eArgError, "Use DataSet.from_csr for sparse inputs" );
+      }
+    }
+    rv_scale = ValAtSymbol( rv_opts, "input_scale" );
+    rv_offset = ValAtSymbol( rv_opts, "input_offset" );
+    if ( input_type == DATASET_INPUT_SFLOAT && ( !NIL_P( rv_scale ) || !NIL_P( rv_offset ) ) ) {
+      rb_raise( rb_eArgError, "input_scale and input_offset only apply to :byte or :float16 inputs" );
+    }
+  }
+
+  val_inputs = dataset_cast_inputs( rv_inputs, input_type );
   GetNArray( val_inputs, na_inputs );
 
   val_targets = na_cast_object( rv_targets, NA_SFLOAT );
@@ -78,11 +169,178 @@ VALUE dataset_class_initialize( VALUE self, VALUE rv_inputs, VALUE rv_targets )
 
   dataset__init_from_narray( dataset, val_inputs, val_targets );
 
+  if ( input_type != DATASET_INPUT_SFLOAT ) {
+    scale = ALLOCA_N( float, dataset->input_item_size );
+    offset = ALLOCA_N( float, dataset->input_item_size );
+    dataset_input_transform_param( NIL_P( rv_scale ) ? DBL2NUM( 1.0 ) : rv_scale, "input_scale",
+        dataset->input_item_size, scale );
+    dataset_input_transform_param( NIL_P( rv_offset ) ? DBL2NUM( 0.0 ) : rv_offset, "input_offset",
+        dataset->input_item_size, offset );
+    dataset__set_input_transform( dataset, scale, offset );
+  }
+
   return self;
 }
 
+/* @overload open_mmap( path )
+ * Opens a DataSet file written by #write_file. The file is memory-mapped read-only, and items are
+ * read directly from the mapping, so the data does not need to fit in memory, and processes that
+ * open the same file share the operating system's page cache. A memory-mapped DataSet has no
+ * inputs or outputs NArrays.
+ * @param [String] path file to open
+ * @return [RuNeNe::DataSet] new dataset
+ */
+VALUE dataset_rbclass__open_mmap( VALUE self, VALUE rv_path ) {
+  volatile VALUE rv_dataset = dataset_alloc( RuNeNe_DataSet );
+  DataSet *dataset = get_dataset_struct( rv_dataset );
+  dataset__init_from_file( dataset, rv_path );
+  return rv_dataset;
+}
+
+/* @overload from_csr( row_ptr, col_idx, values, num_inputs, targets )
+ * Creates a new dataset with sparse inputs, for features that are mostly zero, such as
+ * bag-of-words or one-hot encodings. Inputs are rows of a compressed sparse row (CSR) matrix,
+ * one row per item. Training reads the first layer's weights and updates its gradients only
+ * for non-zero inputs, so cost grows with the number of non-zero values, not num_inputs.
+ * Sparse inputs cannot be saved with #write_file, and Learn::MBGD#train_one_batch cannot
+ * calculate :input_de_da for them.
+ * @param [NArray<int>] row_ptr start of each item in col_idx and values, plus total number of values
+ * @param [NArray<int>] col_idx input index of each non-zero value, from 0 to num_inputs - 1
+ * @param [NArray<sfloat>] values non-zero input values
+ * @param [Integer] num_inputs size of a dense input item
+ * @param [NArray<sfloat>] targets known outputs, with one item per row
+ * @return [RuNeNe::DataSet] new dataset
+ */
+VALUE dataset_rbclass__from_csr( VALUE self, VALUE rv_row_ptr, VALUE rv_col_idx, VALUE rv_values,
+      VALUE rv_num_inputs, VALUE rv_targets ) {
+  volatile VALUE val_row_ptr, val_col_idx, val_values, val_targets, rv_dataset;
+  struct NARRAY *na_row_ptr, *na_col_idx, *na_values, *na_targets;
+  int i, num_items, nnz, num_inputs = NUM2INT( rv_num_inputs );
+  int *row_ptr, *col_idx;
+
+  val_row_ptr = na_cast_object( rv_row_ptr, NA_LINT );
+  GetNArray( val_row_ptr, na_row_ptr );
+  val_col_idx = na_cast_object( rv_col_idx, NA_LINT );
+  GetNArray( val_col_idx, na_col_idx );
+  val_values = na_cast_object( rv_values, NA_SFLOAT );
+  GetNArray( val_values, na_values );
+  val_targets = na_cast_object( rv_targets, NA_SFLOAT );
+  GetNArray( val_targets, na_targets );
+
+  if ( num_inputs < 1 ) {
+    rb_raise( rb_eArgError, "num_inputs must be at least 1, got %d", num_inputs );
+  }
+  if ( na_targets->rank < 2 ) {
+    rb_raise( rb_eArgError, "Targets rank should be at least 2, but got %d", na_targets->rank );
+  }
+  num_items = na_row_ptr->total - 1;
+  if ( num_items != na_targets->shape[ na_targets->rank - 1 ] ) {
+    rb_raise( rb_eArgError, "Number of input items %d not same as target items %d",
+        num_items, na_targets->shape[ na_targets->rank - 1 ] );
+  }
+  nnz = na_col_idx->total;
+  if ( na_values->total != nnz ) {
+    rb_raise( rb_eArgError, "col_idx has %d entries, but values has %d", nnz, na_values->total );
+  }
+
+  row_ptr = (int*) na_row_ptr->ptr;
+  if ( row_ptr[0] != 0 || row_ptr[num_items] != nnz ) {
+    rb_raise( rb_eArgError, "row_ptr should run from 0 to number of values %d", nnz );
+  }
+  for ( i = 0; i < num_items; i++ ) {
+    if ( row_ptr[i + 1] < row_ptr[i] ) {
+      rb_raise( rb_eArgError, "row_ptr decreases at item %d", i );
+    }
+  }
+  col_idx = (int*) na_col_idx->ptr;
+  for ( i = 0; i < nnz; i++ ) {
+    if ( col_idx[i] < 0 || col_idx[i] >= num_inputs ) {
+      rb_raise( rb_eArgError, "col_idx %d out of range 0...%d", col_idx[i], num_inputs );
+    }
+  }
+
+  rv_dataset = dataset_alloc( RuNeNe_DataSet );
+  dataset__init_from_csr( get_dataset_struct( rv_dataset ), val_row_ptr, val_col_idx, val_values,
+      num_inputs, val_targets );
+  return rv_dataset;
+}
+
+// Item shape may be given as an Integer, or an Array of Integers
+static int dataset_stream_shape_param( VALUE rv_shape, const char *name, int *shape ) {
+  int i, rank;
+
+  if ( FIXNUM_P( rv_shape ) ) {
+    rv_shape = rb_ary_new3( 1, rv_shape );
+  }
+  Check_Type( rv_shape, T_ARRAY );
+  rank = RARRAY_LEN( rv_shape );
+  if ( rank < 1 || rank > DATASET_FILE_MAX_RANK ) {
+    rb_raise( rb_eArgError, "%s rank should be in range 1..%d, got %d", name, DATASET_FILE_MAX_RANK, rank );
+  }
+  for ( i = 0; i < rank; i++ ) {
+    shape[i] = NUM2INT( rb_ary_entry( rv_shape, i ) );
+    if ( shape[i] < 1 ) {
+      rb_raise( rb_eArgError, "%s dimensions should be at least 1, got %d", name, shape[i] );
+    }
+  }
+  return rank;
+}
+
+/* @overload stream( source, input_shape, output_shape, opts = {} )
+ * Creates a DataSet that reads items as it needs them, for data too large to hold in memory.
+ * Items are read into a buffer of fixed size, and taken from it in random order, which shuffles
+ * them within a window of :buffer_size items. Learn::MBGD#train_one_batch refills the buffer
+ * before each batch, and raises StopIteration when the source has no more items.
+ *
+ * An IO source supplies each item as native sfloat values, all inputs followed by all outputs.
+ * Any other source should respond to #next like an Enumerator, and return [ input, output ] pairs
+ * of Arrays or NArrays.
+ *
+ * A streaming DataSet has no inputs or outputs NArrays, #num_items is the number of items
+ * currently buffered, and it cannot be cloned, split or saved.
+ * @param [IO,Enumerator] source where to read items from
+ * @param [Integer,Array<Integer>] input_shape shape of each input item
+ * @param [Integer,Array<Integer>] output_shape shape of each output item
+ * @param [Hash] opts
+ * @option opts [Integer] :buffer_size number of items to buffer and shuffle between, default 1024
+ * @option opts [Boolean] :repeat whether to rewind source when it ends, default false
+ * @return [RuNeNe::DataSet] new dataset
+ */
+VALUE dataset_rbclass__stream( int argc, VALUE* argv, VALUE self ) {
+  volatile VALUE rv_source, rv_input_shape, rv_output_shape, rv_opts, rv_var;
+  volatile VALUE rv_dataset;
+  int input_shape[DATASET_FILE_MAX_RANK], output_shape[DATASET_FILE_MAX_RANK];
+  int input_rank, output_rank, capacity = 1024, repeat = 0;
+
+  rb_scan_args( argc, argv, "31", &rv_source, &rv_input_shape, &rv_output_shape, &rv_opts );
+  input_rank = dataset_stream_shape_param( rv_input_shape, "input_shape", input_shape );
+  output_rank = dataset_stream_shape_param( rv_output_shape, "output_shape", output_shape );
+
+  if ( !NIL_P( rv_opts ) ) {
+    Check_Type( rv_opts, T_HASH );
+    rv_var = ValAtSymbol( rv_opts, "buffer_size" );
+    if ( !NIL_P( rv_var ) ) {
+      capacity = NUM2INT( rv_var );
+      if ( capacity < 1 ) {
+        rb_raise( rb_eArgError, "buffer_size must be at least 1, got %d", capacity );
+      }
+    }
+    repeat = RTEST( ValAtSymbol( rv_opts, "repeat" ) );
+  }
+
+  if ( ! rb_respond_to( rv_source, rb_intern( "read" ) ) && ! rb_respond_to( rv_source, rb_intern( "next" ) ) ) {
+    rb_raise( rb_eTypeError, "Stream source should be an IO or Enumerator" );
+  }
+
+  rv_dataset = dataset_alloc( RuNeNe_DataSet );
+  dataset__init_stream( get_dataset_struct( rv_dataset ), rv_source, input_rank, input_shape,
+      output_rank, output_shape, capacity, repeat );
+  return rv_dataset;
+}
+
 /* @overload clone
- * When cloned, the returned DataSet has deep copies of inputs and outputs,
+ * When cloned, the returned DataSet has deep copies of inputs and outputs, or for a memory-mapped
+ * DataSet it maps the same file again. A clone of a view is another view of the same items.
  * @return [RuNeNe::DataSet] new training data with identical items to caller.
  */
 VALUE dataset_class_initialize_copy( VALUE copy, VALUE orig ) {
@@ -92,19 +350,43 @@ VALUE dataset_class_initialize_copy( VALUE copy, VALUE orig ) {
   if (copy == orig) return copy;
   dataset_orig = get_dataset_struct( orig );
   dataset_copy = get_dataset_struct( copy );
+  assert_dataset_not_streaming( dataset_orig, "clone" );
+  dataset__check_not_busy( dataset_orig );
+  dataset_copy->shuffle_block_size = dataset_orig->shuffle_block_size;
+
+  if ( !NIL_P( dataset_orig->mmap_path ) ) {
+    dataset__init_from_file( dataset_copy, dataset_orig->mmap_path );
+    return copy;
+  }
+
+  if ( dataset_orig->input_type == DATASET_INPUT_CSR && ! dataset_orig->item_idx ) {
+    dataset__init_from_csr( dataset_copy, na_clone( rb_ary_entry( dataset_orig->narr_csr, 0 ) ),
+        na_clone( rb_ary_entry( dataset_orig->narr_csr, 1 ) ), na_clone( rb_ary_entry( dataset_orig->narr_csr, 2 ) ),
+        dataset_orig->input_item_size, na_clone( dataset_orig->narr_outputs ) );
+    return copy;
+  }
+
+  if ( dataset_orig->item_idx ) {
+    dataset__init_view( dataset_copy, get_dataset_struct( dataset_orig->view_of ), dataset_orig->view_of,
+        dataset_orig->num_items, dataset_orig->item_idx );
+    dataset_copy->shuffle_block_size = dataset_orig->shuffle_block_size;
+    return copy;
+  }
 
   dataset_copy->num_items = dataset_orig->num_items;
   dataset_copy->narr_outputs = na_clone( dataset_orig->narr_outputs );
   dataset_copy->narr_inputs = na_clone( dataset_orig->narr_inputs );
 
   dataset__reinit( dataset_copy );
+  dataset__set_input_transform( dataset_copy, dataset_orig->input_scale, dataset_orig->input_offset );
 
   return copy;
 }
 
 /* @!attribute [r] inputs
- * The inputs array.
- * @return [NArray<sfloat>]
+ * The inputs array, as stored (see #input_type), or nil if the DataSet is memory-mapped, sparse
+ * or a view.
+ * @return [NArray]
  */
 VALUE dataset_object_inputs( VALUE self ) {
   DataSet *dataset = get_dataset_struct( self );
@@ -112,7 +394,7 @@ VALUE dataset_object_inputs( VALUE self ) {
 }
 
 /* @!attribute [r] outputs
- * The outputs array.
+ * The outputs array, or nil if the DataSet is memory-mapped or a view.
  * @return [NArray<sfloat>]
  */
 VALUE dataset_object_outputs( VALUE self ) {
@@ -129,14 +411,291 @@ VALUE dataset_object_num_items( VALUE self ) {
   return INT2NUM( dataset->num_items );
 }
 
+/* @!attribute [r] num_inputs
+ * The number of input values in each item.
+ * @return [Integer]
+ */
+VALUE dataset_object_num_inputs( VALUE self ) {
+  DataSet *dataset = get_dataset_struct( self );
+  return INT2NUM( dataset->input_item_size );
+}
+
+/* @!attribute [r] csr
+ * For sparse inputs, the [ row_ptr, col_idx, values ] NArrays that hold them, otherwise nil. Nil
+ * for a view.
+ * @return [Array<NArray>]
+ */
+VALUE dataset_object_csr( VALUE self ) {
+  DataSet *dataset = get_dataset_struct( self );
+  return NIL_P( dataset->narr_csr ) ? Qnil : rb_ary_dup( dataset->narr_csr );
+}
+
+/* @!attribute [r] input_type
+ * How inputs are stored, one of :sfloat, :byte, :float16 or :csr.
+ * @return [Symbol]
+ */
+VALUE dataset_object_input_type( VALUE self ) {
+  DataSet *dataset = get_dataset_struct( self );
+  return dataset_input_type_to_symbol( dataset->input_type );
+}
+
+static VALUE dataset_item_narray( int rank, int *shape, int size, float *values ) {
+  struct NARRAY *narr;
+  volatile VALUE rv_item = na_make_object( NA_SFLOAT, rank, shape, cNArray );
+  GetNArray( rv_item, narr );
+  memcpy( (float*) narr->ptr, values, size * sizeof(float) );
+  return rv_item;
+}
+
+/* @!attribute [r] input_scale
+ * Multiplier for each input feature when reading :byte or :float16 inputs, nil for :sfloat.
+ * @return [NArray<sfloat>]
+ */
+VALUE dataset_object_input_scale( VALUE self ) {
+  DataSet *dataset = get_dataset_struct( self );
+  if ( ! dataset->input_scale ) {
+    return Qnil;
+  }
+  return dataset_item_narray( dataset->input_item_rank, dataset->input_item_shape,
+      dataset->input_item_size, dataset->input_scale );
+}
+
+/* @!attribute [r] input_offset
+ * Added to each input feature, after scaling, when reading :byte or :float16 inputs, nil for :sfloat.
+ * @return [NArray<sfloat>]
+ */
+VALUE dataset_object_input_offset( VALUE self ) {
+  DataSet *dataset = get_dataset_struct( self );
+  if ( ! dataset->input_offset ) {
+    return Qnil;
+  }
+  return dataset_item_narray( dataset->input_item_rank, dataset->input_item_shape,
+      dataset->input_item_size, dataset->input_offset );
+}
+
+/* @!attribute [r] mmap_path
+ * The file that the DataSet is memory-mapped from, or nil if it is held in NArrays.
+ * @return [String]
+ */
+VALUE dataset_object_mmap_path( VALUE self ) {
+  DataSet *dataset = get_dataset_struct( self );
+  return dataset->mmap_path;
+}
+
+/* @!attribute shuffle_block_size
+ * When items run out, they are shuffled for the next pass. By default the order is completely
+ * random. When shuffle_block_size is set, items are instead grouped into blocks of that many
+ * items in stored order, the blocks are shuffled, then items within each block. Access to
+ * storage is then mostly sequential, which is much faster for a memory-mapped DataSet larger
+ * than available memory. Set nil for a full shuffle.
+ * @return [Integer]
+ */
+VALUE dataset_object_shuffle_block_size( VALUE self ) {
+  DataSet *dataset = get_dataset_struct( self );
+  return dataset->shuffle_block_size > 0 ? INT2NUM( dataset->shuffle_block_size ) : Qnil;
+}
+
+VALUE dataset_object_set_shuffle_block_size( VALUE self, VALUE rv_block_size ) {
+  DataSet *dataset = get_dataset_struct( self );
+  int block_size = 0;
+
+  dataset__check_not_busy( dataset );
+  if ( !NIL_P( rv_block_size ) ) {
+    block_size = NUM2INT( rv_block_size );
+    if ( block_size < 1 ) {
+      rb_raise( rb_eArgError, "shuffle_block_size must be at least 1, got %d", block_size );
+    }
+  }
+  dataset->shuffle_block_size = block_size;
+  return rv_block_size;
+}
+
+/* @!attribute [r] source
+ * The IO or Enumerator that a streaming DataSet reads from, otherwise nil.
+ * @return [Object]
+ */
+VALUE dataset_object_source( VALUE self ) {
+  DataSet *dataset = get_dataset_struct( self );
+  return dataset->stream ? dataset->stream->source : Qnil;
+}
+
+/* @!attribute [r] buffer_size
+ * The number of items a streaming DataSet can buffer, otherwise nil.
+ * @return [Integer]
+ */
+VALUE dataset_object_buffer_size( VALUE self ) {
+  DataSet *dataset = get_dataset_struct( self );
+  return dataset->stream ? INT2NUM( dataset->stream->capacity ) : Qnil;
+}
+
+/* @!attribute [r] view_of
+ * The DataSet whose storage this one shares, or nil if it is not a view. Views of views refer
+ * to the original DataSet.
+ * @return [RuNeNe::DataSet]
+ */
+VALUE dataset_object_view_of( VALUE self ) {
+  DataSet *dataset = get_dataset_struct( self );
+  return dataset->view_of;
+}
+
+/* @!attribute [r] indices
+ * For a view, the position of each of its items in #view_of, otherwise nil.
+ * @return [NArray<int>]
+ */
+VALUE dataset_object_indices( VALUE self ) {
+  struct NARRAY *narr;
+  volatile VALUE rv_indices;
+  DataSet *dataset = get_dataset_struct( self );
+  int shape[1];
+
+  if ( ! dataset->item_idx ) {
+    return Qnil;
+  }
+  shape[0] = dataset->num_items;
+  rv_indices = na_make_object( NA_LINT, 1, shape, cNArray );
+  GetNArray( rv_indices, narr );
+  memcpy( (int*) narr->ptr, dataset->item_idx, dataset->num_items * sizeof(int) );
+  return rv_indices;
+}
+
+static VALUE dataset_new_view( VALUE parent, int num_items, int *indices ) {
+  volatile VALUE rv_view = dataset_alloc( RuNeNe_DataSet );
+  dataset__init_view( get_dataset_struct( rv_view ), get_dataset_struct( parent ), parent, num_items, indices );
+  return rv_view;
+}
+
+/* @overload subset( indices )
+ * Creates a view of selected items. The view shares storage with this DataSet, so no inputs or
+ * outputs are copied, but it has its own item order for #next_item and training. Items may be
+ * selected more than once.
+ * @param [NArray<int>,Array<Integer>] indices positions of items to include
+ * @return [RuNeNe::DataSet] new view
+ */
+VALUE dataset_object_subset( VALUE self, VALUE rv_indices ) {
+  volatile VALUE val_indices;
+  struct NARRAY *na_indices;
+  DataSet *dataset = get_dataset_struct( self );
+  int i, *indices;
+
+  assert_dataset_not_streaming( dataset, "subset" );
+  val_indices = na_cast_object( rv_indices, NA_LINT );
+  GetNArray( val_indices, na_indices );
+  if ( na_indices->total < 1 ) {
+    rb_raise( rb_eArgError, "Subset must have at least one item" );
+  }
+  indices = (int*) na_indices->ptr;
+  for ( i = 0; i < na_indices->total; i++ ) {
+    if ( indices[i] < 0 || indices[i] >= dataset->num_items ) {
+      rb_raise( rb_eArgError, "Index %d out of range 0...%d", indices[i], dataset->num_items );
+    }
+  }
+
+  return dataset_new_view( self, na_indices->total, indices );
+}
+
+static int dataset_compare_ints( const void *a, const void *b ) {
+  return *(const int *) a - *(const int *) b;
+}
+
+/* @overload split( fractions, opts = {} )
+ * Divides items between views, e.g. for training, validation and test sets. The views share
+ * storage with this DataSet, and no item is in more than one of them. Items are assigned in a
+ * random order unless :shuffle is false, in which case each view is a contiguous range. Use
+ * RuNeNe.srand for a repeatable split. Each view lists its items in stored order, so that
+ * #shuffle_block_size still groups items that are stored together.
+ * @param [Array<Float>] fractions share of items for each view, must total no more than 1.0
+ * @param [Hash] opts
+ * @option opts [Boolean] :shuffle default true
+ * @return [Array<RuNeNe::DataSet>] one view per fraction
+ */
+VALUE dataset_object_split( int argc, VALUE* argv, VALUE self ) {
+  volatile VALUE rv_fractions, rv_opts, rv_views;
+  DataSet *dataset = get_dataset_struct( self );
+  int i, n, count, start = 0, shuffle = 1, *order;
+  double fraction, total = 0.0;
+
+  rb_scan_args( argc, argv, "11", &rv_fractions, &rv_opts );
+  assert_dataset_not_streaming( dataset, "split" );
+  Check_Type( rv_fractions, T_ARRAY );
+  n = RARRAY_LEN( rv_fractions );
+  if ( n < 1 ) {
+    rb_raise( rb_eArgError, "No fractions given" );
+  }
+  if ( !NIL_P( rv_opts ) ) {
+    Check_Type( rv_opts, T_HASH );
+    shuffle = ValAtSymbol( rv_opts, "shuffle" ) != Qfalse;
+  }
+
+  for ( i = 0; i < n; i++ ) {
+    fraction = NUM2DBL( rb_ary_entry( rv_fractions, i ) );
+    if ( fraction <= 0.0 ) {
+      rb_raise( rb_eArgError, "Fraction %f is not positive", fraction );
+    }
+    total += fraction;
+  }
+  if ( total > 1.0 + 1e-9 ) {
+    rb_raise( rb_eArgError, "Fractions total %f, more than 1.0", total );
+  }
+
+  order = ALLOC_N( int, dataset->num_items );
+  for ( i = 0; i < dataset->num_items; i++ ) {
+    order[i] = i;
+  }
+  if ( shuffle ) {
+    shuffle_ints( dataset->num_items, order );
+  }
+
+  rv_views = rb_ary_new2( n );
+  total = 0.0;
+  for ( i = 0; i < n; i++ ) {
+    total += NUM2DBL( rb_ary_entry( rv_fractions, i ) );
+    count = (int) ( total * dataset->num_items + 0.5 );
+    if ( count > dataset->num_items ) {
+      count = dataset->num_items;
+    }
+    count -= start;
+    if ( count < 1 ) {
+      xfree( order );
+      rb_raise( rb_eArgError, "Fraction %d selects no items from %d", i, dataset->num_items );
+    }
+    qsort( order + start, count, sizeof(int), dataset_compare_ints );
+    rb_ary_push( rv_views, dataset_new_view( self, count, order + start ) );
+    start += count;
+  }
+
+  xfree( order );
+  return rv_views;
+}
+
+/* @overload write_file( path )
+ * Writes all items to a binary file, which can be opened with DataSet.open_mmap. Items are
+ * written in their stored order, not the current shuffled order.
+ * @param [String] path file to write
+ * @return [RuNeNe::DataSet] self
+ */
+VALUE dataset_object_write_file( VALUE self, VALUE rv_path ) {
+  DataSet *dataset = get_dataset_struct( self );
+  assert_dataset_not_streaming( dataset, "save" );
+  dataset__write_file( dataset, StringValueCStr( rv_path ) );
+  return self;
+}
+
 VALUE dataset_object_next_item( VALUE self ) {
-  dataset__next( get_dataset_struct( self ) );
+  DataSet *dataset = get_dataset_struct( self );
+  dataset__check_not_busy( dataset );
+  if ( dataset->stream ) {
+    dataset__stream_prepare_batch( dataset, 1 );
+  }
+  dataset__next( dataset );
   return self;
 }
 
 VALUE dataset_object_current_input_item( VALUE self ) {
   DataSet *dataset = get_dataset_struct( self );
-  float *input_data = dataset__current_input( dataset );
+  float *input_data;
+
+  dataset__check_not_busy( dataset );
+  input_data = dataset__current_input( dataset );
 
   struct NARRAY *narr;
   volatile VALUE current_input = na_make_object( NA_SFLOAT, dataset->input_item_rank, dataset->input_item_shape, cNArray );
@@ -148,7 +707,10 @@ VALUE dataset_object_current_input_item( VALUE self ) {
 
 VALUE dataset_object_current_output_item( VALUE self ) {
   DataSet *dataset = get_dataset_struct( self );
-  float *output_data = dataset__current_output( dataset );
+  float *output_data;
+
+  dataset__check_not_busy( dataset );
+  output_data = dataset__current_output( dataset );
 
   struct NARRAY *narr;
   volatile VALUE current_output = na_make_object( NA_SFLOAT, dataset->output_item_rank, dataset->output_item_shape, cNArray );
@@ -163,15 +725,33 @@ VALUE dataset_object_current_output_item( VALUE self ) {
 void init_dataset_class( ) {
   // DataSet instantiation and class methods
   rb_define_alloc_func( RuNeNe_DataSet, dataset_alloc );
-  rb_define_method( RuNeNe_DataSet, "initialize", dataset_class_initialize, 2 );
+  rb_define_method( RuNeNe_DataSet, "initialize", dataset_class_initialize, -1 );
   rb_define_method( RuNeNe_DataSet, "initialize_copy", dataset_class_initialize_copy, 1 );
+  rb_define_singleton_method( RuNeNe_DataSet, "open_mmap", dataset_rbclass__open_mmap, 1 );
+  rb_define_singleton_method( RuNeNe_DataSet, "stream", dataset_rbclass__stream, -1 );
+  rb_define_singleton_method( RuNeNe_DataSet, "from_csr", dataset_rbclass__from_csr, 5 );
 
   // DataSet attributes
   rb_define_method( RuNeNe_DataSet, "inputs", dataset_object_inputs, 0 );
   rb_define_method( RuNeNe_DataSet, "outputs", dataset_object_outputs, 0 );
   rb_define_method( RuNeNe_DataSet, "num_items", dataset_object_num_items, 0 );
+  rb_define_method( RuNeNe_DataSet, "num_inputs", dataset_object_num_inputs, 0 );
+  rb_define_method( RuNeNe_DataSet, "csr", dataset_object_csr, 0 );
+  rb_define_method( RuNeNe_DataSet, "input_type", dataset_object_input_type, 0 );
+  rb_define_method( RuNeNe_DataSet, "input_scale", dataset_object_input_scale, 0 );
+  rb_define_method( RuNeNe_DataSet, "input_offset", dataset_object_input_offset, 0 );
+  rb_define_method( RuNeNe_DataSet, "mmap_path", dataset_object_mmap_path, 0 );
+  rb_define_method( RuNeNe_DataSet, "shuffle_block_size", dataset_object_shuffle_block_size, 0 );
+  rb_define_method( RuNeNe_DataSet, "shuffle_block_size=", dataset_object_set_shuffle_block_size, 1 );
+  rb_define_method( RuNeNe_DataSet, "source", dataset_object_source, 0 );
+  rb_define_method( RuNeNe_DataSet, "buffer_size", dataset_object_buffer_size, 0 );
+  rb_define_method( RuNeNe_DataSet, "view_of", dataset_object_view_of, 0 );
+  rb_define_method( RuNeNe_DataSet, "indices", dataset_object_indices, 0 );
 
   // Methods
+  rb_define_method( RuNeNe_DataSet, "write_file", dataset_object_write_file, 1 );
+  rb_define_method( RuNeNe_DataSet, "subset", dataset_object_subset, 1 );
+  rb_define_method( RuNeNe_DataSet, "split", dataset_object_split, -1 );
   rb_define_method( RuNeNe_DataSet, "next_item", dataset_object_next_item, 0 );
   rb_define_method( RuNeNe_DataSet, "current_input_item", dataset_object_current_input_item, 0 );
   rb_define_method( RuNeNe_DataSet, "current_output_item", dataset_object_current_output_item, 0 );
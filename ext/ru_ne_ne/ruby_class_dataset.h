@@ -7,8 +7,10 @@
 #include "narray.h"
 #include "struct_dataset.h"
 #include "shared_vars.h"
+#include "ruby_c_conversions.h"
 
 void init_dataset_class( );
 DataSet *safe_get_dataset_struct( VALUE obj );
+void assert_dataset_not_streaming( DataSet *dataset, const char *action );
 
 #endif
@@ -0,0 +1,235 @@
+// ext/ru_ne_ne/ruby_class_gd_adagrad.c
+
+#include "ruby_class_gd_adagrad.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Ruby bindings for training data arrays - the deeper implementation is in
+//  struct_gd_adagrad.c
+//
+
+inline VALUE gd_adagrad_as_ruby_class( GradientDescent_AdaGrad *gd_adagrad , VALUE klass ) {
+  return Data_Wrap_Struct( klass, gd_adagrad__gc_mark, gd_adagrad__destroy, gd_adagrad );
+}
+
+VALUE gd_adagrad_alloc(VALUE klass) {
+  return gd_adagrad_as_ruby_class( gd_adagrad__create(), klass );
+}
+
+inline GradientDescent_AdaGrad *get_gd_adagrad_struct( VALUE obj ) {
+  GradientDescent_AdaGrad *gd_adagrad;
+  Data_Get_Struct( obj, GradientDescent_AdaGrad, gd_adagrad );
+  return gd_adagrad;
+}
+
+void assert_value_wraps_gd_adagrad( VALUE obj ) {
+  if ( TYPE(obj) != T_DATA ||
+      RDATA(obj)->dfree != (RUBY_DATA_FUNC)gd_adagrad__destroy) {
+    rb_raise( rb_eTypeError, "Expected a GradientDescent_AdaGrad object, but got something else" );
+  }
+}
+
+// Helper for converting hash to C properties
+void copy_hash_to_gd_adagrad_properties( VALUE rv_opts, GradientDescent_AdaGrad *gd_adagrad ) {
+  volatile VALUE rv_var;
+  volatile VALUE new_narray;
+  struct NARRAY* narr;
+
+  // Start with simple properties
+  rv_var = ValAtSymbol(rv_opts,"num_params");
+  if ( !NIL_P(rv_var) ) {
+    gd_adagrad->num_params = NUM2INT( rv_var );
+  }
+
+  rv_var = ValAtSymbol(rv_opts,"epsilon");
+  if ( !NIL_P(rv_var) ) {
+    gd_adagrad->epsilon = NUM2FLT( rv_var );
+  }
+
+  rv_var = ValAtSymbol(rv_opts,"sum_squared_grads");
+  if ( !NIL_P(rv_var) ) {
+    new_narray = na_cast_object(rv_var, NA_SFLOAT);
+    GetNArray( new_narray, narr );
+    gd_adagrad->narr_sum_squared_grads = new_narray;
+    gd_adagrad->sum_squared_grads = (float *) narr->ptr;
+    gd_adagrad->num_params = narr->total;
+  }
+
+  // TODO: Deal with partially-complete object here, and detect
+  // inconsistent params
+
+  return;
+}
+
+/* Document-class: RuNeNe::GradientDescent::AdaGrad
+ *
+ * AdaGrad scales each param's learning rate down by the square root of the sum of all its
+ * squared gradients so far. Params with rare, large gradients keep taking larger steps.
+ */
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  NNModel method definitions
+//
+
+/* @overload initialize( params, epsilon )
+ * Creates a new AdaGrad optimiser, with sum of squared gradients starting at zero.
+ * @param [NArray<sfloat>] params actual or example NArray of params for optimisation
+ * @param [Float] epsilon added to sum of squared gradients before taking square root
+ * @return [RuNeNe::GradientDescent::AdaGrad] new optimiser
+ */
+
+VALUE gd_adagrad_rbobject__initialize( VALUE self, VALUE rv_params, VALUE rv_epsilon ) {
+  GradientDescent_AdaGrad *gd_adagrad = get_gd_adagrad_struct( self );
+
+  volatile VALUE example_params = na_cast_object( rv_params, NA_SFLOAT );
+
+  gd_adagrad__init( gd_adagrad, example_params, NUM2FLT( rv_epsilon ) );
+
+  return self;
+}
+
+/* @overload clone
+ * When cloned, the returned GradientDescent_AdaGrad has deep copies of C data.
+ * @return [RuNeNe::GradientDescent::AdaGrad] new
+ */
+VALUE gd_adagrad_rbobject__initialize_copy( VALUE copy, VALUE orig ) {
+  GradientDescent_AdaGrad *gd_adagrad_copy;
+  GradientDescent_AdaGrad *gd_adagrad_orig;
+
+  if (copy == orig) return copy;
+  gd_adagrad_orig = get_gd_adagrad_struct( orig );
+  gd_adagrad_copy = get_gd_adagrad_struct( copy );
+
+  gd_adagrad__deep_copy( gd_adagrad_copy, gd_adagrad_orig );
+
+  return copy;
+}
+
+/* @overload initialize( h )
+ * Creates a new ...
+ * keys are h[:num_params], h[:epsilon], h[:sum_squared_grads]
+ * @return [RuNeNe::GradientDescent::AdaGrad] new ...
+ */
+
+VALUE gd_adagrad_rbclass__from_h( VALUE self, VALUE rv_h ) {
+  GradientDescent_AdaGrad *gd_adagrad;
+  Check_Type( rv_h, T_HASH );
+
+  VALUE rv_gd_adagrad = gd_adagrad_alloc( RuNeNe_GradientDescent_AdaGrad );
+  gd_adagrad = get_gd_adagrad_struct( rv_gd_adagrad );
+
+  copy_hash_to_gd_adagrad_properties( rv_h, gd_adagrad );
+
+  return rv_gd_adagrad;
+}
+
+/* @!attribute [r] num_params
+ * Description goes here
+ * @return [Integer]
+ */
+VALUE gd_adagrad_rbobject__get_num_params( VALUE self ) {
+  GradientDescent_AdaGrad *gd_adagrad = get_gd_adagrad_struct( self );
+  return INT2NUM( gd_adagrad->num_params );
+}
+
+/* @!attribute epsilon
+ * Description goes here
+ * @return [Float]
+ */
+VALUE gd_adagrad_rbobject__get_epsilon( VALUE self ) {
+  GradientDescent_AdaGrad *gd_adagrad = get_gd_adagrad_struct( self );
+  return FLT2NUM( gd_adagrad->epsilon );
+}
+
+VALUE gd_adagrad_rbobject__set_epsilon( VALUE self, VALUE rv_epsilon ) {
+  GradientDescent_AdaGrad *gd_adagrad = get_gd_adagrad_struct( self );
+  gd_adagrad->epsilon = NUM2FLT( rv_epsilon );
+  return rv_epsilon;
+}
+
+/* @!attribute [r] sum_squared_grads
+ * Running total of squared gradients for each param
+ * @return [NArray<sfloat>]
+ */
+VALUE gd_adagrad_rbobject__get_narr_sum_squared_grads( VALUE self ) {
+  GradientDescent_AdaGrad *gd_adagrad = get_gd_adagrad_struct( self );
+  return gd_adagrad->narr_sum_squared_grads;
+}
+
+/* @overload pre_gradient_step( params, learning_rate )
+ * Prepares object for a gradient step. Some optimisers alter params
+ * @param [NArray<sfloat>] params array of same size as initial example
+ * @param [Float] learning_rate size of
+ * @return [NArray<sfloat>] the params array that willbe optimised (may be cast to NArray<sfloat> from supplied params)
+ */
+VALUE gd_adagrad_rbobject__pre_gradient_step( VALUE self, VALUE rv_params, VALUE rv_learning_rate ) {
+  GradientDescent_AdaGrad *gd_adagrad = get_gd_adagrad_struct( self );
+
+  volatile VALUE opt_params;
+  struct NARRAY *na_params;
+  opt_params = na_cast_object( rv_params, NA_SFLOAT );
+  GetNArray( opt_params, na_params );
+
+  if ( gd_adagrad->num_params != na_params->total ) {
+    rb_raise( rb_eArgError, "Expecting NArray with %d params, but input has %d params", gd_adagrad->num_params, na_params->total );
+  }
+
+  gd_adagrad__pre_gradient_step( gd_adagrad, (float *)na_params->ptr, NUM2FLT(rv_learning_rate) );
+
+  return opt_params;
+}
+
+/* @overload pre_gradient_step( params, gradients, learning_rate )
+ * Prepares object for a gradient step. Some optimisers alter params
+ * @param [NArray<sfloat>] params array of same size as initial example
+ * @param [NArray<sfloat>] gradients array of same size as initial example
+ * @param [Float] learning_rate size of
+ * @return [NArray<sfloat>] the params array that willbe optimised (may be cast to NArray<sfloat> from supplied params)
+ */
+VALUE gd_adagrad_rbobject__gradient_step( VALUE self, VALUE rv_params, VALUE rv_gradients, VALUE rv_learning_rate ) {
+  GradientDescent_AdaGrad *gd_adagrad = get_gd_adagrad_struct( self );
+
+  volatile VALUE opt_params;
+  struct NARRAY *na_params;
+  volatile VALUE gradients;
+  struct NARRAY *na_grads;
+
+  opt_params = na_cast_object( rv_params, NA_SFLOAT );
+  GetNArray( opt_params, na_params );
+
+  if ( gd_adagrad->num_params != na_params->total ) {
+    rb_raise( rb_eArgError, "Expecting NArray with %d params, but input has %d params", gd_adagrad->num_params, na_params->total );
+  }
+
+  gradients = na_cast_object( rv_gradients, NA_SFLOAT );
+  GetNArray( gradients, na_grads );
+
+  if ( gd_adagrad->num_params != na_grads->total ) {
+    rb_raise( rb_eArgError, "Expecting NArray with %d params, but gradient has %d params", gd_adagrad->num_params, na_grads->total );
+  }
+
+  gd_adagrad__gradient_step( gd_adagrad, (float *)na_params->ptr, (float *)na_grads->ptr, NUM2FLT(rv_learning_rate) );
+
+  return opt_params;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void init_gd_adagrad_class( ) {
+  // GradientDescent_AdaGrad instantiation and class methods
+  rb_define_alloc_func( RuNeNe_GradientDescent_AdaGrad, gd_adagrad_alloc );
+  rb_define_method( RuNeNe_GradientDescent_AdaGrad, "initialize", gd_adagrad_rbobject__initialize, 2 );
+  rb_define_singleton_method( RuNeNe_GradientDescent_AdaGrad, "from_h", gd_adagrad_rbclass__from_h, 1 );
+  rb_define_method( RuNeNe_GradientDescent_AdaGrad, "initialize_copy", gd_adagrad_rbobject__initialize_copy, 1 );
+
+  // GradientDescent_AdaGrad attributes
+  rb_define_method( RuNeNe_GradientDescent_AdaGrad, "num_params", gd_adagrad_rbobject__get_num_params, 0 );
+  rb_define_method( RuNeNe_GradientDescent_AdaGrad, "epsilon", gd_adagrad_rbobject__get_epsilon, 0 );
+  rb_define_method( RuNeNe_GradientDescent_AdaGrad, "epsilon=", gd_adagrad_rbobject__set_epsilon, 1 );
+  rb_define_method( RuNeNe_GradientDescent_AdaGrad, "sum_squared_grads", gd_adagrad_rbobject__get_narr_sum_squared_grads, 0 );
+
+  // GradientDescent_AdaGrad instance methods
+  rb_define_method( RuNeNe_GradientDescent_AdaGrad, "pre_gradient_step", gd_adagrad_rbobject__pre_gradient_step, 2 );
+  rb_define_method( RuNeNe_GradientDescent_AdaGrad, "gradient_step", gd_adagrad_rbobject__gradient_step, 3 );
+}
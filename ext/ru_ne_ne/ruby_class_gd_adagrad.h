@@ -0,0 +1,13 @@
+// ext/ru_ne_ne/ruby_class_gd_adagrad.h
+
+#ifndef RUBY_CLASS_GD_ADAGRAD_H
+#define RUBY_CLASS_GD_ADAGRAD_H
+
+#include <ruby.h>
+#include "narray.h"
+#include "struct_gd_adagrad.h"
+#include "shared_vars.h"
+
+void init_gd_adagrad_class( );
+
+#endif
@@ -0,0 +1,316 @@
+// ext/ru_ne_ne/ruby_class_gd_adam.c
+
+#include "ruby_class_gd_adam.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Ruby bindings for training data arrays - the deeper implementation is in
+//  struct_gd_adam.c
+//
+
+inline VALUE gd_adam_as_ruby_class( GradientDescent_Adam *gd_adam , VALUE klass ) {
+  return Data_Wrap_Struct( klass, gd_adam__gc_mark, gd_adam__destroy, gd_adam );
+}
+
+VALUE gd_adam_alloc(VALUE klass) {
+  return gd_adam_as_ruby_class( gd_adam__create(), klass );
+}
+
+inline GradientDescent_Adam *get_gd_adam_struct( VALUE obj ) {
+  GradientDescent_Adam *gd_adam;
+  Data_Get_Struct( obj, GradientDescent_Adam, gd_adam );
+  return gd_adam;
+}
+
+void assert_value_wraps_gd_adam( VALUE obj ) {
+  if ( TYPE(obj) != T_DATA ||
+      RDATA(obj)->dfree != (RUBY_DATA_FUNC)gd_adam__destroy) {
+    rb_raise( rb_eTypeError, "Expected a GradientDescent_Adam object, but got something else" );
+  }
+}
+
+// Helper for converting hash to C properties
+void copy_hash_to_gd_adam_properties( VALUE rv_opts, GradientDescent_Adam *gd_adam ) {
+  volatile VALUE rv_var;
+  volatile VALUE new_narray;
+  struct NARRAY* narr;
+
+  // Start with simple properties
+  rv_var = ValAtSymbol(rv_opts,"num_params");
+  if ( !NIL_P(rv_var) ) {
+    gd_adam->num_params = NUM2INT( rv_var );
+  }
+
+  rv_var = ValAtSymbol(rv_opts,"beta1");
+  if ( !NIL_P(rv_var) ) {
+    gd_adam->beta1 = NUM2FLT( rv_var );
+  }
+
+  rv_var = ValAtSymbol(rv_opts,"beta2");
+  if ( !NIL_P(rv_var) ) {
+    gd_adam->beta2 = NUM2FLT( rv_var );
+  }
+
+  rv_var = ValAtSymbol(rv_opts,"num_steps");
+  if ( !NIL_P(rv_var) ) {
+    gd_adam->num_steps = NUM2INT( rv_var );
+  }
+
+  rv_var = ValAtSymbol(rv_opts,"epsilon");
+  if ( !NIL_P(rv_var) ) {
+    gd_adam->epsilon = NUM2FLT( rv_var );
+  }
+
+  rv_var = ValAtSymbol(rv_opts,"first_moment");
+  if ( !NIL_P(rv_var) ) {
+    new_narray = na_cast_object(rv_var, NA_SFLOAT);
+    GetNArray( new_narray, narr );
+    gd_adam->narr_first_moment = new_narray;
+    gd_adam->first_moment = (float *) narr->ptr;
+    gd_adam->num_params = narr->total;
+  }
+
+  rv_var = ValAtSymbol(rv_opts,"second_moment");
+  if ( !NIL_P(rv_var) ) {
+    new_narray = na_cast_object(rv_var, NA_SFLOAT);
+    GetNArray( new_narray, narr );
+    gd_adam->narr_second_moment = new_narray;
+    gd_adam->second_moment = (float *) narr->ptr;
+    gd_adam->num_params = narr->total;
+  }
+
+  // TODO: Deal with partially-complete object here, and detect
+  // inconsistent params
+
+  return;
+}
+
+/* Document-class: RuNeNe::GradientDescent::Adam
+ *
+ * Adam keeps decaying averages of each param's gradient and squared gradient, and steps by
+ * their ratio. The averages start at zero, so early steps are corrected for that bias.
+ */
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  NNModel method definitions
+//
+
+/* @overload initialize( params, beta1, beta2, epsilon )
+ * Creates a new Adam optimiser, with both moments starting at zero.
+ * @param [NArray<sfloat>] params actual or example NArray of params for optimisation
+ * @param [Float] beta1 decay rate for average gradient, usually 0.9
+ * @param [Float] beta2 decay rate for average squared gradient, usually 0.999
+ * @param [Float] epsilon added to root of average squared gradient, usually 1e-8
+ * @return [RuNeNe::GradientDescent::Adam] new optimiser
+ */
+
+VALUE gd_adam_rbobject__initialize( VALUE self, VALUE rv_params, VALUE rv_beta1, VALUE rv_beta2, VALUE rv_epsilon ) {
+  GradientDescent_Adam *gd_adam = get_gd_adam_struct( self );
+
+  volatile VALUE example_params = na_cast_object( rv_params, NA_SFLOAT );
+
+  gd_adam__init( gd_adam, example_params, NUM2FLT( rv_beta1 ), NUM2FLT( rv_beta2 ), NUM2FLT( rv_epsilon ) );
+
+  return self;
+}
+
+/* @overload clone
+ * When cloned, the returned GradientDescent_Adam has deep copies of C data.
+ * @return [RuNeNe::GradientDescent::Adam] new
+ */
+VALUE gd_adam_rbobject__initialize_copy( VALUE copy, VALUE orig ) {
+  GradientDescent_Adam *gd_adam_copy;
+  GradientDescent_Adam *gd_adam_orig;
+
+  if (copy == orig) return copy;
+  gd_adam_orig = get_gd_adam_struct( orig );
+  gd_adam_copy = get_gd_adam_struct( copy );
+
+  gd_adam__deep_copy( gd_adam_copy, gd_adam_orig );
+
+  return copy;
+}
+
+/* @overload initialize( h )
+ * Creates a new ...
+ * keys are h[:num_params], h[:beta1], h[:beta2], h[:epsilon], h[:num_steps],
+ * h[:first_moment], h[:second_moment]
+ * @return [RuNeNe::GradientDescent::Adam] new ...
+ */
+
+VALUE gd_adam_rbclass__from_h( VALUE self, VALUE rv_h ) {
+  GradientDescent_Adam *gd_adam;
+  Check_Type( rv_h, T_HASH );
+
+  VALUE rv_gd_adam = gd_adam_alloc( RuNeNe_GradientDescent_Adam );
+  gd_adam = get_gd_adam_struct( rv_gd_adam );
+
+  copy_hash_to_gd_adam_properties( rv_h, gd_adam );
+
+  return rv_gd_adam;
+}
+
+/* @!attribute [r] num_params
+ * Description goes here
+ * @return [Integer]
+ */
+VALUE gd_adam_rbobject__get_num_params( VALUE self ) {
+  GradientDescent_Adam *gd_adam = get_gd_adam_struct( self );
+  return INT2NUM( gd_adam->num_params );
+}
+
+/* @!attribute beta1
+ * Decay rate for average gradient
+ * @return [Float]
+ */
+VALUE gd_adam_rbobject__get_beta1( VALUE self ) {
+  GradientDescent_Adam *gd_adam = get_gd_adam_struct( self );
+  return FLT2NUM( gd_adam->beta1 );
+}
+
+VALUE gd_adam_rbobject__set_beta1( VALUE self, VALUE rv_beta1 ) {
+  GradientDescent_Adam *gd_adam = get_gd_adam_struct( self );
+  gd_adam->beta1 = NUM2FLT( rv_beta1 );
+  return rv_beta1;
+}
+
+/* @!attribute beta2
+ * Decay rate for average squared gradient
+ * @return [Float]
+ */
+VALUE gd_adam_rbobject__get_beta2( VALUE self ) {
+  GradientDescent_Adam *gd_adam = get_gd_adam_struct( self );
+  return FLT2NUM( gd_adam->beta2 );
+}
+
+VALUE gd_adam_rbobject__set_beta2( VALUE self, VALUE rv_beta2 ) {
+  GradientDescent_Adam *gd_adam = get_gd_adam_struct( self );
+  gd_adam->beta2 = NUM2FLT( rv_beta2 );
+  return rv_beta2;
+}
+
+/* @!attribute [r] num_steps
+ * Number of gradient steps taken, used for bias correction
+ * @return [Integer]
+ */
+VALUE gd_adam_rbobject__get_num_steps( VALUE self ) {
+  GradientDescent_Adam *gd_adam = get_gd_adam_struct( self );
+  return INT2NUM( gd_adam->num_steps );
+}
+
+/* @!attribute epsilon
+ * Description goes here
+ * @return [Float]
+ */
+VALUE gd_adam_rbobject__get_epsilon( VALUE self ) {
+  GradientDescent_Adam *gd_adam = get_gd_adam_struct( self );
+  return FLT2NUM( gd_adam->epsilon );
+}
+
+VALUE gd_adam_rbobject__set_epsilon( VALUE self, VALUE rv_epsilon ) {
+  GradientDescent_Adam *gd_adam = get_gd_adam_struct( self );
+  gd_adam->epsilon = NUM2FLT( rv_epsilon );
+  return rv_epsilon;
+}
+
+/* @!attribute [r] first_moment
+ * Decaying average of gradients for each param
+ * @return [NArray<sfloat>]
+ */
+VALUE gd_adam_rbobject__get_narr_first_moment( VALUE self ) {
+  GradientDescent_Adam *gd_adam = get_gd_adam_struct( self );
+  return gd_adam->narr_first_moment;
+}
+
+/* @!attribute [r] second_moment
+ * Decaying average of squared gradients for each param
+ * @return [NArray<sfloat>]
+ */
+VALUE gd_adam_rbobject__get_narr_second_moment( VALUE self ) {
+  GradientDescent_Adam *gd_adam = get_gd_adam_struct( self );
+  return gd_adam->narr_second_moment;
+}
+
+/* @overload pre_gradient_step( params, learning_rate )
+ * Prepares object for a gradient step. Some optimisers alter params
+ * @param [NArray<sfloat>] params array of same size as initial example
+ * @param [Float] learning_rate size of
+ * @return [NArray<sfloat>] the params array that willbe optimised (may be cast to NArray<sfloat> from supplied params)
+ */
+VALUE gd_adam_rbobject__pre_gradient_step( VALUE self, VALUE rv_params, VALUE rv_learning_rate ) {
+  GradientDescent_Adam *gd_adam = get_gd_adam_struct( self );
+
+  volatile VALUE opt_params;
+  struct NARRAY *na_params;
+  opt_params = na_cast_object( rv_params, NA_SFLOAT );
+  GetNArray( opt_params, na_params );
+
+  if ( gd_adam->num_params != na_params->total ) {
+    rb_raise( rb_eArgError, "Expecting NArray with %d params, but input has %d params", gd_adam->num_params, na_params->total );
+  }
+
+  gd_adam__pre_gradient_step( gd_adam, (float *)na_params->ptr, NUM2FLT(rv_learning_rate) );
+
+  return opt_params;
+}
+
+/* @overload pre_gradient_step( params, gradients, learning_rate )
+ * Prepares object for a gradient step. Some optimisers alter params
+ * @param [NArray<sfloat>] params array of same size as initial example
+ * @param [NArray<sfloat>] gradients array of same size as initial example
+ * @param [Float] learning_rate size of
+ * @return [NArray<sfloat>] the params array that willbe optimised (may be cast to NArray<sfloat> from supplied params)
+ */
+VALUE gd_adam_rbobject__gradient_step( VALUE self, VALUE rv_params, VALUE rv_gradients, VALUE rv_learning_rate ) {
+  GradientDescent_Adam *gd_adam = get_gd_adam_struct( self );
+
+  volatile VALUE opt_params;
+  struct NARRAY *na_params;
+  volatile VALUE gradients;
+  struct NARRAY *na_grads;
+
+  opt_params = na_cast_object( rv_params, NA_SFLOAT );
+  GetNArray( opt_params, na_params );
+
+  if ( gd_adam->num_params != na_params->total ) {
+    rb_raise( rb_eArgError, "Expecting NArray with %d params, but input has %d params", gd_adam->num_params, na_params->total );
+  }
+
+  gradients = na_cast_object( rv_gradients, NA_SFLOAT );
+  GetNArray( gradients, na_grads );
+
+  if ( gd_adam->num_params != na_grads->total ) {
+    rb_raise( rb_eArgError, "Expecting NArray with %d params, but gradient has %d params", gd_adam->num_params, na_grads->total );
+  }
+
+  gd_adam__gradient_step( gd_adam, (float *)na_params->ptr, (float *)na_grads->ptr, NUM2FLT(rv_learning_rate) );
+
+  return opt_params;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void init_gd_adam_class( ) {
+  // GradientDescent_Adam instantiation and class methods
+  rb_define_alloc_func( RuNeNe_GradientDescent_Adam, gd_adam_alloc );
+  rb_define_method( RuNeNe_GradientDescent_Adam, "initialize", gd_adam_rbobject__initialize, 4 );
+  rb_define_singleton_method( RuNeNe_GradientDescent_Adam, "from_h", gd_adam_rbclass__from_h, 1 );
+  rb_define_method( RuNeNe_GradientDescent_Adam, "initialize_copy", gd_adam_rbobject__initialize_copy, 1 );
+
+  // GradientDescent_Adam attributes
+  rb_define_method( RuNeNe_GradientDescent_Adam, "num_params", gd_adam_rbobject__get_num_params, 0 );
+  rb_define_method( RuNeNe_GradientDescent_Adam, "beta1", gd_adam_rbobject__get_beta1, 0 );
+  rb_define_method( RuNeNe_GradientDescent_Adam, "beta1=", gd_adam_rbobject__set_beta1, 1 );
+  rb_define_method( RuNeNe_GradientDescent_Adam, "beta2", gd_adam_rbobject__get_beta2, 0 );
+  rb_define_method( RuNeNe_GradientDescent_Adam, "beta2=", gd_adam_rbobject__set_beta2, 1 );
+  rb_define_method( RuNeNe_GradientDescent_Adam, "num_steps", gd_adam_rbobject__get_num_steps, 0 );
+  rb_define_method( RuNeNe_GradientDescent_Adam, "epsilon", gd_adam_rbobject__get_epsilon, 0 );
+  rb_define_method( RuNeNe_GradientDescent_Adam, "epsilon=", gd_adam_rbobject__set_epsilon, 1 );
+  rb_define_method( RuNeNe_GradientDescent_Adam, "first_moment", gd_adam_rbobject__get_narr_first_moment, 0 );
+  rb_define_method( RuNeNe_GradientDescent_Adam, "second_moment", gd_adam_rbobject__get_narr_second_moment, 0 );
+
+  // GradientDescent_Adam instance methods
+  rb_define_method( RuNeNe_GradientDescent_Adam, "pre_gradient_step", gd_adam_rbobject__pre_gradient_step, 2 );
+  rb_define_method( RuNeNe_GradientDescent_Adam, "gradient_step", gd_adam_rbobject__gradient_step, 3 );
+}
@@ -0,0 +1,13 @@
+// ext/ru_ne_ne/ruby_class_gd_adam.h
+
+#ifndef RUBY_CLASS_GD_ADAM_H
+#define RUBY_CLASS_GD_ADAM_H
+
+#include <ruby.h>
+#include "narray.h"
+#include "struct_gd_adam.h"
+#include "shared_vars.h"
+
+void init_gd_adam_class( );
+
+#endif
@@ -0,0 +1,267 @@
+// ext/ru_ne_ne/ruby_class_layer_embedding.c
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Ruby bindings for an embedding layer - the deeper implementation is in
+//  struct_layer_embedding.c
+//
+
+#include "ruby_class_layer_embedding.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline VALUE layer_embedding_as_ruby_class( Layer_Embedding *layer_embedding, VALUE klass ) {
+  return Data_Wrap_Struct( klass, layer_embedding__gc_mark, layer_embedding__destroy, layer_embedding );
+}
+
+VALUE layer_embedding_alloc(VALUE klass) {
+  return layer_embedding_as_ruby_class( layer_embedding__create(), klass );
+}
+
+inline Layer_Embedding *get_layer_embedding_struct( VALUE obj ) {
+  Layer_Embedding *layer_embedding;
+  Data_Get_Struct( obj, Layer_Embedding, layer_embedding );
+  return layer_embedding;
+}
+
+static void check_embedding_sizes( int n_inputs, int vocab_size, int embed_size ) {
+  if ( n_inputs < 1 ) {
+    rb_raise( rb_eArgError, "Input size %d is less than minimum of 1", n_inputs );
+  }
+  if ( vocab_size < 1 ) {
+    rb_raise( rb_eArgError, "Vocabulary size %d is less than minimum of 1", vocab_size );
+  }
+  if ( embed_size < 1 ) {
+    rb_raise( rb_eArgError, "Embedding size %d is less than minimum of 1", embed_size );
+  }
+  return;
+}
+
+/* Document-class:  RuNeNe::Layer::Embedding
+ *
+ * An object of this class represents a lookup table for categorical inputs, such as word or
+ * product ids. Each input is an index into the table, and is replaced in the output by that
+ * row of the table, so a model can learn from high-cardinality ids without one-hot encoding
+ * them. The indices are given as floats, and any that are not in the table give a row of
+ * zeros. An Embedding layer can only be the first layer of a RuNeNe::NNModel.
+ */
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//  Layer method definitions
+//
+
+/* @overload initialize( num_inputs, vocab_size, embed_size )
+ * Creates a new layer and randomly initializes the table.
+ * @param [Integer] num_inputs number of indices in each input array
+ * @param [Integer] vocab_size number of rows in the table, indices are 0...vocab_size
+ * @param [Integer] embed_size size of each row
+ * @return [RuNeNe::Layer::Embedding] new layer with random weights.
+ */
+VALUE layer_embedding_class_initialize( VALUE self, VALUE rv_n_inputs, VALUE rv_vocab_size, VALUE rv_embed_size ) {
+  Layer_Embedding *layer_embedding = get_layer_embedding_struct( self );
+  int n_inputs = NUM2INT( rv_n_inputs ), vocab_size = NUM2INT( rv_vocab_size ), embed_size = NUM2INT( rv_embed_size );
+
+  check_embedding_sizes( n_inputs, vocab_size, embed_size );
+
+  layer_embedding->num_inputs = n_inputs;
+  layer_embedding->vocab_size = vocab_size;
+  layer_embedding->embed_size = embed_size;
+  layer_embedding->num_outputs = n_inputs * embed_size;
+
+  layer_embedding__new_narrays( layer_embedding );
+  layer_embedding__init_weights( layer_embedding );
+
+  return self;
+}
+
+/* @overload clone
+ * When cloned, the returned Layer has a deep copy of the table.
+ * @return [RuNeNe::Layer::Embedding] new layer with same weights.
+ */
+VALUE layer_embedding_class_initialize_copy( VALUE copy, VALUE orig ) {
+  Layer_Embedding *layer_embedding_copy;
+  Layer_Embedding *layer_embedding_orig;
+
+  if (copy == orig) return copy;
+  layer_embedding_copy = get_layer_embedding_struct( copy );
+  layer_embedding_orig = get_layer_embedding_struct( orig );
+
+  layer_embedding_copy->num_inputs = layer_embedding_orig->num_inputs;
+  layer_embedding_copy->num_outputs = layer_embedding_orig->num_outputs;
+  layer_embedding_copy->vocab_size = layer_embedding_orig->vocab_size;
+  layer_embedding_copy->embed_size = layer_embedding_orig->embed_size;
+
+  layer_embedding__set_weights( layer_embedding_copy, na_clone( layer_embedding_orig->narr_weights ) );
+
+  return copy;
+}
+
+/* @overload from_weights( weights, num_inputs )
+ * Creates a new layer using the supplied table, which must be rank 2. Each row is taken from
+ * the first dimension, so an array with shape [8,1000] holds 1000 rows of size 8.
+ * @param [NArray] weights
+ * @param [Integer] num_inputs number of indices in each input array
+ * @return [RuNeNe::Layer::Embedding] new layer using supplied weights.
+ */
+VALUE layer_embedding_class_from_weights( VALUE self, VALUE rv_weights, VALUE rv_n_inputs ) {
+  struct NARRAY *na_weights;
+  volatile VALUE val_weights, rv_layer_embedding;
+  Layer_Embedding *layer_embedding;
+  int n_inputs = NUM2INT( rv_n_inputs );
+
+  val_weights = na_cast_object( rv_weights, NA_SFLOAT );
+  GetNArray( val_weights, na_weights );
+
+  if ( na_weights->rank != 2 ) {
+    rb_raise( rb_eArgError, "Weights rank should be 2, but got %d", na_weights->rank );
+  }
+  check_embedding_sizes( n_inputs, na_weights->shape[1], na_weights->shape[0] );
+
+  rv_layer_embedding = layer_embedding_alloc( RuNeNe_Layer_Embedding );
+  layer_embedding = get_layer_embedding_struct( rv_layer_embedding );
+
+  layer_embedding->num_inputs = n_inputs;
+  layer_embedding->vocab_size = na_weights->shape[1];
+  layer_embedding->embed_size = na_weights->shape[0];
+  layer_embedding->num_outputs = n_inputs * layer_embedding->embed_size;
+  layer_embedding__set_weights( layer_embedding, val_weights );
+
+  return rv_layer_embedding;
+}
+
+/* @!attribute [r] num_inputs
+ * Number of indices in each input array.
+ * @return [Integer]
+ */
+VALUE layer_embedding_object_num_inputs( VALUE self ) {
+  Layer_Embedding *layer_embedding = get_layer_embedding_struct( self );
+  return INT2FIX( layer_embedding->num_inputs );
+}
+
+/* @!attribute [r] num_outputs
+ * Number of outputs from the layer, which is #num_inputs * #embed_size.
+ * @return [Integer]
+ */
+VALUE layer_embedding_object_num_outputs( VALUE self ) {
+  Layer_Embedding *layer_embedding = get_layer_embedding_struct( self );
+  return INT2FIX( layer_embedding->num_outputs );
+}
+
+/* @!attribute [r] vocab_size
+ * Number of rows in the table.
+ * @return [Integer]
+ */
+VALUE layer_embedding_object_vocab_size( VALUE self ) {
+  Layer_Embedding *layer_embedding = get_layer_embedding_struct( self );
+  return INT2FIX( layer_embedding->vocab_size );
+}
+
+/* @!attribute [r] embed_size
+ * Size of each row in the table.
+ * @return [Integer]
+ */
+VALUE layer_embedding_object_embed_size( VALUE self ) {
+  Layer_Embedding *layer_embedding = get_layer_embedding_struct( self );
+  return INT2FIX( layer_embedding->embed_size );
+}
+
+/* @!attribute [r] transfer
+ * Always RuNeNe::Transfer::Linear, as rows of the table are output unchanged.
+ * @return [Module]
+ */
+VALUE layer_embedding_object_transfer( VALUE self ) {
+  return transfer_type_to_module( LINEAR );
+}
+
+/* @!attribute [r] weights
+ * The table, of shape [#embed_size, #vocab_size].
+ * @return [NArray<sfloat>]
+ */
+VALUE layer_embedding_object_weights( VALUE self ) {
+  Layer_Embedding *layer_embedding = get_layer_embedding_struct( self );
+  return layer_embedding->narr_weights;
+}
+
+/* @overload init_weights( mult = 1.0 )
+ * Initialises the table to a normal distribution based on the embedding size.
+ * @param [Float] mult optional size factor
+ * @return [RuNeNe::Layer::Embedding] self
+ */
+VALUE layer_embedding_object_init_weights( int argc, VALUE* argv, VALUE self ) {
+  VALUE rv_mult;
+  Layer_Embedding *layer_embedding = get_layer_embedding_struct( self );
+  double m;
+  int i, t;
+  struct NARRAY *narr;
+
+  rb_scan_args( argc, argv, "01", &rv_mult );
+
+  layer_embedding__init_weights( layer_embedding );
+
+  if ( ! NIL_P( rv_mult ) ) {
+    m = NUM2DBL( rv_mult );
+    GetNArray( layer_embedding->narr_weights, narr );
+    t = narr->total;
+    for ( i = 0; i < t; i++ ) {
+      layer_embedding->weights[i] *= m;
+    }
+  }
+
+  return self;
+}
+
+/* @overload run( input )
+ * Looks up the rows for one array of indices.
+ * @param [NArray] input indices, each in range 0...vocab_size
+ * @return [NArray<sfloat>] the selected rows, one after another
+ */
+VALUE layer_embedding_object_run( VALUE self, VALUE rv_input ) {
+  Layer_Embedding *layer_embedding = get_layer_embedding_struct( self );
+  int i, out_shape[1] = { layer_embedding->num_outputs };
+  float *input;
+  struct NARRAY *na_input, *na_output;
+  volatile VALUE val_input = na_cast_object( rv_input, NA_SFLOAT );
+  volatile VALUE val_output;
+
+  GetNArray( val_input, na_input );
+  if ( na_input->total != layer_embedding->num_inputs ) {
+    rb_raise( rb_eArgError, "Input array must be size %d, but it was size %d", layer_embedding->num_inputs, na_input->total );
+  }
+
+  input = (float*) na_input->ptr;
+  for ( i = 0; i < layer_embedding->num_inputs; i++ ) {
+    if ( layer_embedding__row( layer_embedding->vocab_size, input[i] ) < 0 ) {
+      rb_raise( rb_eArgError, "Index %f is not in table of size %d", input[i], layer_embedding->vocab_size );
+    }
+  }
+
+  val_output = na_make_object( NA_SFLOAT, 1, out_shape, cNArray );
+  GetNArray( val_output, na_output );
+
+  layer_embedding__run( layer_embedding, input, (float*) na_output->ptr );
+
+  return val_output;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void init_layer_embedding_class() {
+  // Embedding instantiation and class methods
+  rb_define_alloc_func( RuNeNe_Layer_Embedding, layer_embedding_alloc );
+  rb_define_method( RuNeNe_Layer_Embedding, "initialize", layer_embedding_class_initialize, 3 );
+  rb_define_method( RuNeNe_Layer_Embedding, "initialize_copy", layer_embedding_class_initialize_copy, 1 );
+  rb_define_singleton_method( RuNeNe_Layer_Embedding, "from_weights", layer_embedding_class_from_weights, 2 );
+
+  // Embedding attributes
+  rb_define_method( RuNeNe_Layer_Embedding, "num_inputs", layer_embedding_object_num_inputs, 0 );
+  rb_define_method( RuNeNe_Layer_Embedding, "num_outputs", layer_embedding_object_num_outputs, 0 );
+  rb_define_method( RuNeNe_Layer_Embedding, "vocab_size", layer_embedding_object_vocab_size, 0 );
+  rb_define_method( RuNeNe_Layer_Embedding, "embed_size", layer_embedding_object_embed_size, 0 );
+  rb_define_method( RuNeNe_Layer_Embedding, "transfer", layer_embedding_object_transfer, 0 );
+  rb_define_method( RuNeNe_Layer_Embedding, "weights", layer_embedding_object_weights, 0 );
+
+  // Embedding methods
+  rb_define_method( RuNeNe_Layer_Embedding, "init_weights", layer_embedding_object_init_weights, -1 );
+  rb_define_method( RuNeNe_Layer_Embedding, "run", layer_embedding_object_run, 1 );
+}
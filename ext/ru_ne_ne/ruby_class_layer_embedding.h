@@ -0,0 +1,20 @@
+// ext/ru_ne_ne/ruby_class_layer_embedding.h
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Declarations of embedding layer class
+//
+
+#ifndef RUBY_CLASS_LAYER_EMBEDDING_H
+#define RUBY_CLASS_LAYER_EMBEDDING_H
+
+#include <ruby.h>
+#include "narray.h"
+#include "struct_layer_embedding.h"
+#include "ruby_module_transfer.h"
+#include "shared_vars.h"
+#include "ruby_c_conversions.h"
+
+void init_layer_embedding_class();
+
+#endif
@@ -7,10 +7,13 @@ void copy_hash_to_mbgd_layer_properties( VALUE rv_opts, MBGDLayer *mbgd_layer, i
   volatile VALUE rv_var;
   volatile VALUE new_narray;
   struct NARRAY* narr;
-  float momentum = 0.9, decay = 0.9, epsilon = 1e-6;
+  float momentum = 0.9, decay = 0.9, beta1 = 0.9, beta2 = 0.999, epsilon = 1e-6;
+  gradient_descent_type gd_type;
   GradientDescent_SGD * gd_sgd;
   GradientDescent_NAG * gd_nag;
   GradientDescent_RMSProp * gd_rmsprop;
+  GradientDescent_AdaGrad * gd_adagrad;
+  GradientDescent_Adam * gd_adam;
 
   // Start with simple properties
   rv_var = ValAtSymbol(rv_opts,"learning_rate");
@@ -68,20 +71,30 @@ void copy_hash_to_mbgd_layer_properties( VALUE rv_opts, MBGDLayer *mbgd_layer, i
       rb_raise( rb_eArgError, "de_dw rank should be 2, but got %d", narr->rank );
     }
 
-    if ( narr->shape[0] != ( 1 + mbgd_layer->num_inputs ) ) {
-      rb_raise( rb_eArgError, "de_dw num columns %d is not same as (num_inputs+1) = %d",narr->shape[0], mbgd_layer->num_inputs + 1 );
-    }
+    if ( mbgd_layer->vocab_size ) {
+      if ( narr->shape[0] != mbgd_layer->num_outputs / mbgd_layer->num_inputs || narr->shape[1] != mbgd_layer->vocab_size ) {
+        rb_raise( rb_eArgError, "de_dw shape [%d, %d] is not same as embedding table [%d, %d]", narr->shape[0], narr->shape[1],
+            mbgd_layer->num_outputs / mbgd_layer->num_inputs, mbgd_layer->vocab_size );
+      }
+    } else {
+      if ( narr->shape[0] != ( 1 + mbgd_layer->num_inputs ) ) {
+        rb_raise( rb_eArgError, "de_dw num columns %d is not same as (num_inputs+1) = %d",narr->shape[0], mbgd_layer->num_inputs + 1 );
+      }
 
-    if ( narr->shape[1] != ( mbgd_layer->num_outputs ) ) {
-      rb_raise( rb_eArgError, "de_dw num rows %d is not same as num_outputs %d",narr->shape[0], mbgd_layer->num_outputs );
+      if ( narr->shape[1] != ( mbgd_layer->num_outputs ) ) {
+        rb_raise( rb_eArgError, "de_dw num rows %d is not same as num_outputs %d",narr->shape[0], mbgd_layer->num_outputs );
+      }
     }
     mbgd_layer->narr_de_dw = new_narray;
     mbgd_layer->de_dw = (float *) narr->ptr;
+    mbgd_layer__use_all_rows( mbgd_layer );
   }
 
   rv_var = ValAtSymbol(rv_opts,"gradient_descent");
   if ( !NIL_P(rv_var) ) {
-    int t = ( 1 + mbgd_layer->num_inputs ) * mbgd_layer->num_outputs;
+    int t = mbgd_layer__num_params( mbgd_layer );
+
+    mbgd_layer__check_not_busy( mbgd_layer );
 
     if ( TYPE(rv_var) != T_DATA ) {
       rb_raise( rb_eTypeError, "Expected a GradientDescent object for :gradient_descent, but got something else" );
@@ -105,6 +118,18 @@ void copy_hash_to_mbgd_layer_properties( VALUE rv_opts, MBGDLayer *mbgd_layer, i
         rb_raise( rb_eArgError, "Supplied GradientDescent object is set for %d params, but need %d", gd_rmsprop->num_params, t  );
       }
       mbgd_layer->gradient_descent_type = GD_TYPE_RMSPROP;
+    } else if ( RDATA(rv_var)->dfree == (RUBY_DATA_FUNC)gd_adagrad__destroy ) {
+      Data_Get_Struct( rv_var, GradientDescent_AdaGrad, gd_adagrad );
+      if ( gd_adagrad->num_params != t ) {
+        rb_raise( rb_eArgError, "Supplied GradientDescent object is set for %d params, but need %d", gd_adagrad->num_params, t  );
+      }
+      mbgd_layer->gradient_descent_type = GD_TYPE_ADAGRAD;
+    } else if ( RDATA(rv_var)->dfree == (RUBY_DATA_FUNC)gd_adam__destroy ) {
+      Data_Get_Struct( rv_var, GradientDescent_Adam, gd_adam );
+      if ( gd_adam->num_params != t ) {
+        rb_raise( rb_eArgError, "Supplied GradientDescent object is set for %d params, but need %d", gd_adam->num_params, t  );
+      }
+      mbgd_layer->gradient_descent_type = GD_TYPE_ADAM;
     } else {
       rb_raise( rb_eTypeError, "Expected a GradientDescent object for :gradient_descent, but got something else" );
     }
@@ -120,14 +145,29 @@ void copy_hash_to_mbgd_layer_properties( VALUE rv_opts, MBGDLayer *mbgd_layer, i
       decay = NUM2FLT( rv_var );
     }
 
+    rv_var = ValAtSymbol(rv_opts,"beta1");
+    if ( !NIL_P(rv_var) ) {
+      beta1 = NUM2FLT( rv_var );
+    }
+
+    rv_var = ValAtSymbol(rv_opts,"beta2");
+    if ( !NIL_P(rv_var) ) {
+      beta2 = NUM2FLT( rv_var );
+    }
+
+    gd_type = symbol_to_gradient_descent_type( ValAtSymbol(rv_opts, "gradient_descent_type") );
+
+    // Adam adds epsilon outside the square root, so needs a smaller default
+    if ( gd_type == GD_TYPE_ADAM ) {
+      epsilon = 1e-8;
+    }
+
     rv_var = ValAtSymbol(rv_opts,"epsilon");
     if ( !NIL_P(rv_var) ) {
       epsilon = NUM2FLT( rv_var );
     }
 
-    mbgd_layer__init_gradient_descent( mbgd_layer,
-        symbol_to_gradient_descent_type( ValAtSymbol(rv_opts, "gradient_descent_type") ),
-        momentum, decay, epsilon );
+    mbgd_layer__init_gradient_descent( mbgd_layer, gd_type, momentum, decay, beta1, beta2, epsilon );
   } else {
     switch ( mbgd_layer->gradient_descent_type ) {
       case GD_TYPE_SGD:
@@ -154,6 +194,34 @@ void copy_hash_to_mbgd_layer_properties( VALUE rv_opts, MBGDLayer *mbgd_layer, i
           gd_rmsprop->epsilon = NUM2FLT( rv_var );
         }
 
+        break;
+
+      case GD_TYPE_ADAGRAD:
+        Data_Get_Struct( mbgd_layer->gradient_descent, GradientDescent_AdaGrad, gd_adagrad );
+        rv_var = ValAtSymbol(rv_opts,"epsilon");
+        if ( !NIL_P(rv_var) ) {
+          gd_adagrad->epsilon = NUM2FLT( rv_var );
+        }
+
+        break;
+
+      case GD_TYPE_ADAM:
+        Data_Get_Struct( mbgd_layer->gradient_descent, GradientDescent_Adam, gd_adam );
+        rv_var = ValAtSymbol(rv_opts,"beta1");
+        if ( !NIL_P(rv_var) ) {
+          gd_adam->beta1 = NUM2FLT( rv_var );
+        }
+
+        rv_var = ValAtSymbol(rv_opts,"beta2");
+        if ( !NIL_P(rv_var) ) {
+          gd_adam->beta2 = NUM2FLT( rv_var );
+        }
+
+        rv_var = ValAtSymbol(rv_opts,"epsilon");
+        if ( !NIL_P(rv_var) ) {
+          gd_adam->epsilon = NUM2FLT( rv_var );
+        }
+
         break;
     }
   }
@@ -188,6 +256,33 @@ void assert_value_wraps_mbgd_layer( VALUE obj ) {
   }
 }
 
+// Sets up a new MBGDLayer, which trains an embedding if rv_vocab_size is not nil
+void mbgd_layer_init_from_sizes( MBGDLayer *mbgd_layer, int num_ins, int num_outs, VALUE rv_vocab_size ) {
+  int vocab_size;
+
+  if ( NIL_P( rv_vocab_size ) ) {
+    mbgd_layer__init( mbgd_layer, num_ins, num_outs );
+    return;
+  }
+
+  vocab_size = NUM2INT( rv_vocab_size );
+  if ( vocab_size < 1 ) {
+    rb_raise( rb_eArgError, "Vocabulary size %d is less than minimum of 1", vocab_size );
+  }
+  if ( num_outs % num_ins != 0 ) {
+    rb_raise( rb_eArgError, "Output size %d of embedding is not a multiple of input size %d", num_outs, num_ins );
+  }
+  mbgd_layer__init_embedding( mbgd_layer, num_ins, num_outs / num_ins, vocab_size );
+  return;
+}
+
+// Per-item backprop is only written for feed-forward layers
+static void assert_mbgd_layer_not_embedding( MBGDLayer *mbgd_layer ) {
+  if ( mbgd_layer->vocab_size ) {
+    rb_raise( rb_eArgError, "Embedding layers can only be trained in batches, via RuNeNe::Learn::MBGD" );
+  }
+}
+
 /* Document-class:  RuNeNe::Learn::MBGD::Layer
  *
  * This class models the training algorithms and data used across a single layer during gradient
@@ -202,7 +297,8 @@ void assert_value_wraps_mbgd_layer( VALUE obj ) {
 
 /* @overload initialize( opts )
  * Creates a new RuNeNe::Learn::MBGD::Layer instance. In normal use, the nn_model trainer will create
- * the necessary layer objects automatically from the nn_model acrhitecture.
+ * the necessary layer objects automatically from the nn_model acrhitecture. Option :vocab_size
+ * makes a layer that trains a RuNeNe::Layer::Embedding with a table of that many rows.
  * @param [Hash] opts initialisation options
  * @return [RuNeNe::Learn::MBGD::Layer] the new RuNeNe::Learn::MBGD::Layer object.
  */
@@ -231,7 +327,7 @@ VALUE mbgd_layer_rbobject__initialize( VALUE self, VALUE rv_opts ) {
     rb_raise( rb_eArgError, "Output size %d is less than minimum of 1", num_outs );
   }
 
-  mbgd_layer__init( mbgd_layer, num_ins, num_outs );
+  mbgd_layer_init_from_sizes( mbgd_layer, num_ins, num_outs, ValAtSymbol(rv_opts,"vocab_size") );
 
   copy_hash_to_mbgd_layer_properties( rv_opts, mbgd_layer, 1 );
 
@@ -240,23 +336,22 @@ VALUE mbgd_layer_rbobject__initialize( VALUE self, VALUE rv_opts ) {
 
 /* @overload from_layer( opts )
  * Creates a new RuNeNe::Learn::MBGD::Layer instance to match a given layer
- * @param [RuNeNe::Layer::FeedForward] layer to create training structures for
+ * @param [RuNeNe::Layer::FeedForward,RuNeNe::Layer::Embedding] layer to create training structures for
  * @param [Hash] opts initialisation options
  * @return [RuNeNe::Learn::MBGD::Layer] the new RuNeNe::Learn::MBGD::Layer object.
  */
 VALUE mbgd_layer_rbclass__from_layer( int argc, VALUE* argv, VALUE self ) {
   volatile VALUE rv_layer, rv_opts;
-  Layer_FF *layer_ff;
+  const LayerOps *layer_ops;
   MBGDLayer *mbgd_layer;
 
   rb_scan_args( argc, argv, "11", &rv_layer, &rv_opts );
 
   // Check we really have a layer object to build on
-  if ( TYPE(rv_layer) != T_DATA ||
-      RDATA(rv_layer)->dfree != (RUBY_DATA_FUNC)layer_ff__destroy) {
+  layer_ops = layer_ops__for_value( rv_layer );
+  if ( ! layer_ops ) {
     rb_raise( rb_eTypeError, "Expected a Layer object, but got something else" );
   }
-  Data_Get_Struct( rv_layer, Layer_FF, layer_ff );
 
   if (!NIL_P(rv_opts)) {
     Check_Type( rv_opts, T_HASH );
@@ -265,13 +360,13 @@ VALUE mbgd_layer_rbclass__from_layer( int argc, VALUE* argv, VALUE self ) {
   volatile VALUE rv_new_mbgd_layer = mbgd_layer_alloc( RuNeNe_Learn_MBGD_Layer );
   mbgd_layer = get_mbgd_layer_struct( rv_new_mbgd_layer );
 
-  mbgd_layer__init( mbgd_layer, layer_ff->num_inputs, layer_ff->num_outputs );
+  layer_ops->init_mbgd_layer( DATA_PTR( rv_layer ), mbgd_layer );
 
   if (!NIL_P(rv_opts)) {
     copy_hash_to_mbgd_layer_properties( rv_opts, mbgd_layer, 1 );
   } else {
     mbgd_layer__init_gradient_descent( mbgd_layer, GD_TYPE_SGD,
-        0.9, 0.9, 1e-6 ); // These last values are ignored for SGD
+        0.9, 0.9, 0.9, 0.999, 1e-6 ); // These last values are ignored for SGD
   }
 
   return rv_new_mbgd_layer;
@@ -312,6 +407,16 @@ VALUE mbgd_layer_rbobject__get_num_outputs( VALUE self ) {
   return INT2NUM( mbgd_layer->num_outputs );
 }
 
+/* @!attribute [r] vocab_size
+ * Number of rows in the table of the RuNeNe::Layer::Embedding that this trains, or nil when
+ * training a RuNeNe::Layer::FeedForward.
+ * @return [Integer,nil]
+ */
+VALUE mbgd_layer_rbobject__get_vocab_size( VALUE self ) {
+  MBGDLayer *mbgd_layer = get_mbgd_layer_struct( self );
+  return mbgd_layer->vocab_size ? INT2NUM( mbgd_layer->vocab_size ) : Qnil;
+}
+
 /* @!attribute learning_rate
  * Description goes here
  * @return [Float]
@@ -339,10 +444,11 @@ VALUE mbgd_layer_rbobject__get_gradient_descent_type( VALUE self ) {
 VALUE mbgd_layer_rbobject__set_gradient_descent_type( VALUE self, VALUE rv_gradient_descent_type, VALUE rv_opt ) {
   MBGDLayer *mbgd_layer = get_mbgd_layer_struct( self );
 
+  mbgd_layer__check_not_busy( mbgd_layer );
   mbgd_layer->gradient_descent_type = symbol_to_gradient_descent_type( rv_gradient_descent_type );
 
-  mbgd_layer__init_gradient_descent( mbgd_layer,
-      mbgd_layer->gradient_descent_type, 0.9, 0.9, 1e-6 );
+  mbgd_layer__init_gradient_descent( mbgd_layer, mbgd_layer->gradient_descent_type,
+      0.9, 0.9, 0.9, 0.999, mbgd_layer->gradient_descent_type == GD_TYPE_ADAM ? 1e-8 : 1e-6 );
 
   return rv_gradient_descent_type;
 }
@@ -406,7 +512,7 @@ VALUE mbgd_layer_rbobject__get_narr_de_dw( VALUE self ) {
 
 /* @!attribute gradient_descent
  * Description goes here
- * @return [RuNeNe::GradientDescent::SGD,RuNeNe::GradientDescent::NAG,RuNeNe::GradientDescent::RMSProp]
+ * @return [RuNeNe::GradientDescent::SGD,RuNeNe::GradientDescent::NAG,RuNeNe::GradientDescent::RMSProp,RuNeNe::GradientDescent::AdaGrad,RuNeNe::GradientDescent::Adam]
  */
 VALUE mbgd_layer_rbobject__get_gradient_descent( VALUE self ) {
   MBGDLayer *mbgd_layer = get_mbgd_layer_struct( self );
@@ -418,9 +524,12 @@ VALUE mbgd_layer_rbobject__set_gradient_descent( VALUE self, VALUE rv_var ) {
   GradientDescent_SGD * gd_sgd;
   GradientDescent_NAG * gd_nag;
   GradientDescent_RMSProp * gd_rmsprop;
+  GradientDescent_AdaGrad * gd_adagrad;
+  GradientDescent_Adam * gd_adam;
 
-  int t = ( 1 + mbgd_layer->num_inputs ) * mbgd_layer->num_outputs;
+  int t = mbgd_layer__num_params( mbgd_layer );
 
+  mbgd_layer__check_not_busy( mbgd_layer );
   if ( TYPE(rv_var) != T_DATA ) {
    rb_raise( rb_eTypeError, "Expected a GradientDescent object for :gradient_descent, but got something else" );
   }
@@ -443,6 +552,18 @@ VALUE mbgd_layer_rbobject__set_gradient_descent( VALUE self, VALUE rv_var ) {
       rb_raise( rb_eArgError, "Supplied GradientDescent object is set for %d params, but need %d", gd_rmsprop->num_params, t  );
     }
     mbgd_layer->gradient_descent_type = GD_TYPE_RMSPROP;
+  } else if ( RDATA(rv_var)->dfree == (RUBY_DATA_FUNC)gd_adagrad__destroy ) {
+    Data_Get_Struct( rv_var, GradientDescent_AdaGrad, gd_adagrad );
+    if ( gd_adagrad->num_params != t ) {
+      rb_raise( rb_eArgError, "Supplied GradientDescent object is set for %d params, but need %d", gd_adagrad->num_params, t  );
+    }
+    mbgd_layer->gradient_descent_type = GD_TYPE_ADAGRAD;
+  } else if ( RDATA(rv_var)->dfree == (RUBY_DATA_FUNC)gd_adam__destroy ) {
+    Data_Get_Struct( rv_var, GradientDescent_Adam, gd_adam );
+    if ( gd_adam->num_params != t ) {
+      rb_raise( rb_eArgError, "Supplied GradientDescent object is set for %d params, but need %d", gd_adam->num_params, t  );
+    }
+    mbgd_layer->gradient_descent_type = GD_TYPE_ADAM;
   } else {
     rb_raise( rb_eTypeError, "Expected a GradientDescent object for :gradient_descent, but got something else" );
   }
@@ -489,6 +610,8 @@ VALUE mbgd_layer_rbobject__start_batch( VALUE self, VALUE rv_layer ) {
   MBGDLayer *mbgd_layer = get_mbgd_layer_struct( self );
   Layer_FF *layer_ff;
 
+  assert_mbgd_layer_not_embedding( mbgd_layer );
+
   // Check we really have a layer object to fetch output from
   if ( TYPE(rv_layer) != T_DATA ||
       RDATA(rv_layer)->dfree != (RUBY_DATA_FUNC)layer_ff__destroy) {
@@ -524,6 +647,8 @@ VALUE mbgd_layer_rbobject__backprop_for_output_layer( VALUE self, VALUE rv_layer
   volatile VALUE output_narray;
   volatile VALUE input_narray;
 
+  assert_mbgd_layer_not_embedding( mbgd_layer );
+
   // Check we really have a layer object to fetch output from
   if ( TYPE(rv_layer) != T_DATA ||
       RDATA(rv_layer)->dfree != (RUBY_DATA_FUNC)layer_ff__destroy) {
@@ -596,6 +721,8 @@ VALUE mbgd_layer_rbobject__backprop_for_mid_layer( VALUE self, VALUE rv_layer, V
   volatile VALUE output_narray;
   volatile VALUE input_narray;
 
+  assert_mbgd_layer_not_embedding( mbgd_layer );
+
   // Check we really have a layer object to fetch output from
   if ( TYPE(rv_layer) != T_DATA ||
       RDATA(rv_layer)->dfree != (RUBY_DATA_FUNC)layer_ff__destroy) {
@@ -657,6 +784,8 @@ VALUE mbgd_layer_rbobject__finish_batch( VALUE self, VALUE rv_layer ) {
   MBGDLayer *mbgd_layer = get_mbgd_layer_struct( self );
   Layer_FF *layer_ff;
 
+  assert_mbgd_layer_not_embedding( mbgd_layer );
+
   // Check we really have a layer object to fetch output from
   if ( TYPE(rv_layer) != T_DATA ||
       RDATA(rv_layer)->dfree != (RUBY_DATA_FUNC)layer_ff__destroy) {
@@ -683,6 +812,7 @@ void init_mbgd_layer_class( ) {
   rb_define_method( RuNeNe_Learn_MBGD_Layer, "de_dz", mbgd_layer_rbobject__get_narr_de_dz, 0 );
   rb_define_method( RuNeNe_Learn_MBGD_Layer, "de_da", mbgd_layer_rbobject__get_narr_de_da, 0 );
   rb_define_method( RuNeNe_Learn_MBGD_Layer, "de_dw", mbgd_layer_rbobject__get_narr_de_dw, 0 );
+  rb_define_method( RuNeNe_Learn_MBGD_Layer, "vocab_size", mbgd_layer_rbobject__get_vocab_size, 0 );
 
   rb_define_method( RuNeNe_Learn_MBGD_Layer, "learning_rate", mbgd_layer_rbobject__get_learning_rate, 0 );
   rb_define_method( RuNeNe_Learn_MBGD_Layer, "learning_rate=", mbgd_layer_rbobject__set_learning_rate, 1 );
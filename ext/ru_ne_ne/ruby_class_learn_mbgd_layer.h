@@ -6,6 +6,7 @@
 #include <ruby.h>
 #include "narray.h"
 #include "struct_layer_ff.h"
+#include "struct_layer_ops.h"
 #include "struct_mbgd_layer.h"
 #include "shared_vars.h"
 #include "ruby_c_conversions.h"
@@ -14,5 +15,6 @@ void init_mbgd_layer_class( );
 void assert_value_wraps_mbgd_layer( VALUE obj );
 void copy_hash_to_mbgd_layer_properties( VALUE rv_opts, MBGDLayer *mbgd_layer, int new_gds );
 VALUE mbgd_layer_rbclass__from_layer( int argc, VALUE* argv, VALUE self );
+void mbgd_layer_init_from_sizes( MBGDLayer *mbgd_layer, int num_ins, int num_outs, VALUE rv_vocab_size );
 
 #endif
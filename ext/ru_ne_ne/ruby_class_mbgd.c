@@ -46,7 +46,8 @@ VALUE cast_mbgd_layer( volatile VALUE rv_layer_def, int *last_num_outputs ) {
       n_inputs = NUM2INT( rv_var  );
     }
 
-    mbgd_layer__init( mbgd_layer, n_inputs, NUM2INT( ValAtSymbol( rv_layer_def, "num_outputs" ) ) );
+    mbgd_layer_init_from_sizes( mbgd_layer, n_inputs, NUM2INT( ValAtSymbol( rv_layer_def, "num_outputs" ) ),
+        ValAtSymbol( rv_layer_def, "vocab_size" ) );
     copy_hash_to_mbgd_layer_properties( rv_layer_def, mbgd_layer, 1 );
     this_layer = Data_Wrap_Struct( RuNeNe_Learn_MBGD_Layer, mbgd_layer__gc_mark, mbgd_layer__destroy, mbgd_layer );
   } else {
@@ -239,22 +240,132 @@ VALUE mbgd_rbobject__set_meta_params( VALUE self, VALUE rv_opts ) {
   return self;
 }
 
-/* @overload train_one_batch( nn_model, dataset, objective, batch_size )
+typedef struct _mbgd_train_args {
+    MBGD *mbgd;
+    NNModel *nn_model;
+    DataSet *dataset;
+    int batch_size;
+    int num_threads;
+    int calc_input_de_da;
+    int dense_inputs;
+    int dataset_busy;
+    float result;
+  } MBGDTrainArgs;
+
+static void *mbgd_train_one_batch_without_gvl( void *data ) {
+  MBGDTrainArgs *args = (MBGDTrainArgs *) data;
+  args->result = mbgd__train_one_batch_threaded( args->mbgd, args->nn_model, args->dataset,
+      args->batch_size, args->num_threads, args->calc_input_de_da );
+  return NULL;
+}
+
+// A streaming dataset is refilled here, once it is marked busy, as refilling calls Ruby and may
+// let another thread run
+static VALUE mbgd_train_one_batch_busy( VALUE data ) {
+  MBGDTrainArgs *args = (MBGDTrainArgs *) data;
+  dataset__start_busy( args->dataset );
+  args->dataset_busy = 1;
+
+  if ( args->dataset->stream ) {
+    args->batch_size = dataset__stream_prepare_batch( args->dataset, args->batch_size );
+  }
+  if ( args->num_threads > args->batch_size ) {
+    args->num_threads = args->batch_size;
+  }
+
+  mbgd__init_workers( args->mbgd, args->nn_model, args->num_threads, args->dense_inputs );
+  mbgd__init_staging( args->mbgd, args->batch_size, args->dense_inputs );
+  mbgd__init_staging_csr( args->mbgd, args->dataset, args->batch_size );
+  CallWithoutGVL( mbgd_train_one_batch_without_gvl, args );
+  return Qnil;
+}
+
+static VALUE mbgd_train_one_batch_end_busy( VALUE data ) {
+  MBGDTrainArgs *args = (MBGDTrainArgs *) data;
+  mbgd__copy_last_activations( args->mbgd, args->nn_model );
+  if ( args->dataset_busy ) {
+    dataset__end_busy( args->dataset );
+  }
+  nn_model__end_busy( args->nn_model );
+  mbgd__end_busy( args->mbgd );
+  return Qnil;
+}
+
+/* @overload train_one_batch( nn_model, dataset, batch_size, opts = {} )
+ * Trains nn_model on next batch_size items from dataset. Other Ruby threads can run
+ * during training, but the same nn_model should not be used by two threads at once. Training
+ * with, or moving through, the learning object or dataset from a second thread while it trains
+ * raises RuntimeError.
+ *
+ * With option :threads, the batch is split into that many slices, which are shared between
+ * the threads of the pool set by RuNeNe.threads. Results are repeatable for the same seed and
+ * number of slices, whatever the size of the pool, but will differ very slightly from
+ * single-threaded training because gradients are summed in a different order.
+ *
+ * A streaming dataset is refilled before training. At the end of its source the batch may be
+ * smaller than batch_size, and once no items remain StopIteration is raised.
+ *
+ * Gradients with respect to the network inputs are not usually needed, so are skipped
+ * unless option :input_de_da is true. When set, de_da of the first layer holds the
+ * input gradient for the last item in the batch, e.g. for building a saliency map.
  * @param [RuNeNe::NNModel] nn_model network architecture to be trained
  * @param [RuNeNe::Dataset] dataset training data
- * @param [Symbol] objective objective function to optimise (TODO: Should be set in constructor)
  * @param [Integer] batch_size number of items in dataset to process before altering weights
+ * @param [Hash] opts
+ * @option opts [Integer] :threads number of threads to use, default 1
+ * @option opts [Boolean] :input_de_da whether to calculate de_da for first layer, default false
  * @return [Float] mean score of objective function for batch
  */
-VALUE mbgd_rbobject__train_one_batch( VALUE self, VALUE rv_nn_model, VALUE rv_dataset, VALUE rv_batch_size ) {
-  MBGD *mbgd = get_mbgd_struct( self );
-  NNModel *nn_model = safe_get_nn_model_struct( rv_nn_model );
-  DataSet *dataset = safe_get_dataset_struct( rv_dataset );
+VALUE mbgd_rbobject__train_one_batch( int argc, VALUE* argv, VALUE self ) {
+  VALUE rv_nn_model, rv_dataset, rv_batch_size, rv_opts, rv_var;
+  MBGDTrainArgs args;
 
-  int batch_size = NUM2INT( rv_batch_size );
+  rb_scan_args( argc, argv, "31", &rv_nn_model, &rv_dataset, &rv_batch_size, &rv_opts );
 
-  mbgd__check_size_compatible( mbgd, nn_model, dataset );
-  return FLT2NUM( mbgd__train_one_batch( mbgd, nn_model, dataset, batch_size ) );
+  args.mbgd = get_mbgd_struct( self );
+  args.nn_model = safe_get_nn_model_struct( rv_nn_model );
+  args.dataset = safe_get_dataset_struct( rv_dataset );
+  args.batch_size = NUM2INT( rv_batch_size );
+  args.num_threads = 1;
+  args.calc_input_de_da = 0;
+
+  if ( args.batch_size < 1 ) {
+    rb_raise( rb_eArgError, "batch_size must be at least 1, got %d", args.batch_size );
+  }
+
+  if ( !NIL_P( rv_opts ) ) {
+    Check_Type( rv_opts, T_HASH );
+    rv_var = ValAtSymbol( rv_opts, "threads" );
+    if ( !NIL_P( rv_var ) ) {
+      args.num_threads = NUM2INT( rv_var );
+      if ( args.num_threads < 1 || args.num_threads > PARALLEL_MAX_THREADS ) {
+        rb_raise( rb_eArgError, "threads must be in range 1..%d, got %d", PARALLEL_MAX_THREADS, args.num_threads );
+      }
+    }
+    args.calc_input_de_da = RTEST( ValAtSymbol( rv_opts, "input_de_da" ) );
+  }
+
+  mbgd__check_size_compatible( args.mbgd, args.nn_model, args.dataset );
+  mbgd__check_objective_compatible( args.mbgd, args.nn_model );
+
+  args.dense_inputs = args.dataset->input_type != DATASET_INPUT_CSR;
+  if ( args.calc_input_de_da && ! args.dense_inputs ) {
+    rb_raise( rb_eArgError, "input_de_da is not available for sparse inputs" );
+  }
+  if ( args.calc_input_de_da && args.nn_model->layer_ops[0]->index_inputs ) {
+    rb_raise( rb_eArgError, "input_de_da is not available for an %s layer", args.nn_model->layer_ops[0]->name );
+  }
+  args.dataset_busy = 0;
+  mbgd__start_busy( args.mbgd );
+  nn_model__start_busy( args.nn_model );
+  rb_ensure( mbgd_train_one_batch_busy, (VALUE) &args, mbgd_train_one_batch_end_busy, (VALUE) &args );
+
+  // Objects must not be collected before training completes
+  RB_GC_GUARD( self );
+  RB_GC_GUARD( rv_nn_model );
+  RB_GC_GUARD( rv_dataset );
+
+  return FLT2NUM( args.result );
 }
 
 
@@ -294,6 +405,32 @@ VALUE mbgd_rbobject__get_objective( VALUE self ) {
   return objective_type_to_module( mbgd->objective );
 }
 
+/* @!attribute [r] arena?
+ * Whether gradients and optimiser state of all layers are stored in one block of memory, see
+ * #pack_arena.
+ * @return [Boolean]
+ */
+VALUE mbgd_rbobject__get_arena( VALUE self ) {
+  MBGD *mbgd = get_mbgd_struct( self );
+  return NIL_P( mbgd->narr_arena ) ? Qfalse : Qtrue;
+}
+
+/* @overload pack_arena
+ * Moves de_dw, de_dz, de_da and gradient descent state of all layers into one contiguous block
+ * of memory, with each array starting on a 32-byte boundary. The arrays of each layer are
+ * replaced by views into that block. Gradient descent state created later, by changing
+ * gradient_descent_type, is stored separately.
+ * @return [RuNeNe::Learn::MBGD] self
+ */
+VALUE mbgd_rbobject__pack_arena( VALUE self ) {
+  MBGD *mbgd = get_mbgd_struct( self );
+  // Raises if another thread is training with the arrays that would be moved
+  mbgd__start_busy( mbgd );
+  mbgd__end_busy( mbgd );
+  mbgd__pack_arena( mbgd );
+  return self;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void init_mbgd_class( ) {
@@ -309,9 +446,11 @@ void init_mbgd_class( ) {
   rb_define_method( RuNeNe_Learn_MBGD, "num_inputs", mbgd_rbobject__get_num_inputs, 0 );
   rb_define_method( RuNeNe_Learn_MBGD, "num_outputs", mbgd_rbobject__get_num_outputs, 0 );
   rb_define_method( RuNeNe_Learn_MBGD, "objective", mbgd_rbobject__get_objective, 0 );
+  rb_define_method( RuNeNe_Learn_MBGD, "arena?", mbgd_rbobject__get_arena, 0 );
 
   // MBGD methods
   rb_define_method( RuNeNe_Learn_MBGD, "layer", mbgd_rbobject__get_layer, 1 );
   rb_define_method( RuNeNe_Learn_MBGD, "set_meta_params", mbgd_rbobject__set_meta_params, 1 );
-  rb_define_method( RuNeNe_Learn_MBGD, "train_one_batch", mbgd_rbobject__train_one_batch, 3 );
+  rb_define_method( RuNeNe_Learn_MBGD, "train_one_batch", mbgd_rbobject__train_one_batch, -1 );
+  rb_define_method( RuNeNe_Learn_MBGD, "pack_arena", mbgd_rbobject__pack_arena, 0 );
 }
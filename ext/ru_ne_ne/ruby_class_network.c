@@ -88,6 +88,210 @@ VALUE network_rbobject__get_learn( VALUE self ) {
   return network->learn;
 }
 
+static void *network_train_epoch_without_gvl( void *data ) {
+  network__train_epoch( (NetworkTrainState *) data );
+  return NULL;
+}
+
+// Called from another thread when the training thread is interrupted
+static void network_train_cancel( void *data ) {
+  ( (NetworkTrainState *) data )->cancelled = 1;
+  return;
+}
+
+static VALUE network_train_progress( NetworkTrainState *state ) {
+  volatile VALUE rv_progress = rb_hash_new();
+  rb_hash_aset( rv_progress, ID2SYM( rb_intern("epoch") ), INT2NUM( state->epoch ) );
+  rb_hash_aset( rv_progress, ID2SYM( rb_intern("train_loss") ), FLT2NUM( state->train_loss ) );
+  if ( state->validation ) {
+    rb_hash_aset( rv_progress, ID2SYM( rb_intern("validation_loss") ), FLT2NUM( state->validation_loss ) );
+    rb_hash_aset( rv_progress, ID2SYM( rb_intern("best_epoch") ), INT2NUM( state->best_epoch ) );
+  }
+  return rv_progress;
+}
+
+typedef struct _network_train_run {
+    NetworkTrainState *state;
+    int num_epochs;
+    int report_every;
+    int dense_inputs;
+    int dataset_busy;
+  } NetworkTrainRun;
+
+// The GVL is released for one epoch at a time. An interrupt stops training between batches,
+// and if it does not raise, the epoch carries on from where it stopped.
+static VALUE network_train_run_epochs( VALUE data ) {
+  NetworkTrainRun *run = (NetworkTrainRun *) data;
+  NetworkTrainState *state = run->state;
+  int epoch;
+
+  while ( state->epoch < run->num_epochs && ! state->stopped_early ) {
+    epoch = state->epoch;
+    state->cancelled = 0;
+    CallWithoutGVLCancellable( network_train_epoch_without_gvl, state, network_train_cancel, state );
+    mbgd__copy_last_activations( state->mbgd, state->nn_model );
+
+    if ( state->epoch > epoch && rb_block_given_p() && ( state->epoch % run->report_every == 0 ||
+        state->epoch == run->num_epochs || state->stopped_early ) ) {
+      rb_yield( network_train_progress( state ) );
+    }
+  }
+
+  return Qnil;
+}
+
+static VALUE network_train_start( VALUE data ) {
+  NetworkTrainRun *run = (NetworkTrainRun *) data;
+  dataset__start_busy( run->state->dataset );
+  run->dataset_busy = 1;
+  mbgd__init_workers( run->state->mbgd, run->state->nn_model, run->state->num_threads, run->dense_inputs );
+  mbgd__init_staging( run->state->mbgd, run->state->batch_size, run->dense_inputs );
+  mbgd__init_staging_csr( run->state->mbgd, run->state->dataset, run->state->batch_size );
+  if ( run->state->validation ) {
+    mbgd__init_staging_csr( run->state->mbgd, run->state->validation, MBGD_CHUNK_SIZE );
+  }
+  return network_train_run_epochs( data );
+}
+
+// Runs however training ends, including when the block raises or breaks
+static VALUE network_train_finish( VALUE data ) {
+  NetworkTrainRun *run = (NetworkTrainRun *) data;
+  NetworkTrainState *state = run->state;
+  mbgd__copy_last_activations( state->mbgd, state->nn_model );
+  network__restore_best_weights( state );
+  if ( run->dataset_busy ) {
+    dataset__end_busy( state->dataset );
+  }
+  nn_model__end_busy( state->nn_model );
+  mbgd__end_busy( state->mbgd );
+  return Qnil;
+}
+
+static int network_train_opt_int( VALUE rv_opts, const char *name, int default_value, int min_value ) {
+  volatile VALUE rv_var = ValAtSymbol( rv_opts, name );
+  int value = default_value;
+  if ( !NIL_P( rv_var ) ) {
+    value = NUM2INT( rv_var );
+  }
+  if ( value < min_value ) {
+    rb_raise( rb_eArgError, "%s must be at least %d, got %d", name, min_value, value );
+  }
+  return value;
+}
+
+/* @overload train( dataset, opts = {} )
+ * Trains nn_model using learn, for a number of epochs over dataset. Each epoch runs natively
+ * without the GVL. Training can be interrupted between batches, e.g. by Thread#kill or Timeout.
+ * Until training returns, moving through dataset or training with it raises RuntimeError.
+ *
+ * With option :validation, mean loss over the validation set is measured after each epoch. The
+ * weights with the lowest validation loss are kept, and restored at the end of training. This
+ * also happens when training is interrupted or the block raises. The gradient descent state is
+ * not restored. With option :patience as well, training stops early once validation loss has
+ * not improved for that many epochs.
+ *
+ * If a block is given, it is called with a Hash of progress (:epoch, :train_loss, and with
+ * validation also :validation_loss and :best_epoch), after every :report_every epochs and after
+ * the last epoch.
+ * @param [RuNeNe::DataSet] dataset training data
+ * @param [Hash] opts
+ * @option opts [Integer] :epochs number of passes through dataset, default 1
+ * @option opts [Integer] :batch_size number of items between weight updates, default 1
+ * @option opts [RuNeNe::DataSet] :validation optional data for measuring loss between epochs
+ * @option opts [Integer] :patience number of epochs without improvement before stopping, default 0 (never)
+ * @option opts [Integer] :threads number of threads to use, default 1
+ * @option opts [Integer] :report_every number of epochs between calls to block, default 1
+ * @return [Hash] :epochs completed, :train_loss of last epoch, :stopped_early, and with validation
+ *   :validation_loss and :best_epoch for the weights that were kept
+ */
+VALUE network_rbobject__train( int argc, VALUE* argv, VALUE self ) {
+  volatile VALUE rv_dataset, rv_opts, rv_var, rv_best_weights, rv_result;
+  Network *network = get_network_struct( self );
+  NetworkTrainState state;
+  NetworkTrainRun run;
+  struct NARRAY *narr;
+  int i, num_epochs, report_every;
+
+  rb_scan_args( argc, argv, "11", &rv_dataset, &rv_opts );
+  if ( NIL_P( rv_opts ) ) {
+    rv_opts = rb_hash_new();
+  }
+  Check_Type( rv_opts, T_HASH );
+
+  Data_Get_Struct( network->learn, MBGD, state.mbgd );
+  state.nn_model = safe_get_nn_model_struct( network->nn_model );
+  state.dataset = safe_get_dataset_struct( rv_dataset );
+  assert_dataset_not_streaming( state.dataset, "train for epochs on" );
+  state.validation = NULL;
+
+  num_epochs = network_train_opt_int( rv_opts, "epochs", 1, 1 );
+  state.batch_size = network_train_opt_int( rv_opts, "batch_size", 1, 1 );
+  state.patience = network_train_opt_int( rv_opts, "patience", 0, 0 );
+  report_every = network_train_opt_int( rv_opts, "report_every", 1, 1 );
+  state.num_threads = network_train_opt_int( rv_opts, "threads", 1, 1 );
+  if ( state.num_threads > PARALLEL_MAX_THREADS ) {
+    rb_raise( rb_eArgError, "threads must be in range 1..%d, got %d", PARALLEL_MAX_THREADS, state.num_threads );
+  }
+
+  mbgd__check_size_compatible( state.mbgd, state.nn_model, state.dataset );
+  mbgd__check_objective_compatible( state.mbgd, state.nn_model );
+
+  rv_var = ValAtSymbol( rv_opts, "validation" );
+  rv_best_weights = rb_ary_new();
+  state.best_weights = ALLOCA_N( float *, state.nn_model->num_layers );
+  if ( !NIL_P( rv_var ) ) {
+    state.validation = safe_get_dataset_struct( rv_var );
+    assert_dataset_not_streaming( state.validation, "validate with" );
+    mbgd__check_size_compatible( state.mbgd, state.nn_model, state.validation );
+    for ( i = 0; i < state.nn_model->num_layers; i++ ) {
+      rb_ary_push( rv_best_weights, na_clone( nn_model__layer_narr_weights_at( state.nn_model, i ) ) );
+      GetNArray( rb_ary_entry( rv_best_weights, i ), narr );
+      state.best_weights[i] = (float *) narr->ptr;
+    }
+  }
+
+  if ( state.num_threads > state.batch_size ) {
+    state.num_threads = state.batch_size;
+  }
+  run.dense_inputs = state.dataset->input_type != DATASET_INPUT_CSR ||
+      ( state.validation && state.validation->input_type != DATASET_INPUT_CSR );
+
+  state.epoch = 0;
+  state.epoch_batch = 0;
+  state.epoch_score = 0.0;
+  state.best_epoch = 0;
+  state.stopped_early = 0;
+  state.train_loss = 0.0;
+  state.validation_loss = 0.0;
+  state.best_validation_loss = 0.0;
+
+  run.state = &state;
+  run.num_epochs = num_epochs;
+  run.report_every = report_every;
+  run.dataset_busy = 0;
+
+  mbgd__start_busy( state.mbgd );
+  nn_model__start_busy( state.nn_model );
+  rb_ensure( network_train_start, (VALUE) &run, network_train_finish, (VALUE) &run );
+
+  rv_result = rb_hash_new();
+  rb_hash_aset( rv_result, ID2SYM( rb_intern("epochs") ), INT2NUM( state.epoch ) );
+  rb_hash_aset( rv_result, ID2SYM( rb_intern("train_loss") ), FLT2NUM( state.train_loss ) );
+  rb_hash_aset( rv_result, ID2SYM( rb_intern("stopped_early") ), state.stopped_early ? Qtrue : Qfalse );
+  if ( state.validation ) {
+    rb_hash_aset( rv_result, ID2SYM( rb_intern("validation_loss") ), FLT2NUM( state.best_validation_loss ) );
+    rb_hash_aset( rv_result, ID2SYM( rb_intern("best_epoch") ), INT2NUM( state.best_epoch ) );
+  }
+
+  // Objects must not be collected before training completes
+  RB_GC_GUARD( self );
+  RB_GC_GUARD( rv_dataset );
+  RB_GC_GUARD( rv_opts );
+  RB_GC_GUARD( rv_best_weights );
+
+  return rv_result;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void init_network_class( ) {
@@ -99,4 +303,7 @@ void init_network_class( ) {
   // Network attributes
   rb_define_method( RuNeNe_Network, "nn_model", network_rbobject__get_nn_model, 0 );
   rb_define_method( RuNeNe_Network, "learn", network_rbobject__get_learn, 0 );
+
+  // Network instance methods
+  rb_define_method( RuNeNe_Network, "train", network_rbobject__train, -1 );
 }
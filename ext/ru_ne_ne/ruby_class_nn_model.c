@@ -40,7 +40,7 @@ NNModel *safe_get_nn_model_struct( VALUE obj ) {
 VALUE cast_nn_model_layer( volatile VALUE rv_layer_def, int *last_num_outputs ) {
   volatile VALUE this_layer;
   volatile VALUE rv_var;
-  Layer_FF * layer_ff;
+  const LayerOps *layer_ops;
   int n_inputs = *last_num_outputs;
 
   if ( TYPE(rv_layer_def) == T_HASH ) {
@@ -56,11 +56,13 @@ VALUE cast_nn_model_layer( volatile VALUE rv_layer_def, int *last_num_outputs )
     );
   } else {
     this_layer = rv_layer_def;
-    assert_value_wraps_layer_ff( this_layer );
   }
 
-  Data_Get_Struct( this_layer, Layer_FF, layer_ff );
-  *last_num_outputs = layer_ff->num_outputs;
+  layer_ops = layer_ops__for_value( this_layer );
+  if ( ! layer_ops ) {
+    rb_raise( rb_eTypeError, "Expected a Layer object, but got something else" );
+  }
+  *last_num_outputs = layer_ops->num_outputs( DATA_PTR( this_layer ) );
 
   return this_layer;
 }
@@ -75,8 +77,9 @@ VALUE cast_nn_model_layer( volatile VALUE rv_layer_def, int *last_num_outputs )
 //
 
 /* @overload initialize( layers )
- * Creates a new NNModel
- * @param [Array<RuNeNe::Layer::Feedforward>] layers ...
+ * Creates a new NNModel. The first layer may be a RuNeNe::Layer::Embedding, in which case
+ * inputs to the model are indices into its table.
+ * @param [Array<RuNeNe::Layer::Feedforward,RuNeNe::Layer::Embedding>] layers ...
  * @return [RuNeNe::NNModel] new ...
  */
 VALUE nn_model_rbobject__initialize( VALUE self, VALUE rv_layers ) {
@@ -188,10 +191,8 @@ VALUE nn_model_rbobject__get_num_outputs( VALUE self ) {
 VALUE nn_model_rbobject__init_weights( int argc, VALUE* argv, VALUE self ) {
   NNModel *nn_model = get_nn_model_struct( self );
   VALUE rv_mult;
-  Layer_FF *layer_ff;
-  float m = 1.0;
+  float m = 1.0, *weights;
   int i, j, t;
-  struct NARRAY *narr;
 
   rb_scan_args( argc, argv, "01", &rv_mult );
   if ( ! NIL_P( rv_mult ) ) {
@@ -199,16 +200,13 @@ VALUE nn_model_rbobject__init_weights( int argc, VALUE* argv, VALUE self ) {
   }
 
   for ( i = 0; i < nn_model->num_layers; i++ ) {
-    // TODO: This only works for Layer_FF layers, we need a more flexible system
-    Data_Get_Struct( nn_model->layers[i], Layer_FF, layer_ff );
-
-    layer_ff__init_weights( layer_ff );
+    nn_model->layer_ops[i]->init_params( nn_model->layer_structs[i] );
 
     if ( m != 0 ) {
-      GetNArray( layer_ff->narr_weights, narr );
-      t = narr->total;
+      weights = nn_model__layer_weights_at( nn_model, i );
+      t = nn_model__layer_num_weights_at( nn_model, i );
       for ( j = 0; j < t; j++ ) {
-        layer_ff->weights[j] *= m;
+        weights[j] *= m;
       }
     }
   }
@@ -216,8 +214,97 @@ VALUE nn_model_rbobject__init_weights( int argc, VALUE* argv, VALUE self ) {
   return self;
 }
 
+typedef struct _nn_model_run_args {
+    NNModel *nn_model;
+    NNModelWorkspace *workspace;
+    void *(*run_fn)( void * );
+    int keep_activations;
+    int num_batch_slots;
+    int num_items;
+    float *inputs;
+    float *outputs;
+    volatile int cancelled;
+  } NNModelRunArgs;
+
+// Called from another thread when the running thread is interrupted
+static void nn_model_run_cancel( void *data ) {
+  ( (NNModelRunArgs *) data )->cancelled = 1;
+  return;
+}
+
+static void *nn_model_run_without_gvl( void *data ) {
+  NNModelRunArgs *args = (NNModelRunArgs *) data;
+  nn_model__run_with_activations( args->nn_model, args->inputs, args->workspace->activations );
+  return NULL;
+}
+
+// Runs one chunk of items, using the buffers of the pool thread's slot. The last layer writes
+// directly to the output array.
+static void nn_model_run_batch_chunk( void *data, int slot, int start, int end ) {
+  NNModelRunArgs *args = (NNModelRunArgs *) data;
+  NNModel *nn_model = args->nn_model;
+  float **batch_activations = args->workspace->batch_activations[slot];
+
+  if ( args->cancelled ) {
+    return;
+  }
+
+  batch_activations[nn_model->num_layers - 1] = args->outputs + start * nn_model->num_outputs;
+  nn_model__run_batch( nn_model, end - start, args->inputs + start * nn_model->num_inputs, batch_activations );
+  return;
+}
+
+// Work is split into chunks of items, so that the intermediate activations stay small
+// enough to be cached, and chunks are shared out between the pool threads.
+static void *nn_model_run_batch_without_gvl( void *data ) {
+  NNModelRunArgs *args = (NNModelRunArgs *) data;
+  parallel_for( args->num_items, NN_MODEL_RUN_BATCH_SIZE, args->num_batch_slots, nn_model_run_batch_chunk, args );
+  return NULL;
+}
+
+// Runs args->run_fn without the GVL, then copies the results of a single item out of the
+// workspace. The model's own activations are only written while holding the GVL. A batch
+// stops early when interrupted, and if the interrupt does not raise, it is run again.
+static VALUE nn_model_run_in_workspace( VALUE data ) {
+  NNModelRunArgs *args = (NNModelRunArgs *) data;
+  NNModel *nn_model = args->nn_model;
+  int i, last = nn_model->num_layers - 1;
+
+  do {
+    args->cancelled = 0;
+    CallWithoutGVLCancellable( args->run_fn, args, nn_model_run_cancel, args );
+  } while ( args->cancelled );
+
+  if ( args->keep_activations ) {
+    for ( i = 0; i <= last; i++ ) {
+      memcpy( nn_model->activations[i], args->workspace->activations[i],
+          nn_model__layer_num_outputs_at( nn_model, i ) * sizeof(float) );
+    }
+    memcpy( args->outputs, args->workspace->activations[last], nn_model->num_outputs * sizeof(float) );
+  }
+
+  return Qnil;
+}
+
+static VALUE nn_model_release_workspace( VALUE data ) {
+  NNModelRunArgs *args = (NNModelRunArgs *) data;
+  nn_model__end_busy( args->nn_model );
+  nn_model__release_workspace( args->nn_model, args->workspace );
+  return Qnil;
+}
+
+// Each call has its own workspace, so that many threads can run one model at the same time.
+// The workspace goes back to the pool even if the thread is interrupted.
+static void nn_model_run_with_workspace( NNModelRunArgs *args ) {
+  args->workspace = nn_model__acquire_workspace( args->nn_model, args->num_batch_slots );
+  nn_model__start_busy( args->nn_model );
+  rb_ensure( nn_model_run_in_workspace, (VALUE) args, nn_model_release_workspace, (VALUE) args );
+  return;
+}
+
 /* @overload run( input )
- * Runs nn_model forward and generates a result
+ * Runs nn_model forward and generates a result. Many threads may run the same model at once,
+ * each call uses its own buffers, and #activations are from whichever call finished last.
  * @param [NArray<sfloat>] input single input vector
  * @return [NArray<sfloat>] output of nn_model
  */
@@ -243,13 +330,73 @@ VALUE nn_model_rbobject__run( VALUE self, VALUE rv_input ) {
   volatile VALUE val_output = na_make_object( NA_SFLOAT, 1, out_shape, cNArray );
   GetNArray( val_output, na_output );
 
-  nn_model__run( nn_model, (float*) na_input->ptr );
-
-  memcpy( (float*) na_output->ptr, nn_model->activations[nn_model->num_layers-1], nn_model->num_outputs * sizeof(float) );
+  NNModelRunArgs args;
+  args.nn_model = nn_model;
+  args.run_fn = nn_model_run_without_gvl;
+  args.keep_activations = 1;
+  args.num_batch_slots = 0;
+  args.inputs = (float*) na_input->ptr;
+  args.outputs = (float*) na_output->ptr;
+  nn_model_run_with_workspace( &args );
 
   return val_output;
 }
 
+/* @overload run_batch( inputs )
+ * Runs nn_model forward for many input vectors at once. This is faster than calling
+ * run for each item, because each layer is processed as a matrix multiplication. Unlike
+ * run, the activations are not stored. Many threads may run the same model at once.
+ * @param [NArray<sfloat>] inputs input vectors, of shape [num_inputs, num_items]
+ * @return [NArray<sfloat>] outputs of nn_model, of shape [num_outputs, num_items]
+ */
+VALUE nn_model_rbobject__run_batch( VALUE self, VALUE rv_inputs ) {
+  NNModel *nn_model = get_nn_model_struct( self );
+  int num_items;
+  int out_shape[2];
+
+  struct NARRAY *na_inputs;
+  volatile VALUE val_inputs = na_cast_object(rv_inputs, NA_SFLOAT);
+  GetNArray( val_inputs, na_inputs );
+
+  // Shouldn't happen, but we don't want a segfault
+  if ( nn_model->num_layers < 1 ) {
+    return Qnil;
+  }
+
+  if ( na_inputs->rank != 2 ) {
+    rb_raise( rb_eArgError, "Inputs array must be rank 2, but it was rank %d", na_inputs->rank );
+  }
+
+  if ( na_inputs->shape[0] != nn_model->num_inputs ) {
+    rb_raise( rb_eArgError, "Input vectors must be size %d, but they were size %d", nn_model->num_inputs, na_inputs->shape[0] );
+  }
+
+  num_items = na_inputs->shape[1];
+  out_shape[0] = nn_model->num_outputs;
+  out_shape[1] = num_items;
+
+  struct NARRAY *na_outputs;
+  volatile VALUE val_outputs = na_make_object( NA_SFLOAT, 2, out_shape, cNArray );
+  GetNArray( val_outputs, na_outputs );
+
+  NNModelRunArgs args;
+  args.nn_model = nn_model;
+  args.run_fn = nn_model_run_batch_without_gvl;
+  args.keep_activations = 0;
+  args.num_items = num_items;
+  args.num_batch_slots = ( num_items + NN_MODEL_RUN_BATCH_SIZE - 1 ) / NN_MODEL_RUN_BATCH_SIZE;
+  if ( args.num_batch_slots > parallel_num_threads() ) {
+    args.num_batch_slots = parallel_num_threads();
+  }
+  if ( args.num_batch_slots < 1 ) {
+    args.num_batch_slots = 1;
+  }
+  args.inputs = (float*) na_inputs->ptr;
+  args.outputs = (float*) na_outputs->ptr;
+  nn_model_run_with_workspace( &args );
+
+  return val_outputs;
+}
 
 /* @overload activations( layer_id )
  * Array of activation values from last call to .run from layer identified by layer_id
@@ -258,27 +405,49 @@ VALUE nn_model_rbobject__run( VALUE self, VALUE rv_input ) {
  */
 VALUE nn_model_rbobject__activations( VALUE self, VALUE rv_layer_id ) {
   NNModel *nn_model = get_nn_model_struct( self );
-  Layer_FF *layer_ff;
   int layer_id = NUM2INT( rv_layer_id );
 
   if ( layer_id < 0 || layer_id >= nn_model->num_layers ) {
     return Qnil; // Should this raise instead? Not sure . . .
   }
 
-  Data_Get_Struct( nn_model->layers[ layer_id ], Layer_FF, layer_ff );
-  int out_shape[1] = { layer_ff->num_outputs };
+  int out_shape[1] = { nn_model__layer_num_outputs_at( nn_model, layer_id ) };
 
   struct NARRAY *na_output;
 
   volatile VALUE val_output = na_make_object( NA_SFLOAT, 1, out_shape, cNArray );
   GetNArray( val_output, na_output );
 
-  memcpy( (float*) na_output->ptr, nn_model->activations[layer_id], layer_ff->num_outputs * sizeof(float) );
+  memcpy( (float*) na_output->ptr, nn_model->activations[layer_id], out_shape[0] * sizeof(float) );
 
   return val_output;
 }
 
 
+/* @!attribute [r] arena?
+ * Whether weights of all layers are stored in one block of memory, see #pack_arena.
+ * @return [Boolean]
+ */
+VALUE nn_model_rbobject__get_arena( VALUE self ) {
+  NNModel *nn_model = get_nn_model_struct( self );
+  return NIL_P( nn_model->narr_arena ) ? Qfalse : Qtrue;
+}
+
+/* @overload pack_arena
+ * Moves weights of all layers into one contiguous block of memory, with each layer's weights
+ * starting on a 32-byte boundary. The weights arrays of each layer are replaced by views into
+ * that block, so any references to the old arrays will no longer be updated by training.
+ * Clones of the model are packed in the same way. Raises RuntimeError if another thread is
+ * running or training the model.
+ * @return [RuNeNe::NNModel] self
+ */
+VALUE nn_model_rbobject__pack_arena( VALUE self ) {
+  NNModel *nn_model = get_nn_model_struct( self );
+  nn_model__check_not_busy( nn_model );
+  nn_model__pack_arena( nn_model );
+  return self;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void init_nn_model_class( ) {
@@ -292,10 +461,13 @@ void init_nn_model_class( ) {
   rb_define_method( RuNeNe_NNModel, "num_layers", nn_model_rbobject__get_num_layers, 0 );
   rb_define_method( RuNeNe_NNModel, "num_inputs", nn_model_rbobject__get_num_inputs, 0 );
   rb_define_method( RuNeNe_NNModel, "num_outputs", nn_model_rbobject__get_num_outputs, 0 );
+  rb_define_method( RuNeNe_NNModel, "arena?", nn_model_rbobject__get_arena, 0 );
 
   // NNModel methods
   rb_define_method( RuNeNe_NNModel, "layer", nn_model_rbobject__get_layer, 1 );
   rb_define_method( RuNeNe_NNModel, "init_weights", nn_model_rbobject__init_weights, -1 );
   rb_define_method( RuNeNe_NNModel, "run", nn_model_rbobject__run, 1 );
+  rb_define_method( RuNeNe_NNModel, "run_batch", nn_model_rbobject__run_batch, 1 );
   rb_define_method( RuNeNe_NNModel, "activations", nn_model_rbobject__activations, 1 );
+  rb_define_method( RuNeNe_NNModel, "pack_arena", nn_model_rbobject__pack_arena, 0 );
 }
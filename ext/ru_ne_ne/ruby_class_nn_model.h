@@ -8,6 +8,7 @@
 #include "struct_nn_model.h"
 #include "shared_vars.h"
 #include "ruby_class_layer_ff.h"
+#include "core_parallel.h"
 
 void init_nn_model_class( );
 NNModel *safe_get_nn_model_struct( VALUE obj );
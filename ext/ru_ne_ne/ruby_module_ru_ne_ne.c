@@ -23,9 +23,12 @@ volatile VALUE RuNeNe_GradientDescent = Qnil;
 volatile VALUE RuNeNe_GradientDescent_SGD = Qnil;
 volatile VALUE RuNeNe_GradientDescent_NAG = Qnil;
 volatile VALUE RuNeNe_GradientDescent_RMSProp = Qnil;
+volatile VALUE RuNeNe_GradientDescent_AdaGrad = Qnil;
+volatile VALUE RuNeNe_GradientDescent_Adam = Qnil;
 
 volatile VALUE RuNeNe_Layer = Qnil;
 volatile VALUE RuNeNe_Layer_FeedForward  = Qnil;
+volatile VALUE RuNeNe_Layer_Embedding  = Qnil;
 
 volatile VALUE RuNeNe_NNModel = Qnil;
 
@@ -37,10 +40,34 @@ volatile VALUE RuNeNe_Learn_MBGD_Layer = Qnil;
 
 volatile VALUE RuNeNe_Network = Qnil;
 
+typedef struct _narray_convolve_args {
+    int rank;
+    int *in_shape;
+    float *in_ptr;
+    int *kernel_shape;
+    int num_kernels;
+    float *kernel_ptr;
+    int *out_shape;
+    float *out_ptr;
+    int status;
+  } NArrayConvolveArgs;
+
+static void *narray_convolve_without_gvl( void *data ) {
+  NArrayConvolveArgs *args = (NArrayConvolveArgs *) data;
+  args->status = core_convolve_bank(
+    args->rank, args->in_shape, args->in_ptr,
+    args->kernel_shape, args->num_kernels, args->kernel_ptr,
+    args->out_shape, args->out_ptr );
+  return NULL;
+}
+
 /* @overload convolve( signal, kernel )
  * Calculates convolution of an array of floats representing a signal, with a second array representing
  * a kernel. The two parameters must have the same rank. The output has same rank, its size in each dimension d is given by
  *  signal.shape[d] - kernel.shape[d] + 1
+ * The kernel may instead be a bank of kernels, with rank one higher than signal, and one kernel for
+ * each index in its last dimension. The output then has one result for each kernel, also in its last
+ * dimension, and is calculated with a single pass over signal.
  * @param [NArray] signal must be same size or larger than kernel in each dimension
  * @param [NArray] kernel must be same size or smaller than signal in each dimension
  * @return [NArray] result of convolving signal with kernel
@@ -48,8 +75,8 @@ volatile VALUE RuNeNe_Network = Qnil;
 VALUE narray_convolve( VALUE self, VALUE rv_a, VALUE rv_b ) {
   struct NARRAY *na_a, *na_b, *na_c;
   volatile VALUE val_a, val_b, val_c;
-  int target_rank, i;
-  int target_shape[LARGEST_RANK];
+  int target_rank, i, num_kernels = 1;
+  int target_shape[LARGEST_RANK + 1];
 
   val_a = na_cast_object( rv_a, NA_SFLOAT );
   GetNArray( val_a, na_a );
@@ -57,7 +84,9 @@ VALUE narray_convolve( VALUE self, VALUE rv_a, VALUE rv_b ) {
   val_b = na_cast_object( rv_b, NA_SFLOAT );
   GetNArray( val_b, na_b );
 
-  if ( na_a->rank != na_b->rank ) {
+  if ( na_a->rank == na_b->rank - 1 ) {
+    num_kernels = na_b->shape[ na_a->rank ];
+  } else if ( na_a->rank != na_b->rank ) {
     rb_raise( rb_eArgError, "narray a must have equal rank to narray b (a rack %d, b rank %d)", na_a->rank,  na_b->rank );
   }
 
@@ -74,17 +103,50 @@ VALUE narray_convolve( VALUE self, VALUE rv_a, VALUE rv_b ) {
     }
   }
 
-  val_c = na_make_object( NA_SFLOAT, target_rank, target_shape, cNArray );
+  if ( na_b->rank > na_a->rank ) {
+    target_shape[ target_rank ] = num_kernels;
+    val_c = na_make_object( NA_SFLOAT, target_rank + 1, target_shape, cNArray );
+  } else {
+    val_c = na_make_object( NA_SFLOAT, target_rank, target_shape, cNArray );
+  }
   GetNArray( val_c, na_c );
 
-  core_convole(
-    target_rank, na_a->shape, (float*) na_a->ptr,
-    target_rank, na_b->shape, (float*) na_b->ptr,
-    target_rank, target_shape, (float*) na_c->ptr );
+  NArrayConvolveArgs args;
+  args.rank = target_rank;
+  args.in_shape = na_a->shape;
+  args.in_ptr = (float*) na_a->ptr;
+  args.kernel_shape = na_b->shape;
+  args.num_kernels = num_kernels;
+  args.kernel_ptr = (float*) na_b->ptr;
+  args.out_shape = target_shape;
+  args.out_ptr = (float*) na_c->ptr;
+  CallWithoutGVL( narray_convolve_without_gvl, &args );
+  if ( args.status ) {
+    rb_raise( rb_eNoMemError, "not enough memory for convolve" );
+  }
 
   return val_c;
 }
 
+typedef struct _narray_max_pool_args {
+    int rank;
+    int *in_shape;
+    float *in_ptr;
+    int *out_shape;
+    float *out_ptr;
+    int tile;
+    int pool;
+  } NArrayMaxPoolArgs;
+
+static void *narray_max_pool_without_gvl( void *data ) {
+  NArrayMaxPoolArgs *args = (NArrayMaxPoolArgs *) data;
+  core_max_pool(
+    args->rank, args->in_shape, args->in_ptr,
+    args->out_shape, args->out_ptr,
+    args->tile, args->pool );
+  return NULL;
+}
+
 /* @overload max_pool( array, tile_size, pool_size )
  * Reduces an array in each dimension by a factor tile_size, by sampling pool_size entries
  * and using the maximum value found.
@@ -124,10 +186,15 @@ VALUE narray_max_pool( VALUE self, VALUE rv_a, VALUE rv_tile_size, VALUE rv_pool
   val_b = na_make_object( NA_SFLOAT, target_rank, target_shape, cNArray );
   GetNArray( val_b, na_b );
 
-  core_max_pool(
-    target_rank, na_a->shape, (float*) na_a->ptr,
-    target_shape, (float*) na_b->ptr,
-    tile, pool );
+  NArrayMaxPoolArgs args;
+  args.rank = target_rank;
+  args.in_shape = na_a->shape;
+  args.in_ptr = (float*) na_a->ptr;
+  args.out_shape = target_shape;
+  args.out_ptr = (float*) na_b->ptr;
+  args.tile = tile;
+  args.pool = pool;
+  CallWithoutGVL( narray_max_pool_without_gvl, &args );
 
   return val_b;
 }
@@ -262,6 +329,47 @@ static VALUE runene_rb_module__max_norm( VALUE self, VALUE rv_weights, VALUE rv_
   return val_weights;
 }
 
+/* @overload simd_level
+ * Which set of vector instructions is used by the maths kernels. This is chosen to suit the
+ * CPU when RuNeNe is loaded, and can be capped by setting environment variable RU_NE_NE_SIMD
+ * to "sse2" or "avx2".
+ * @return [Symbol] one of :sse2, :avx2 or :avx512
+ */
+static VALUE runene_rb_module__simd_level( VALUE self ) {
+  return ID2SYM( rb_intern( simd_level_name( simd_kernels.level ) ) );
+}
+
+/* @overload threads
+ * Number of native threads that RuNeNe uses for one piece of work, such as a large #convolve,
+ * NNModel#run_batch or training a batch with option :threads. All of these share one pool of
+ * threads, which are started when first needed. The default is the number of CPUs.
+ * @return [Integer]
+ */
+static VALUE runene_rb_module__get_threads( VALUE self ) {
+  return INT2NUM( parallel_num_threads() );
+}
+
+static void *runene_set_threads_without_gvl( void *data ) {
+  parallel_set_num_threads( *(int *) data );
+  return NULL;
+}
+
+/* @overload threads=( num_threads )
+ * Sets size of the thread pool. Pool threads are stopped, after finishing any work they have
+ * started, and restarted at the new size when next needed. With a size of 1, all work runs on
+ * the calling thread. Results do not depend on the size of the pool.
+ * @param [Integer] num_threads in range 1..256
+ * @return [Integer] num_threads
+ */
+static VALUE runene_rb_module__set_threads( VALUE self, VALUE rv_num_threads ) {
+  int num_threads = NUM2INT( rv_num_threads );
+  if ( num_threads < 1 || num_threads > PARALLEL_MAX_THREADS ) {
+    rb_raise( rb_eArgError, "threads must be in range 1..%d, got %d", PARALLEL_MAX_THREADS, num_threads );
+  }
+  CallWithoutGVL( runene_set_threads_without_gvl, &num_threads );
+  return rv_num_threads;
+}
+
 
 void init_module_ru_ne_ne() {
   RuNeNe = rb_define_module( "RuNeNe" );
@@ -282,9 +390,12 @@ void init_module_ru_ne_ne() {
   RuNeNe_GradientDescent_SGD = rb_define_class_under( RuNeNe_GradientDescent, "SGD", rb_cObject );
   RuNeNe_GradientDescent_NAG = rb_define_class_under( RuNeNe_GradientDescent, "NAG", rb_cObject );
   RuNeNe_GradientDescent_RMSProp = rb_define_class_under( RuNeNe_GradientDescent, "RMSProp", rb_cObject );
+  RuNeNe_GradientDescent_AdaGrad = rb_define_class_under( RuNeNe_GradientDescent, "AdaGrad", rb_cObject );
+  RuNeNe_GradientDescent_Adam = rb_define_class_under( RuNeNe_GradientDescent, "Adam", rb_cObject );
 
   RuNeNe_Layer = rb_define_class_under( RuNeNe, "Layer", rb_cObject );
   RuNeNe_Layer_FeedForward = rb_define_class_under( RuNeNe_Layer, "FeedForward", rb_cObject );
+  RuNeNe_Layer_Embedding = rb_define_class_under( RuNeNe_Layer, "Embedding", rb_cObject );
 
   RuNeNe_NNModel = rb_define_class_under( RuNeNe, "NNModel", rb_cObject );
 
@@ -304,14 +415,20 @@ void init_module_ru_ne_ne() {
   rb_define_singleton_method( RuNeNe, "shuffled_integers", runene_shuffled_integers, 1 );
   rb_define_singleton_method( RuNeNe, "weight_decay", runene_rb_module__weight_decay, 3 );
   rb_define_singleton_method( RuNeNe, "max_norm", runene_rb_module__max_norm, 2 );
+  rb_define_singleton_method( RuNeNe, "simd_level", runene_rb_module__simd_level, 0 );
+  rb_define_singleton_method( RuNeNe, "threads", runene_rb_module__get_threads, 0 );
+  rb_define_singleton_method( RuNeNe, "threads=", runene_rb_module__set_threads, 1 );
 
   init_transfer_module();
   init_objective_module();
   init_layer_ff_class();
+  init_layer_embedding_class();
   init_mbgd_layer_class();
   init_gd_sgd_class();
   init_gd_nag_class();
   init_gd_rmsprop_class();
+  init_gd_adagrad_class();
+  init_gd_adam_class();
   init_dataset_class();
   init_nn_model_class();
   init_mbgd_class();
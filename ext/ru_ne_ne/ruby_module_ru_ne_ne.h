@@ -18,12 +18,17 @@
 #include "ruby_class_gd_sgd.h"
 #include "ruby_class_gd_nag.h"
 #include "ruby_class_gd_rmsprop.h"
+#include "ruby_class_gd_adagrad.h"
+#include "ruby_class_gd_adam.h"
 #include "ruby_class_layer_ff.h"
+#include "ruby_class_layer_embedding.h"
 #include "ruby_class_dataset.h"
 #include "ruby_class_learn_mbgd_layer.h"
 #include "ruby_class_mbgd.h"
 #include "mt.h"
 #include "core_shuffle.h"
+#include "core_simd.h"
+#include "core_parallel.h"
 #include "shared_vars.h"
 #include "core_regularise.h"
 #include "ruby_class_nn_model.h"
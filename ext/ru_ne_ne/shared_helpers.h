@@ -15,6 +15,24 @@
 #include "st.h"
 #endif
 
+// Long-running C code is called via CallWithoutGVL so that other Ruby threads can run. The
+// called function must not use the Ruby API (no allocating Ruby objects, no raising errors),
+// so all checks should be made before calling it. An interrupt, such as Thread#kill, takes
+// effect when the function returns.
+//
+// Work that may run for a long time should use CallWithoutGVLCancellable instead, where ubf is
+// called from another thread on interrupt, and should set a flag that fn checks regularly so
+// that it can stop early. Interrupts that do not raise (e.g. Thread#wakeup) also call ubf, so
+// the caller must cope with fn returning before its work is complete.
+#ifdef HAVE_RUBY_THREAD_H
+#include "ruby/thread.h"
+#define CallWithoutGVL(fn, data) rb_thread_call_without_gvl( (fn), (data), RUBY_UBF_IO, NULL )
+#define CallWithoutGVLCancellable(fn, data, ubf, ubf_data) rb_thread_call_without_gvl( (fn), (data), (ubf), (ubf_data) )
+#else
+#define CallWithoutGVL(fn, data) (fn)(data)
+#define CallWithoutGVLCancellable(fn, data, ubf, ubf_data) (fn)(data)
+#endif
+
 // Hash lookup helper
 VALUE ValAtSymbol(VALUE hash, const char* key);
 
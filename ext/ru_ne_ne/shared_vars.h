@@ -22,9 +22,12 @@ extern volatile VALUE RuNeNe_GradientDescent;
 extern volatile VALUE RuNeNe_GradientDescent_SGD;
 extern volatile VALUE RuNeNe_GradientDescent_NAG;
 extern volatile VALUE RuNeNe_GradientDescent_RMSProp;
+extern volatile VALUE RuNeNe_GradientDescent_AdaGrad;
+extern volatile VALUE RuNeNe_GradientDescent_Adam;
 
 extern volatile VALUE RuNeNe_Layer;
 extern volatile VALUE RuNeNe_Layer_FeedForward;
+extern volatile VALUE RuNeNe_Layer_Embedding;
 
 extern volatile VALUE RuNeNe_NNModel;
 
@@ -1,12 +1,47 @@
 // ext/ru_ne_ne/struct_dataset.c
 
 #include "struct_dataset.h"
+#include "core_simd.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 //
 //  Definitions of OO-style functions for manipulating DataSet structs
 //
 
+// Number of items ahead of the current one that dataset__gather_batch prefetches
+#define DATASET_PREFETCH_DISTANCE 8
+
+// Only the start of each item is prefetched, hardware prefetch will stream the rest
+#define DATASET_PREFETCH_MAX_LINES 4
+
+// Bytes of inputs and outputs below which dataset__gather_batch copies on the calling thread only
+#define DATASET_GATHER_PARALLEL_MIN_BYTES 262144
+
+// Items copied together by one pool thread in dataset__gather_batch
+#define DATASET_GATHER_CHUNK_SIZE 64
+
+static inline void dataset_prefetch( void *item, int item_bytes ) {
+#if defined(__GNUC__)
+  int i, num_lines = ( item_bytes + 63 ) / 64;
+  if ( num_lines > DATASET_PREFETCH_MAX_LINES ) {
+    num_lines = DATASET_PREFETCH_MAX_LINES;
+  }
+  for ( i = 0; i < num_lines; i++ ) {
+    __builtin_prefetch( (char *) item + i * 64, 0, 0 );
+  }
+#endif
+  return;
+}
+
 DataSet *dataset__create() {
   DataSet *dataset;
   dataset = xmalloc( sizeof(DataSet) );
@@ -22,10 +57,134 @@ DataSet *dataset__create() {
   dataset->output_item_shape = NULL;
   dataset->pos_idx = NULL;
   dataset->current_pos = 0;
+  dataset->shuffle_block_size = 0;
   dataset->num_items = 0;
+  dataset->mmap_path = Qnil;
+  dataset->mmap_addr = NULL;
+  dataset->mmap_length = 0;
+  dataset->input_type = DATASET_INPUT_SFLOAT;
+  dataset->raw_inputs = NULL;
+  dataset->input_scale = NULL;
+  dataset->input_offset = NULL;
+  dataset->decoded_input = NULL;
+  dataset->view_of = Qnil;
+  dataset->item_idx = NULL;
+  dataset->stream = NULL;
+  dataset->csr.row_ptr = NULL;
+  dataset->csr.col_idx = NULL;
+  dataset->csr.values = NULL;
+  dataset->narr_csr = Qnil;
+  dataset->busy = 0;
   return dataset;
 }
 
+int dataset__input_type_size( dataset_input_type input_type ) {
+  switch ( input_type ) {
+    case DATASET_INPUT_BYTE:
+      return 1;
+    case DATASET_INPUT_FLOAT16:
+      return 2;
+    default:
+      return sizeof(float);
+  }
+}
+
+// Sets where input items are stored. Compact types start with scale 1.0 and offset 0.0. Sparse
+// inputs are found from the csr field instead, and need somewhere to expand a single item.
+static void dataset__init_input_storage( DataSet *dataset, dataset_input_type input_type, void *raw_inputs ) {
+  int i;
+
+  xfree( dataset->input_scale );
+  xfree( dataset->input_offset );
+  xfree( dataset->decoded_input );
+  dataset->input_scale = NULL;
+  dataset->input_offset = NULL;
+  dataset->decoded_input = NULL;
+
+  dataset->input_type = input_type;
+  dataset->raw_inputs = raw_inputs;
+  if ( input_type == DATASET_INPUT_SFLOAT ) {
+    dataset->inputs = (float*) raw_inputs;
+    return;
+  }
+
+  dataset->inputs = NULL;
+  if ( input_type == DATASET_INPUT_CSR ) {
+    dataset->decoded_input = ALLOC_N( float, dataset->input_item_size );
+    return;
+  }
+
+  dataset->input_scale = ALLOC_N( float, dataset->input_item_size );
+  dataset->input_offset = ALLOC_N( float, dataset->input_item_size );
+  dataset->decoded_input = ALLOC_N( float, dataset->input_item_size );
+  for ( i = 0; i < dataset->input_item_size; i++ ) {
+    dataset->input_scale[i] = 1.0;
+    dataset->input_offset[i] = 0.0;
+  }
+  return;
+}
+
+static dataset_input_type dataset_input_type_of_narray( struct NARRAY *narr ) {
+  switch ( narr->type ) {
+    case NA_BYTE:
+      return DATASET_INPUT_BYTE;
+    case NA_SINT:
+      return DATASET_INPUT_FLOAT16;
+    default:
+      return DATASET_INPUT_SFLOAT;
+  }
+}
+
+void dataset__set_input_transform( DataSet *dataset, float *scale, float *offset ) {
+  if ( ! dataset->input_scale ) {
+    return;
+  }
+  memcpy( dataset->input_scale, scale, dataset->input_item_size * sizeof(float) );
+  memcpy( dataset->input_offset, offset, dataset->input_item_size * sizeof(float) );
+  return;
+}
+
+// Widens num_items stored input items, starting from raw, into rows of floats
+static void dataset_widen_inputs( DataSet *dataset, void *raw, int num_items, float *dst ) {
+  int i, size = dataset->input_item_size;
+  float *scale = dataset->input_scale, *offset = dataset->input_offset;
+  uint8_t *src_byte;
+  uint16_t *src_half;
+
+  switch ( dataset->input_type ) {
+    case DATASET_INPUT_BYTE:
+      src_byte = (uint8_t *) raw;
+      for ( i = 0; i < num_items; i++, src_byte += size, dst += size ) {
+        simd_kernels.widen_u8( size, src_byte, scale, offset, dst );
+      }
+      break;
+    case DATASET_INPUT_FLOAT16:
+      src_half = (uint16_t *) raw;
+      for ( i = 0; i < num_items; i++, src_half += size, dst += size ) {
+        simd_kernels.widen_f16( size, src_half, scale, offset, dst );
+      }
+      break;
+    default:
+      memcpy( dst, raw, (size_t) num_items * size * sizeof(float) );
+  }
+  return;
+}
+
+// Items are addressed by position in storage, which for a view is different from position in
+// the view
+static inline int dataset_storage_item( DataSet *dataset, int item ) {
+  return dataset->item_idx ? dataset->item_idx[item] : item;
+}
+
+static void *dataset_raw_input_at( DataSet *dataset, int item ) {
+  return (char *) dataset->raw_inputs + (size_t) dataset_storage_item( dataset, item ) *
+      dataset->input_item_size * dataset__input_type_size( dataset->input_type );
+}
+
+static float *dataset_output_at( DataSet *dataset, int item ) {
+  return dataset->outputs + (size_t) dataset_storage_item( dataset, item ) * dataset->output_item_size;
+}
+
 void dataset__init( DataSet *dataset, int input_rank, int *input_shape,
       int output_rank, int *output_shape, int num_items ) {
   int i, size, *pos;
@@ -42,7 +201,7 @@ void dataset__init( DataSet *dataset, int input_rank, int *input_shape,
   dataset->input_item_size = size;
   dataset->input_item_rank = input_rank;
   GetNArray( dataset->narr_inputs, narr );
-  dataset->inputs = (float*) narr->ptr;
+  dataset__init_input_storage( dataset, DATASET_INPUT_SFLOAT, narr->ptr );
   na_sfloat_set( narr->total, dataset->inputs, (float) 0.0 );
 
   dataset->output_item_shape = ALLOC_N( int, output_rank + 1);
@@ -71,29 +230,217 @@ void dataset__init( DataSet *dataset, int input_rank, int *input_shape,
   return;
 }
 
+static void dataset_csr_expand( DataSet *dataset, int item, float *dst );
+
+// For compact and sparse input types, the returned item is only valid until the next call
 float *dataset__current_input( DataSet *dataset ) {
-  return dataset->inputs + dataset->input_item_size * dataset->pos_idx[ dataset->current_pos ];
+  if ( dataset->input_type == DATASET_INPUT_SFLOAT ) {
+    return (float *) dataset_raw_input_at( dataset, dataset->pos_idx[ dataset->current_pos ] );
+  }
+  if ( dataset->input_type == DATASET_INPUT_CSR ) {
+    dataset_csr_expand( dataset, dataset->pos_idx[ dataset->current_pos ], dataset->decoded_input );
+    return dataset->decoded_input;
+  }
+  dataset_widen_inputs( dataset, dataset_raw_input_at( dataset, dataset->pos_idx[ dataset->current_pos ] ),
+      1, dataset->decoded_input );
+  return dataset->decoded_input;
 }
 
 float *dataset__current_output( DataSet *dataset ) {
-  return dataset->outputs + dataset->output_item_size * dataset->pos_idx[ dataset->current_pos ];
+  return dataset_output_at( dataset, dataset->pos_idx[ dataset->current_pos ] );
 }
 
+static void dataset_stream_take( DataSet *dataset );
+
 void dataset__next( DataSet *dataset ) {
+  if ( dataset->stream ) {
+    dataset_stream_take( dataset );
+    return;
+  }
+
   dataset->current_pos = ( dataset->current_pos + 1 ) % dataset->num_items;
 
   // Shuffle sequence if we ran out last time
   if ( dataset->current_pos == 0 ) {
+    dataset__shuffle( dataset );
+  }
+
+  return;
+}
+
+// Sets a new random order of items. With a shuffle_block_size, only the order of blocks and
+// the order within each block is random, so items are read from storage mostly sequentially.
+void dataset__shuffle( DataSet *dataset ) {
+  if ( dataset->shuffle_block_size > 1 ) {
+    shuffle_ints_in_blocks( dataset->num_items, dataset->pos_idx, dataset->shuffle_block_size );
+  } else {
     shuffle_ints( dataset->num_items, dataset->pos_idx );
   }
+  return;
+}
+
+// Copies the next num_items items, starting with the current one, into contiguous inputs and
+// outputs with one row per item, leaving dataset at the item after them. Compact inputs are
+// widened to float here. Items a few places ahead in the current order are prefetched, as they
+// may be anywhere in a large dataset.
+typedef struct _dataset_gather_args {
+    DataSet *dataset;
+    int first_pos;
+    float *inputs;
+    float *outputs;
+  } DataSetGatherArgs;
+
+// Copies items from positions first_pos + start ... first_pos + end in the current order, which
+// must not go past the end of the epoch, to rows start...end of inputs and outputs
+static void dataset_gather_range( void *data, int slot, int start, int end ) {
+  DataSetGatherArgs *args = (DataSetGatherArgs *) data;
+  DataSet *dataset = args->dataset;
+  int i, pos, ahead, in_size = dataset->input_item_size, out_size = dataset->output_item_size;
+  int in_bytes = in_size * dataset__input_type_size( dataset->input_type );
+
+  for ( i = start; i < end; i++ ) {
+    pos = args->first_pos + i;
+    ahead = pos + DATASET_PREFETCH_DISTANCE;
+    if ( ahead < args->first_pos + end ) {
+      dataset_prefetch( dataset_raw_input_at( dataset, dataset->pos_idx[ahead] ), in_bytes );
+      dataset_prefetch( dataset_output_at( dataset, dataset->pos_idx[ahead] ), out_size * sizeof(float) );
+    }
+    dataset_widen_inputs( dataset, dataset_raw_input_at( dataset, dataset->pos_idx[pos] ),
+        1, args->inputs + (size_t) i * in_size );
+    memcpy( args->outputs + (size_t) i * out_size, dataset_output_at( dataset, dataset->pos_idx[pos] ),
+        out_size * sizeof(float) );
+  }
 
   return;
 }
 
+// Items up to the end of the current epoch are copied by the thread pool when there are enough
+// of them, then the position moves on, shuffling at the end of the epoch as dataset__next does
+void dataset__gather_batch( DataSet *dataset, int num_items, float *inputs, float *outputs ) {
+  int i, num_seg, in_size = dataset->input_item_size, out_size = dataset->output_item_size;
+  size_t item_bytes = (size_t) in_size * dataset__input_type_size( dataset->input_type ) + out_size * sizeof(float);
+  DataSetGatherArgs args;
+
+  // A stream has no current item until one is taken from its buffer, and no order to look ahead in
+  if ( dataset->stream ) {
+    for ( i = 0; i < num_items; i++ ) {
+      dataset_stream_take( dataset );
+      memcpy( inputs + (size_t) i * in_size, dataset__current_input( dataset ), in_size * sizeof(float) );
+      memcpy( outputs + (size_t) i * out_size, dataset__current_output( dataset ), out_size * sizeof(float) );
+    }
+    return;
+  }
+
+  args.dataset = dataset;
+  for ( i = 0; i < num_items; i += num_seg ) {
+    num_seg = dataset->num_items - dataset->current_pos;
+    if ( num_seg > num_items - i ) {
+      num_seg = num_items - i;
+    }
+    args.first_pos = dataset->current_pos;
+    args.inputs = inputs + (size_t) i * in_size;
+    args.outputs = outputs + (size_t) i * out_size;
+
+    if ( num_seg * item_bytes >= DATASET_GATHER_PARALLEL_MIN_BYTES ) {
+      parallel_for( num_seg, DATASET_GATHER_CHUNK_SIZE, parallel_num_threads(), dataset_gather_range, &args );
+    } else {
+      dataset_gather_range( &args, 0, 0, num_seg );
+    }
+
+    dataset->current_pos += num_seg;
+    if ( dataset->current_pos == dataset->num_items ) {
+      dataset->current_pos = 0;
+      dataset__shuffle( dataset );
+    }
+  }
+
+  return;
+}
+
+// Returns num_items input items in stored order, starting at start_item, as rows of floats. Float
+// inputs are returned in place, compact ones or those of a view are copied into buffer, which
+// must have room.
+float *dataset__stored_inputs( DataSet *dataset, int start_item, int num_items, float *buffer ) {
+  int i;
+
+  if ( dataset->item_idx ) {
+    for ( i = 0; i < num_items; i++ ) {
+      dataset_widen_inputs( dataset, dataset_raw_input_at( dataset, start_item + i ), 1,
+          buffer + (size_t) i * dataset->input_item_size );
+    }
+    return buffer;
+  }
+
+  if ( dataset->input_type == DATASET_INPUT_SFLOAT ) {
+    return dataset->inputs + (size_t) start_item * dataset->input_item_size;
+  }
+  dataset_widen_inputs( dataset, dataset_raw_input_at( dataset, start_item ), num_items, buffer );
+  return buffer;
+}
+
+float *dataset__stored_output( DataSet *dataset, int item ) {
+  return dataset_output_at( dataset, item );
+}
+
+// Makes view a DataSet of selected items from parent, sharing its storage. Indices are positions
+// in parent, and must be valid. The view refers to the DataSet that owns the storage, so that is
+// kept from garbage collection while the view exists.
+void dataset__init_view( DataSet *view, DataSet *parent, VALUE rv_parent, int num_items, int *indices ) {
+  int i, *pos;
+
+  view->view_of = NIL_P( parent->view_of ) ? rv_parent : parent->view_of;
+  view->outputs = parent->outputs;
+
+  view->input_item_size = parent->input_item_size;
+  view->input_item_rank = parent->input_item_rank;
+  view->input_item_shape = ALLOC_N( int, parent->input_item_rank + 1 );
+  memcpy( view->input_item_shape, parent->input_item_shape, parent->input_item_rank * sizeof(int) );
+  view->input_item_shape[ view->input_item_rank ] = num_items;
+
+  view->output_item_size = parent->output_item_size;
+  view->output_item_rank = parent->output_item_rank;
+  view->output_item_shape = ALLOC_N( int, parent->output_item_rank + 1 );
+  memcpy( view->output_item_shape, parent->output_item_shape, parent->output_item_rank * sizeof(int) );
+  view->output_item_shape[ view->output_item_rank ] = num_items;
+
+  dataset__init_input_storage( view, parent->input_type, parent->raw_inputs );
+  dataset__set_input_transform( view, parent->input_scale, parent->input_offset );
+  view->csr = parent->csr;
+
+  view->item_idx = ALLOC_N( int, num_items );
+  for ( i = 0; i < num_items; i++ ) {
+    view->item_idx[i] = dataset_storage_item( parent, indices[i] );
+  }
+
+  pos = ALLOC_N( int, num_items );
+  for( i = 0; i < num_items; i++ ) {
+    pos[i] = i;
+  }
+  view->pos_idx = pos;
+  view->current_pos = num_items - 1;
+  view->num_items = num_items;
+  view->shuffle_block_size = parent->shuffle_block_size;
+  return;
+}
+
 void dataset__destroy( DataSet *dataset ) {
+#ifdef HAVE_SYS_MMAN_H
+  if ( dataset->mmap_addr ) {
+    munmap( dataset->mmap_addr, dataset->mmap_length );
+  }
+#endif
   xfree( dataset->pos_idx );
   xfree( dataset->input_item_shape );
   xfree( dataset->output_item_shape );
+  xfree( dataset->input_scale );
+  xfree( dataset->input_offset );
+  xfree( dataset->decoded_input );
+  xfree( dataset->item_idx );
+  if ( dataset->stream ) {
+    xfree( dataset->inputs );
+    xfree( dataset->outputs );
+    xfree( dataset->stream );
+  }
   xfree( dataset );
 
   // No need to free NArrays - they will be handled by Ruby's GC, and may still be reachable
@@ -105,6 +452,12 @@ void dataset__destroy( DataSet *dataset ) {
 void dataset__gc_mark( DataSet *dataset ) {
   rb_gc_mark( dataset->narr_inputs );
   rb_gc_mark( dataset->narr_outputs );
+  rb_gc_mark( dataset->mmap_path );
+  rb_gc_mark( dataset->view_of );
+  rb_gc_mark( dataset->narr_csr );
+  if ( dataset->stream ) {
+    rb_gc_mark( dataset->stream->source );
+  }
   return;
 }
 
@@ -117,7 +470,6 @@ void dataset__init_from_narray( DataSet *dataset, VALUE inputs, VALUE outputs )
   dataset->narr_outputs = outputs;
   GetNArray( dataset->narr_inputs, na_inputs );
   GetNArray( dataset->narr_outputs, na_outputs );
-  dataset->inputs = (float*) na_inputs->ptr;
   dataset->outputs = (float*) na_outputs->ptr;
 
   dataset->input_item_rank = na_inputs->rank - 1;
@@ -130,6 +482,7 @@ void dataset__init_from_narray( DataSet *dataset, VALUE inputs, VALUE outputs )
   }
   num_items = tmp_shape[ na_inputs->rank - 1 ];
   dataset->input_item_size = size;
+  dataset__init_input_storage( dataset, dataset_input_type_of_narray( na_inputs ), na_inputs->ptr );
 
   dataset->output_item_rank = na_outputs->rank - 1;
   dataset->output_item_shape = ALLOC_N( int, na_outputs->rank );
@@ -163,7 +516,6 @@ void dataset__reinit( DataSet *dataset ) {
 
   GetNArray( dataset->narr_inputs, na_inputs );
   GetNArray( dataset->narr_outputs, na_outputs );
-  dataset->inputs = (float*) na_inputs->ptr;
   dataset->outputs = (float*) na_outputs->ptr;
 
   dataset->input_item_rank = na_inputs->rank - 1;
@@ -176,6 +528,7 @@ void dataset__reinit( DataSet *dataset ) {
   }
   num_items = tmp_shape[ na_inputs->rank - 1 ];
   dataset->input_item_size = size;
+  dataset__init_input_storage( dataset, dataset_input_type_of_narray( na_inputs ), na_inputs->ptr );
 
   dataset->output_item_rank = na_outputs->rank - 1;
   dataset->output_item_shape = ALLOC_N( int, na_outputs->rank );
@@ -196,3 +549,542 @@ void dataset__reinit( DataSet *dataset ) {
   dataset->num_items = num_items;
   return;
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Binary file support. A DataSet opened from a file maps it read-only, and serves items
+//  directly from the mapping, so that processes training from the same file share page cache
+//
+
+static size_t dataset_file_align( size_t offset ) {
+  return ( offset + DATASET_FILE_ALIGN - 1 ) & ~( (size_t) DATASET_FILE_ALIGN - 1 );
+}
+
+static int *dataset_file_item_shape( int rank, int32_t *file_shape, int num_items, int *size ) {
+  int i, *shape = ALLOC_N( int, rank + 1 );
+  *size = 1;
+  for ( i = 0; i < rank; i++ ) {
+    shape[i] = file_shape[i];
+    *size *= file_shape[i];
+  }
+  shape[rank] = num_items;
+  return shape;
+}
+
+static void dataset_file_check_header( DataSetFileHeader *header, size_t file_size, const char *path ) {
+  int i;
+  size_t input_size = 1, output_size = 1;
+
+  if ( file_size < sizeof(DataSetFileHeader) ||
+      memcmp( header->magic, DATASET_FILE_MAGIC, 8 ) != 0 ) {
+    rb_raise( rb_eIOError, "File '%s' is not a RuNeNe DataSet file", path );
+  }
+  if ( header->version != DATASET_FILE_VERSION ) {
+    rb_raise( rb_eIOError, "File '%s' has unsupported version %d", path, header->version );
+  }
+  if ( header->input_type < DATASET_INPUT_SFLOAT || header->input_type > DATASET_INPUT_FLOAT16 ) {
+    rb_raise( rb_eIOError, "File '%s' has unsupported input type %d", path, header->input_type );
+  }
+  if ( header->num_items < 1 ||
+      header->input_item_rank < 1 || header->input_item_rank > DATASET_FILE_MAX_RANK ||
+      header->output_item_rank < 1 || header->output_item_rank > DATASET_FILE_MAX_RANK ) {
+    rb_raise( rb_eIOError, "File '%s' has a corrupt header", path );
+  }
+  for ( i = 0; i < header->input_item_rank; i++ ) {
+    if ( header->input_item_shape[i] < 1 ) {
+      rb_raise( rb_eIOError, "File '%s' has a corrupt header", path );
+    }
+    input_size *= header->input_item_shape[i];
+  }
+  for ( i = 0; i < header->output_item_rank; i++ ) {
+    if ( header->output_item_shape[i] < 1 ) {
+      rb_raise( rb_eIOError, "File '%s' has a corrupt header", path );
+    }
+    output_size *= header->output_item_shape[i];
+  }
+  if ( header->inputs_offset < (int64_t) sizeof(DataSetFileHeader) ||
+      header->inputs_offset % DATASET_FILE_ALIGN != 0 ||
+      header->outputs_offset % DATASET_FILE_ALIGN != 0 ||
+      (size_t) header->inputs_offset + input_size * header->num_items *
+          dataset__input_type_size( header->input_type ) > file_size ||
+      (size_t) header->outputs_offset + output_size * header->num_items * sizeof(float) > file_size ) {
+    rb_raise( rb_eIOError, "File '%s' is truncated or has a corrupt header", path );
+  }
+  if ( header->input_type != DATASET_INPUT_SFLOAT && (
+      header->input_transform_offset < (int64_t) sizeof(DataSetFileHeader) ||
+      header->input_transform_offset % DATASET_FILE_ALIGN != 0 ||
+      (size_t) header->input_transform_offset + 2 * input_size * sizeof(float) > file_size ) ) {
+    rb_raise( rb_eIOError, "File '%s' is truncated or has a corrupt header", path );
+  }
+  return;
+}
+
+void dataset__init_from_file( DataSet *dataset, VALUE path ) {
+#ifdef HAVE_SYS_MMAN_H
+  int i, fd, size, *pos;
+  struct stat st;
+  void *addr;
+  float *transform;
+  DataSetFileHeader *header;
+  const char *cpath = StringValueCStr( path );
+
+  fd = open( cpath, O_RDONLY );
+  if ( fd < 0 ) {
+    rb_sys_fail( cpath );
+  }
+  if ( fstat( fd, &st ) != 0 ) {
+    close( fd );
+    rb_sys_fail( cpath );
+  }
+  if ( (size_t) st.st_size < sizeof(DataSetFileHeader) ) {
+    close( fd );
+    rb_raise( rb_eIOError, "File '%s' is not a RuNeNe DataSet file", cpath );
+  }
+
+  addr = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+  close( fd );
+  if ( addr == MAP_FAILED ) {
+    rb_sys_fail( cpath );
+  }
+
+  // From here the mapping belongs to dataset, so it is released by dataset__destroy on error
+  dataset->mmap_addr = addr;
+  dataset->mmap_length = st.st_size;
+  dataset->mmap_path = rb_obj_freeze( rb_str_dup( path ) );
+
+  header = (DataSetFileHeader *) addr;
+  dataset_file_check_header( header, st.st_size, cpath );
+
+  dataset->num_items = header->num_items;
+  dataset->outputs = (float *) ( (char *) addr + header->outputs_offset );
+
+  dataset->input_item_rank = header->input_item_rank;
+  dataset->input_item_shape = dataset_file_item_shape( header->input_item_rank,
+      header->input_item_shape, header->num_items, &size );
+  dataset->input_item_size = size;
+  dataset__init_input_storage( dataset, header->input_type, (char *) addr + header->inputs_offset );
+  if ( header->input_type != DATASET_INPUT_SFLOAT ) {
+    transform = (float *) ( (char *) addr + header->input_transform_offset );
+    dataset__set_input_transform( dataset, transform, transform + size );
+  }
+
+  dataset->output_item_rank = header->output_item_rank;
+  dataset->output_item_shape = dataset_file_item_shape( header->output_item_rank,
+      header->output_item_shape, header->num_items, &size );
+  dataset->output_item_size = size;
+
+  pos = ALLOC_N( int, dataset->num_items );
+  for( i = 0; i < dataset->num_items; i++ ) {
+    pos[i] = i;
+  }
+  dataset->pos_idx = pos;
+  dataset->current_pos = dataset->num_items - 1;
+#else
+  rb_raise( rb_eNotImpError, "Memory-mapped DataSet files are not supported on this platform" );
+#endif
+  return;
+}
+
+// Writes zero padding from *pos up to offset, then bytes of data. Returns 0 on failure
+static int dataset_file_write_block( FILE *f, size_t *pos, size_t offset, void *data, size_t bytes ) {
+  static const char padding[DATASET_FILE_ALIGN] = { 0 };
+  size_t pad = offset - *pos;
+
+  if ( fwrite( padding, 1, pad, f ) != pad || fwrite( data, 1, bytes, f ) != bytes ) {
+    return 0;
+  }
+  *pos = offset + bytes;
+  return 1;
+}
+
+// Writes inputs then outputs starting at the given offsets. A view writes its items one at a time,
+// so that the file holds a plain copy of the selected items.
+static int dataset_file_write_items( FILE *f, size_t *pos, DataSet *dataset,
+      size_t inputs_offset, size_t outputs_offset ) {
+  int i;
+  size_t in_bytes = (size_t) dataset->input_item_size * dataset__input_type_size( dataset->input_type );
+  size_t out_bytes = (size_t) dataset->output_item_size * sizeof(float);
+
+  if ( ! dataset->item_idx ) {
+    return dataset_file_write_block( f, pos, inputs_offset, dataset->raw_inputs, in_bytes * dataset->num_items ) &&
+        dataset_file_write_block( f, pos, outputs_offset, dataset->outputs, out_bytes * dataset->num_items );
+  }
+
+  for ( i = 0; i < dataset->num_items; i++ ) {
+    if ( ! dataset_file_write_block( f, pos, i ? *pos : inputs_offset, dataset_raw_input_at( dataset, i ), in_bytes ) ) {
+      return 0;
+    }
+  }
+  for ( i = 0; i < dataset->num_items; i++ ) {
+    if ( ! dataset_file_write_block( f, pos, i ? *pos : outputs_offset, dataset_output_at( dataset, i ), out_bytes ) ) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void dataset__write_file( DataSet *dataset, const char *path ) {
+  DataSetFileHeader header;
+  FILE *f;
+  int i, ok;
+  size_t pos = 0, transform_bytes = 0;
+  size_t inputs_bytes = (size_t) dataset->input_item_size * dataset->num_items *
+      dataset__input_type_size( dataset->input_type );
+
+  if ( dataset->input_item_rank > DATASET_FILE_MAX_RANK || dataset->output_item_rank > DATASET_FILE_MAX_RANK ) {
+    rb_raise( rb_eArgError, "Item rank too large to save, maximum is %d", DATASET_FILE_MAX_RANK );
+  }
+  if ( dataset->input_type == DATASET_INPUT_CSR ) {
+    rb_raise( rb_eArgError, "Sparse inputs cannot be saved to a DataSet file" );
+  }
+
+  memset( &header, 0, sizeof(DataSetFileHeader) );
+  memcpy( header.magic, DATASET_FILE_MAGIC, 8 );
+  header.version = DATASET_FILE_VERSION;
+  header.input_type = dataset->input_type;
+  header.num_items = dataset->num_items;
+  header.input_item_rank = dataset->input_item_rank;
+  header.output_item_rank = dataset->output_item_rank;
+  for ( i = 0; i < dataset->input_item_rank; i++ ) {
+    header.input_item_shape[i] = dataset->input_item_shape[i];
+  }
+  for ( i = 0; i < dataset->output_item_rank; i++ ) {
+    header.output_item_shape[i] = dataset->output_item_shape[i];
+  }
+  header.inputs_offset = dataset_file_align( sizeof(DataSetFileHeader) );
+  if ( dataset->input_type != DATASET_INPUT_SFLOAT ) {
+    transform_bytes = dataset->input_item_size * sizeof(float);
+    header.input_transform_offset = header.inputs_offset;
+    header.inputs_offset = dataset_file_align( header.input_transform_offset + 2 * transform_bytes );
+  }
+  header.outputs_offset = dataset_file_align( header.inputs_offset + inputs_bytes );
+
+  f = fopen( path, "wb" );
+  if ( ! f ) {
+    rb_sys_fail( path );
+  }
+
+  ok = dataset_file_write_block( f, &pos, 0, &header, sizeof(DataSetFileHeader) );
+  if ( ok && transform_bytes ) {
+    ok = dataset_file_write_block( f, &pos, header.input_transform_offset, dataset->input_scale, transform_bytes ) &&
+        dataset_file_write_block( f, &pos, pos, dataset->input_offset, transform_bytes );
+  }
+  ok = ok && dataset_file_write_items( f, &pos, dataset, header.inputs_offset, header.outputs_offset );
+
+  if ( fclose( f ) != 0 ) {
+    ok = 0;
+  }
+  if ( ! ok ) {
+    rb_sys_fail( path );
+  }
+  return;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Streaming support. Items are read from Ruby, so the buffer is filled while holding the GVL,
+//  and then training can take up to the buffered number of items without it
+//
+
+static int *dataset_stream_shape( int rank, int *shape, int capacity, int *size ) {
+  int i, *item_shape = ALLOC_N( int, rank + 1 );
+  *size = 1;
+  for ( i = 0; i < rank; i++ ) {
+    item_shape[i] = shape[i];
+    *size *= shape[i];
+  }
+  item_shape[rank] = capacity;
+  return item_shape;
+}
+
+void dataset__init_stream( DataSet *dataset, VALUE source, int input_rank, int *input_shape,
+      int output_rank, int *output_shape, int capacity, int repeat ) {
+  DataSetStream *stream = ALLOC( DataSetStream );
+
+  stream->source = source;
+  stream->from_io = rb_respond_to( source, rb_intern( "read" ) );
+  stream->repeat = repeat;
+  stream->capacity = capacity;
+  stream->count = 0;
+  dataset->stream = stream;
+
+  dataset->input_item_rank = input_rank;
+  dataset->input_item_shape = dataset_stream_shape( input_rank, input_shape, capacity, &dataset->input_item_size );
+  dataset->output_item_rank = output_rank;
+  dataset->output_item_shape = dataset_stream_shape( output_rank, output_shape, capacity, &dataset->output_item_size );
+
+  dataset->inputs = ALLOC_N( float, (size_t) ( capacity + 1 ) * dataset->input_item_size );
+  dataset->outputs = ALLOC_N( float, (size_t) ( capacity + 1 ) * dataset->output_item_size );
+  memset( dataset->inputs, 0, (size_t) ( capacity + 1 ) * dataset->input_item_size * sizeof(float) );
+  memset( dataset->outputs, 0, (size_t) ( capacity + 1 ) * dataset->output_item_size * sizeof(float) );
+  dataset->raw_inputs = dataset->inputs;
+  dataset->input_type = DATASET_INPUT_SFLOAT;
+
+  // The current item is always the extra slot
+  dataset->pos_idx = ALLOC_N( int, 1 );
+  dataset->pos_idx[0] = capacity;
+  dataset->current_pos = 0;
+  dataset->num_items = 0;
+  return;
+}
+
+static VALUE dataset_stream_call_next( VALUE source ) {
+  return rb_funcall( source, rb_intern( "next" ), 0 );
+}
+
+static VALUE dataset_stream_stopped( VALUE data, VALUE error ) {
+  return Qundef;
+}
+
+static void dataset_stream_copy_value( VALUE rv_value, const char *name, int size, float *dst ) {
+  volatile VALUE val_value = na_cast_object( rv_value, NA_SFLOAT );
+  struct NARRAY *narr;
+
+  GetNArray( val_value, narr );
+  if ( narr->total != size ) {
+    rb_raise( rb_eArgError, "Streamed %s has %d values, expected %d", name, narr->total, size );
+  }
+  memcpy( dst, (float*) narr->ptr, size * sizeof(float) );
+  return;
+}
+
+// Reads one item into the given slot, returning 0 at the end of the source. An IO supplies
+// native sfloat input values followed by output values, an enumerator supplies
+// [ input, output ] pairs of Arrays or NArrays.
+static int dataset_stream_read_item( DataSet *dataset, int slot ) {
+  DataSetStream *stream = dataset->stream;
+  float *input = dataset->inputs + (size_t) slot * dataset->input_item_size;
+  float *output = dataset->outputs + (size_t) slot * dataset->output_item_size;
+  long in_bytes = dataset->input_item_size * sizeof(float);
+  long out_bytes = dataset->output_item_size * sizeof(float);
+  volatile VALUE rv_item;
+
+  if ( stream->from_io ) {
+    rv_item = rb_funcall( stream->source, rb_intern( "read" ), 1, LONG2NUM( in_bytes + out_bytes ) );
+    if ( NIL_P( rv_item ) || RSTRING_LEN( rv_item ) == 0 ) {
+      return 0;
+    }
+    StringValue( rv_item );
+    if ( RSTRING_LEN( rv_item ) != in_bytes + out_bytes ) {
+      rb_raise( rb_eIOError, "Stream ended part way through an item" );
+    }
+    memcpy( input, RSTRING_PTR( rv_item ), in_bytes );
+    memcpy( output, RSTRING_PTR( rv_item ) + in_bytes, out_bytes );
+    return 1;
+  }
+
+  rv_item = rb_rescue2( dataset_stream_call_next, stream->source, dataset_stream_stopped, Qnil,
+      rb_eStopIteration, (VALUE) 0 );
+  if ( rv_item == Qundef ) {
+    return 0;
+  }
+  Check_Type( rv_item, T_ARRAY );
+  if ( RARRAY_LEN( rv_item ) != 2 ) {
+    rb_raise( rb_eArgError, "Streamed item should be [ input, output ]" );
+  }
+  dataset_stream_copy_value( rb_ary_entry( rv_item, 0 ), "input", dataset->input_item_size, input );
+  dataset_stream_copy_value( rb_ary_entry( rv_item, 1 ), "output", dataset->output_item_size, output );
+  return 1;
+}
+
+// Reads from the source until the buffer is full, or the source ends. A repeating stream
+// rewinds its source once at the end. Returns the number of items buffered.
+int dataset__stream_fill( DataSet *dataset ) {
+  DataSetStream *stream = dataset->stream;
+  int rewound = 0;
+
+  while ( stream->count < stream->capacity ) {
+    if ( dataset_stream_read_item( dataset, stream->count ) ) {
+      stream->count++;
+      rewound = 0;
+      continue;
+    }
+    if ( ! stream->repeat || rewound ) {
+      break;
+    }
+    rb_funcall( stream->source, rb_intern( "rewind" ), 0 );
+    rewound = 1;
+  }
+
+  dataset->num_items = stream->count;
+  return stream->count;
+}
+
+// Fills the buffer ready to take a batch, and returns how many items the batch can have, which
+// is fewer than batch_size only at the end of the source. Raises StopIteration once all items
+// have been taken.
+int dataset__stream_prepare_batch( DataSet *dataset, int batch_size ) {
+  if ( batch_size > dataset->stream->capacity ) {
+    rb_raise( rb_eArgError, "batch_size %d is larger than stream buffer_size %d",
+        batch_size, dataset->stream->capacity );
+  }
+  if ( dataset__stream_fill( dataset ) == 0 ) {
+    rb_raise( rb_eStopIteration, "Streaming DataSet has no more items" );
+  }
+  return batch_size < dataset->stream->count ? batch_size : dataset->stream->count;
+}
+
+// Moves a random buffered item into the current slot, and closes the gap with the last buffered
+// item
+static void dataset_stream_take( DataSet *dataset ) {
+  DataSetStream *stream = dataset->stream;
+  int r, last, in_size = dataset->input_item_size, out_size = dataset->output_item_size;
+  float *inputs = dataset->inputs, *outputs = dataset->outputs;
+
+  if ( stream->count == 0 ) {
+    return;
+  }
+  r = genrand_int31() % stream->count;
+  last = stream->count - 1;
+
+  memcpy( inputs + (size_t) stream->capacity * in_size, inputs + (size_t) r * in_size, in_size * sizeof(float) );
+  memcpy( outputs + (size_t) stream->capacity * out_size, outputs + (size_t) r * out_size, out_size * sizeof(float) );
+  if ( r != last ) {
+    memcpy( inputs + (size_t) r * in_size, inputs + (size_t) last * in_size, in_size * sizeof(float) );
+    memcpy( outputs + (size_t) r * out_size, outputs + (size_t) last * out_size, out_size * sizeof(float) );
+  }
+
+  stream->count = last;
+  dataset->num_items = last;
+  return;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Sparse inputs. Items are rows of a CSR matrix, which training copies into batches of rows
+//  without expanding them
+//
+
+// row_ptr and col_idx must be int NArrays, values and outputs sfloat NArrays, already checked
+// for consistent sizes and column range
+void dataset__init_from_csr( DataSet *dataset, VALUE row_ptr, VALUE col_idx, VALUE values,
+      int num_inputs, VALUE outputs ) {
+  struct NARRAY *narr;
+  int i, num_items;
+
+  GetNArray( row_ptr, narr );
+  num_items = narr->total - 1;
+  dataset->csr.row_ptr = (int*) narr->ptr;
+  GetNArray( col_idx, narr );
+  dataset->csr.col_idx = (int*) narr->ptr;
+  GetNArray( values, narr );
+  dataset->csr.values = (float*) narr->ptr;
+  dataset->narr_csr = rb_ary_new3( 3, row_ptr, col_idx, values );
+
+  dataset->input_item_rank = 1;
+  dataset->input_item_size = num_inputs;
+  dataset->input_item_shape = ALLOC_N( int, 2 );
+  dataset->input_item_shape[0] = num_inputs;
+  dataset->input_item_shape[1] = num_items;
+  dataset__init_input_storage( dataset, DATASET_INPUT_CSR, NULL );
+
+  GetNArray( outputs, narr );
+  dataset->narr_outputs = outputs;
+  dataset->outputs = (float*) narr->ptr;
+  dataset->output_item_rank = narr->rank - 1;
+  dataset->output_item_size = 1;
+  dataset->output_item_shape = ALLOC_N( int, narr->rank );
+  for ( i = 0; i < narr->rank; i++ ) {
+    dataset->output_item_shape[i] = narr->shape[i];
+    if ( i < dataset->output_item_rank ) {
+      dataset->output_item_size *= narr->shape[i];
+    }
+  }
+
+  dataset->num_items = num_items;
+  dataset->pos_idx = ALLOC_N( int, num_items );
+  for ( i = 0; i < num_items; i++ ) {
+    dataset->pos_idx[i] = i;
+  }
+  dataset->current_pos = num_items - 1;
+  return;
+}
+
+static void dataset_csr_expand( DataSet *dataset, int item, float *dst ) {
+  int k, row = dataset_storage_item( dataset, item );
+
+  memset( dst, 0, dataset->input_item_size * sizeof(float) );
+  for ( k = dataset->csr.row_ptr[row]; k < dataset->csr.row_ptr[row + 1]; k++ ) {
+    dst[ dataset->csr.col_idx[k] ] = dataset->csr.values[k];
+  }
+  return;
+}
+
+static inline int dataset_csr_nnz( DataSet *dataset, int item ) {
+  int row = dataset_storage_item( dataset, item );
+  return dataset->csr.row_ptr[row + 1] - dataset->csr.row_ptr[row];
+}
+
+// Most non-zero values that any num_items items can have between them, allowing for a batch
+// that wraps around to the start of the dataset again
+int dataset__max_csr_nnz( DataSet *dataset, int num_items ) {
+  int i, nnz, max_nnz = 0;
+  long total_nnz = 0;
+
+  for ( i = 0; i < dataset->num_items; i++ ) {
+    nnz = dataset_csr_nnz( dataset, i );
+    max_nnz = nnz > max_nnz ? nnz : max_nnz;
+    total_nnz += nnz;
+  }
+
+  if ( num_items <= dataset->num_items && total_nnz < (long) max_nnz * num_items ) {
+    return (int) total_nnz;
+  }
+  return max_nnz * num_items;
+}
+
+// Adds item as the next row of inputs, which has num_rows rows already. This runs without the
+// GVL, so inputs must already have room, from dataset__max_csr_nnz.
+static void dataset_csr_append( DataSet *dataset, int item, CSRBuffer *inputs, int num_rows ) {
+  int row = dataset_storage_item( dataset, item );
+  int start = dataset->csr.row_ptr[row], nnz = dataset->csr.row_ptr[row + 1] - start;
+  int pos = num_rows > 0 ? inputs->rows.row_ptr[num_rows] : 0;
+
+  inputs->rows.row_ptr[0] = 0;
+  memcpy( inputs->rows.col_idx + pos, dataset->csr.col_idx + start, nnz * sizeof(int) );
+  memcpy( inputs->rows.values + pos, dataset->csr.values + start, nnz * sizeof(float) );
+  inputs->rows.row_ptr[num_rows + 1] = pos + nnz;
+  return;
+}
+
+// As dataset__gather_batch, with inputs as sparse rows
+void dataset__gather_batch_csr( DataSet *dataset, int num_items, CSRBuffer *inputs, float *outputs ) {
+  int i, out_size = dataset->output_item_size;
+
+  for ( i = 0; i < num_items; i++ ) {
+    dataset_csr_append( dataset, dataset->pos_idx[ dataset->current_pos ], inputs, i );
+    memcpy( outputs + (size_t) i * out_size, dataset__current_output( dataset ), out_size * sizeof(float) );
+    dataset__next( dataset );
+  }
+
+  return;
+}
+
+// As dataset__stored_inputs, with inputs as sparse rows
+void dataset__stored_csr( DataSet *dataset, int start_item, int num_items, CSRBuffer *inputs ) {
+  int i;
+
+  for ( i = 0; i < num_items; i++ ) {
+    dataset_csr_append( dataset, start_item + i, inputs, i );
+  }
+
+  return;
+}
+
+void dataset__check_not_busy( DataSet *dataset ) {
+  if ( dataset->busy ) {
+    rb_raise( rb_eRuntimeError, "DataSet is already in use by another thread" );
+  }
+  return;
+}
+
+void dataset__start_busy( DataSet *dataset ) {
+  dataset__check_not_busy( dataset );
+  dataset->busy = 1;
+  return;
+}
+
+void dataset__end_busy( DataSet *dataset ) {
+  dataset->busy = 0;
+  return;
+}
@@ -12,6 +12,56 @@
 #include "narray.h"
 #include "core_narray.h"
 #include "core_shuffle.h"
+#include "core_float16.h"
+#include "core_sparse.h"
+#include "core_parallel.h"
+
+#include <stdint.h>
+
+// Inputs may be stored compactly, and are then widened to float as items are read, as
+// stored_value * input_scale + input_offset, with scale and offset per input feature. Inputs
+// that are mostly zero may be stored as sparse rows instead, which training reads directly.
+// Outputs are always stored as float.
+typedef enum {
+  DATASET_INPUT_SFLOAT = 0,
+  DATASET_INPUT_BYTE = 1,
+  DATASET_INPUT_FLOAT16 = 2,
+  DATASET_INPUT_CSR = 3
+} dataset_input_type;
+
+// Binary file format that DataSet can save to and memory-map from. The header is followed by
+// input scales then offsets (compact input types only), all input items, then all output items,
+// each starting at an offset aligned to DATASET_FILE_ALIGN
+#define DATASET_FILE_MAGIC "RuNeNeDS"
+#define DATASET_FILE_VERSION 1
+#define DATASET_FILE_MAX_RANK 8
+#define DATASET_FILE_ALIGN 64
+
+typedef struct _dataset_file_header {
+    char magic[8];
+    int32_t version;
+    int32_t input_type;
+    int32_t num_items;
+    int32_t input_item_rank;
+    int32_t output_item_rank;
+    int32_t input_item_shape[DATASET_FILE_MAX_RANK];
+    int32_t output_item_shape[DATASET_FILE_MAX_RANK];
+    int32_t reserved;
+    int64_t inputs_offset;
+    int64_t outputs_offset;
+    int64_t input_transform_offset;
+  } DataSetFileHeader;
+
+// A streaming DataSet reads items from a Ruby IO or enumerator into a fixed-size buffer, and
+// serves them in random order from within the buffer. The buffer has one extra slot, after
+// capacity, which holds the current item.
+typedef struct _dataset_stream {
+    volatile VALUE source;
+    int from_io;
+    int repeat;
+    int capacity;
+    int count;
+  } DataSetStream;
 
 typedef struct _dataset_raw {
     int input_item_size;
@@ -22,11 +72,26 @@ typedef struct _dataset_raw {
     int *output_item_shape;
     int *pos_idx;
     int current_pos;
+    int shuffle_block_size;
     int num_items;
     volatile VALUE narr_inputs;
     volatile VALUE narr_outputs;
+    dataset_input_type input_type;
+    void *raw_inputs;
+    float *input_scale;
+    float *input_offset;
+    float *decoded_input;
     float *inputs;
     float *outputs;
+    volatile VALUE mmap_path;
+    void *mmap_addr;
+    size_t mmap_length;
+    volatile VALUE view_of;
+    int *item_idx;
+    DataSetStream *stream;
+    CSRRows csr;
+    volatile VALUE narr_csr;
+    int busy;
   } DataSet;
 
 DataSet *dataset__create();
@@ -40,6 +105,29 @@ float *dataset__current_output( DataSet *dataset );
 
 void dataset__next( DataSet *dataset );
 
+void dataset__shuffle( DataSet *dataset );
+
+void dataset__gather_batch( DataSet *dataset, int num_items, float *inputs, float *outputs );
+
+void dataset__gather_batch_csr( DataSet *dataset, int num_items, CSRBuffer *inputs, float *outputs );
+
+void dataset__stored_csr( DataSet *dataset, int start_item, int num_items, CSRBuffer *inputs );
+
+int dataset__max_csr_nnz( DataSet *dataset, int num_items );
+
+void dataset__init_from_csr( DataSet *dataset, VALUE row_ptr, VALUE col_idx, VALUE values,
+      int num_inputs, VALUE outputs );
+
+float *dataset__stored_inputs( DataSet *dataset, int start_item, int num_items, float *buffer );
+
+float *dataset__stored_output( DataSet *dataset, int item );
+
+void dataset__init_view( DataSet *view, DataSet *parent, VALUE rv_parent, int num_items, int *indices );
+
+int dataset__input_type_size( dataset_input_type input_type );
+
+void dataset__set_input_transform( DataSet *dataset, float *scale, float *offset );
+
 void dataset__init_from_narray( DataSet *dataset, VALUE inputs, VALUE outputs );
 
 void dataset__destroy( DataSet *dataset );
@@ -48,4 +136,24 @@ void dataset__gc_mark( DataSet *dataset );
 
 void dataset__reinit( DataSet *dataset );
 
+void dataset__init_from_file( DataSet *dataset, VALUE path );
+
+void dataset__write_file( DataSet *dataset, const char *path );
+
+void dataset__init_stream( DataSet *dataset, VALUE source, int input_rank, int *input_shape,
+      int output_rank, int *output_shape, int capacity, int repeat );
+
+int dataset__stream_fill( DataSet *dataset );
+
+int dataset__stream_prepare_batch( DataSet *dataset, int batch_size );
+
+// Marks the DataSet as being trained on by a call that releases the GVL, raising RuntimeError if
+// it already is, so that a second thread cannot move its position or refill it meanwhile
+void dataset__start_busy( DataSet *dataset );
+
+void dataset__end_busy( DataSet *dataset );
+
+// Raises RuntimeError if the DataSet is marked by dataset__start_busy
+void dataset__check_not_busy( DataSet *dataset );
+
 #endif
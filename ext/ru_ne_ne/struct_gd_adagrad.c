@@ -0,0 +1,87 @@
+// ext/ru_ne_ne/struct_gd_adagrad.c
+
+#include "struct_gd_adagrad.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Definitions for GradientDescent_AdaGrad memory management
+//
+
+GradientDescent_AdaGrad *gd_adagrad__create() {
+  GradientDescent_AdaGrad *gd_adagrad;
+  gd_adagrad = xmalloc( sizeof(GradientDescent_AdaGrad) );
+  gd_adagrad->num_params = 0;
+  gd_adagrad->epsilon = 1.0e-6;
+  gd_adagrad->narr_sum_squared_grads = Qnil;
+  gd_adagrad->sum_squared_grads = NULL;
+  return gd_adagrad;
+}
+
+void gd_adagrad__init( GradientDescent_AdaGrad *gd_adagrad, VALUE example_params, float epsilon ) {
+  int i;
+  struct NARRAY *narr;
+  float *narr_sum_squared_grads_ptr;
+
+  gd_adagrad->epsilon = epsilon;
+
+  gd_adagrad->narr_sum_squared_grads = na_clone( example_params );
+  GetNArray( gd_adagrad->narr_sum_squared_grads, narr );
+  narr_sum_squared_grads_ptr = (float*) narr->ptr;
+  for( i = 0; i < narr->total; i++ ) {
+    narr_sum_squared_grads_ptr[i] = 0.0;
+  }
+  gd_adagrad->sum_squared_grads = (float *) narr->ptr;
+  gd_adagrad->num_params = narr->total;
+
+  return;
+}
+
+void gd_adagrad__destroy( GradientDescent_AdaGrad *gd_adagrad ) {
+  xfree( gd_adagrad );
+  return;
+}
+
+void gd_adagrad__gc_mark( GradientDescent_AdaGrad *gd_adagrad ) {
+  rb_gc_mark( gd_adagrad->narr_sum_squared_grads );
+  return;
+}
+
+void gd_adagrad__deep_copy( GradientDescent_AdaGrad *gd_adagrad_copy, GradientDescent_AdaGrad *gd_adagrad_orig ) {
+  struct NARRAY *narr;
+
+  gd_adagrad_copy->num_params = gd_adagrad_orig->num_params;
+  gd_adagrad_copy->epsilon = gd_adagrad_orig->epsilon;
+
+  gd_adagrad_copy->narr_sum_squared_grads = na_clone( gd_adagrad_orig->narr_sum_squared_grads );
+  GetNArray( gd_adagrad_copy->narr_sum_squared_grads, narr );
+  gd_adagrad_copy->sum_squared_grads = (float *) narr->ptr;
+
+  return;
+}
+
+GradientDescent_AdaGrad * gd_adagrad__clone( GradientDescent_AdaGrad *gd_adagrad_orig ) {
+  GradientDescent_AdaGrad * gd_adagrad_copy = gd_adagrad__create();
+  gd_adagrad__deep_copy( gd_adagrad_copy, gd_adagrad_orig );
+  return gd_adagrad_copy;
+}
+
+int gd_adagrad__arena_size( GradientDescent_AdaGrad *gd_adagrad ) {
+  return na_arena_block_size( gd_adagrad->num_params );
+}
+
+// State is copied into the arena, starting offset floats in. Returns offset for next block.
+int gd_adagrad__move_to_arena( GradientDescent_AdaGrad *gd_adagrad, VALUE narr_arena, int offset ) {
+  gd_adagrad->narr_sum_squared_grads = na_arena_move( narr_arena, offset, gd_adagrad->narr_sum_squared_grads );
+  gd_adagrad->sum_squared_grads = na_arena_ptr( narr_arena ) + offset;
+  return offset + gd_adagrad__arena_size( gd_adagrad );
+}
+
+void gd_adagrad__pre_gradient_step( GradientDescent_AdaGrad *gd_adagrad, float *params, float lr ) {
+  return;
+}
+
+void gd_adagrad__gradient_step( GradientDescent_AdaGrad *gd_adagrad, float *params, float *gradients, float lr ) {
+  optimiser_adagrad_step( gd_adagrad->num_params, params, gradients, gd_adagrad->sum_squared_grads,
+      lr, 0.0, gd_adagrad->epsilon );
+  return;
+}
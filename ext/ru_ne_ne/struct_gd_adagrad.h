@@ -0,0 +1,43 @@
+// ext/ru_ne_ne/struct_gd_adagrad.h
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Definition for GradientDescent_AdaGrad and declarations for its memory management
+//
+
+#ifndef STRUCT_GD_ADAGRAD_H
+#define STRUCT_GD_ADAGRAD_H
+
+#include <ruby.h>
+#include "narray.h"
+#include "core_optimiser.h"
+#include "core_narray.h"
+
+typedef struct _gd_adagrad_raw {
+  int num_params;
+  float epsilon;
+  volatile VALUE narr_sum_squared_grads;
+  float *sum_squared_grads;
+  } GradientDescent_AdaGrad;
+
+GradientDescent_AdaGrad *gd_adagrad__create();
+
+void gd_adagrad__init( GradientDescent_AdaGrad *gd_adagrad, VALUE example_params, float epsilon );
+
+void gd_adagrad__destroy( GradientDescent_AdaGrad *gd_adagrad );
+
+void gd_adagrad__gc_mark( GradientDescent_AdaGrad *gd_adagrad );
+
+void gd_adagrad__deep_copy( GradientDescent_AdaGrad *gd_adagrad_copy, GradientDescent_AdaGrad *gd_adagrad_orig );
+
+GradientDescent_AdaGrad * gd_adagrad__clone( GradientDescent_AdaGrad *gd_adagrad_orig );
+
+int gd_adagrad__arena_size( GradientDescent_AdaGrad *gd_adagrad );
+
+int gd_adagrad__move_to_arena( GradientDescent_AdaGrad *gd_adagrad, VALUE narr_arena, int offset );
+
+void gd_adagrad__pre_gradient_step( GradientDescent_AdaGrad *gd_adagrad, float *params, float lr );
+
+void gd_adagrad__gradient_step( GradientDescent_AdaGrad *gd_adagrad, float *params, float *gradients, float lr );
+
+#endif
@@ -0,0 +1,123 @@
+// ext/ru_ne_ne/struct_gd_adam.c
+
+#include "struct_gd_adam.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Definitions for GradientDescent_Adam memory management
+//
+
+GradientDescent_Adam *gd_adam__create() {
+  GradientDescent_Adam *gd_adam;
+  gd_adam = xmalloc( sizeof(GradientDescent_Adam) );
+  gd_adam->num_params = 0;
+  gd_adam->beta1 = 0.9;
+  gd_adam->beta2 = 0.999;
+  gd_adam->epsilon = 1.0e-8;
+  gd_adam->num_steps = 0;
+  gd_adam->narr_first_moment = Qnil;
+  gd_adam->first_moment = NULL;
+  gd_adam->narr_second_moment = Qnil;
+  gd_adam->second_moment = NULL;
+  return gd_adam;
+}
+
+void gd_adam__init( GradientDescent_Adam *gd_adam, VALUE example_params, float beta1, float beta2, float epsilon ) {
+  int i;
+  struct NARRAY *narr;
+  float *narr_moment_ptr;
+
+  gd_adam->beta1 = beta1;
+  gd_adam->beta2 = beta2;
+  gd_adam->epsilon = epsilon;
+  gd_adam->num_steps = 0;
+
+  gd_adam->narr_first_moment = na_clone( example_params );
+  GetNArray( gd_adam->narr_first_moment, narr );
+  narr_moment_ptr = (float*) narr->ptr;
+  for( i = 0; i < narr->total; i++ ) {
+    narr_moment_ptr[i] = 0.0;
+  }
+  gd_adam->first_moment = (float *) narr->ptr;
+
+  gd_adam->narr_second_moment = na_clone( example_params );
+  GetNArray( gd_adam->narr_second_moment, narr );
+  narr_moment_ptr = (float*) narr->ptr;
+  for( i = 0; i < narr->total; i++ ) {
+    narr_moment_ptr[i] = 0.0;
+  }
+  gd_adam->second_moment = (float *) narr->ptr;
+  gd_adam->num_params = narr->total;
+
+  return;
+}
+
+void gd_adam__destroy( GradientDescent_Adam *gd_adam ) {
+  xfree( gd_adam );
+  return;
+}
+
+void gd_adam__gc_mark( GradientDescent_Adam *gd_adam ) {
+  rb_gc_mark( gd_adam->narr_first_moment );
+  rb_gc_mark( gd_adam->narr_second_moment );
+  return;
+}
+
+void gd_adam__deep_copy( GradientDescent_Adam *gd_adam_copy, GradientDescent_Adam *gd_adam_orig ) {
+  struct NARRAY *narr;
+
+  gd_adam_copy->num_params = gd_adam_orig->num_params;
+  gd_adam_copy->beta1 = gd_adam_orig->beta1;
+  gd_adam_copy->beta2 = gd_adam_orig->beta2;
+  gd_adam_copy->epsilon = gd_adam_orig->epsilon;
+  gd_adam_copy->num_steps = gd_adam_orig->num_steps;
+
+  gd_adam_copy->narr_first_moment = na_clone( gd_adam_orig->narr_first_moment );
+  GetNArray( gd_adam_copy->narr_first_moment, narr );
+  gd_adam_copy->first_moment = (float *) narr->ptr;
+
+  gd_adam_copy->narr_second_moment = na_clone( gd_adam_orig->narr_second_moment );
+  GetNArray( gd_adam_copy->narr_second_moment, narr );
+  gd_adam_copy->second_moment = (float *) narr->ptr;
+
+  return;
+}
+
+GradientDescent_Adam * gd_adam__clone( GradientDescent_Adam *gd_adam_orig ) {
+  GradientDescent_Adam * gd_adam_copy = gd_adam__create();
+  gd_adam__deep_copy( gd_adam_copy, gd_adam_orig );
+  return gd_adam_copy;
+}
+
+int gd_adam__arena_size( GradientDescent_Adam *gd_adam ) {
+  return 2 * na_arena_block_size( gd_adam->num_params );
+}
+
+// State is copied into the arena, starting offset floats in. Returns offset for next block.
+int gd_adam__move_to_arena( GradientDescent_Adam *gd_adam, VALUE narr_arena, int offset ) {
+  gd_adam->narr_first_moment = na_arena_move( narr_arena, offset, gd_adam->narr_first_moment );
+  gd_adam->first_moment = na_arena_ptr( narr_arena ) + offset;
+  offset += na_arena_block_size( gd_adam->num_params );
+
+  gd_adam->narr_second_moment = na_arena_move( narr_arena, offset, gd_adam->narr_second_moment );
+  gd_adam->second_moment = na_arena_ptr( narr_arena ) + offset;
+  return offset + na_arena_block_size( gd_adam->num_params );
+}
+
+// Counts one more step, and returns the learning rate with the bias corrections for moments
+// that started at zero. Callers that update params in several blocks should call this once.
+float gd_adam__start_step( GradientDescent_Adam *gd_adam, float lr ) {
+  gd_adam->num_steps++;
+  return lr * sqrt( 1.0 - pow( gd_adam->beta2, gd_adam->num_steps ) ) /
+      ( 1.0 - pow( gd_adam->beta1, gd_adam->num_steps ) );
+}
+
+void gd_adam__pre_gradient_step( GradientDescent_Adam *gd_adam, float *params, float lr ) {
+  return;
+}
+
+void gd_adam__gradient_step( GradientDescent_Adam *gd_adam, float *params, float *gradients, float lr ) {
+  optimiser_adam_step( gd_adam->num_params, params, gradients, gd_adam->first_moment, gd_adam->second_moment,
+      gd_adam__start_step( gd_adam, lr ), 0.0, gd_adam->beta1, gd_adam->beta2, gd_adam->epsilon );
+  return;
+}
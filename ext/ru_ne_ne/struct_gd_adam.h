@@ -0,0 +1,51 @@
+// ext/ru_ne_ne/struct_gd_adam.h
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Definition for GradientDescent_Adam and declarations for its memory management
+//
+
+#ifndef STRUCT_GD_ADAM_H
+#define STRUCT_GD_ADAM_H
+
+#include <ruby.h>
+#include <math.h>
+#include "narray.h"
+#include "core_optimiser.h"
+#include "core_narray.h"
+
+typedef struct _gd_adam_raw {
+  int num_params;
+  float beta1;
+  float beta2;
+  float epsilon;
+  int num_steps;
+  volatile VALUE narr_first_moment;
+  float *first_moment;
+  volatile VALUE narr_second_moment;
+  float *second_moment;
+  } GradientDescent_Adam;
+
+GradientDescent_Adam *gd_adam__create();
+
+void gd_adam__init( GradientDescent_Adam *gd_adam, VALUE example_params, float beta1, float beta2, float epsilon );
+
+void gd_adam__destroy( GradientDescent_Adam *gd_adam );
+
+void gd_adam__gc_mark( GradientDescent_Adam *gd_adam );
+
+void gd_adam__deep_copy( GradientDescent_Adam *gd_adam_copy, GradientDescent_Adam *gd_adam_orig );
+
+GradientDescent_Adam * gd_adam__clone( GradientDescent_Adam *gd_adam_orig );
+
+int gd_adam__arena_size( GradientDescent_Adam *gd_adam );
+
+int gd_adam__move_to_arena( GradientDescent_Adam *gd_adam, VALUE narr_arena, int offset );
+
+float gd_adam__start_step( GradientDescent_Adam *gd_adam, float lr );
+
+void gd_adam__pre_gradient_step( GradientDescent_Adam *gd_adam, float *params, float lr );
+
+void gd_adam__gradient_step( GradientDescent_Adam *gd_adam, float *params, float *gradients, float lr );
+
+#endif
@@ -65,6 +65,17 @@ GradientDescent_NAG * gd_nag__clone( GradientDescent_NAG *gd_nag_orig ) {
   return gd_nag_copy;
 }
 
+int gd_nag__arena_size( GradientDescent_NAG *gd_nag ) {
+  return na_arena_block_size( gd_nag->num_params );
+}
+
+// State is copied into the arena, starting offset floats in. Returns offset for next block.
+int gd_nag__move_to_arena( GradientDescent_NAG *gd_nag, VALUE narr_arena, int offset ) {
+  gd_nag->narr_param_update_velocity = na_arena_move( narr_arena, offset, gd_nag->narr_param_update_velocity );
+  gd_nag->param_update_velocity = na_arena_ptr( narr_arena ) + offset;
+  return offset + gd_nag__arena_size( gd_nag );
+}
+
 void gd_nag__pre_gradient_step( GradientDescent_NAG *gd_nag, float *params, float lr ) {
   // For Nesterov momentum, we take a step here
   int i;
@@ -77,12 +88,6 @@ void gd_nag__pre_gradient_step( GradientDescent_NAG *gd_nag, float *params, floa
 }
 
 void gd_nag__gradient_step( GradientDescent_NAG *gd_nag, float *params, float *gradients, float lr ) {
-  int i;
-  float u;
-  for( i = 0; i < gd_nag->num_params; i++ ) {
-    u = lr * gradients[i];
-    gd_nag->param_update_velocity[i] -= u;
-    params[i] -= u;
-  }
+  optimiser_nag_step( gd_nag->num_params, params, gradients, gd_nag->param_update_velocity, lr, 0.0 );
   return;
 }
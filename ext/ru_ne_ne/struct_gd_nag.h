@@ -10,6 +10,8 @@
 
 #include <ruby.h>
 #include "narray.h"
+#include "core_optimiser.h"
+#include "core_narray.h"
 
 typedef struct _gd_nag_raw {
   int num_params;
@@ -30,6 +32,10 @@ void gd_nag__deep_copy( GradientDescent_NAG *gd_nag_copy, GradientDescent_NAG *g
 
 GradientDescent_NAG * gd_nag__clone( GradientDescent_NAG *gd_nag_orig );
 
+int gd_nag__arena_size( GradientDescent_NAG *gd_nag );
+
+int gd_nag__move_to_arena( GradientDescent_NAG *gd_nag, VALUE narr_arena, int offset );
+
 void gd_nag__pre_gradient_step( GradientDescent_NAG *gd_nag, float *params, float lr );
 
 void gd_nag__gradient_step( GradientDescent_NAG *gd_nag, float *params, float *gradients, float lr );
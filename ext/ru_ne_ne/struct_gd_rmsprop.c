@@ -69,16 +69,23 @@ GradientDescent_RMSProp * gd_rmsprop__clone( GradientDescent_RMSProp *gd_rmsprop
   return gd_rmsprop_copy;
 }
 
+int gd_rmsprop__arena_size( GradientDescent_RMSProp *gd_rmsprop ) {
+  return na_arena_block_size( gd_rmsprop->num_params );
+}
+
+// State is copied into the arena, starting offset floats in. Returns offset for next block.
+int gd_rmsprop__move_to_arena( GradientDescent_RMSProp *gd_rmsprop, VALUE narr_arena, int offset ) {
+  gd_rmsprop->narr_av_squared_grads = na_arena_move( narr_arena, offset, gd_rmsprop->narr_av_squared_grads );
+  gd_rmsprop->av_squared_grads = na_arena_ptr( narr_arena ) + offset;
+  return offset + gd_rmsprop__arena_size( gd_rmsprop );
+}
+
 void gd_rmsprop__pre_gradient_step( GradientDescent_RMSProp *gd_rmsprop, float *params, float lr ) {
   return;
 }
 
 void gd_rmsprop__gradient_step( GradientDescent_RMSProp *gd_rmsprop, float *params, float *gradients, float lr ) {
-  int i;
-  float u = 1.0 - gd_rmsprop->decay;
-  for( i = 0; i < gd_rmsprop->num_params; i++ ) {
-    gd_rmsprop->av_squared_grads[i] = ( gd_rmsprop->decay * gd_rmsprop->av_squared_grads[i] ) + u * gradients[i] * gradients[i];
-    params[i] -= lr * gradients[i]/( sqrt( gd_rmsprop->av_squared_grads[i] + gd_rmsprop->epsilon ) );
-  }
+  optimiser_rmsprop_step( gd_rmsprop->num_params, params, gradients, gd_rmsprop->av_squared_grads,
+      lr, 0.0, gd_rmsprop->decay, gd_rmsprop->epsilon );
   return;
 }
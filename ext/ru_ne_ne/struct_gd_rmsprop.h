@@ -10,6 +10,8 @@
 
 #include <ruby.h>
 #include "narray.h"
+#include "core_optimiser.h"
+#include "core_narray.h"
 
 typedef struct _gd_rmsprop_raw {
   int num_params;
@@ -31,6 +33,10 @@ void gd_rmsprop__deep_copy( GradientDescent_RMSProp *gd_rmsprop_copy, GradientDe
 
 GradientDescent_RMSProp * gd_rmsprop__clone( GradientDescent_RMSProp *gd_rmsprop_orig );
 
+int gd_rmsprop__arena_size( GradientDescent_RMSProp *gd_rmsprop );
+
+int gd_rmsprop__move_to_arena( GradientDescent_RMSProp *gd_rmsprop, VALUE narr_arena, int offset );
+
 void gd_rmsprop__pre_gradient_step( GradientDescent_RMSProp *gd_rmsprop, float *params, float lr );
 
 void gd_rmsprop__gradient_step( GradientDescent_RMSProp *gd_rmsprop, float *params, float *gradients, float lr );
@@ -40,8 +40,6 @@ void gd_sgd__pre_gradient_step( GradientDescent_SGD *gd_sgd, float *params, floa
 }
 
 void gd_sgd__gradient_step( GradientDescent_SGD *gd_sgd, float *params, float *gradients, float lr ) {
-  int i;
-  for (i=0; i < gd_sgd->num_params; i++) {
-    params[i] -= lr * gradients[i];
-  }
+  optimiser_sgd_step( gd_sgd->num_params, params, gradients, lr, 0.0 );
+  return;
 }
\ No newline at end of file
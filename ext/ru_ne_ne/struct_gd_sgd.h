@@ -10,6 +10,7 @@
 
 #include <ruby.h>
 #include "narray.h"
+#include "core_optimiser.h"
 
 typedef struct _gd_sgd_raw {
   int num_params;
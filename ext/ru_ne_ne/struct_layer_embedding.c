@@ -0,0 +1,109 @@
+// ext/ru_ne_ne/struct_layer_embedding.c
+
+#include "struct_layer_embedding.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Definitions of OO-style functions for manipulating Layer_Embedding structs
+//
+
+Layer_Embedding *layer_embedding__create() {
+  Layer_Embedding *layer_embedding;
+  layer_embedding = xmalloc( sizeof(Layer_Embedding) );
+  layer_embedding->num_inputs = 0;
+  layer_embedding->num_outputs = 0;
+  layer_embedding->vocab_size = 0;
+  layer_embedding->embed_size = 0;
+  layer_embedding->narr_weights = Qnil;
+  layer_embedding->weights = NULL;
+
+  return layer_embedding;
+}
+
+void layer_embedding__destroy( Layer_Embedding *layer_embedding ) {
+  xfree( layer_embedding );
+  // No need to free NArrays - they will be handled by Ruby's GC, and may still be reachable
+  return;
+}
+
+void layer_embedding__gc_mark( Layer_Embedding *layer_embedding ) {
+  rb_gc_mark( layer_embedding->narr_weights );
+  return;
+}
+
+// Creates the table, one row of embed_size weights for each index
+void layer_embedding__new_narrays( Layer_Embedding *layer_embedding ) {
+  int shape[2];
+  struct NARRAY *narr;
+
+  shape[0] = layer_embedding->embed_size;
+  shape[1] = layer_embedding->vocab_size;
+  layer_embedding->narr_weights = na_make_object( NA_SFLOAT, 2, shape, cNArray );
+  GetNArray( layer_embedding->narr_weights, narr );
+  layer_embedding->weights = (float*) narr->ptr;
+  na_sfloat_set( narr->total, layer_embedding->weights, (float) 0.0 );
+
+  return;
+}
+
+// Each row is drawn from a normal distribution, scaled so that its expected length is 1
+void layer_embedding__init_weights( Layer_Embedding *layer_embedding ) {
+  int i;
+  struct NARRAY *narr;
+  GetNArray( layer_embedding->narr_weights, narr );
+  int t = narr->total;
+
+  double sigma = sqrt( 1.0 / layer_embedding->embed_size );
+  for ( i = 0; i < t; i++ ) {
+    layer_embedding->weights[i] = sigma * genrand_norm();
+  }
+
+  return;
+}
+
+void layer_embedding__set_weights( Layer_Embedding *layer_embedding, VALUE weights ) {
+  struct NARRAY *narr;
+  layer_embedding->narr_weights = weights;
+  GetNArray( layer_embedding->narr_weights, narr );
+  layer_embedding->weights = (float*) narr->ptr;
+  return;
+}
+
+int layer_embedding__arena_size( Layer_Embedding *layer_embedding ) {
+  return na_arena_block_size( layer_embedding->embed_size * layer_embedding->vocab_size );
+}
+
+// Weights are copied into the arena, starting offset floats in. Returns offset for next block.
+int layer_embedding__move_to_arena( Layer_Embedding *layer_embedding, VALUE narr_arena, int offset ) {
+  layer_embedding__set_weights( layer_embedding, na_arena_move( narr_arena, offset, layer_embedding->narr_weights ) );
+  return offset + layer_embedding__arena_size( layer_embedding );
+}
+
+// There is no transfer function, the output is a copy of the selected rows
+void layer_embedding__run( Layer_Embedding *layer_embedding, float *input, float *output ) {
+  int i, row, embed_size = layer_embedding->embed_size;
+
+  for ( i = 0; i < layer_embedding->num_inputs; i++ ) {
+    row = layer_embedding__row( layer_embedding->vocab_size, input[i] );
+    if ( row < 0 ) {
+      memset( output + i * embed_size, 0, embed_size * sizeof(float) );
+    } else {
+      memcpy( output + i * embed_size, layer_embedding->weights + (size_t) row * embed_size,
+          embed_size * sizeof(float) );
+    }
+  }
+
+  return;
+}
+
+// Items in batch are contiguous rows, as for layer_ff__run_batch
+void layer_embedding__run_batch( Layer_Embedding *layer_embedding, int batch_size, float *input, float *output ) {
+  int i;
+
+  for ( i = 0; i < batch_size; i++ ) {
+    layer_embedding__run( layer_embedding, input + (size_t) i * layer_embedding->num_inputs,
+        output + (size_t) i * layer_embedding->num_outputs );
+  }
+
+  return;
+}
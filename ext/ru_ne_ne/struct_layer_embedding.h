@@ -0,0 +1,53 @@
+// ext/ru_ne_ne/struct_layer_embedding.h
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Declarations of OO-style functions for manipulating Layer_Embedding structs
+//
+
+#ifndef STRUCT_LAYER_EMBEDDING_H
+#define STRUCT_LAYER_EMBEDDING_H
+
+#include <ruby.h>
+#include "narray.h"
+#include "mt.h"
+#include "core_narray.h"
+
+// Each input is an index into a table of vocab_size rows, and is replaced by that row of
+// embed_size weights, so num_outputs is num_inputs * embed_size. Indices are read from float
+// inputs, and any outside the table give a row of zeros.
+typedef struct _layer_embedding_raw {
+    int num_inputs;
+    int num_outputs;
+    int vocab_size;
+    int embed_size;
+    volatile VALUE narr_weights;
+    float * weights;
+  } Layer_Embedding;
+
+// Row of the table selected by an input value, or -1 if there is none
+static inline int layer_embedding__row( int vocab_size, float input ) {
+  return ( input >= 0.0 && input < (float) vocab_size ) ? (int) input : -1;
+}
+
+Layer_Embedding *layer_embedding__create();
+
+void layer_embedding__destroy( Layer_Embedding *layer_embedding );
+
+void layer_embedding__gc_mark( Layer_Embedding *layer_embedding );
+
+void layer_embedding__new_narrays( Layer_Embedding *layer_embedding );
+
+void layer_embedding__init_weights( Layer_Embedding *layer_embedding );
+
+void layer_embedding__set_weights( Layer_Embedding *layer_embedding, VALUE weights );
+
+int layer_embedding__arena_size( Layer_Embedding *layer_embedding );
+
+int layer_embedding__move_to_arena( Layer_Embedding *layer_embedding, VALUE narr_arena, int offset );
+
+void layer_embedding__run( Layer_Embedding *layer_embedding, float *input, float *output );
+
+void layer_embedding__run_batch( Layer_Embedding *layer_embedding, int batch_size, float *input, float *output );
+
+#endif
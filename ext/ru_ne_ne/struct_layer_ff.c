@@ -71,37 +71,38 @@ void layer_ff__set_weights( Layer_FF *layer_ff, VALUE weights ) {
   return;
 }
 
-void feed_forward_linear( int in_size, int out_size, float *in_ptr, float *weights, float *out_ptr ) {
-  int i, j, in_aligned_size, offset;
-  __m128 simd_x, simd_y, simd_t;
-  float v[4];
-
-  in_aligned_size = 4 * ( in_size/4 );
-
-  // Calculate activation
-  for ( i = 0; i < out_size; i++ ) {
-
-    float t = 0.0;
-    simd_t = _mm_setzero_ps();
-    offset = i * (in_size + 1);
-
-    // Use SIMD for all the aligned values in groups of 4
-    for ( j = 0; j < in_aligned_size; j +=4 ) {
-      // Unfortunately loadu is required, we just don't know the offset
-      simd_x = _mm_loadu_ps( in_ptr + j );
-      simd_y = _mm_loadu_ps( weights + (offset + j) );
-      simd_x = _mm_mul_ps( simd_x, simd_y );
-      simd_t = _mm_add_ps( simd_x, simd_t );
-    }
-    _mm_store_ps( v, simd_t );
+int layer_ff__arena_size( Layer_FF *layer_ff ) {
+  return na_arena_block_size( ( layer_ff->num_inputs + 1 ) * layer_ff->num_outputs );
+}
 
-    // Complete any remaining 1,2 or 3 items one at a time
-    for ( j = in_aligned_size; j < in_size; j++ ) {
-      t += in_ptr[ j ] * weights[ offset + j ];
-    }
+// Weights are copied into the arena, starting offset floats in. Returns offset for next block.
+int layer_ff__move_to_arena( Layer_FF *layer_ff, VALUE narr_arena, int offset ) {
+  layer_ff__set_weights( layer_ff, na_arena_move( narr_arena, offset, layer_ff->narr_weights ) );
+  return offset + layer_ff__arena_size( layer_ff );
+}
 
-    // Add together 4 simd channels, plus bias
-    out_ptr[i] = v[0] + v[1] + v[2] + v[3] + t + weights[ offset + in_size ];
+// Uses kernels from core_simd.c, which were selected to match the CPU when the extension loaded
+void feed_forward_linear( int in_size, int out_size, float *in_ptr, float *weights, float *out_ptr ) {
+  int i, out_aligned_size, stride = in_size + 1;
+  float *w;
+
+  out_aligned_size = 4 * ( out_size/4 );
+
+  // Four outputs at a time share each load from in_ptr
+  for ( i = 0; i < out_aligned_size; i += 4 ) {
+    w = weights + i * stride;
+    // Start from bias
+    out_ptr[i] = w[in_size];
+    out_ptr[i+1] = w[stride + in_size];
+    out_ptr[i+2] = w[2 * stride + in_size];
+    out_ptr[i+3] = w[3 * stride + in_size];
+    simd_kernels.dot_1x4( in_size, in_ptr, w, w + stride, w + 2 * stride, w + 3 * stride, out_ptr + i );
+  }
+
+  // Complete any remaining 1,2 or 3 outputs one at a time
+  for ( i = out_aligned_size; i < out_size; i++ ) {
+    w = weights + i * stride;
+    out_ptr[i] = simd_kernels.dot( in_size, in_ptr, w ) + w[in_size];
   }
 
   return;
@@ -112,3 +113,73 @@ void layer_ff__run( Layer_FF *layer_ff, float *input, float *output ) {
   transfer_bulk_apply_function( layer_ff->transfer_fn, layer_ff->num_outputs, output );
   return;
 }
+
+// Items in batch are contiguous rows, so in_ptr is [batch_size][in_size] and out_ptr is
+// [batch_size][out_size]
+void feed_forward_linear_batch( int in_size, int out_size, int batch_size, float *in_ptr, float *weights, float *out_ptr ) {
+  int i, j;
+  float *out_row;
+
+  // Start from bias, then accumulate weighted inputs
+  for ( i = 0; i < batch_size; i++ ) {
+    out_row = out_ptr + i * out_size;
+    for ( j = 0; j < out_size; j++ ) {
+      out_row[j] = weights[ j * (in_size + 1) + in_size ];
+    }
+  }
+
+  gemm_abt_accumulate( batch_size, out_size, in_size, in_ptr, in_size, weights, in_size + 1, out_ptr, out_size );
+
+  return;
+}
+
+// Inputs are sparse rows, and only the weights for their non-zero values are read
+void feed_forward_linear_batch_csr( int in_size, int out_size, int batch_size, CSRRows *in,
+      float *weights, float *out_ptr ) {
+  int i, j, k, start, end, stride = in_size + 1;
+  int *cols = in->col_idx;
+  float *vals = in->values, *w, t;
+
+  for ( i = 0; i < batch_size; i++ ) {
+    start = in->row_ptr[i];
+    end = in->row_ptr[i + 1];
+    for ( j = 0; j < out_size; j++ ) {
+      w = weights + (size_t) j * stride;
+      t = w[in_size];
+      for ( k = start; k < end; k++ ) {
+        t += vals[k] * w[ cols[k] ];
+      }
+      out_ptr[ (size_t) i * out_size + j ] = t;
+    }
+  }
+
+  return;
+}
+
+static void layer_ff_transfer_batch( Layer_FF *layer_ff, int batch_size, float *output ) {
+  int i, out_size = layer_ff->num_outputs;
+
+  // Softmax normalises each item separately, all other transfer functions are element-wise
+  if ( layer_ff->transfer_fn == SOFTMAX ) {
+    for ( i = 0; i < batch_size; i++ ) {
+      transfer_bulk_apply_function( SOFTMAX, out_size, output + i * out_size );
+    }
+  } else {
+    transfer_bulk_apply_function( layer_ff->transfer_fn, batch_size * out_size, output );
+  }
+  return;
+}
+
+void layer_ff__run_batch( Layer_FF *layer_ff, int batch_size, float *input, float *output ) {
+  feed_forward_linear_batch( layer_ff->num_inputs, layer_ff->num_outputs, batch_size, input,
+      layer_ff->weights, output );
+  layer_ff_transfer_batch( layer_ff, batch_size, output );
+  return;
+}
+
+void layer_ff__run_batch_csr( Layer_FF *layer_ff, int batch_size, CSRRows *input, float *output ) {
+  feed_forward_linear_batch_csr( layer_ff->num_inputs, layer_ff->num_outputs, batch_size, input,
+      layer_ff->weights, output );
+  layer_ff_transfer_batch( layer_ff, batch_size, output );
+  return;
+}
@@ -12,6 +12,9 @@
 #include "narray.h"
 #include "mt.h"
 #include "core_narray.h"
+#include "core_simd.h"
+#include "core_gemm.h"
+#include "core_sparse.h"
 #include <xmmintrin.h>
 
 #include "ruby_module_transfer.h"
@@ -36,6 +39,14 @@ void layer_ff__init_weights( Layer_FF *layer_ff );
 
 void layer_ff__set_weights( Layer_FF *layer_ff, VALUE weights );
 
+int layer_ff__arena_size( Layer_FF *layer_ff );
+
+int layer_ff__move_to_arena( Layer_FF *layer_ff, VALUE narr_arena, int offset );
+
 void layer_ff__run( Layer_FF *layer_ff, float *input, float *output );
 
+void layer_ff__run_batch( Layer_FF *layer_ff, int batch_size, float *input, float *output );
+
+void layer_ff__run_batch_csr( Layer_FF *layer_ff, int batch_size, CSRRows *input, float *output );
+
 #endif
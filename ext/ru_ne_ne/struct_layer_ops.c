@@ -0,0 +1,199 @@
+// ext/ru_ne_ne/struct_layer_ops.c
+
+#include "struct_layer_ops.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Layer_FF
+//
+
+static int layer_ff_ops__num_inputs( void *layer ) {
+  return ( (Layer_FF *) layer )->num_inputs;
+}
+
+static int layer_ff_ops__num_outputs( void *layer ) {
+  return ( (Layer_FF *) layer )->num_outputs;
+}
+
+static transfer_type layer_ff_ops__transfer( void *layer ) {
+  return ( (Layer_FF *) layer )->transfer_fn;
+}
+
+static int layer_ff_ops__num_params( void *layer ) {
+  Layer_FF *layer_ff = (Layer_FF *) layer;
+  return ( layer_ff->num_inputs + 1 ) * layer_ff->num_outputs;
+}
+
+static float *layer_ff_ops__params( void *layer ) {
+  return ( (Layer_FF *) layer )->weights;
+}
+
+static VALUE layer_ff_ops__narr_params( void *layer ) {
+  return ( (Layer_FF *) layer )->narr_weights;
+}
+
+static void layer_ff_ops__init_params( void *layer ) {
+  layer_ff__init_weights( (Layer_FF *) layer );
+}
+
+static int layer_ff_ops__move_to_arena( void *layer, VALUE narr_arena, int offset ) {
+  return layer_ff__move_to_arena( (Layer_FF *) layer, narr_arena, offset );
+}
+
+static void layer_ff_ops__init_mbgd_layer( void *layer, MBGDLayer *mbgd_layer ) {
+  Layer_FF *layer_ff = (Layer_FF *) layer;
+  mbgd_layer__init( mbgd_layer, layer_ff->num_inputs, layer_ff->num_outputs );
+}
+
+static void layer_ff_ops__forward( void *layer, float *input, float *output ) {
+  layer_ff__run( (Layer_FF *) layer, input, output );
+}
+
+static void layer_ff_ops__forward_batch( void *layer, int batch_size, float *input, float *output ) {
+  layer_ff__run_batch( (Layer_FF *) layer, batch_size, input, output );
+}
+
+static void layer_ff_ops__start_batch( MBGDLayer *mbgd_layer, void *layer, int batch_size, float *inputs ) {
+  mbgd_layer__start_batch( mbgd_layer, (Layer_FF *) layer );
+}
+
+static void layer_ff_ops__backward( MBGDLayer *mbgd_layer, void *layer, int num_items, float *inputs,
+    float *de_dz, float *de_da, float *de_dw, float *workspace ) {
+  mbgd_layer__backprop_batch( mbgd_layer, (Layer_FF *) layer, num_items, inputs, de_dz, de_da, de_dw, workspace );
+}
+
+static void layer_ff_ops__finish_batch( MBGDLayer *mbgd_layer, void *layer ) {
+  mbgd_layer__finish_batch( mbgd_layer, (Layer_FF *) layer );
+}
+
+const LayerOps layer_ff_ops = {
+  "FeedForward",
+  (RUBY_DATA_FUNC) layer_ff__destroy,
+  0,
+  layer_ff_ops__num_inputs,
+  layer_ff_ops__num_outputs,
+  layer_ff_ops__transfer,
+  layer_ff_ops__num_params,
+  layer_ff_ops__params,
+  layer_ff_ops__narr_params,
+  layer_ff_ops__init_params,
+  layer_ff_ops__move_to_arena,
+  layer_ff_ops__init_mbgd_layer,
+  layer_ff_ops__forward,
+  layer_ff_ops__forward_batch,
+  mbgd_layer__batch_scratch_size,
+  layer_ff_ops__start_batch,
+  layer_ff_ops__backward,
+  layer_ff_ops__finish_batch
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Layer_Embedding
+//
+
+static int layer_embedding_ops__num_inputs( void *layer ) {
+  return ( (Layer_Embedding *) layer )->num_inputs;
+}
+
+static int layer_embedding_ops__num_outputs( void *layer ) {
+  return ( (Layer_Embedding *) layer )->num_outputs;
+}
+
+// Rows of the table are output unchanged
+static transfer_type layer_embedding_ops__transfer( void *layer ) {
+  return LINEAR;
+}
+
+static int layer_embedding_ops__num_params( void *layer ) {
+  Layer_Embedding *layer_embedding = (Layer_Embedding *) layer;
+  return layer_embedding->embed_size * layer_embedding->vocab_size;
+}
+
+static float *layer_embedding_ops__params( void *layer ) {
+  return ( (Layer_Embedding *) layer )->weights;
+}
+
+static VALUE layer_embedding_ops__narr_params( void *layer ) {
+  return ( (Layer_Embedding *) layer )->narr_weights;
+}
+
+static void layer_embedding_ops__init_params( void *layer ) {
+  layer_embedding__init_weights( (Layer_Embedding *) layer );
+}
+
+static int layer_embedding_ops__move_to_arena( void *layer, VALUE narr_arena, int offset ) {
+  return layer_embedding__move_to_arena( (Layer_Embedding *) layer, narr_arena, offset );
+}
+
+static void layer_embedding_ops__init_mbgd_layer( void *layer, MBGDLayer *mbgd_layer ) {
+  Layer_Embedding *layer_embedding = (Layer_Embedding *) layer;
+  mbgd_layer__init_embedding( mbgd_layer, layer_embedding->num_inputs, layer_embedding->embed_size,
+      layer_embedding->vocab_size );
+}
+
+static void layer_embedding_ops__forward( void *layer, float *input, float *output ) {
+  layer_embedding__run( (Layer_Embedding *) layer, input, output );
+}
+
+static void layer_embedding_ops__forward_batch( void *layer, int batch_size, float *input, float *output ) {
+  layer_embedding__run_batch( (Layer_Embedding *) layer, batch_size, input, output );
+}
+
+static int layer_embedding_ops__workspace_size( MBGDLayer *mbgd_layer, int num_items ) {
+  return 0;
+}
+
+static void layer_embedding_ops__start_batch( MBGDLayer *mbgd_layer, void *layer, int batch_size, float *inputs ) {
+  mbgd_layer__start_batch_embedding( mbgd_layer, (Layer_Embedding *) layer, batch_size, inputs );
+}
+
+static void layer_embedding_ops__backward( MBGDLayer *mbgd_layer, void *layer, int num_items, float *inputs,
+    float *de_dz, float *de_da, float *de_dw, float *workspace ) {
+  mbgd_layer__backprop_batch_embedding( mbgd_layer, num_items, inputs, de_dz, de_dw );
+}
+
+static void layer_embedding_ops__finish_batch( MBGDLayer *mbgd_layer, void *layer ) {
+  mbgd_layer__finish_batch_embedding( mbgd_layer, (Layer_Embedding *) layer );
+}
+
+const LayerOps layer_embedding_ops = {
+  "Embedding",
+  (RUBY_DATA_FUNC) layer_embedding__destroy,
+  1,
+  layer_embedding_ops__num_inputs,
+  layer_embedding_ops__num_outputs,
+  layer_embedding_ops__transfer,
+  layer_embedding_ops__num_params,
+  layer_embedding_ops__params,
+  layer_embedding_ops__narr_params,
+  layer_embedding_ops__init_params,
+  layer_embedding_ops__move_to_arena,
+  layer_embedding_ops__init_mbgd_layer,
+  layer_embedding_ops__forward,
+  layer_embedding_ops__forward_batch,
+  layer_embedding_ops__workspace_size,
+  layer_embedding_ops__start_batch,
+  layer_embedding_ops__backward,
+  layer_embedding_ops__finish_batch
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const LayerOps *all_layer_ops[] = { &layer_ff_ops, &layer_embedding_ops };
+
+// Returns NULL if layer is not a layer object
+const LayerOps *layer_ops__for_value( VALUE layer ) {
+  int i;
+
+  if ( TYPE(layer) != T_DATA ) {
+    return NULL;
+  }
+  for ( i = 0; i < (int) ( sizeof(all_layer_ops) / sizeof(LayerOps *) ); i++ ) {
+    if ( RDATA(layer)->dfree == all_layer_ops[i]->dfree ) {
+      return all_layer_ops[i];
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,66 @@
+// ext/ru_ne_ne/struct_layer_ops.h
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Declarations of the table of functions that NNModel and MBGD use to run and train a layer,
+//  without knowing which kind of layer struct it is
+//
+
+#ifndef STRUCT_LAYER_OPS_H
+#define STRUCT_LAYER_OPS_H
+
+#include <ruby.h>
+#include "narray.h"
+#include "struct_layer_ff.h"
+#include "struct_layer_embedding.h"
+#include "struct_mbgd_layer.h"
+
+// One of these exists for each kind of layer. The layer argument is the struct wrapped by the
+// Ruby layer object, e.g. a Layer_FF. Functions from forward onwards may be called without the
+// GVL, so must not call Ruby or raise.
+typedef struct _layer_ops {
+    const char *name;
+
+    // Matches dfree of the Ruby object wrapping this kind of layer
+    RUBY_DATA_FUNC dfree;
+
+    // Set if inputs are indices rather than activations. Such a layer can only be first in a
+    // model, and has no de_da for its inputs.
+    int index_inputs;
+
+    int (*num_inputs)( void *layer );
+    int (*num_outputs)( void *layer );
+    transfer_type (*transfer)( void *layer );
+
+    // Parameters are a single block of floats, held in an NArray
+    int (*num_params)( void *layer );
+    float *(*params)( void *layer );
+    VALUE (*narr_params)( void *layer );
+    void (*init_params)( void *layer );
+    int (*move_to_arena)( void *layer, VALUE narr_arena, int offset );
+
+    // Sets up an MBGDLayer with the right shape of de_dw to train this layer
+    void (*init_mbgd_layer)( void *layer, MBGDLayer *mbgd_layer );
+
+    void (*forward)( void *layer, float *input, float *output );
+    void (*forward_batch)( void *layer, int batch_size, float *input, float *output );
+
+    // Number of floats of workspace that backward needs for num_items items
+    int (*workspace_size)( MBGDLayer *mbgd_layer, int num_items );
+
+    void (*start_batch)( MBGDLayer *mbgd_layer, void *layer, int batch_size, float *inputs );
+
+    // Adds gradients for num_items items to de_dw, and writes de_da unless it is NULL
+    void (*backward)( MBGDLayer *mbgd_layer, void *layer, int num_items, float *inputs,
+        float *de_dz, float *de_da, float *de_dw, float *workspace );
+
+    void (*finish_batch)( MBGDLayer *mbgd_layer, void *layer );
+  } LayerOps;
+
+extern const LayerOps layer_ff_ops;
+
+extern const LayerOps layer_embedding_ops;
+
+const LayerOps *layer_ops__for_value( VALUE layer );
+
+#endif
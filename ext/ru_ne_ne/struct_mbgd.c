@@ -1,6 +1,7 @@
 // ext/ru_ne_ne/struct_mbgd.c
 
 #include "struct_mbgd.h"
+#include <unistd.h>
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 //
@@ -11,10 +12,24 @@ MBGD *mbgd__create() {
   MBGD *mbgd;
   mbgd = xmalloc( sizeof(MBGD) );
   mbgd->mbgd_layers = NULL;
+  mbgd->layer_structs = NULL;
   mbgd->num_layers = 0;
   mbgd->num_inputs = 0;
   mbgd->num_outputs = 0;
   mbgd->objective = MSE;
+  mbgd->num_workers = 0;
+  mbgd->workers_dense_inputs = 0;
+  mbgd->workers = NULL;
+  mbgd->last_activations = NULL;
+  mbgd->has_last_activations = 0;
+  mbgd->busy = 0;
+  mbgd->narr_arena = Qnil;
+  mbgd->staging_capacity = 0;
+  mbgd->staging_dense_inputs = 0;
+  mbgd->staging_alloc = NULL;
+  csr_buffer_init( &mbgd->staging_csr );
+  mbgd->staging_inputs[0] = mbgd->staging_inputs[1] = NULL;
+  mbgd->staging_targets[0] = mbgd->staging_targets[1] = NULL;
   return mbgd;
 }
 
@@ -24,9 +39,11 @@ void mbgd__init( MBGD *mbgd, int num_mbgd_layers, VALUE *mbgd_layers, objective_
 
   mbgd->num_layers = num_mbgd_layers;
   mbgd->mbgd_layers = ALLOC_N( VALUE, num_mbgd_layers );
+  mbgd->layer_structs = ALLOC_N( MBGDLayer *, num_mbgd_layers );
 
   for ( i = 0; i < mbgd->num_layers; i++ ) {
     Data_Get_Struct( mbgd_layers[i], MBGDLayer, mbgd_layer );
+    mbgd->layer_structs[i] = mbgd_layer;
     if ( i == 0 ) {
       mbgd->num_inputs = mbgd_layer->num_inputs;
     } else {
@@ -48,8 +65,49 @@ void mbgd__init( MBGD *mbgd, int num_mbgd_layers, VALUE *mbgd_layers, objective_
 }
 
 
+void mbgd__destroy_workers( MBGD *mbgd ) {
+  int i, j;
+  MBGDWorker *worker;
+
+  for ( i = 0; i < mbgd->num_workers; i++ ) {
+    worker = mbgd->workers + i;
+    for ( j = 0; j < mbgd->num_layers; j++ ) {
+      xfree( worker->activations[j] );
+      xfree( worker->de_dz[j] );
+      if ( worker->de_dw ) {
+        xfree( worker->de_dw[j] );
+      }
+    }
+    xfree( worker->activations );
+    xfree( worker->de_dz );
+    xfree( worker->de_da );
+    xfree( worker->scratch );
+    if ( worker->de_dw ) {
+      xfree( worker->de_dw );
+    }
+  }
+  xfree( mbgd->workers );
+
+  if ( mbgd->last_activations ) {
+    for ( j = 0; j < mbgd->num_layers; j++ ) {
+      xfree( mbgd->last_activations[j] );
+    }
+    xfree( mbgd->last_activations );
+  }
+
+  mbgd->num_workers = 0;
+  mbgd->workers = NULL;
+  mbgd->last_activations = NULL;
+  mbgd->has_last_activations = 0;
+  return;
+}
+
 void mbgd__destroy( MBGD *mbgd ) {
+  mbgd__destroy_workers( mbgd );
+  xfree( mbgd->staging_alloc );
+  csr_buffer_free( &mbgd->staging_csr );
   xfree( mbgd->mbgd_layers );
+  xfree( mbgd->layer_structs );
   xfree( mbgd );
   return;
 }
@@ -59,6 +117,7 @@ void mbgd__gc_mark( MBGD *mbgd ) {
   for ( i = 0; i < mbgd->num_layers; i++ ) {
     rb_gc_mark( mbgd->mbgd_layers[i] );
   }
+  rb_gc_mark( mbgd->narr_arena );
   return;
 }
 
@@ -67,12 +126,27 @@ void mbgd__deep_copy( MBGD *mbgd_copy, MBGD *mbgd_orig ) {
   mbgd_copy->num_inputs = mbgd_orig->num_inputs;
   mbgd_copy->num_outputs = mbgd_orig->num_outputs;
   mbgd_copy->objective = mbgd_orig->objective;
+  // Worker and staging buffers are not copied, they are re-created when needed
+  mbgd_copy->num_workers = 0;
+  mbgd_copy->workers = NULL;
+  mbgd_copy->last_activations = NULL;
+  mbgd_copy->has_last_activations = 0;
+  mbgd_copy->busy = 0;
+  mbgd_copy->staging_capacity = 0;
+  mbgd_copy->staging_alloc = NULL;
 
   mbgd_copy->mbgd_layers = ALLOC_N( VALUE, mbgd_copy->num_layers );
+  mbgd_copy->layer_structs = ALLOC_N( MBGDLayer *, mbgd_copy->num_layers );
   int i;
   for ( i = 0; i < mbgd_copy->num_layers; i++ ) {
     // This calls .clone of each layer via Ruby
     mbgd_copy->mbgd_layers[i] = rb_funcall( mbgd_orig->mbgd_layers[i], rb_intern("clone"), 0 );
+    Data_Get_Struct( mbgd_copy->mbgd_layers[i], MBGDLayer, mbgd_copy->layer_structs[i] );
+  }
+
+  mbgd_copy->narr_arena = Qnil;
+  if ( !NIL_P( mbgd_orig->narr_arena ) ) {
+    mbgd__pack_arena( mbgd_copy );
   }
 
   return;
@@ -85,14 +159,50 @@ MBGD * mbgd__clone( MBGD *mbgd_orig ) {
 }
 
 MBGDLayer *mbgd__get_mbgd_layer_at( MBGD *mbgd, int idx ) {
-  MBGDLayer * mbgd_layer;
-  Data_Get_Struct( mbgd->mbgd_layers[idx], MBGDLayer, mbgd_layer );
-  return mbgd_layer;
+  return mbgd->layer_structs[idx];
 }
 
-void mbgd__check_size_compatible( MBGD *mbgd, NNModel *nn_model, DataSet *dataset ) {
+// Moves gradients and optimiser state of all layers into one arena, so they are contiguous and
+// aligned
+void mbgd__pack_arena( MBGD *mbgd ) {
+  int i, size = 0, offset = 0;
+
+  for ( i = 0; i < mbgd->num_layers; i++ ) {
+    size += mbgd_layer__arena_size( mbgd__get_mbgd_layer_at( mbgd, i ) );
+  }
+
+  mbgd->narr_arena = na_arena_create( size );
+
+  for ( i = 0; i < mbgd->num_layers; i++ ) {
+    offset = mbgd_layer__move_to_arena( mbgd__get_mbgd_layer_at( mbgd, i ), mbgd->narr_arena, offset );
+  }
+
+  return;
+}
+
+void mbgd__start_busy( MBGD *mbgd ) {
   int i;
-  Layer_FF * layer_ff;
+  if ( mbgd->busy ) {
+    rb_raise( rb_eRuntimeError, "MBGD learner is already in use by another thread" );
+  }
+  mbgd->busy = 1;
+  for ( i = 0; i < mbgd->num_layers; i++ ) {
+    mbgd->layer_structs[i]->num_busy++;
+  }
+  return;
+}
+
+void mbgd__end_busy( MBGD *mbgd ) {
+  int i;
+  for ( i = 0; i < mbgd->num_layers; i++ ) {
+    mbgd->layer_structs[i]->num_busy--;
+  }
+  mbgd->busy = 0;
+  return;
+}
+
+void mbgd__check_size_compatible( MBGD *mbgd, NNModel *nn_model, DataSet *dataset ) {
+  int i, num_inputs, num_outputs, num_params;
   MBGDLayer * mbgd_layer;
 
   if ( mbgd->num_inputs != nn_model->num_inputs || dataset->input_item_size != nn_model->num_inputs ) {
@@ -108,89 +218,594 @@ void mbgd__check_size_compatible( MBGD *mbgd, NNModel *nn_model, DataSet *datase
   }
 
   for( i = 0; i < mbgd->num_layers; i++ ) {
-    layer_ff = nn_model__get_layer_ff_at( nn_model, i );
+    num_inputs = nn_model__layer_num_inputs_at( nn_model, i );
+    num_outputs = nn_model__layer_num_outputs_at( nn_model, i );
     mbgd_layer = mbgd__get_mbgd_layer_at( mbgd, i );
 
-    if ( layer_ff->num_inputs != mbgd_layer->num_inputs || mbgd_layer->num_outputs != layer_ff->num_outputs ) {
+    if ( num_inputs != mbgd_layer->num_inputs || mbgd_layer->num_outputs != num_outputs ) {
       rb_raise( rb_eArgError, "Layer size mismatch in layer %d. NNModel %d in, % d out. MBGD %d in, %d out.",
-        i, layer_ff->num_inputs, layer_ff->num_outputs, mbgd_layer->num_inputs, mbgd_layer->num_outputs );
+        i, num_inputs, num_outputs, mbgd_layer->num_inputs, mbgd_layer->num_outputs );
+    }
+
+    num_params = nn_model__layer_num_weights_at( nn_model, i );
+    if ( num_params != mbgd_layer__num_params( mbgd_layer ) ||
+        nn_model->layer_ops[i]->index_inputs != ( mbgd_layer->vocab_size > 0 ) ) {
+      rb_raise( rb_eArgError, "Parameter mismatch in %s layer %d. NNModel %d params, MBGD %d params%s.",
+        nn_model->layer_ops[i]->name, i, num_params, mbgd_layer__num_params( mbgd_layer ),
+        mbgd_layer->vocab_size ? " for an embedding" : "" );
     }
   }
 
+  if ( dataset->input_type == DATASET_INPUT_CSR && nn_model->layer_ops[0] != &layer_ff_ops ) {
+    rb_raise( rb_eArgError, "Sparse inputs cannot be used with an %s layer", nn_model->layer_ops[0]->name );
+  }
+
   return;
 }
 
+// Training may run without the GVL, so cannot raise an error part-way through
+void mbgd__check_objective_compatible( MBGD *mbgd, NNModel *nn_model ) {
+  transfer_type t = nn_model__layer_transfer_at( nn_model, nn_model->num_layers - 1 );
 
-float mbgd__train_one_batch( MBGD *mbgd, NNModel *nn_model, DataSet *dataset, int batch_size ) {
-  int i, j;
-  float o_score = 0.0;
-  float *inputs;
-  float *targets;
-  float *predictions;
-  float *layer_activations;
-  float *layer_inputs;
+  if ( ! objective_supports_transfer( mbgd->objective, t ) ) {
+    // This raises the relevant error
+    de_dz_from_objective_and_transfer( mbgd->objective, t, 0, NULL, NULL, NULL );
+  }
 
-  Layer_FF * layer_ff;
-  MBGDLayer * mbgd_layer;
-  MBGDLayer * upper_mbgd_layer;
+  return;
+}
 
-  // Start batch each layer pair
-  for ( i = 0; i < mbgd->num_layers; i++ ) {
-    mbgd_layer__start_batch(
-      mbgd__get_mbgd_layer_at( mbgd, i ),
-      nn_model__get_layer_ff_at( nn_model, i ) );
+
+// Allocates per-thread buffers, this must be called before training with at least as many
+// workers as threads. Existing buffers are re-used when possible. Unless dense_inputs is set, the
+// first layer is only trained from sparse inputs, which needs no buffers sized by its inputs. A
+// layer with index inputs, such as an embedding, needs no de_da, but de_da is also used to widen
+// a chunk of compact or view inputs for mbgd__dataset_loss, so always has room for those.
+void mbgd__init_workers( MBGD *mbgd, NNModel *nn_model, int num_workers, int dense_inputs ) {
+  int i, j, max_inputs = 0, scratch_size = 0, layer_scratch_size;
+  MBGDWorker *worker;
+  MBGDLayer *mbgd_layer;
+
+  if ( num_workers <= mbgd->num_workers && ( mbgd->workers_dense_inputs || ! dense_inputs ) ) {
+    return;
+  }
+  if ( num_workers < mbgd->num_workers ) {
+    num_workers = mbgd->num_workers;
+  }
+
+  mbgd__destroy_workers( mbgd );
+
+  for ( j = dense_inputs ? 0 : 1; j < mbgd->num_layers; j++ ) {
+    mbgd_layer = mbgd->layer_structs[j];
+    if ( ! nn_model->layer_ops[j]->index_inputs && mbgd_layer->num_inputs > max_inputs ) {
+      max_inputs = mbgd_layer->num_inputs;
+    }
+    layer_scratch_size = nn_model->layer_ops[j]->workspace_size( mbgd_layer, MBGD_CHUNK_SIZE );
+    if ( layer_scratch_size > scratch_size ) {
+      scratch_size = layer_scratch_size;
+    }
+  }
+  if ( dense_inputs && nn_model->num_inputs > max_inputs ) {
+    max_inputs = nn_model->num_inputs;
+  }
+
+  mbgd->workers = ALLOC_N( MBGDWorker, num_workers );
+  for ( i = 0; i < num_workers; i++ ) {
+    worker = mbgd->workers + i;
+    worker->activations = ALLOC_N( float*, mbgd->num_layers );
+    worker->de_dz = ALLOC_N( float*, mbgd->num_layers );
+    worker->de_da = ALLOC_N( float, MBGD_CHUNK_SIZE * max_inputs );
+    worker->scratch = ALLOC_N( float, scratch_size );
+    worker->de_dw = i > 0 ? ALLOC_N( float*, mbgd->num_layers ) : NULL;
+    for ( j = 0; j < mbgd->num_layers; j++ ) {
+      mbgd_layer = mbgd->layer_structs[j];
+      worker->activations[j] = ALLOC_N( float, MBGD_CHUNK_SIZE * mbgd_layer->num_outputs );
+      worker->de_dz[j] = ALLOC_N( float, MBGD_CHUNK_SIZE * mbgd_layer->num_outputs );
+      if ( worker->de_dw ) {
+        worker->de_dw[j] = ALLOC_N( float, mbgd_layer__num_params( mbgd_layer ) );
+      }
+    }
+  }
+  mbgd->last_activations = ALLOC_N( float*, mbgd->num_layers );
+  for ( j = 0; j < mbgd->num_layers; j++ ) {
+    mbgd->last_activations[j] = ALLOC_N( float, mbgd->layer_structs[j]->num_outputs );
+  }
+  mbgd->num_workers = num_workers;
+  mbgd->workers_dense_inputs = dense_inputs;
+
+  return;
+}
+
+// Allocates two aligned pairs of input and target buffers, each big enough for a whole batch, so
+// that one batch can be gathered while another trains. Existing buffers are re-used when possible.
+// Unless dense_inputs is set, inputs are sparse, gathered into staging_csr instead, and no space
+// is allocated for dense ones.
+void mbgd__init_staging( MBGD *mbgd, int batch_size, int dense_inputs ) {
+  int align_floats = MBGD_STAGING_ALIGN / sizeof(float);
+  size_t inputs_size = 0, targets_size;
+  float *base;
+
+  if ( batch_size <= mbgd->staging_capacity && ( mbgd->staging_dense_inputs || ! dense_inputs ) ) {
+    return;
+  }
+  if ( batch_size < mbgd->staging_capacity ) {
+    batch_size = mbgd->staging_capacity;
+  }
+
+  if ( dense_inputs ) {
+    inputs_size = align_floats * ( ( (size_t) batch_size * mbgd->num_inputs + align_floats - 1 ) / align_floats );
   }
+  targets_size = align_floats * ( ( (size_t) batch_size * mbgd->num_outputs + align_floats - 1 ) / align_floats );
+
+  xfree( mbgd->staging_alloc );
+  mbgd->staging_alloc = ALLOC_N( float, 2 * ( inputs_size + targets_size ) + align_floats );
+  base = (float*) ( ( (size_t) mbgd->staging_alloc + MBGD_STAGING_ALIGN - 1 ) & ~( (size_t) MBGD_STAGING_ALIGN - 1 ) );
 
-  for ( i = 0; i < batch_size; i++ ) {
-    // Get next dataset entry
-    inputs = dataset__current_input( dataset );
-    targets = dataset__current_output( dataset );
+  mbgd->staging_inputs[0] = base;
+  mbgd->staging_targets[0] = base + inputs_size;
+  mbgd->staging_inputs[1] = base + inputs_size + targets_size;
+  mbgd->staging_targets[1] = base + 2 * inputs_size + targets_size;
+  mbgd->staging_capacity = batch_size;
+  mbgd->staging_dense_inputs = dense_inputs;
 
-    // Run through network
-    nn_model__run( nn_model, inputs );
-    predictions = nn_model->activations[ nn_model->num_layers - 1 ];
+  return;
+}
 
-    o_score += objective_function_loss( mbgd->objective, mbgd->num_outputs, predictions, targets );
+// Makes staging_csr big enough for any num_items items of a dataset with sparse inputs, so that
+// they can be gathered without the GVL. Does nothing for other datasets.
+void mbgd__init_staging_csr( MBGD *mbgd, DataSet *dataset, int num_items ) {
+  if ( dataset->input_type != DATASET_INPUT_CSR ) {
+    return;
+  }
+  csr_buffer_reserve( &mbgd->staging_csr, num_items + 1, dataset__max_csr_nnz( dataset, num_items ) );
+  return;
+}
+
+// Returns the de_dw buffer that a worker adds gradients to for one layer
+static float *mbgd__worker_de_dw( MBGD *mbgd, int worker_id, int layer_idx ) {
+  if ( worker_id == 0 ) {
+    return mbgd->layer_structs[layer_idx]->de_dw;
+  }
+  return mbgd->workers[worker_id].de_dw[layer_idx];
+}
+
+// Runs a chunk of up to MBGD_CHUNK_SIZE items, from contiguous inputs and targets with one row
+// per item, forward and back through nn_model as matrices,
+// adding gradients to the worker's de_dw. Returns total objective loss for the items. If
+// keep_last_item is set, activations of the last item are kept in mbgd->last_activations, for
+// mbgd__copy_last_activations to copy to nn_model once the GVL is held again, and its gradients
+// are copied to the MBGDLayers, so that they can be inspected after training as with per-item
+// backprop. de_da
+// for the first layer is only calculated if calc_input_de_da is set. When sparse_inputs is set,
+// inputs is not used, and de_da for the first layer is never calculated.
+static float mbgd__train_chunk( MBGD *mbgd, NNModel *nn_model, int worker_id, int num_items,
+    float *inputs, CSRRows *sparse_inputs, float *targets, int keep_last_item, int calc_input_de_da ) {
+  MBGDWorker *worker = mbgd->workers + worker_id;
+  int i, j, last = mbgd->num_layers - 1;
+  int num_outputs = mbgd->num_outputs;
+  int in_size, out_size;
+  float o_score = 0.0;
+  float *layer_inputs, *output, *target, *de_da;
+  transfer_type t;
+  MBGDLayer *mbgd_layer;
 
-    mbgd_layer = mbgd__get_mbgd_layer_at( mbgd, mbgd->num_layers - 1 );
-    layer_ff = nn_model__get_layer_ff_at( nn_model, mbgd->num_layers - 1 );
-    layer_activations = nn_model->activations[ mbgd->num_layers - 1 ];
-    if ( mbgd->num_layers > 1 ) {
-      layer_inputs = nn_model->activations[ mbgd->num_layers - 2 ];
+  // Run through network
+  if ( sparse_inputs ) {
+    nn_model__run_batch_csr( nn_model, num_items, sparse_inputs, worker->activations );
+  } else {
+    nn_model__run_batch( nn_model, num_items, inputs, worker->activations );
+  }
+
+  t = nn_model__layer_transfer_at( nn_model, last );
+  for ( i = 0; i < num_items; i++ ) {
+    output = worker->activations[last] + i * num_outputs;
+    target = targets + i * num_outputs;
+    o_score += objective_function_loss( mbgd->objective, num_outputs, output, target );
+    de_dz_from_objective_and_transfer( mbgd->objective, t,
+        num_outputs, output, target, worker->de_dz[last] + i * num_outputs );
+  }
+
+  for ( j = last; j >= 0; j-- ) {
+    mbgd_layer = mbgd->layer_structs[j];
+    in_size = mbgd_layer->num_inputs;
+    out_size = mbgd_layer->num_outputs;
+    layer_inputs = j > 0 ? worker->activations[j - 1] : inputs;
+    de_da = ( j > 0 || ( calc_input_de_da && ! sparse_inputs && ! nn_model->layer_ops[j]->index_inputs ) ) ?
+        worker->de_da : NULL;
+
+    if ( j == 0 && sparse_inputs ) {
+      mbgd_layer__backprop_batch_csr( mbgd_layer, num_items, sparse_inputs, worker->de_dz[j],
+          mbgd__worker_de_dw( mbgd, worker_id, j ) );
     } else {
-      layer_inputs = inputs;
+      nn_model->layer_ops[j]->backward( mbgd_layer, nn_model->layer_structs[j], num_items,
+          layer_inputs, worker->de_dz[j], de_da, mbgd__worker_de_dw( mbgd, worker_id, j ),
+          worker->scratch );
+    }
+
+    if ( keep_last_item ) {
+      i = num_items - 1;
+      memcpy( mbgd->last_activations[j], worker->activations[j] + i * out_size, out_size * sizeof(float) );
+      mbgd->has_last_activations = 1;
+      memcpy( mbgd_layer->de_dz, worker->de_dz[j] + i * out_size, out_size * sizeof(float) );
+      if ( de_da ) {
+        memcpy( mbgd_layer->de_da, de_da + i * in_size, in_size * sizeof(float) );
+      }
+    }
+
+    if ( j > 0 ) {
+      t = nn_model__layer_transfer_at( nn_model, j - 1 );
+      for ( i = 0; i < num_items; i++ ) {
+        de_dz_from_upper_de_da( t, in_size,
+            layer_inputs + i * in_size, worker->de_da + i * in_size, worker->de_dz[j - 1] + i * in_size );
+      }
     }
+  }
 
-    mbgd_layer__backprop_for_output_layer( mbgd_layer, layer_ff,
-        layer_inputs, layer_activations, targets, mbgd->objective );
+  return o_score;
+}
 
-    // Continue back-propagation to all earlier layers
-    for ( j = mbgd->num_layers - 2; j >= 0; j-- ) {
-      upper_mbgd_layer = mbgd_layer;
-      mbgd_layer = mbgd__get_mbgd_layer_at( mbgd, j );
-      layer_ff = nn_model__get_layer_ff_at( nn_model, j );
-      layer_activations =  nn_model->activations[ j ];
-      if ( j > 0 ) {
-        layer_inputs = nn_model->activations[ j - 1 ];
+float mbgd__train_one_batch( MBGD *mbgd, NNModel *nn_model, DataSet *dataset, int batch_size ) {
+  return mbgd__train_one_batch_threaded( mbgd, nn_model, dataset, batch_size, 1, 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Multi-threaded training. Each thread processes a contiguous slice of the batch using its own
+//  MBGDWorker buffers, then the de_dw buffers are summed
+//
+
+typedef struct _mbgd_batch_task {
+    MBGD *mbgd;
+    NNModel *nn_model;
+    int worker_id;
+    int num_workers;
+    float *inputs;
+    CSRRows *sparse_inputs;
+    float *targets;
+    int start_item;
+    int end_item;
+    int calc_input_de_da;
+    float o_score;
+  } MBGDBatchTask;
+
+// Only the rows of an embedding used in the batch are read back from a worker's de_dw
+static void mbgd_worker_clear_rows_used( MBGDLayer *mbgd_layer, float *de_dw ) {
+  int i, embed_size = mbgd_layer->num_outputs / mbgd_layer->num_inputs;
+
+  for ( i = 0; i < mbgd_layer->num_rows_used; i++ ) {
+    memset( de_dw + (size_t) mbgd_layer->rows_used[i] * embed_size, 0, embed_size * sizeof(float) );
+  }
+  return;
+}
+
+static void *mbgd_batch_task_accumulate( void *data ) {
+  MBGDBatchTask *task = (MBGDBatchTask *) data;
+  MBGDLayer *mbgd_layer;
+  CSRRows chunk_rows;
+  int i, num_items, is_last_task = ( task->worker_id == task->num_workers - 1 );
+
+  if ( task->worker_id > 0 ) {
+    for ( i = 0; i < task->mbgd->num_layers; i++ ) {
+      mbgd_layer = task->mbgd->layer_structs[i];
+      if ( mbgd_layer->vocab_size ) {
+        mbgd_worker_clear_rows_used( mbgd_layer, mbgd__worker_de_dw( task->mbgd, task->worker_id, i ) );
       } else {
-        layer_inputs = inputs;
+        memset( mbgd__worker_de_dw( task->mbgd, task->worker_id, i ), 0,
+            mbgd_layer__num_params( mbgd_layer ) * sizeof(float) );
       }
+    }
+  }
+
+  task->o_score = 0.0;
+  for ( i = task->start_item; i < task->end_item; i += MBGD_CHUNK_SIZE ) {
+    num_items = task->end_item - i < MBGD_CHUNK_SIZE ? task->end_item - i : MBGD_CHUNK_SIZE;
+    if ( task->sparse_inputs ) {
+      chunk_rows = csr_rows_from( task->sparse_inputs, i );
+    }
+    task->o_score += mbgd__train_chunk( task->mbgd, task->nn_model, task->worker_id, num_items,
+        task->sparse_inputs ? NULL : task->inputs + (size_t) i * task->mbgd->num_inputs,
+        task->sparse_inputs ? &chunk_rows : NULL,
+        task->targets + (size_t) i * task->mbgd->num_outputs,
+        is_last_task && i + num_items == task->end_item,
+        task->calc_input_de_da );
+  }
+
+  return NULL;
+}
+
+// For an embedding, each task sums a slice of the rows used in the batch
+static void mbgd_batch_task_reduce_rows_used( MBGDBatchTask *task, int layer_idx, MBGDLayer *mbgd_layer ) {
+  int i, w, stride, start, end;
+  int embed_size = mbgd_layer->num_outputs / mbgd_layer->num_inputs;
+  size_t offset;
+
+  start = (int) ( (long) mbgd_layer->num_rows_used * task->worker_id / task->num_workers );
+  end = (int) ( (long) mbgd_layer->num_rows_used * ( task->worker_id + 1 ) / task->num_workers );
+
+  for ( i = start; i < end; i++ ) {
+    offset = (size_t) mbgd_layer->rows_used[i] * embed_size;
+    for ( stride = 1; stride < task->num_workers; stride *= 2 ) {
+      for ( w = 0; w + stride < task->num_workers; w += 2 * stride ) {
+        simd_kernels.axpy( embed_size, 1.0, mbgd__worker_de_dw( task->mbgd, w + stride, layer_idx ) + offset,
+            mbgd__worker_de_dw( task->mbgd, w, layer_idx ) + offset );
+      }
+    }
+  }
+
+  return;
+}
 
-      // FIXME: this needlessly calculates de_da for input layer
-      mbgd_layer__backprop_for_mid_layer( mbgd_layer, layer_ff,
-        layer_inputs, layer_activations, upper_mbgd_layer->de_da );
+// Each task sums one slice of every layer's de_dw across all workers. The order of additions
+// depends only on number of workers, so results are repeatable.
+static void *mbgd_batch_task_reduce( void *data ) {
+  MBGDBatchTask *task = (MBGDBatchTask *) data;
+  MBGD *mbgd = task->mbgd;
+  MBGDLayer *mbgd_layer;
+  int i, w, stride, t, start, len;
+
+  for ( i = 0; i < mbgd->num_layers; i++ ) {
+    mbgd_layer = mbgd->layer_structs[i];
+    if ( mbgd_layer->vocab_size ) {
+      mbgd_batch_task_reduce_rows_used( task, i, mbgd_layer );
+      continue;
     }
+    t = mbgd_layer__num_params( mbgd_layer );
+    start = (int) ( (long) t * task->worker_id / task->num_workers );
+    len = (int) ( (long) t * ( task->worker_id + 1 ) / task->num_workers ) - start;
+
+    // Pairwise tree, ending in the first worker's de_dw, which is the one in mbgd_layer
+    for ( stride = 1; stride < task->num_workers; stride *= 2 ) {
+      for ( w = 0; w + stride < task->num_workers; w += 2 * stride ) {
+        simd_kernels.axpy( len, 1.0, mbgd__worker_de_dw( mbgd, w + stride, i ) + start,
+            mbgd__worker_de_dw( mbgd, w, i ) + start );
+      }
+    }
+  }
 
-    // Next item
-    dataset__next( dataset );
+  return NULL;
+}
+
+// Trains one batch that has already been gathered into contiguous inputs and targets, or sparse
+// inputs when sparse_inputs is set. Fewer threads than requested are used if there are not
+// enough workers or items.
+static float mbgd__train_gathered_batch( MBGD *mbgd, NNModel *nn_model, int batch_size,
+    float *inputs, CSRRows *sparse_inputs, float *targets, int num_threads, int calc_input_de_da ) {
+  int i;
+  float o_score = 0.0;
+  MBGDBatchTask tasks[PARALLEL_MAX_THREADS];
+
+  if ( num_threads > batch_size ) {
+    num_threads = batch_size;
+  }
+  if ( num_threads > mbgd->num_workers ) {
+    num_threads = mbgd->num_workers;
+  }
+  if ( num_threads < 1 ) {
+    num_threads = 1;
+  }
+
+  for ( i = 0; i < mbgd->num_layers; i++ ) {
+    nn_model->layer_ops[i]->start_batch( mbgd->layer_structs[i], nn_model->layer_structs[i],
+        batch_size, i == 0 ? inputs : NULL );
+  }
+
+  for ( i = 0; i < num_threads; i++ ) {
+    tasks[i].mbgd = mbgd;
+    tasks[i].nn_model = nn_model;
+    tasks[i].worker_id = i;
+    tasks[i].num_workers = num_threads;
+    tasks[i].inputs = inputs;
+    tasks[i].sparse_inputs = sparse_inputs;
+    tasks[i].targets = targets;
+    tasks[i].start_item = ( batch_size * i ) / num_threads;
+    tasks[i].end_item = ( batch_size * ( i + 1 ) ) / num_threads;
+    tasks[i].calc_input_de_da = calc_input_de_da;
+  }
+
+  parallel_run( num_threads, mbgd_batch_task_accumulate, tasks, sizeof(MBGDBatchTask) );
+  if ( num_threads > 1 ) {
+    parallel_run( num_threads, mbgd_batch_task_reduce, tasks, sizeof(MBGDBatchTask) );
+  }
+
+  for ( i = 0; i < num_threads; i++ ) {
+    o_score += tasks[i].o_score;
   }
 
   // Weight update each layer pair
   for ( i = 0; i < mbgd->num_layers; i++ ) {
-    mbgd_layer__finish_batch(
-      mbgd__get_mbgd_layer_at( mbgd, i ),
-      nn_model__get_layer_ff_at( nn_model, i ) );
+    nn_model->layer_ops[i]->finish_batch( mbgd->layer_structs[i], nn_model->layer_structs[i] );
   }
 
   return o_score / batch_size;
 }
+
+// Calls to this must be preceded by mbgd__init_workers with at least one worker, and
+// mbgd__init_staging with at least batch_size items, so that nothing is allocated without the
+// GVL. The batch is gathered into the first staging buffer, or staging_csr for sparse inputs.
+float mbgd__train_one_batch_threaded( MBGD *mbgd, NNModel *nn_model, DataSet *dataset, int batch_size,
+    int num_threads, int calc_input_de_da ) {
+  if ( dataset->input_type == DATASET_INPUT_CSR ) {
+    dataset__gather_batch_csr( dataset, batch_size, &mbgd->staging_csr, mbgd->staging_targets[0] );
+    return mbgd__train_gathered_batch( mbgd, nn_model, batch_size, NULL, &mbgd->staging_csr.rows,
+        mbgd->staging_targets[0], num_threads, 0 );
+  }
+
+  dataset__gather_batch( dataset, batch_size, mbgd->staging_inputs[0], mbgd->staging_targets[0] );
+  return mbgd__train_gathered_batch( mbgd, nn_model, batch_size, mbgd->staging_inputs[0], NULL,
+      mbgd->staging_targets[0], num_threads, calc_input_de_da );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Training several batches in a row. When batches are large and there is more than one CPU, the
+//  next batch is gathered on a second thread while the current one trains
+//
+
+typedef struct _mbgd_pipeline_task {
+    int is_gather;
+    MBGD *mbgd;
+    NNModel *nn_model;
+    DataSet *dataset;
+    int batch_size;
+    int num_threads;
+    float *inputs;
+    float *targets;
+    float o_score;
+  } MBGDPipelineTask;
+
+static void *mbgd_pipeline_task( void *data ) {
+  MBGDPipelineTask *task = (MBGDPipelineTask *) data;
+  if ( task->is_gather ) {
+    dataset__gather_batch( task->dataset, task->batch_size, task->inputs, task->targets );
+  } else {
+    task->o_score = mbgd__train_gathered_batch( task->mbgd, task->nn_model, task->batch_size,
+        task->inputs, NULL, task->targets, task->num_threads, 0 );
+  }
+  return NULL;
+}
+
+static int mbgd__use_double_buffer( MBGD *mbgd, DataSet *dataset, int batch_size ) {
+  if ( dataset->input_type == DATASET_INPUT_CSR || ! mbgd->staging_dense_inputs ) {
+    return 0;
+  }
+  if ( (size_t) batch_size * ( mbgd->num_inputs + mbgd->num_outputs ) * sizeof(float) < MBGD_DOUBLE_BUFFER_MIN_BYTES ) {
+    return 0;
+  }
+  return parallel_num_threads() > 1;
+}
+
+// Trains up to num_batches batches in sequence, adding the loss of each to o_score, and returns
+// the number trained. Items are taken from dataset in the same order, and results are the same,
+// as calling mbgd__train_one_batch_threaded num_batches times. Once cancel is set, training
+// stops after the current batch, leaving dataset at the start of the next one. Calls to this
+// must be preceded by mbgd__init_workers with at least one worker and mbgd__init_staging with
+// at least batch_size items.
+int mbgd__train_batches( MBGD *mbgd, NNModel *nn_model, DataSet *dataset, int batch_size,
+    int num_batches, int num_threads, volatile int *cancel, double *o_score ) {
+  int b, cur = 0, gather_next;
+  MBGDPipelineTask tasks[2];
+
+  if ( num_batches < 1 ) {
+    return 0;
+  }
+
+  if ( ! mbgd__use_double_buffer( mbgd, dataset, batch_size ) ) {
+    for ( b = 0; b < num_batches && ! *cancel; b++ ) {
+      *o_score += mbgd__train_one_batch_threaded( mbgd, nn_model, dataset, batch_size, num_threads, 0 );
+    }
+    return b;
+  }
+
+  for ( b = 0; b < 2; b++ ) {
+    tasks[b].is_gather = b;
+    tasks[b].mbgd = mbgd;
+    tasks[b].nn_model = nn_model;
+    tasks[b].dataset = dataset;
+    tasks[b].batch_size = batch_size;
+    tasks[b].num_threads = num_threads;
+  }
+
+  dataset__gather_batch( dataset, batch_size, mbgd->staging_inputs[cur], mbgd->staging_targets[cur] );
+
+  for ( b = 0; b < num_batches; b++ ) {
+    tasks[0].inputs = mbgd->staging_inputs[cur];
+    tasks[0].targets = mbgd->staging_targets[cur];
+    tasks[1].inputs = mbgd->staging_inputs[1 - cur];
+    tasks[1].targets = mbgd->staging_targets[1 - cur];
+
+    // The last batch is not followed by a gather, so that dataset is left where it would be
+    // after training the same batches one at a time
+    gather_next = b + 1 < num_batches && ! *cancel;
+    parallel_run( gather_next ? 2 : 1, mbgd_pipeline_task, tasks, sizeof(MBGDPipelineTask) );
+
+    *o_score += tasks[0].o_score;
+    cur = 1 - cur;
+    if ( ! gather_next ) {
+      return b + 1;
+    }
+  }
+
+  return num_batches;
+}
+
+typedef struct _mbgd_loss_args {
+    MBGD *mbgd;
+    NNModel *nn_model;
+    DataSet *dataset;
+    int first_item;
+    double chunk_scores[MBGD_LOSS_ROUND_CHUNKS];
+  } MBGDLossArgs;
+
+// Finds total loss for one chunk of stored items from first_item onwards, using the buffers of
+// the pool thread's slot
+static void mbgd_loss_chunk( void *data, int slot, int start, int end ) {
+  MBGDLossArgs *args = (MBGDLossArgs *) data;
+  MBGD *mbgd = args->mbgd;
+  DataSet *dataset = args->dataset;
+  MBGDWorker *worker = mbgd->workers + slot;
+  int j, num_items = end - start, last = mbgd->num_layers - 1, chunk = start / MBGD_CHUNK_SIZE;
+  int num_outputs = mbgd->num_outputs;
+  double o_score = 0.0;
+  float *inputs;
+
+  start += args->first_item;
+  if ( dataset->input_type == DATASET_INPUT_CSR ) {
+    dataset__stored_csr( dataset, start, num_items, &mbgd->staging_csr );
+    nn_model__run_batch_csr( args->nn_model, num_items, &mbgd->staging_csr.rows, worker->activations );
+  } else {
+    // de_da is not needed for a forward pass, and always has room to widen a chunk of inputs
+    inputs = dataset__stored_inputs( dataset, start, num_items, worker->de_da );
+    nn_model__run_batch( args->nn_model, num_items, inputs, worker->activations );
+  }
+  for ( j = 0; j < num_items; j++ ) {
+    o_score += objective_function_loss( mbgd->objective, num_outputs,
+        worker->activations[last] + j * num_outputs, dataset__stored_output( dataset, start + j ) );
+  }
+
+  args->chunk_scores[chunk] = o_score;
+  return;
+}
+
+// Mean objective loss over every item in dataset, in stored order, without training or moving
+// the dataset's position. Each round of chunks is shared out between pool threads, up to one per
+// worker, and their losses are added in order so that the result does not depend on the number
+// of threads. Must be preceded by mbgd__init_workers, with dense_inputs set unless dataset has
+// sparse inputs, in which case staging_csr must have room for any MBGD_CHUNK_SIZE of its items.
+void mbgd__copy_last_activations( MBGD *mbgd, NNModel *nn_model ) {
+  int j;
+
+  if ( ! mbgd->has_last_activations ) {
+    return;
+  }
+  for ( j = 0; j < mbgd->num_layers; j++ ) {
+    memcpy( nn_model->activations[j], mbgd->last_activations[j],
+        mbgd->layer_structs[j]->num_outputs * sizeof(float) );
+  }
+  mbgd->has_last_activations = 0;
+  return;
+}
+
+float mbgd__dataset_loss( MBGD *mbgd, NNModel *nn_model, DataSet *dataset ) {
+  int i, num_items, round_size = MBGD_LOSS_ROUND_CHUNKS * MBGD_CHUNK_SIZE;
+  double o_score = 0.0;
+  MBGDLossArgs args;
+
+  args.mbgd = mbgd;
+  args.nn_model = nn_model;
+  args.dataset = dataset;
+
+  for ( args.first_item = 0; args.first_item < dataset->num_items; args.first_item += round_size ) {
+    num_items = dataset->num_items - args.first_item;
+    num_items = num_items < round_size ? num_items : round_size;
+
+    // Sparse chunks are all gathered into the one staging_csr buffer
+    parallel_for( num_items, MBGD_CHUNK_SIZE,
+        dataset->input_type == DATASET_INPUT_CSR ? 1 : mbgd->num_workers, mbgd_loss_chunk, &args );
+
+    for ( i = 0; i * MBGD_CHUNK_SIZE < num_items; i++ ) {
+      o_score += args.chunk_scores[i];
+    }
+  }
+
+  return (float) ( o_score / dataset->num_items );
+}
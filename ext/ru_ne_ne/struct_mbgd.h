@@ -14,13 +14,54 @@
 #include "struct_nn_model.h"
 #include "struct_dataset.h"
 #include "core_objective_functions.h"
+#include "core_parallel.h"
 
+// Items in a batch are trained in chunks of up to this many at a time
+#define MBGD_CHUNK_SIZE 128
+
+// Loss over a whole dataset is found this many chunks at a time
+#define MBGD_LOSS_ROUND_CHUNKS 256
+
+// Staging buffers start on this byte boundary
+#define MBGD_STAGING_ALIGN 64
+
+// Gathering the next batch on a background thread only pays off for batches at least this large
+#define MBGD_DOUBLE_BUFFER_MIN_BYTES 262144
+
+// Per-thread buffers for training. Matrix buffers hold one row per item in a chunk, and
+// activations, de_dz and de_dw have one entry per layer. The first worker adds gradients
+// directly to the MBGDLayer de_dw, so only later workers have their own de_dw
+typedef struct _mbgd_worker_raw {
+  float **activations;
+  float **de_dz;
+  float *de_da;
+  float *scratch;
+  float **de_dw;
+  } MBGDWorker;
+
+// layer_structs holds the MBGDLayer of each of mbgd_layers, so that training without the GVL
+// makes no Ruby calls. last_activations holds the last trained item's activations per layer,
+// until they are copied to the NNModel with the GVL held
 typedef struct _mbgd_raw {
   VALUE *mbgd_layers;
+  MBGDLayer **layer_structs;
   int num_layers;
   int num_inputs;
   int num_outputs;
   objective_type objective;
+  int num_workers;
+  int workers_dense_inputs;
+  MBGDWorker *workers;
+  float **last_activations;
+  int has_last_activations;
+  int busy;
+  volatile VALUE narr_arena;
+  int staging_capacity;
+  int staging_dense_inputs;
+  float *staging_alloc;
+  float *staging_inputs[2];
+  float *staging_targets[2];
+  CSRBuffer staging_csr;
   } MBGD;
 
 MBGD *mbgd__create();
@@ -37,8 +78,37 @@ MBGD * mbgd__clone( MBGD *mbgd_orig );
 
 MBGDLayer *mbgd__get_mbgd_layer_at( MBGD *mbgd, int idx );
 
+void mbgd__pack_arena( MBGD *mbgd );
+
+// Marks the learner and its layers as in use by a call that releases the GVL, raising
+// RuntimeError if it already is, so that a second thread cannot free its buffers or replace
+// gradient descent state during training
+void mbgd__start_busy( MBGD *mbgd );
+
+void mbgd__end_busy( MBGD *mbgd );
+
+void mbgd__init_workers( MBGD *mbgd, NNModel *nn_model, int num_workers, int dense_inputs );
+
+void mbgd__init_staging( MBGD *mbgd, int batch_size, int dense_inputs );
+
+void mbgd__init_staging_csr( MBGD *mbgd, DataSet *dataset, int num_items );
+
 float mbgd__train_one_batch( MBGD *mbgd, NNModel *nn_model, DataSet *dataset, int batch_size );
 
+float mbgd__train_one_batch_threaded( MBGD *mbgd, NNModel *nn_model, DataSet *dataset, int batch_size,
+    int num_threads, int calc_input_de_da );
+
+int mbgd__train_batches( MBGD *mbgd, NNModel *nn_model, DataSet *dataset, int batch_size,
+    int num_batches, int num_threads, volatile int *cancel, double *o_score );
+
+// Copies activations kept from the last trained item to nn_model, if training has kept any
+// since the last copy. Call with the GVL held, after training returns
+void mbgd__copy_last_activations( MBGD *mbgd, NNModel *nn_model );
+
+float mbgd__dataset_loss( MBGD *mbgd, NNModel *nn_model, DataSet *dataset );
+
 void mbgd__check_size_compatible( MBGD *mbgd, NNModel *nn_model, DataSet *dataset );
 
+void mbgd__check_objective_compatible( MBGD *mbgd, NNModel *nn_model );
+
 #endif
@@ -11,13 +11,18 @@
 #include <ruby.h>
 #include "narray.h"
 #include "struct_layer_ff.h"
+#include "struct_layer_embedding.h"
 #include "core_objective_functions.h"
 #include "struct_gd_sgd.h"
 #include "struct_gd_nag.h"
 #include "struct_gd_rmsprop.h"
+#include "struct_gd_adagrad.h"
+#include "struct_gd_adam.h"
 #include "core_regularise.h"
+#include "core_simd.h"
+#include "core_gemm.h"
 
-typedef enum {GD_TYPE_SGD, GD_TYPE_NAG, GD_TYPE_RMSPROP} gradient_descent_type;
+typedef enum {GD_TYPE_SGD, GD_TYPE_NAG, GD_TYPE_RMSPROP, GD_TYPE_ADAGRAD, GD_TYPE_ADAM} gradient_descent_type;
 
 typedef struct _mbgd_layer_raw {
   int num_inputs;
@@ -34,13 +39,35 @@ typedef struct _mbgd_layer_raw {
   float learning_rate;
   float max_norm;
   float weight_decay;
+
+  // Set for an embedding layer, when de_dw has one row of num_outputs / num_inputs for each of
+  // vocab_size indices. Only the rows used in the current batch, listed in rows_used and marked
+  // in row_marks, are updated. Other rows of de_dw are zero.
+  int vocab_size;
+  int *rows_used;
+  int num_rows_used;
+  unsigned char *row_marks;
+
+  // Number of learners training with this layer without the GVL, see mbgd__start_busy
+  int num_busy;
   } MBGDLayer;
 
 MBGDLayer *mbgd_layer__create();
 
 void mbgd_layer__init( MBGDLayer *mbgd_layer, int num_inputs, int num_outputs );
 
-void mbgd_layer__init_gradient_descent( MBGDLayer *mbgd_layer, gradient_descent_type gd_at, float momentum, float decay, float epsilon );
+void mbgd_layer__init_embedding( MBGDLayer *mbgd_layer, int num_inputs, int embed_size, int vocab_size );
+
+int mbgd_layer__num_params( MBGDLayer *mbgd_layer );
+
+void mbgd_layer__use_all_rows( MBGDLayer *mbgd_layer );
+
+// Raises RuntimeError if a learner is training with the layer, so that its gradient descent
+// object is not replaced during training
+void mbgd_layer__check_not_busy( MBGDLayer *mbgd_layer );
+
+void mbgd_layer__init_gradient_descent( MBGDLayer *mbgd_layer, gradient_descent_type gd_at, float momentum, float decay,
+    float beta1, float beta2, float epsilon );
 
 void mbgd_layer__destroy( MBGDLayer *mbgd_layer );
 
@@ -50,6 +77,10 @@ void mbgd_layer__deep_copy( MBGDLayer *mbgd_layer_copy, MBGDLayer *mbgd_layer_or
 
 MBGDLayer * mbgd_layer__clone( MBGDLayer *mbgd_layer_orig );
 
+int mbgd_layer__arena_size( MBGDLayer *mbgd_layer );
+
+int mbgd_layer__move_to_arena( MBGDLayer *mbgd_layer, VALUE narr_arena, int offset );
+
 void mbgd_layer__start_batch( MBGDLayer *mbgd_layer, Layer_FF *layer_ff );
 
 void mbgd_layer__backprop_for_output_layer( MBGDLayer *mbgd_layer, Layer_FF *layer_ff,
@@ -58,6 +89,24 @@ void mbgd_layer__backprop_for_output_layer( MBGDLayer *mbgd_layer, Layer_FF *lay
 void mbgd_layer__backprop_for_mid_layer( MBGDLayer *mbgd_layer, Layer_FF *layer_ff,
       float *input, float *output, float *upper_de_da );
 
+void de_dz_from_upper_de_da( transfer_type t, int out_size, float *output, float *de_da, float *de_dz );
+
+int mbgd_layer__batch_scratch_size( MBGDLayer *mbgd_layer, int num_items );
+
+void mbgd_layer__backprop_batch( MBGDLayer *mbgd_layer, Layer_FF *layer_ff, int num_items,
+      float *inputs, float *de_dz, float *de_da, float *de_dw, float *scratch );
+
+void mbgd_layer__backprop_batch_csr( MBGDLayer *mbgd_layer, int num_items, CSRRows *inputs,
+      float *de_dz, float *de_dw );
+
 void mbgd_layer__finish_batch( MBGDLayer *mbgd_layer, Layer_FF *layer_ff );
 
+void mbgd_layer__start_batch_embedding( MBGDLayer *mbgd_layer, Layer_Embedding *layer_embedding,
+      int num_items, float *inputs );
+
+void mbgd_layer__backprop_batch_embedding( MBGDLayer *mbgd_layer, int num_items, float *inputs,
+      float *de_dz, float *de_dw );
+
+void mbgd_layer__finish_batch_embedding( MBGDLayer *mbgd_layer, Layer_Embedding *layer_embedding );
+
 #endif
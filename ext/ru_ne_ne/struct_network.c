@@ -44,3 +44,70 @@ Network * network__clone( Network *network_orig ) {
   network__deep_copy( network_copy, network_orig );
   return network_copy;
 }
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Multi-epoch training. These do not call Ruby, so can run without the GVL. Sizes and objective
+//  must be checked, and mbgd__init_workers and mbgd__init_staging called, before starting.
+//
+
+static void network__save_best_weights( NetworkTrainState *state ) {
+  int i;
+
+  for ( i = 0; i < state->nn_model->num_layers; i++ ) {
+    memcpy( state->best_weights[i], nn_model__layer_weights_at( state->nn_model, i ),
+        nn_model__layer_num_weights_at( state->nn_model, i ) * sizeof(float) );
+  }
+  return;
+}
+
+// Runs the rest of the current epoch, where an epoch is enough batches to cover the dataset
+// once, stopping between batches if state->cancelled is set. With a validation set, loss is
+// measured after each epoch, and training stops once it has not improved for patience epochs
+// (patience 0 means never stop early).
+void network__train_epoch( NetworkTrainState *state ) {
+  int num_batches;
+
+  num_batches = ( state->dataset->num_items + state->batch_size - 1 ) / state->batch_size;
+
+  state->epoch_batch += mbgd__train_batches( state->mbgd, state->nn_model, state->dataset,
+      state->batch_size, num_batches - state->epoch_batch, state->num_threads,
+      &state->cancelled, &state->epoch_score );
+  if ( state->epoch_batch < num_batches ) {
+    return;
+  }
+
+  state->train_loss = (float) ( state->epoch_score / num_batches );
+  state->epoch_batch = 0;
+  state->epoch_score = 0.0;
+  state->epoch++;
+
+  if ( ! state->validation ) {
+    return;
+  }
+
+  state->validation_loss = mbgd__dataset_loss( state->mbgd, state->nn_model, state->validation );
+  if ( state->best_epoch == 0 || state->validation_loss < state->best_validation_loss ) {
+    state->best_validation_loss = state->validation_loss;
+    state->best_epoch = state->epoch;
+    network__save_best_weights( state );
+  } else if ( state->patience > 0 && state->epoch - state->best_epoch >= state->patience ) {
+    state->stopped_early = 1;
+  }
+
+  return;
+}
+
+void network__restore_best_weights( NetworkTrainState *state ) {
+  int i;
+
+  if ( ! state->validation || state->best_epoch == 0 ) {
+    return;
+  }
+
+  for ( i = 0; i < state->nn_model->num_layers; i++ ) {
+    memcpy( nn_model__layer_weights_at( state->nn_model, i ), state->best_weights[i],
+        nn_model__layer_num_weights_at( state->nn_model, i ) * sizeof(float) );
+  }
+  return;
+}
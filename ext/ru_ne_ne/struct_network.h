@@ -18,6 +18,30 @@ typedef struct _network_raw {
   volatile VALUE learn;
   } Network;
 
+// Progress of a multi-epoch training run, kept between calls to network__train_epoch so
+// that control can return to Ruby for progress reports and interrupts. An epoch that was
+// cancelled part-way continues from epoch_batch on the next call. best_weights has one buffer
+// per layer, and is only used when there is a validation set.
+typedef struct _network_train_state {
+  MBGD *mbgd;
+  NNModel *nn_model;
+  DataSet *dataset;
+  DataSet *validation;
+  int batch_size;
+  int num_threads;
+  int patience;
+  volatile int cancelled;
+  int epoch;
+  int epoch_batch;
+  double epoch_score;
+  int best_epoch;
+  int stopped_early;
+  float train_loss;
+  float validation_loss;
+  float best_validation_loss;
+  float **best_weights;
+  } NetworkTrainState;
+
 Network *network__create();
 
 void network__destroy( Network *network );
@@ -30,4 +54,8 @@ void network__deep_copy( Network *network_copy, Network *network_orig );
 
 Network * network__clone( Network *network_orig );
 
+void network__train_epoch( NetworkTrainState *state );
+
+void network__restore_best_weights( NetworkTrainState *state );
+
 #endif
@@ -11,15 +11,46 @@ NNModel *nn_model__create() {
   NNModel *nn_model;
   nn_model = xmalloc( sizeof(NNModel) );
   nn_model->layers = NULL;
+  nn_model->layer_ops = NULL;
+  nn_model->layer_structs = NULL;
   nn_model->activations = NULL;
   nn_model->num_layers = 0;
   nn_model->num_inputs = 0;
   nn_model->num_outputs = 0;
+  nn_model->narr_arena = Qnil;
+  nn_model->idle_workspaces = NULL;
+  nn_model->num_idle_workspaces = 0;
+  nn_model->num_busy = 0;
   return nn_model;
 }
 
+static void nn_model__free_workspace( NNModel *nn_model, NNModelWorkspace *workspace ) {
+  int i, slot;
+  for ( i = 0; i < nn_model->num_layers; i++ ) {
+    xfree( workspace->activations[i] );
+  }
+  for ( slot = 0; slot < workspace->num_batch_slots; slot++ ) {
+    // The last batch_activations entry points into the caller's output array
+    for ( i = 0; i < nn_model->num_layers - 1; i++ ) {
+      xfree( workspace->batch_activations[slot][i] );
+    }
+    xfree( workspace->batch_activations[slot] );
+  }
+  xfree( workspace->activations );
+  xfree( workspace->batch_activations );
+  xfree( workspace );
+  return;
+}
+
 void nn_model__destroy( NNModel *nn_model ) {
   int i;
+  NNModelWorkspace *workspace;
+
+  while ( nn_model->idle_workspaces ) {
+    workspace = nn_model->idle_workspaces;
+    nn_model->idle_workspaces = workspace->next;
+    nn_model__free_workspace( nn_model, workspace );
+  }
   if ( nn_model->activations ) {
     for ( i = 0; i < nn_model->num_layers; i++ ) {
       xfree( nn_model->activations[i] );
@@ -27,13 +58,37 @@ void nn_model__destroy( NNModel *nn_model ) {
     xfree( nn_model->activations );
   }
   xfree( nn_model->layers );
+  xfree( nn_model->layer_ops );
+  xfree( nn_model->layer_structs );
   xfree( nn_model );
   return;
 }
 
+// Finds the LayerOps and struct for each of nn_model->layers
+static void nn_model__resolve_layers( NNModel *nn_model ) {
+  int i;
+  const LayerOps *layer_ops;
+
+  nn_model->layer_ops = ALLOC_N( const LayerOps *, nn_model->num_layers );
+  nn_model->layer_structs = ALLOC_N( void *, nn_model->num_layers );
+
+  for ( i = 0; i < nn_model->num_layers; i++ ) {
+    layer_ops = layer_ops__for_value( nn_model->layers[i] );
+    if ( ! layer_ops ) {
+      rb_raise( rb_eTypeError, "When building nn_model, layer %d is not a layer object", i );
+    }
+    if ( layer_ops->index_inputs && i > 0 ) {
+      rb_raise( rb_eArgError, "When building nn_model, %s layer %d is not the first layer", layer_ops->name, i );
+    }
+    nn_model->layer_ops[i] = layer_ops;
+    nn_model->layer_structs[i] = DATA_PTR( nn_model->layers[i] );
+  }
+
+  return;
+}
+
 void nn_model__init( NNModel *nn_model, int num_layers, VALUE *layers ) {
   int i, last_num_outputs;
-  Layer_FF *layer_ff;
 
   nn_model->num_layers = num_layers;
   nn_model->layers = ALLOC_N( VALUE, num_layers );
@@ -41,21 +96,23 @@ void nn_model__init( NNModel *nn_model, int num_layers, VALUE *layers ) {
   // This immediate allocation avoids segfaults when cleaning up
   for ( i = 0; i < nn_model->num_layers; i++ ) {
     nn_model->activations[i] = NULL;
+    nn_model->layers[i] = layers[i];
   }
 
+  nn_model__resolve_layers( nn_model );
+
   for ( i = 0; i < nn_model->num_layers; i++ ) {
-    Data_Get_Struct( layers[i], Layer_FF, layer_ff );
+
     if ( i == 0 ) {
-      nn_model->num_inputs = layer_ff->num_inputs;
+      nn_model->num_inputs = nn_model__layer_num_inputs_at( nn_model, i );
     } else {
-      if ( layer_ff->num_inputs != last_num_outputs ) {
+      if ( nn_model__layer_num_inputs_at( nn_model, i ) != last_num_outputs ) {
         rb_raise( rb_eRuntimeError, "When building nn_model, layer connections failed between output size %d and next input size %d",
-            last_num_outputs, layer_ff->num_inputs );
+            last_num_outputs, nn_model__layer_num_inputs_at( nn_model, i ) );
       }
     }
-    last_num_outputs = layer_ff->num_outputs;
+    last_num_outputs = nn_model__layer_num_outputs_at( nn_model, i );
 
-    nn_model->layers[i] = layers[i];
     nn_model->activations[i] = ALLOC_N( float, last_num_outputs );
   }
 
@@ -69,11 +126,12 @@ void nn_model__gc_mark( NNModel *nn_model ) {
   for ( i = 0; i < nn_model->num_layers; i++ ) {
     rb_gc_mark( nn_model->layers[i] );
   }
+  rb_gc_mark( nn_model->narr_arena );
   return;
 }
 
 void nn_model__deep_copy( NNModel *nn_model_copy, NNModel *nn_model_orig ) {
-  Layer_FF *layer_ff;
+  int num_outputs;
 
   nn_model_copy->num_layers = nn_model_orig->num_layers;
   nn_model_copy->num_inputs = nn_model_orig->num_inputs;
@@ -86,15 +144,22 @@ void nn_model__deep_copy( NNModel *nn_model_copy, NNModel *nn_model_orig ) {
     nn_model_copy->layers[i] = rb_funcall( nn_model_orig->layers[i], rb_intern("clone"), 0 );
   }
 
+  nn_model__resolve_layers( nn_model_copy );
+
   nn_model_copy->activations = ALLOC_N( float*, nn_model_copy->num_layers );
   for ( i = 0; i < nn_model_copy->num_layers; i++ ) {
     nn_model_copy->activations[i] = NULL;
   }
 
   for ( i = 0; i < nn_model_copy->num_layers; i++ ) {
-    layer_ff = nn_model__get_layer_ff_at( nn_model_copy, i );
-    nn_model_copy->activations[i] = ALLOC_N( float, layer_ff->num_outputs );
-    memcpy( nn_model_copy->activations[i], nn_model_orig->activations[i], layer_ff->num_outputs * sizeof(float) );
+    num_outputs = nn_model__layer_num_outputs_at( nn_model_copy, i );
+    nn_model_copy->activations[i] = ALLOC_N( float, num_outputs );
+    memcpy( nn_model_copy->activations[i], nn_model_orig->activations[i], num_outputs * sizeof(float) );
+  }
+
+  nn_model_copy->narr_arena = Qnil;
+  if ( !NIL_P( nn_model_orig->narr_arena ) ) {
+    nn_model__pack_arena( nn_model_copy );
   }
 
   return;
@@ -106,24 +171,164 @@ NNModel * nn_model__clone( NNModel *nn_model_orig ) {
   return nn_model_copy;
 }
 
+void nn_model__start_busy( NNModel *nn_model ) {
+  nn_model->num_busy++;
+  return;
+}
+
+void nn_model__end_busy( NNModel *nn_model ) {
+  nn_model->num_busy--;
+  return;
+}
+
+void nn_model__check_not_busy( NNModel *nn_model ) {
+  if ( nn_model->num_busy ) {
+    rb_raise( rb_eRuntimeError, "NNModel is in use by another thread" );
+  }
+  return;
+}
+
+// Moves weights of all layers into one arena, so they are contiguous and aligned
+void nn_model__pack_arena( NNModel *nn_model ) {
+  int i, size = 0, offset = 0;
+
+  for ( i = 0; i < nn_model->num_layers; i++ ) {
+    size += na_arena_block_size( nn_model__layer_num_weights_at( nn_model, i ) );
+  }
+
+  nn_model->narr_arena = na_arena_create( size );
+
+  for ( i = 0; i < nn_model->num_layers; i++ ) {
+    offset = nn_model->layer_ops[i]->move_to_arena( nn_model->layer_structs[i], nn_model->narr_arena, offset );
+  }
+
+  return;
+}
+
 void nn_model__run( NNModel *nn_model, float *inputs ) {
+  nn_model__run_with_activations( nn_model, inputs, nn_model->activations );
+  return;
+}
+
+// The activations buffers, one per layer sized to its num_outputs, are supplied by the caller
+// so that several threads can run the same model at once
+void nn_model__run_with_activations( NNModel *nn_model, float *inputs, float **activations ) {
+  int i;
+
+  nn_model->layer_ops[0]->forward( nn_model->layer_structs[0], inputs, activations[0] );
+
+  for ( i = 1; i < nn_model->num_layers; i++ ) {
+    nn_model->layer_ops[i]->forward( nn_model->layer_structs[i], activations[i-1], activations[i] );
+  }
+
+  return;
+}
+
+// Runs batch_size items through the model, with items as contiguous rows of inputs. The
+// caller supplies batch_activations, one buffer per layer of batch_size * layer's num_outputs,
+// so that nn_model->activations are not altered
+void nn_model__run_batch( NNModel *nn_model, int batch_size, float *inputs, float **batch_activations ) {
   int i;
 
-  layer_ff__run( nn_model__get_layer_ff_at( nn_model, 0 ),
-      inputs, nn_model->activations[0] );
+  nn_model->layer_ops[0]->forward_batch( nn_model->layer_structs[0], batch_size, inputs, batch_activations[0] );
 
   for ( i = 1; i < nn_model->num_layers; i++ ) {
-    // TODO: This only works for Layer_FF layers, we need a more flexible system
-    layer_ff__run( nn_model__get_layer_ff_at( nn_model, i ),
-        nn_model->activations[i-1], nn_model->activations[i] );
+    nn_model->layer_ops[i]->forward_batch( nn_model->layer_structs[i], batch_size,
+        batch_activations[i-1], batch_activations[i] );
   }
 
   return;
 }
 
+// As nn_model__run_batch, but with sparse inputs to the first layer, which must be feed-forward
+void nn_model__run_batch_csr( NNModel *nn_model, int batch_size, CSRRows *inputs, float **batch_activations ) {
+  int i;
+
+  layer_ff__run_batch_csr( (Layer_FF *) nn_model->layer_structs[0], batch_size, inputs, batch_activations[0] );
+
+  for ( i = 1; i < nn_model->num_layers; i++ ) {
+    nn_model->layer_ops[i]->forward_batch( nn_model->layer_structs[i], batch_size,
+        batch_activations[i-1], batch_activations[i] );
+  }
+
+  return;
+}
+
+// Takes an idle workspace, or makes a new one. This must be called with the GVL held, which is
+// also what keeps the pool safe from other Ruby threads. The workspace has at least
+// num_batch_slots sets of batch_activations.
+NNModelWorkspace *nn_model__acquire_workspace( NNModel *nn_model, int num_batch_slots ) {
+  int i, slot;
+  NNModelWorkspace *workspace = nn_model->idle_workspaces;
+
+  if ( workspace ) {
+    nn_model->idle_workspaces = workspace->next;
+    nn_model->num_idle_workspaces--;
+  } else {
+    workspace = xmalloc( sizeof(NNModelWorkspace) );
+    workspace->batch_activations = NULL;
+    workspace->num_batch_slots = 0;
+    workspace->activations = ALLOC_N( float*, nn_model->num_layers );
+    for ( i = 0; i < nn_model->num_layers; i++ ) {
+      workspace->activations[i] = ALLOC_N( float, nn_model__layer_num_outputs_at( nn_model, i ) );
+    }
+  }
+  workspace->next = NULL;
+
+  if ( num_batch_slots > workspace->num_batch_slots ) {
+    REALLOC_N( workspace->batch_activations, float**, num_batch_slots );
+    for ( slot = workspace->num_batch_slots; slot < num_batch_slots; slot++ ) {
+      workspace->batch_activations[slot] = ALLOC_N( float*, nn_model->num_layers );
+      for ( i = 0; i < nn_model->num_layers; i++ ) {
+        workspace->batch_activations[slot][i] = i < nn_model->num_layers - 1 ?
+            ALLOC_N( float, NN_MODEL_RUN_BATCH_SIZE * nn_model__layer_num_outputs_at( nn_model, i ) ) : NULL;
+      }
+    }
+    workspace->num_batch_slots = num_batch_slots;
+  }
+
+  return workspace;
+}
+
+// Returns a workspace to the pool, or frees it if there are enough idle ones. This must be
+// called with the GVL held.
+void nn_model__release_workspace( NNModel *nn_model, NNModelWorkspace *workspace ) {
+  if ( nn_model->num_idle_workspaces >= NN_MODEL_MAX_IDLE_WORKSPACES ) {
+    nn_model__free_workspace( nn_model, workspace );
+    return;
+  }
+  workspace->next = nn_model->idle_workspaces;
+  nn_model->idle_workspaces = workspace;
+  nn_model->num_idle_workspaces++;
+  return;
+}
+
 Layer_FF *nn_model__get_layer_ff_at( NNModel *nn_model, int idx ) {
   Layer_FF * layer_ff;
   Data_Get_Struct( nn_model->layers[idx], Layer_FF, layer_ff );
   return layer_ff;
 }
 
+int nn_model__layer_num_inputs_at( NNModel *nn_model, int idx ) {
+  return nn_model->layer_ops[idx]->num_inputs( nn_model->layer_structs[idx] );
+}
+
+int nn_model__layer_num_outputs_at( NNModel *nn_model, int idx ) {
+  return nn_model->layer_ops[idx]->num_outputs( nn_model->layer_structs[idx] );
+}
+
+transfer_type nn_model__layer_transfer_at( NNModel *nn_model, int idx ) {
+  return nn_model->layer_ops[idx]->transfer( nn_model->layer_structs[idx] );
+}
+
+VALUE nn_model__layer_narr_weights_at( NNModel *nn_model, int idx ) {
+  return nn_model->layer_ops[idx]->narr_params( nn_model->layer_structs[idx] );
+}
+
+float *nn_model__layer_weights_at( NNModel *nn_model, int idx ) {
+  return nn_model->layer_ops[idx]->params( nn_model->layer_structs[idx] );
+}
+
+int nn_model__layer_num_weights_at( NNModel *nn_model, int idx ) {
+  return nn_model->layer_ops[idx]->num_params( nn_model->layer_structs[idx] );
+}
@@ -11,13 +11,40 @@
 #include <ruby.h>
 #include "narray.h"
 #include "struct_layer_ff.h"
+#include "struct_layer_embedding.h"
+#include "struct_layer_ops.h"
 
+// Number of items processed together by run_batch
+#define NN_MODEL_RUN_BATCH_SIZE 256
+
+// Most workspaces kept for re-use when no call is using them
+#define NN_MODEL_MAX_IDLE_WORKSPACES 8
+
+// Activation buffers for one call to run or run_batch, so that many threads can run the same
+// model and share its weights. There is one set of batch_activations for each pool thread that
+// works on a run_batch call, and none until a batch is run. They have no buffer for the last
+// layer, as run_batch writes that layer straight to its output.
+typedef struct _nn_model_workspace {
+  float **activations;
+  float ***batch_activations;
+  int num_batch_slots;
+  struct _nn_model_workspace *next;
+  } NNModelWorkspace;
+
+// The LayerOps and struct of each layer are found once by nn_model__init, so that running and
+// training a model does not need to look inside the Ruby layer objects
 typedef struct _nn_model_raw {
   VALUE *layers;
+  const LayerOps **layer_ops;
+  void **layer_structs;
   float **activations;
   int num_layers;
   int num_inputs;
   int num_outputs;
+  volatile VALUE narr_arena;
+  NNModelWorkspace *idle_workspaces;
+  int num_idle_workspaces;
+  int num_busy;
   } NNModel;
 
 NNModel *nn_model__create();
@@ -32,8 +59,41 @@ void nn_model__deep_copy( NNModel *nn_model_copy, NNModel *nn_model_orig );
 
 NNModel * nn_model__clone( NNModel *nn_model_orig );
 
+void nn_model__pack_arena( NNModel *nn_model );
+
+// Counts calls that release the GVL while running or training the model. Any number of them can
+// use the model at once, but its weights must not be moved meanwhile.
+void nn_model__start_busy( NNModel *nn_model );
+
+void nn_model__end_busy( NNModel *nn_model );
+
+// Raises RuntimeError if any call has started with nn_model__start_busy and not yet ended
+void nn_model__check_not_busy( NNModel *nn_model );
+
 void nn_model__run( NNModel *nn_model, float *inputs );
 
+void nn_model__run_with_activations( NNModel *nn_model, float *inputs, float **activations );
+
+void nn_model__run_batch( NNModel *nn_model, int batch_size, float *inputs, float **batch_activations );
+
+void nn_model__run_batch_csr( NNModel *nn_model, int batch_size, CSRRows *inputs, float **batch_activations );
+
+NNModelWorkspace *nn_model__acquire_workspace( NNModel *nn_model, int num_batch_slots );
+
+void nn_model__release_workspace( NNModel *nn_model, NNModelWorkspace *workspace );
+
 Layer_FF *nn_model__get_layer_ff_at( NNModel *nn_model, int idx );
 
+int nn_model__layer_num_inputs_at( NNModel *nn_model, int idx );
+
+int nn_model__layer_num_outputs_at( NNModel *nn_model, int idx );
+
+transfer_type nn_model__layer_transfer_at( NNModel *nn_model, int idx );
+
+VALUE nn_model__layer_narr_weights_at( NNModel *nn_model, int idx );
+
+float *nn_model__layer_weights_at( NNModel *nn_model, int idx );
+
+int nn_model__layer_num_weights_at( NNModel *nn_model, int idx );
+
 #endif
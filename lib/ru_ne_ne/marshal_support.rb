@@ -175,6 +175,68 @@ class RuNeNe::GradientDescent::RMSProp
   end
 end
 
+class RuNeNe::GradientDescent::AdaGrad
+  # Short name for AdaGrad optimiser, used as a param for some methods
+  # @return [Symbol] :adagrad
+  def self.label
+    :adagrad
+  end
+
+  # @!visibility private
+  # Adds support for Marshal, via to_h and from_h methods
+  def to_h
+    Hash[
+      :num_params => self.num_params,
+      :sum_squared_grads => self.sum_squared_grads,
+      :epsilon => self.epsilon
+    ]
+  end
+
+  # @!visibility private
+  def _dump *ignored
+    Marshal.dump to_h
+  end
+
+  # @!visibility private
+  def self._load buf
+    h = Marshal.load buf
+    from_h h
+  end
+end
+
+class RuNeNe::GradientDescent::Adam
+  # Short name for Adam optimiser, used as a param for some methods
+  # @return [Symbol] :adam
+  def self.label
+    :adam
+  end
+
+  # @!visibility private
+  # Adds support for Marshal, via to_h and from_h methods
+  def to_h
+    Hash[
+      :num_params => self.num_params,
+      :first_moment => self.first_moment,
+      :second_moment => self.second_moment,
+      :num_steps => self.num_steps,
+      :beta1 => self.beta1,
+      :beta2 => self.beta2,
+      :epsilon => self.epsilon
+    ]
+  end
+
+  # @!visibility private
+  def _dump *ignored
+    Marshal.dump to_h
+  end
+
+  # @!visibility private
+  def self._load buf
+    h = Marshal.load buf
+    from_h h
+  end
+end
+
 class RuNeNe::Layer::FeedForward
   # @!visibility private
   # Adds support for Marshal, via to_h and from_h methods
@@ -205,22 +267,83 @@ class RuNeNe::Layer::FeedForward
   end
 end
 
-class RuNeNe::DataSet
+class RuNeNe::Layer::Embedding
   # @!visibility private
   # Adds support for Marshal, via to_h and from_h methods
   def to_h
     Hash[
-      :inputs => self.inputs,
-      :outputs => self.outputs,
+      :weights => self.weights,
+      :num_inputs => self.num_inputs,
     ]
   end
 
+  # @!visibility private
+  # Constructs a Layer from hash description. Used internally to support Marshal.
+  # @param [Hash] h Keys are :weights and :num_inputs
+  # @return [RuNeNe::Layer::Embedding] new object
+  def self.from_h h
+    RuNeNe::Layer::Embedding.from_weights( h[:weights], h[:num_inputs] )
+  end
+
+  # @!visibility private
+  def _dump *ignored
+    Marshal.dump to_h
+  end
+
+  # @!visibility private
+  def self._load buf
+    h = Marshal.load buf
+    from_h h
+  end
+end
+
+class RuNeNe::DataSet
+  # @!visibility private
+  # Adds support for Marshal, via to_h and from_h methods. A memory-mapped DataSet only
+  # stores the path to its file, and a view stores the DataSet it shares plus its indices.
+  def to_h
+    raise TypeError, "Cannot save a streaming DataSet" if self.source
+    h = Hash[ :shuffle_block_size => self.shuffle_block_size ]
+    if self.mmap_path
+      h[:mmap_path] = self.mmap_path
+    elsif self.view_of
+      h[:view_of] = self.view_of
+      h[:indices] = self.indices
+    elsif self.csr
+      h[:csr] = self.csr
+      h[:num_inputs] = self.num_inputs
+      h[:outputs] = self.outputs
+    else
+      h[:inputs] = self.inputs
+      h[:outputs] = self.outputs
+      unless self.input_type == :sfloat
+        h[:input_type] = self.input_type
+        h[:input_scale] = self.input_scale
+        h[:input_offset] = self.input_offset
+      end
+    end
+    h
+  end
+
   # @!visibility private
   # Constructs a DataSet from hash description. Used internally to support Marshal.
   # @param [Hash] h Keys are :weights and :transfer
   # @return [RuNeNe::Layer::FeedForward] new object
   def self.from_h h
-    RuNeNe::DataSet.new( h[:inputs], h[:outputs] )
+    dataset = if h[:mmap_path]
+      RuNeNe::DataSet.open_mmap( h[:mmap_path] )
+    elsif h[:view_of]
+      h[:view_of].subset( h[:indices] )
+    elsif h[:csr]
+      RuNeNe::DataSet.from_csr( *h[:csr], h[:num_inputs], h[:outputs] )
+    elsif h[:input_type]
+      RuNeNe::DataSet.new( h[:inputs], h[:outputs], :input_type => h[:input_type],
+          :input_scale => h[:input_scale], :input_offset => h[:input_offset] )
+    else
+      RuNeNe::DataSet.new( h[:inputs], h[:outputs] )
+    end
+    dataset.shuffle_block_size = h[:shuffle_block_size]
+    dataset
   end
 
   # @!visibility private
@@ -239,12 +362,14 @@ class RuNeNe::Learn::MBGD::Layer
   # @!visibility private
   # Adds support for Marshal, via to_h and from_h methods
   def to_h
-    Hash[
+    h = Hash[
       [:num_inputs, :num_outputs, :learning_rate, :gradient_descent, :weight_decay, :max_norm,
        :de_dz, :de_da, :de_dw].map do |prop|
         [ prop, self.send(prop) ]
       end
     ]
+    h[:vocab_size] = self.vocab_size if self.vocab_size
+    h
   end
 
   # @!visibility private
@@ -80,5 +80,90 @@ describe RuNeNe do
         [ [ [ 8.5, 8.2 ], [ 11.34, 9.68 ] ], [ [ 7.68, 6.56 ], [ 11.24, 7.16 ] ], [ [ 9.14, 6.54 ], [ 12.44, 9.2 ] ] ]
       ]
     end
+
+    def reference_convolve_2d( a, b )
+      a_rows, b_rows = a.to_a, b.to_a
+      out_w, out_h = a.shape[0] - b.shape[0] + 1, a.shape[1] - b.shape[1] + 1
+      NArray.cast( Array.new( out_h ) { |y|
+        Array.new( out_w ) { |x|
+          t = 0.0
+          b.shape[1].times { |j| b.shape[0].times { |i| t += a_rows[y + j][x + i] * b_rows[j][i] } }
+          t
+        }
+      }, 'sfloat' )
+    end
+
+    def random_rows( *shape )
+      return Array.new( shape[0] ) { rand - 0.5 } if shape.size == 1
+      Array.new( shape.last ) { random_rows( *shape[0...-1] ) }
+    end
+
+    it "should calculate a 2D convolution with a large kernel" do
+      srand( 4400 )
+      a = NArray.cast( random_rows( 37, 29 ), 'sfloat' )
+      b = NArray.cast( random_rows( 13, 12 ), 'sfloat' )
+      c = RuNeNe.convolve( a, b )
+      expect( c.shape ).to eql [ 25, 18 ]
+      expect( c ).to be_narray_like reference_convolve_2d( a, b ), 1e-4
+    end
+
+    it "should calculate a bank of 2D kernels in one call" do
+      srand( 4500 )
+      a = NArray.cast( random_rows( 31, 23 ), 'sfloat' )
+      kernels = Array.new( 6 ) { random_rows( 5, 4 ) }
+      c = RuNeNe.convolve( a, NArray.cast( kernels, 'sfloat' ) )
+      expect( c.shape ).to eql [ 27, 20, 6 ]
+      kernels.each_with_index do |kernel, n|
+        expect( NArray.cast( c.to_a[n], 'sfloat' ) ).to be_narray_like reference_convolve_2d( a, NArray.cast( kernel, 'sfloat' ) ), 1e-4
+      end
+    end
+
+    it "should calculate a bank of 3D kernels the same as one at a time" do
+      srand( 4600 )
+      a = NArray.cast( random_rows( 11, 9, 6 ), 'sfloat' )
+      kernels = Array.new( 16 ) { random_rows( 4, 4, 4 ) }
+      c = RuNeNe.convolve( a, NArray.cast( kernels, 'sfloat' ) )
+      expect( c.shape ).to eql [ 8, 6, 3, 16 ]
+      kernels.each_with_index do |kernel, n|
+        expect( NArray.cast( c.to_a[n], 'sfloat' ) ).to be_narray_like RuNeNe.convolve( a, NArray.cast( kernel, 'sfloat' ) ), 1e-5
+      end
+    end
+
+    it "should calculate a 2D convolution with a kernel large enough to use FFT" do
+      srand( 4700 )
+      a = NArray.cast( random_rows( 96, 90 ), 'sfloat' )
+      b = NArray.cast( random_rows( 48, 45 ), 'sfloat' )
+      expected = reference_convolve_2d( a, b )
+      2.times do
+        c = RuNeNe.convolve( a, b )
+        expect( c.shape ).to eql [ 49, 46 ]
+        expect( c ).to be_narray_like expected, 1e-4
+      end
+    end
+
+    it "should calculate a 1D convolution with a kernel large enough to use FFT" do
+      srand( 4800 )
+      a_values, b_values = random_rows( 2000 ), random_rows( 600 )
+      expected = Array.new( 1401 ) { |x| t = 0.0; 600.times { |i| t += a_values[x + i] * b_values[i] }; t }
+      c = RuNeNe.convolve( NArray.cast( a_values, 'sfloat' ), NArray.cast( b_values, 'sfloat' ) )
+      expect( c ).to be_narray_like NArray.cast( expected, 'sfloat' ), 1e-4
+    end
+
+    it "should calculate a bank of large kernels using FFT" do
+      srand( 4900 )
+      a = NArray.cast( random_rows( 96, 90 ), 'sfloat' )
+      kernels = Array.new( 2 ) { random_rows( 48, 45 ) }
+      c = RuNeNe.convolve( a, NArray.cast( kernels, 'sfloat' ) )
+      expect( c.shape ).to eql [ 49, 46, 2 ]
+      kernels.each_with_index do |kernel, n|
+        expect( NArray.cast( c.to_a[n], 'sfloat' ) ).to be_narray_like reference_convolve_2d( a, NArray.cast( kernel, 'sfloat' ) ), 1e-4
+      end
+    end
+
+    it "should refuse a kernel more than one rank higher than the signal" do
+      a = NArray.sfloat( 5, 5 )
+      b = NArray.sfloat( 2, 2, 2, 2 )
+      expect { RuNeNe.convolve( a, b ) }.to raise_error ArgumentError
+    end
   end
 end
@@ -1,4 +1,6 @@
 require 'helpers'
+require 'tmpdir'
+require 'stringio'
 
 describe RuNeNe::DataSet do
   let(:xor_inputs) { NArray.cast( [ [-1.0, -1.0], [1.0, -1.0], [-1.0, 1.0], [1.0, 1.0] ], 'sfloat' ) }
@@ -34,6 +36,62 @@ describe RuNeNe::DataSet do
         expect { RuNeNe::DataSet.new( xor_inputs, bad_targets ) }.to raise_error ArgumentError
       end
 
+      it "stores byte inputs compactly, reading them with a scale and offset" do
+        byte_inputs = NArray.cast( [ [0, 255], [255, 0], [0, 0], [255, 255] ], 'byte' )
+        training = RuNeNe::DataSet.new( byte_inputs, xor_targets, :input_scale => 2.0 / 255, :input_offset => -1.0 )
+        expect( training.input_type ).to be :byte
+        expect( training.inputs ).to be byte_inputs
+        expect( training.input_scale ).to be_narray_like NArray.cast( [2.0 / 255, 2.0 / 255], 'sfloat' )
+        expect( training.input_offset ).to be_narray_like NArray.cast( [-1.0, -1.0], 'sfloat' )
+        items = 4.times.map { training.next_item; training.current_input_item.to_a.map(&:round) }
+        expect( items.sort ).to eql [ [-1, -1], [-1, 1], [1, -1], [1, 1] ]
+      end
+
+      it "accepts a scale and offset per input feature" do
+        byte_inputs = NArray.cast( [ [1, 2], [3, 4], [5, 6], [7, 8] ], 'byte' )
+        training = RuNeNe::DataSet.new( byte_inputs, xor_targets,
+            :input_scale => NArray.cast( [1.0, 0.5], 'sfloat' ), :input_offset => NArray.cast( [0.0, 10.0], 'sfloat' ) )
+        items = 4.times.map { training.next_item; training.current_input_item.to_a }
+        expect( items.sort ).to eql [ [1.0, 11.0], [3.0, 12.0], [5.0, 13.0], [7.0, 14.0] ]
+      end
+
+      it "stores float16 inputs compactly" do
+        training = RuNeNe::DataSet.new( xor_inputs * 0.1, xor_targets, :input_type => :float16 )
+        expect( training.input_type ).to be :float16
+        expect( training.inputs.typecode ).to be 2
+        items = 4.times.map { training.next_item; training.current_input_item }
+        items.each do |item|
+          expect( item[0].abs ).to be_within( 0.0001 ).of 0.1
+          expect( item[1].abs ).to be_within( 0.0001 ).of 0.1
+        end
+      end
+
+      it "widens compact inputs correctly for all vector tail sizes" do
+        NArray.srand( 800 )
+        [1, 7, 8, 15, 16, 17, 33].each do |size|
+          byte_inputs = NArray.byte( size, 1 ).random( 256 )
+          scale = NArray.sfloat( size ).random( 2.0 )
+          offset = NArray.sfloat( size ).random( 2.0 )
+          expected = NArray.sfloat( size )
+          size.times { |i| expected[i] = byte_inputs[i] * scale[i] + offset[i] }
+
+          training = RuNeNe::DataSet.new( byte_inputs, NArray.sfloat( 1, 1 ), :input_scale => scale, :input_offset => offset )
+          expect( training.current_input_item ).to be_narray_like expected, 1e-8
+
+          float_inputs = NArray.sfloat( size, 1 ).random( 2.0 )
+          training = RuNeNe::DataSet.new( float_inputs, NArray.sfloat( 1, 1 ), :input_type => :float16 )
+          expect( training.current_input_item ).to be_narray_like float_inputs[true, 0], 1e-6
+        end
+      end
+
+      it "refuses bad input storage options" do
+        expect { RuNeNe::DataSet.new( xor_inputs, xor_targets, :input_scale => 2.0 ) }.to raise_error ArgumentError
+        expect { RuNeNe::DataSet.new( xor_inputs, xor_targets, :input_type => :int ) }.to raise_error ArgumentError
+        expect {
+          RuNeNe::DataSet.new( xor_inputs, xor_targets, :input_type => :byte, :input_scale => NArray.sfloat(3) )
+        }.to raise_error ArgumentError
+      end
+
       it "refuses to create new object when inputs and targets last dimension does not match" do
         xor_target_missing = NArray.cast( [ [0.0], [1.0], [1.0] ], 'sfloat' )
         expect {
@@ -42,6 +100,220 @@ describe RuNeNe::DataSet do
       end
     end
 
+    describe "#open_mmap" do
+      before :each do
+        @path = File.join( Dir.tmpdir, "ru_ne_ne_dataset_spec_#{Process.pid}.bin" )
+        RuNeNe::DataSet.new( xor_inputs, xor_targets ).write_file( @path )
+      end
+
+      after :each do
+        File.delete( @path ) if File.exist?( @path )
+      end
+
+      it "opens a file written by #write_file" do
+        training = RuNeNe::DataSet.open_mmap( @path )
+        expect( training ).to be_a RuNeNe::DataSet
+        expect( training.num_items ).to be 4
+        expect( training.mmap_path ).to eql @path
+        expect( training.inputs ).to be_nil
+        expect( training.outputs ).to be_nil
+      end
+
+      it "serves the same items as the original data" do
+        training = RuNeNe::DataSet.open_mmap( @path )
+        items = (0..3).map do |x|
+          training.next_item
+          [ training.current_input_item.to_a, training.current_output_item.to_a ]
+        end
+        expect( items.map(&:first).sort ).to eql xor_inputs.to_a.sort
+        items.each do |input_item, output_item|
+          expect( output_item ).to eql xor_targets.to_a[ xor_inputs.to_a.index( input_item ) ]
+        end
+      end
+
+      it "preserves item shapes" do
+        inputs = NArray.sfloat( 3, 2, 5 ).random
+        outputs = NArray.sfloat( 2, 5 ).random
+        RuNeNe::DataSet.new( inputs, outputs ).write_file( @path )
+        training = RuNeNe::DataSet.open_mmap( @path )
+        expect( training.num_items ).to be 5
+        expect( training.current_input_item.shape ).to eql [3, 2]
+        expect( training.current_output_item.shape ).to eql [2]
+        expect( inputs.to_a ).to include training.current_input_item.to_a
+      end
+
+      it "can be cloned and saved with Marshal" do
+        training = RuNeNe::DataSet.open_mmap( @path )
+        [ training.clone, Marshal.load( Marshal.dump( training ) ) ].each do |copy|
+          expect( copy ).to_not be training
+          expect( copy.mmap_path ).to eql @path
+          expect( copy.num_items ).to be 4
+        end
+      end
+
+      it "maps compact inputs with their scale and offset" do
+        byte_inputs = NArray.cast( [ [0, 255], [255, 0], [0, 0], [255, 255] ], 'byte' )
+        RuNeNe::DataSet.new( byte_inputs, xor_targets, :input_scale => 2.0 / 255, :input_offset => -1.0 ).write_file( @path )
+        training = RuNeNe::DataSet.open_mmap( @path )
+        expect( training.input_type ).to be :byte
+        expect( training.input_offset ).to be_narray_like NArray.cast( [-1.0, -1.0], 'sfloat' )
+        items = 4.times.map { training.next_item; training.current_input_item.to_a.map(&:round) }
+        expect( items.sort ).to eql [ [-1, -1], [-1, 1], [1, -1], [1, 1] ]
+      end
+
+      it "refuses to open missing or invalid files" do
+        expect { RuNeNe::DataSet.open_mmap( @path + ".missing" ) }.to raise_error SystemCallError
+        File.open( @path, "wb" ) { |f| f.write( "not a dataset" * 20 ) }
+        expect { RuNeNe::DataSet.open_mmap( @path ) }.to raise_error IOError
+        File.open( @path, "wb" ) { |f| f.write( "RuNeNeDS" ) }
+        expect { RuNeNe::DataSet.open_mmap( @path ) }.to raise_error IOError
+      end
+
+      it "refuses to open a truncated file" do
+        data = File.binread( @path )
+        File.binwrite( @path, data[0...-4] )
+        expect { RuNeNe::DataSet.open_mmap( @path ) }.to raise_error IOError
+      end
+    end
+
+    describe "#from_csr" do
+      before :each do
+        # Three items of 5 inputs: [0, 2, 0, 0, 1], [0, 0, 0, 0, 0] and [3, 0, 0, 0, 0]
+        @row_ptr = NArray.cast( [ 0, 2, 2, 3 ], 'int' )
+        @col_idx = NArray.cast( [ 1, 4, 0 ], 'int' )
+        @values = NArray.cast( [ 2.0, 1.0, 3.0 ], 'sfloat' )
+        @targets = NArray.cast( [ [ 1.0 ], [ 2.0 ], [ 3.0 ] ], 'sfloat' )
+        @data = RuNeNe::DataSet.from_csr( @row_ptr, @col_idx, @values, 5, @targets )
+      end
+
+      def dense_items dataset
+        dataset.num_items.times.map do
+          dataset.next_item
+          [ dataset.current_output_item[0], dataset.current_input_item.to_a ]
+        end.sort
+      end
+
+      let(:expected_items) { [ [ 1.0, [ 0.0, 2.0, 0.0, 0.0, 1.0 ] ], [ 2.0, [ 0.0 ] * 5 ], [ 3.0, [ 3.0, 0.0, 0.0, 0.0, 0.0 ] ] ] }
+
+      it "creates a DataSet with sparse inputs" do
+        expect( @data.input_type ).to be :csr
+        expect( @data.num_items ).to be 3
+        expect( @data.num_inputs ).to be 5
+        expect( @data.inputs ).to be_nil
+        expect( @data.csr.map( &:to_a ) ).to eql [ [ 0, 2, 2, 3 ], [ 1, 4, 0 ], [ 2.0, 1.0, 3.0 ] ]
+      end
+
+      it "expands the current input item" do
+        expect( dense_items( @data ) ).to eql expected_items
+      end
+
+      it "can be cloned, saved with Marshal, or viewed" do
+        [ @data.clone, Marshal.load( Marshal.dump( @data ) ) ].each do |copy|
+          expect( copy.input_type ).to be :csr
+          expect( dense_items( copy ) ).to eql expected_items
+        end
+        expect( dense_items( @data.subset( [ 2, 0 ] ) ) ).to eql [ expected_items[0], expected_items[2] ]
+      end
+
+      it "refuses inconsistent arrays" do
+        expect { RuNeNe::DataSet.from_csr( @row_ptr, @col_idx, @values, 4, @targets ) }.to raise_error ArgumentError
+        expect { RuNeNe::DataSet.from_csr( NArray.cast( [ 0, 2, 1, 3 ], 'int' ), @col_idx, @values, 5, @targets ) }.to raise_error ArgumentError
+        expect { RuNeNe::DataSet.from_csr( NArray.cast( [ 0, 2, 2, 2 ], 'int' ), @col_idx, @values, 5, @targets ) }.to raise_error ArgumentError
+        expect { RuNeNe::DataSet.from_csr( @row_ptr, @col_idx, NArray.cast( [ 2.0, 1.0 ], 'sfloat' ), 5, @targets ) }.to raise_error ArgumentError
+        expect { RuNeNe::DataSet.from_csr( @row_ptr, @col_idx, @values, 5, NArray.cast( [ [ 1.0 ], [ 2.0 ] ], 'sfloat' ) ) }.to raise_error ArgumentError
+        expect { RuNeNe::DataSet.new( xor_inputs, xor_targets, :input_type => :csr ) }.to raise_error ArgumentError
+      end
+
+      it "cannot be written to a file" do
+        Dir.mktmpdir do |dir|
+          expect { @data.write_file( File.join( dir, 'sparse.rnds' ) ) }.to raise_error ArgumentError
+        end
+      end
+    end
+
+    describe "#stream" do
+      let(:stream_items) { (0...20).map { |i| [ [ i, i + 0.5 ], [ i ] ] } }
+
+      def take_ids dataset, n
+        n.times.map do
+          dataset.next_item
+          id = dataset.current_output_item[0]
+          expect( dataset.current_input_item.to_a ).to eql [ id, id + 0.5 ]
+          id.to_i
+        end
+      end
+
+      it "reads [ input, output ] pairs from an enumerator" do
+        data = RuNeNe::DataSet.stream( stream_items.each, 2, 1, :buffer_size => 8 )
+        expect( data.source ).to be_a Enumerator
+        expect( data.buffer_size ).to be 8
+        expect( data.inputs ).to be_nil
+        expect( take_ids( data, 20 ).sort ).to eql (0...20).to_a
+        expect { data.next_item }.to raise_error StopIteration
+      end
+
+      it "shuffles items within the buffer" do
+        RuNeNe.srand( 800 )
+        ids = take_ids( RuNeNe::DataSet.stream( stream_items.each, 2, 1, :buffer_size => 4 ), 20 )
+        expect( ids ).to_not eql (0...20).to_a
+        # No item can be taken before the buffer has been filled as far as it
+        ids.each_with_index { |id, i| expect( id ).to be <= i + 3 }
+
+        ids = take_ids( RuNeNe::DataSet.stream( stream_items.each, 2, 1, :buffer_size => 1 ), 20 )
+        expect( ids ).to eql (0...20).to_a
+      end
+
+      it "reads sfloat records from an IO" do
+        io = StringIO.new( stream_items.flatten.pack( 'f*' ) )
+        data = RuNeNe::DataSet.stream( io, [ 2 ], [ 1 ], :buffer_size => 5 )
+        expect( take_ids( data, 20 ).sort ).to eql (0...20).to_a
+        expect { data.next_item }.to raise_error StopIteration
+      end
+
+      it "refuses an IO that ends part way through an item" do
+        io = StringIO.new( stream_items.flatten.pack( 'f*' )[0...-4] )
+        data = RuNeNe::DataSet.stream( io, 2, 1, :buffer_size => 50 )
+        expect { data.next_item }.to raise_error IOError
+      end
+
+      it "rewinds the source with :repeat" do
+        data = RuNeNe::DataSet.stream( stream_items.each, 2, 1, :buffer_size => 8, :repeat => true )
+        ids = take_ids( data, 50 )
+        expect( ids.uniq.sort ).to eql (0...20).to_a
+      end
+
+      it "is consumed by MBGD#train_one_batch until the source ends" do
+        nn = RuNeNe::NNModel.new( [ RuNeNe::Layer::FeedForward.new( 2, 3 ), RuNeNe::Layer::FeedForward.new( 3, 1 ) ] )
+        nn.init_weights
+        learn = RuNeNe::Learn::MBGD.from_nn_model( nn, :learning_rate => 0.001 )
+        data = RuNeNe::DataSet.stream( stream_items.each, 2, 1, :buffer_size => 6 )
+
+        3.times { expect( learn.train_one_batch( nn, data, 6 ) ).to be_a Float }
+        expect( data.num_items ).to be 0
+        expect( learn.train_one_batch( nn, data, 6 ) ).to be_a Float
+        expect { learn.train_one_batch( nn, data, 6 ) }.to raise_error StopIteration
+        expect { learn.train_one_batch( nn, data, 7 ) }.to raise_error ArgumentError
+      end
+
+      it "cannot be cloned, split or saved" do
+        data = RuNeNe::DataSet.stream( stream_items.each, 2, 1 )
+        expect { data.clone }.to raise_error TypeError
+        expect { data.split( [ 0.5 ] ) }.to raise_error TypeError
+        expect { Marshal.dump( data ) }.to raise_error TypeError
+      end
+
+      it "refuses bad options" do
+        expect { RuNeNe::DataSet.stream( stream_items.each, 2, 1, :buffer_size => 0 ) }.to raise_error ArgumentError
+        expect { RuNeNe::DataSet.stream( stream_items.each, [], 1 ) }.to raise_error ArgumentError
+        expect { RuNeNe::DataSet.stream( stream_items, 2, 1 ) }.to raise_error TypeError
+      end
+
+      it "refuses items of the wrong size" do
+        data = RuNeNe::DataSet.stream( [ [ [ 1.0 ], [ 1.0 ] ] ].each, 2, 1 )
+        expect { data.next_item }.to raise_error ArgumentError
+      end
+    end
+
     describe "with Marshal" do
       before do
         @orig_data = RuNeNe::DataSet.new( xor_inputs, xor_targets )
@@ -69,6 +341,212 @@ describe RuNeNe::DataSet do
       @tdata = RuNeNe::DataSet.new( xor_inputs, xor_targets )
     end
 
+    describe "with compact inputs" do
+      before :each do
+        # Same values as xor_inputs
+        @byte_data = RuNeNe::DataSet.new( NArray.cast( [ [0, 0], [255, 0], [0, 255], [255, 255] ], 'byte' ),
+            xor_targets, :input_scale => 2.0 / 255, :input_offset => -1.0 )
+      end
+
+      it "can be cloned or saved with Marshal" do
+        [ @byte_data.clone, Marshal.load( Marshal.dump( @byte_data ) ) ].each do |copy|
+          expect( copy.input_type ).to be :byte
+          expect( copy.inputs ).to be_narray_like @byte_data.inputs
+          expect( copy.input_scale ).to be_narray_like @byte_data.input_scale
+          expect( copy.input_offset ).to be_narray_like @byte_data.input_offset
+        end
+      end
+
+      it "trains the same as float inputs" do
+        nn = RuNeNe::NNModel.new( [ RuNeNe::Layer::FeedForward.new( 2, 2 ), RuNeNe::Layer::FeedForward.new( 2, 1 ) ] )
+        nn.init_weights
+        float_nn = nn.clone
+        learn = RuNeNe::Learn::MBGD.from_nn_model( nn, :learning_rate => 1.0 )
+        float_learn = learn.clone
+
+        RuNeNe.srand( 400 )
+        losses = 20.times.map { learn.train_one_batch( nn, @byte_data, 2 ) }
+        RuNeNe.srand( 400 )
+        float_losses = 20.times.map { float_learn.train_one_batch( float_nn, @tdata, 2 ) }
+
+        losses.zip( float_losses ).each { |a, b| expect( a ).to be_within( 1e-6 ).of b }
+      end
+    end
+
+    describe "views" do
+      before :each do
+        @inputs = NArray.sfloat( 3, 10 )
+        @outputs = NArray.sfloat( 1, 10 )
+        10.times do |i|
+          3.times { |j| @inputs[ j + 3 * i ] = i + 0.25 * j }
+          @outputs[i] = i
+        end
+        @data = RuNeNe::DataSet.new( @inputs, @outputs )
+      end
+
+      def all_item_ids dataset
+        dataset.num_items.times.map do
+          dataset.next_item
+          expect( dataset.current_input_item[0] ).to eql dataset.current_output_item[0]
+          dataset.current_output_item[0].to_i
+        end
+      end
+
+      it "#subset selects items without copying inputs or outputs" do
+        view = @data.subset( [ 7, 2, 5 ] )
+        expect( view.num_items ).to be 3
+        expect( view.view_of ).to be @data
+        expect( view.indices.to_a ).to eql [ 7, 2, 5 ]
+        expect( view.inputs ).to be_nil
+        expect( view.outputs ).to be_nil
+        expect( all_item_ids( view ).sort ).to eql [ 2, 5, 7 ]
+        expect( @data.view_of ).to be_nil
+        expect( @data.indices ).to be_nil
+      end
+
+      it "#subset of a view refers to the original DataSet" do
+        view = @data.subset( [ 9, 8, 7, 6 ] ).subset( [ 3, 1 ] )
+        expect( view.view_of ).to be @data
+        expect( view.indices.to_a ).to eql [ 6, 8 ]
+      end
+
+      it "#subset refuses indices out of range" do
+        expect { @data.subset( [ 0, 10 ] ) }.to raise_error ArgumentError
+        expect { @data.subset( [ -1 ] ) }.to raise_error ArgumentError
+        expect { @data.subset( [] ) }.to raise_error ArgumentError
+      end
+
+      it "#split divides all items between views" do
+        RuNeNe.srand( 600 )
+        views = @data.split( [ 0.6, 0.2, 0.2 ] )
+        expect( views.map( &:num_items ) ).to eql [ 6, 2, 2 ]
+        ids = views.map { |view| all_item_ids( view ) }
+        expect( ids.flatten.sort ).to eql (0..9).to_a
+        expect( ids[0].sort ).to_not eql (0..5).to_a
+      end
+
+      it "#split is repeatable with RuNeNe.srand" do
+        RuNeNe.srand( 600 )
+        first = @data.split( [ 0.5, 0.5 ] ).map { |view| view.indices.to_a }
+        RuNeNe.srand( 600 )
+        second = @data.split( [ 0.5, 0.5 ] ).map { |view| view.indices.to_a }
+        expect( second ).to eql first
+      end
+
+      it "#split with :shuffle => false gives contiguous ranges" do
+        views = @data.split( [ 0.7, 0.3 ], :shuffle => false )
+        expect( views.map { |view| view.indices.to_a } ).to eql [ (0..6).to_a, (7..9).to_a ]
+      end
+
+      it "#split refuses bad fractions" do
+        expect { @data.split( [ 0.6, 0.6 ] ) }.to raise_error ArgumentError
+        expect { @data.split( [ 0.5, 0.0 ] ) }.to raise_error ArgumentError
+        expect { @data.split( [ 0.01 ] ) }.to raise_error ArgumentError
+        expect { @data.split( [] ) }.to raise_error ArgumentError
+      end
+
+      it "keeps its own item order" do
+        view = @data.subset( (0..9).to_a )
+        @data.next_item
+        before = @data.current_output_item[0]
+        all_item_ids( view )
+        expect( @data.current_output_item[0] ).to eql before
+      end
+
+      it "can be cloned or saved with Marshal" do
+        view = @data.subset( [ 4, 1, 3 ] )
+        [ view.clone, Marshal.load( Marshal.dump( view ) ) ].each do |copy|
+          expect( copy.indices.to_a ).to eql [ 4, 1, 3 ]
+          expect( all_item_ids( copy ).sort ).to eql [ 1, 3, 4 ]
+        end
+      end
+
+      it "writes only its own items with #write_file" do
+        Dir.mktmpdir do |dir|
+          path = File.join( dir, 'view.rnds' )
+          view = RuNeNe::DataSet.new( @inputs, @outputs, :input_type => :float16 ).subset( [ 8, 3 ] )
+          view.write_file( path )
+          mapped = RuNeNe::DataSet.open_mmap( path )
+          expect( mapped.num_items ).to be 2
+          expect( mapped.input_type ).to be :float16
+          expect( all_item_ids( mapped ).sort ).to eql [ 3, 8 ]
+        end
+      end
+
+      it "trains the same as a copy of the selected items" do
+        nn = RuNeNe::NNModel.new( [ RuNeNe::Layer::FeedForward.new( 3, 4 ), RuNeNe::Layer::FeedForward.new( 4, 1 ) ] )
+        nn.init_weights
+        copy_nn = nn.clone
+        learn = RuNeNe::Learn::MBGD.from_nn_model( nn, :learning_rate => 0.01 )
+        copy_learn = learn.clone
+
+        view = @data.subset( [ 5, 0, 9, 2 ] )
+        copy_inputs = NArray.sfloat( 3, 4 )
+        copy_outputs = NArray.sfloat( 1, 4 )
+        [ 5, 0, 9, 2 ].each_with_index do |item, i|
+          3.times { |j| copy_inputs[ j + 3 * i ] = @inputs[ j + 3 * item ] }
+          copy_outputs[i] = @outputs[item]
+        end
+        copy = RuNeNe::DataSet.new( copy_inputs, copy_outputs )
+
+        RuNeNe.srand( 700 )
+        losses = 10.times.map { learn.train_one_batch( nn, view, 2 ) }
+        RuNeNe.srand( 700 )
+        copy_losses = 10.times.map { copy_learn.train_one_batch( copy_nn, copy, 2 ) }
+
+        losses.zip( copy_losses ).each { |a, b| expect( a ).to be_within( 1e-6 ).of b }
+      end
+    end
+
+    describe "#shuffle_block_size" do
+      before :each do
+        outputs = NArray.sfloat( 1, 10 )
+        10.times { |i| outputs[i] = i }
+        @data = RuNeNe::DataSet.new( NArray.sfloat( 2, 10 ), outputs )
+      end
+
+      def epoch_ids dataset
+        10.times.map do
+          dataset.next_item
+          dataset.current_output_item[0].to_i
+        end
+      end
+
+      it "is nil by default" do
+        expect( @data.shuffle_block_size ).to be_nil
+      end
+
+      it "shuffles blocks of stored items, and items within blocks" do
+        RuNeNe.srand( 900 )
+        @data.shuffle_block_size = 4
+        epochs = 3.times.map { epoch_ids( @data ) }
+        epochs.each do |ids|
+          blocks = ids.chunk_while { |a, b| a / 4 == b / 4 }.map( &:sort )
+          expect( blocks.sort ).to eql [ [0, 1, 2, 3], [4, 5, 6, 7], [8, 9] ]
+        end
+        expect( epochs.uniq.size ).to be > 1
+        expect( epochs.any? { |ids| ids.each_cons( 2 ).any? { |a, b| b != a + 1 } } ).to be true
+      end
+
+      it "can be set back to nil for a full shuffle" do
+        @data.shuffle_block_size = 4
+        @data.shuffle_block_size = nil
+        expect( @data.shuffle_block_size ).to be_nil
+        expect( epoch_ids( @data ).sort ).to eql (0...10).to_a
+      end
+
+      it "is kept by clones, views and Marshal" do
+        @data.shuffle_block_size = 3
+        [ @data.clone, @data.subset( [ 1, 2 ] ), Marshal.load( Marshal.dump( @data ) ) ].each do |copy|
+          expect( copy.shuffle_block_size ).to be 3
+        end
+      end
+
+      it "refuses a block size less than 1" do
+        expect { @data.shuffle_block_size = 0 }.to raise_error ArgumentError
+      end
+    end
+
     describe "#clone" do
       it "makes deep copy of training data" do
         @copy_data = @tdata.clone
@@ -472,3 +472,254 @@ describe RuNeNe::GradientDescent::RMSProp do
     end
   end
 end
+
+describe RuNeNe::GradientDescent::AdaGrad do
+  describe "class methods" do
+    let(:example_params) { NArray.sfloat(2) }
+
+    describe "#new" do
+      it "creates a new object" do
+        expect( RuNeNe::GradientDescent::AdaGrad.new( example_params, 1e-6 ) ).to be_a RuNeNe::GradientDescent::AdaGrad
+      end
+
+      it "should take number of params from example input" do
+        gd = RuNeNe::GradientDescent::AdaGrad.new( example_params, 1e-6 )
+        expect( gd.num_params ).to be 2
+      end
+
+      it "should set an epsilon value" do
+        gd = RuNeNe::GradientDescent::AdaGrad.new( example_params, 1e-6 )
+        expect( gd.epsilon ).to be_within(1e-12).of 1e-6
+      end
+
+      it "should initialize a sum_squared_grads array to match params size and shape" do
+        gd = RuNeNe::GradientDescent::AdaGrad.new( NArray.sfloat(3,2), 1e-6 )
+        expect( gd.sum_squared_grads ).to be_narray_like NArray.sfloat(3,2)
+      end
+    end
+
+    describe "with Marshal" do
+      before do
+        @orig_data = RuNeNe::GradientDescent::AdaGrad.new( example_params, 1e-6 )
+        @orig_data.sum_squared_grads[0..1] = NArray[0.3,1.5]
+
+        @saved_data = Marshal.dump( @orig_data )
+        @copy_data =  Marshal.load( @saved_data )
+      end
+
+      it "can save and retrieve gradient descent settings" do
+        expect( @copy_data ).to_not be @orig_data
+        expect( @copy_data.num_params ).to be 2
+        expect( @copy_data.epsilon ).to be_within(1e-12).of 1e-6
+      end
+
+      it "can save and retrieve sum_squared_grads" do
+        expect( @copy_data.sum_squared_grads ).to_not be @orig_data.sum_squared_grads
+        expect( @copy_data.sum_squared_grads ).to be_narray_like @orig_data.sum_squared_grads
+      end
+    end
+  end
+
+  describe "instance methods" do
+    let :gd do
+       RuNeNe::GradientDescent::AdaGrad.new( NArray.sfloat(2), 1e-8 )
+    end
+
+    before :each do
+      NArray.srand(555)
+      @params = (NArray.sfloat(2).random - 0.5) * 10
+    end
+
+    describe "#clone" do
+      it "should make a deep copy of sum_squared_grads" do
+        gd.gradient_step( @params, NArray[0.5, -0.5], 0.1 )
+        copy = gd.clone
+        expect( copy.num_params ).to eql gd.num_params
+        expect( copy.sum_squared_grads ).to_not be gd.sum_squared_grads
+        expect( copy.sum_squared_grads ).to be_narray_like gd.sum_squared_grads
+      end
+    end
+
+    describe "#gradient_step" do
+      it "should alter params by learning rate on first step" do
+        before_params = @params.clone
+        gd.gradient_step( @params, NArray[0.5, -2.0], 0.1 )
+        expect( @params ).to be_narray_like before_params + NArray[-0.1, 0.1], 1e-5
+      end
+
+      it "should accumulate squared gradients" do
+        gd.gradient_step( @params, NArray[0.5, -2.0], 0.1 )
+        gd.gradient_step( @params, NArray[1.0, 1.0], 0.1 )
+        expect( gd.sum_squared_grads ).to be_narray_like NArray[1.25, 5.0], 1e-5
+      end
+
+      it "should match scalar calculation for long arrays" do
+        gd = RuNeNe::GradientDescent::AdaGrad.new( NArray.sfloat(11), 1e-6 )
+        params = NArray.sfloat(11).random - 0.5
+        gradients = NArray.sfloat(11).random - 0.5
+        expected_params = params - ( gradients * 0.1 ) / NMath.sqrt( gradients * gradients + 1e-6 )
+        gd.gradient_step( params, gradients, 0.1 )
+        expect( params ).to be_narray_like expected_params, 1e-5
+      end
+    end
+
+    describe "optimisation" do
+      it "should optimise a simple quadratic" do
+        tq = TestQuadratic.new(2)
+
+        expect( tq.value_at( @params ) ).to_not be_within(0.1).of 0
+        expect( @params ).to_not be_narray_like tq.roots
+
+        300.times do
+          gd.pre_gradient_step( @params, 2.0 )
+          gd.gradient_step( @params, tq.gradients_at(@params), 2.0 )
+        end
+        expect( tq.value_at( @params ) ).to be_within(1e-6).of 0
+        expect( @params ).to be_narray_like tq.roots
+      end
+    end
+  end
+end
+
+describe RuNeNe::GradientDescent::Adam do
+  describe "class methods" do
+    let(:example_params) { NArray.sfloat(2) }
+
+    describe "#new" do
+      it "creates a new object" do
+        expect( RuNeNe::GradientDescent::Adam.new( example_params, 0.9, 0.999, 1e-8 ) ).to be_a RuNeNe::GradientDescent::Adam
+      end
+
+      it "should take number of params from example input" do
+        gd = RuNeNe::GradientDescent::Adam.new( example_params, 0.9, 0.999, 1e-8 )
+        expect( gd.num_params ).to be 2
+      end
+
+      it "should set beta1, beta2 and epsilon values" do
+        gd = RuNeNe::GradientDescent::Adam.new( example_params, 0.8, 0.99, 1e-7 )
+        expect( gd.beta1 ).to be_within(1e-6).of 0.8
+        expect( gd.beta2 ).to be_within(1e-6).of 0.99
+        expect( gd.epsilon ).to be_within(1e-12).of 1e-7
+        expect( gd.num_steps ).to be 0
+      end
+
+      it "should initialize moment arrays to match params size and shape" do
+        gd = RuNeNe::GradientDescent::Adam.new( NArray.sfloat(3,2), 0.9, 0.999, 1e-8 )
+        expect( gd.first_moment ).to be_narray_like NArray.sfloat(3,2)
+        expect( gd.second_moment ).to be_narray_like NArray.sfloat(3,2)
+      end
+    end
+
+    describe "with Marshal" do
+      before do
+        @orig_data = RuNeNe::GradientDescent::Adam.new( example_params, 0.8, 0.99, 1e-7 )
+        @orig_data.gradient_step( NArray.sfloat(2), NArray[0.3, -1.5], 0.1 )
+
+        @saved_data = Marshal.dump( @orig_data )
+        @copy_data =  Marshal.load( @saved_data )
+      end
+
+      it "can save and retrieve gradient descent settings" do
+        expect( @copy_data ).to_not be @orig_data
+        expect( @copy_data.num_params ).to be 2
+        expect( @copy_data.beta1 ).to be_within(1e-6).of 0.8
+        expect( @copy_data.beta2 ).to be_within(1e-6).of 0.99
+        expect( @copy_data.epsilon ).to be_within(1e-12).of 1e-7
+        expect( @copy_data.num_steps ).to be 1
+      end
+
+      it "can save and retrieve moments" do
+        expect( @copy_data.first_moment ).to_not be @orig_data.first_moment
+        expect( @copy_data.first_moment ).to be_narray_like @orig_data.first_moment
+        expect( @copy_data.second_moment ).to be_narray_like @orig_data.second_moment
+      end
+    end
+  end
+
+  describe "instance methods" do
+    let :gd do
+       RuNeNe::GradientDescent::Adam.new( NArray.sfloat(2), 0.9, 0.999, 1e-8 )
+    end
+
+    before :each do
+      NArray.srand(555)
+      @params = (NArray.sfloat(2).random - 0.5) * 10
+    end
+
+    describe "#clone" do
+      it "should make a deep copy of moments and step count" do
+        gd.gradient_step( @params, NArray[0.5, -0.5], 0.1 )
+        copy = gd.clone
+        expect( copy.num_steps ).to be 1
+        expect( copy.first_moment ).to_not be gd.first_moment
+        expect( copy.first_moment ).to be_narray_like gd.first_moment
+        expect( copy.second_moment ).to be_narray_like gd.second_moment
+      end
+    end
+
+    describe "#gradient_step" do
+      it "should alter params by learning rate on first step, due to bias correction" do
+        before_params = @params.clone
+        gd.gradient_step( @params, NArray[0.5, -2.0], 0.1 )
+        expect( @params ).to be_narray_like before_params + NArray[-0.1, 0.1], 1e-5
+        expect( gd.num_steps ).to be 1
+      end
+
+      it "should update moments" do
+        gd.gradient_step( @params, NArray[0.5, -2.0], 0.1 )
+        expect( gd.first_moment ).to be_narray_like NArray[0.05, -0.2], 1e-6
+        expect( gd.second_moment ).to be_narray_like NArray[0.00025, 0.004], 1e-8
+      end
+
+      it "should match scalar calculation for long arrays" do
+        gd = RuNeNe::GradientDescent::Adam.new( NArray.sfloat(11), 0.9, 0.999, 1e-8 )
+        params = NArray.sfloat(11).random - 0.5
+        g1 = NArray.sfloat(11).random - 0.5
+        g2 = NArray.sfloat(11).random - 0.5
+        m = g1 * 0.1
+        v = g1 * g1 * 0.001
+        m = m * 0.9 + g2 * 0.1
+        v = v * 0.999 + g2 * g2 * 0.001
+        lr_t = 0.1 * Math.sqrt( 1.0 - 0.999**2 ) / ( 1.0 - 0.9**2 )
+        expected_params = params - ( g1 / NMath.sqrt( g1 * g1 ) ) * 0.1 - ( m * lr_t ) / ( NMath.sqrt( v ) + 1e-8 )
+
+        gd.gradient_step( params, g1, 0.1 )
+        gd.gradient_step( params, g2, 0.1 )
+        expect( params ).to be_narray_like expected_params, 1e-5
+      end
+    end
+
+    describe "optimisation" do
+      it "should optimise a simple quadratic" do
+        tq = TestQuadratic.new(2)
+
+        expect( tq.value_at( @params ) ).to_not be_within(0.1).of 0
+        expect( @params ).to_not be_narray_like tq.roots
+
+        1000.times do |t|
+          lr = 0.5 * 0.99**t
+          gd.pre_gradient_step( @params, lr )
+          gd.gradient_step( @params, tq.gradients_at(@params), lr )
+        end
+        expect( tq.value_at( @params ) ).to be_within(1e-6).of 0
+        expect( @params ).to be_narray_like tq.roots
+      end
+
+      it "should optimise rosenbrock with a bit of help" do
+        tq = TestRosenbrock.new
+        @params = NArray.cast( [ -0.5, 0.5 ], 'sfloat' )
+
+        expect( tq.value_at( @params ) ).to_not be_within(0.1).of 0
+        expect( @params ).to_not be_narray_like NArray[1.0,1.0]
+
+        9000.times do |t|
+          lr = 0.02 * 0.9995**t
+          gd.pre_gradient_step( @params, lr )
+          gd.gradient_step( @params, tq.gradients_at(@params), lr )
+        end
+        expect( tq.value_at( @params ) ).to be_within(1e-6).of 0
+        expect( @params ).to be_narray_like NArray[1.0,1.0]
+      end
+    end
+  end
+end
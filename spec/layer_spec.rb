@@ -196,3 +196,75 @@ describe RuNeNe::Layer::FeedForward do
     end
   end
 end
+
+describe RuNeNe::Layer::Embedding do
+  let( :weights ) { NArray.cast( [ [0.1, 0.2], [0.3, 0.4], [0.5, 0.6] ], 'sfloat' ) }
+  let( :layer ) { RuNeNe::Layer::Embedding.from_weights( weights, 2 ) }
+
+  describe "class methods" do
+    describe "#new" do
+      it "creates a new layer with a random table" do
+        layer = RuNeNe::Layer::Embedding.new( 3, 100, 8 )
+        expect( layer ).to be_a RuNeNe::Layer::Embedding
+        expect( layer.num_inputs ).to eql 3
+        expect( layer.num_outputs ).to eql 24
+        expect( layer.vocab_size ).to eql 100
+        expect( layer.embed_size ).to eql 8
+        expect( layer.transfer ).to be RuNeNe::Transfer::Linear
+        expect( layer.weights.shape ).to eql [8, 100]
+        expect( layer.weights.to_a.flatten.uniq.size ).to be > 100
+      end
+
+      it "refuses to create new layers for bad parameters" do
+        expect { RuNeNe::Layer::Embedding.new( 0, 100, 8 ) }.to raise_error ArgumentError
+        expect { RuNeNe::Layer::Embedding.new( 3, 0, 8 ) }.to raise_error ArgumentError
+        expect { RuNeNe::Layer::Embedding.new( 3, 100, 0 ) }.to raise_error ArgumentError
+      end
+    end
+
+    describe "#from_weights" do
+      it "takes sizes from the table" do
+        expect( layer.vocab_size ).to eql 3
+        expect( layer.embed_size ).to eql 2
+        expect( layer.num_outputs ).to eql 4
+        expect( layer.weights ).to be weights
+      end
+
+      it "refuses a table that is not rank 2" do
+        expect { RuNeNe::Layer::Embedding.from_weights( NArray.sfloat(6), 2 ) }.to raise_error ArgumentError
+      end
+    end
+
+    describe "with Marshal" do
+      it "can save and retrieve a layer, preserving the table" do
+        copy = Marshal.load( Marshal.dump( layer ) )
+        expect( copy ).to be_a RuNeNe::Layer::Embedding
+        expect( copy.num_inputs ).to eql 2
+        expect( copy.weights ).to be_narray_like weights
+      end
+    end
+  end
+
+  describe "instance methods" do
+    describe "#clone" do
+      it "should deep clone the table" do
+        copy = layer.clone
+        expect( copy.weights ).to be_narray_like layer.weights
+        copy.weights[0] = 9.0
+        expect( layer.weights[0] ).to be_within( 1e-6 ).of 0.1
+      end
+    end
+
+    describe "#run" do
+      it "outputs the selected rows" do
+        output = layer.run( NArray.cast( [2.0, 0.0], 'sfloat' ) )
+        expect( output ).to be_narray_like NArray[ 0.5, 0.6, 0.1, 0.2 ]
+      end
+
+      it "refuses indices that are not in the table" do
+        expect { layer.run( NArray.cast( [3.0, 0.0], 'sfloat' ) ) }.to raise_error ArgumentError
+        expect { layer.run( NArray.cast( [0.0], 'sfloat' ) ) }.to raise_error ArgumentError
+      end
+    end
+  end
+end
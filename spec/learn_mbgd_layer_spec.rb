@@ -93,6 +93,28 @@ describe RuNeNe::Learn::MBGD::Layer do
         expect( bpl.gradient_descent.av_squared_grads ).to be_narray_like NArray[ [ 1.0, 1.0, 1.0 ] ]
       end
 
+      it "creates AdaGrad optimiser when :gradient_descent_type => :adagrad" do
+        bpl = RuNeNe::Learn::MBGD::Layer.new( :num_inputs => 2, :num_outputs => 1,
+            :gradient_descent_type => :adagrad, :epsilon => 1e-7 )
+        expect( bpl.gradient_descent_type ).to be :adagrad
+        expect( bpl.gradient_descent ).to be_a RuNeNe::GradientDescent::AdaGrad
+        expect( bpl.gradient_descent.num_params ).to be 3
+        expect( bpl.gradient_descent.epsilon ).to be_within(1e-12).of 1e-7
+        expect( bpl.gradient_descent.sum_squared_grads ).to be_narray_like NArray[ [ 0.0, 0.0, 0.0 ] ]
+      end
+
+      it "creates Adam optimiser when :gradient_descent_type => :adam" do
+        bpl = RuNeNe::Learn::MBGD::Layer.new( :num_inputs => 2, :num_outputs => 1,
+            :gradient_descent_type => :adam, :beta1 => 0.85, :beta2 => 0.99 )
+        expect( bpl.gradient_descent_type ).to be :adam
+        expect( bpl.gradient_descent ).to be_a RuNeNe::GradientDescent::Adam
+        expect( bpl.gradient_descent.num_params ).to be 3
+        expect( bpl.gradient_descent.beta1 ).to be_within(1e-6).of 0.85
+        expect( bpl.gradient_descent.beta2 ).to be_within(1e-6).of 0.99
+        expect( bpl.gradient_descent.epsilon ).to be_within(1e-14).of 1e-8
+        expect( bpl.gradient_descent.first_moment ).to be_narray_like NArray[ [ 0.0, 0.0, 0.0 ] ]
+      end
+
       it "accepts setting :gradient_descent directly to SGD instance" do
         opt = RuNeNe::GradientDescent::SGD.new( NArray[ [-0.1, 0.01, 0.001] ] )
         bpl = RuNeNe::Learn::MBGD::Layer.new( :num_inputs => 2, :num_outputs => 1,
@@ -120,6 +142,15 @@ describe RuNeNe::Learn::MBGD::Layer do
         expect( bpl.gradient_descent.epsilon ).to be_within(1e-12).of 3e-7
       end
 
+      it "accepts setting :gradient_descent directly to Adam instance" do
+        opt = RuNeNe::GradientDescent::Adam.new( NArray[ [-0.1, 0.01, 0.001] ], 0.8, 0.95, 3e-7 )
+        bpl = RuNeNe::Learn::MBGD::Layer.new( :num_inputs => 2, :num_outputs => 1,
+            :gradient_descent => opt )
+        expect( bpl.gradient_descent_type ).to be :adam
+        expect( bpl.gradient_descent ).to be opt
+        expect( bpl.gradient_descent.beta2 ).to be_within(1e-6).of 0.95
+      end
+
       it "doesn't accept a :gradient_descent with wrong size" do
         opt = RuNeNe::GradientDescent::RMSProp.new( NArray[ [-0.1, 0.01] ], 0.8, 3e-7 )
         expect { RuNeNe::Learn::MBGD::Layer.new( :num_inputs => 2, :num_outputs => 1,
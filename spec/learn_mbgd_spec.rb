@@ -176,7 +176,7 @@ describe RuNeNe::Learn::MBGD do
         @nn = RuNeNe::NNModel.new( [in_layer_nn, out_layer_nn] )
       end
 
-      [:sgd, :nag, :rmsprop].each do |accel_type|
+      [:sgd, :nag, :rmsprop, :adagrad, :adam].each do |accel_type|
         context "with gradient_descent_type '#{accel_type}'" do
           before :each do
             @learn_subject = RuNeNe::Learn::MBGD.from_nn_model( @nn,
@@ -241,6 +241,13 @@ describe RuNeNe::Learn::MBGD do
               expect( @learn_subject.layer(1).gradient_descent.decay ).to  be_within( 1e-6 ).of 0.9
               expect( @learn_subject.layer(1).gradient_descent.epsilon ).to  be_within( 1e-9 ).of 1e-6
             end
+
+          when :adam
+            it "can set beta1 and beta2 in all layers" do
+              @learn_subject.set_meta_params( :beta1 => 0.8, :beta2 => 0.99 )
+              expect( @learn_subject.layer(0).gradient_descent.beta1 ).to  be_within( 1e-6 ).of 0.8
+              expect( @learn_subject.layer(1).gradient_descent.beta2 ).to  be_within( 1e-6 ).of 0.99
+            end
           end
         end
       end
@@ -255,12 +262,12 @@ describe RuNeNe::Learn::MBGD do
         @data = RuNeNe::DataSet.new( @xor_inputs, @xor_targets )
       end
 
-      [:sgd, :nag, :rmsprop].each do |accel_type|
+      [:sgd, :nag, :rmsprop, :adagrad, :adam].each do |accel_type|
       [:mse, :logloss].each do |objective|
         context "with gradient_descent_type '#{accel_type}' and objective '#{objective}'" do
           before :each do
             # SGD optimiser needs high learning rate, rmsprop needs low learning rate
-            lr = accel_type == :sgd ? 1.0 : 0.1
+            lr = { :sgd => 1.0, :adagrad => 0.4 }.fetch( accel_type, 0.1 )
             @learn_subject = RuNeNe::Learn::MBGD.from_nn_model( @nn,
                   :learning_rate => lr, :gradient_descent_type => accel_type, :objective => objective )
           end
@@ -284,6 +291,9 @@ describe RuNeNe::Learn::MBGD do
             end
           end
 
+          # AdaGrad's steps shrink too quickly to reach this tolerance in 3000 batches
+          next if accel_type == :adagrad
+
           it "eventually learns xor" do
             3000.times do
               @learn_subject.train_one_batch( @nn, @data, 4 )
@@ -297,6 +307,501 @@ describe RuNeNe::Learn::MBGD do
         end
       end
       end
+
+      [:sgd, :nag, :rmsprop, :adagrad, :adam].each do |accel_type|
+        it "trains the same with parameters packed in arenas, using gradient_descent_type '#{accel_type}'" do
+          learn = RuNeNe::Learn::MBGD.from_nn_model( @nn, :learning_rate => 0.1, :gradient_descent_type => accel_type )
+          packed_nn = @nn.clone.pack_arena
+          packed_learn = learn.clone.pack_arena
+          expect( packed_learn.arena? ).to be true
+
+          RuNeNe.srand( 2_000_000 )
+          data = RuNeNe::DataSet.new( @xor_inputs, @xor_targets )
+          losses = 50.times.map { learn.train_one_batch( @nn, data, 4 ) }
+
+          RuNeNe.srand( 2_000_000 )
+          data = RuNeNe::DataSet.new( @xor_inputs, @xor_targets )
+          packed_losses = 50.times.map { packed_learn.train_one_batch( packed_nn, data, 4 ) }
+
+          expect( packed_losses ).to eql losses
+          2.times do |l|
+            expect( packed_nn.layer(l).weights.to_a ).to eql @nn.layer(l).weights.to_a
+            expect( packed_learn.layer(l).de_dw.to_a ).to eql learn.layer(l).de_dw.to_a
+          end
+        end
+      end
+
+      it "applies weight decay to gradients of weights but not of biases" do
+        nn = RuNeNe::NNModel.new( [ RuNeNe::Layer::FeedForward.new( 11, 3, :sigmoid ) ] )
+        data = RuNeNe::DataSet.new( NArray.sfloat( 11, 8 ).random( 2.0 ) - 1.0, NArray.sfloat( 3, 8 ).random( 1.0 ) )
+        orig_weights = nn.layer(0).weights.clone
+        decayed_nn = nn.clone
+
+        learn = RuNeNe::Learn::MBGD.from_nn_model( nn, :learning_rate => 0.5, :objective => :logloss )
+        decayed_learn = RuNeNe::Learn::MBGD.from_nn_model( decayed_nn, :learning_rate => 0.5,
+              :weight_decay => 0.01, :objective => :logloss )
+        RuNeNe.srand( 3_000_000 )
+        learn.train_one_batch( nn, data.clone, 8 )
+        RuNeNe.srand( 3_000_000 )
+        decayed_learn.train_one_batch( decayed_nn, data.clone, 8 )
+
+        de_dw = learn.layer(0).de_dw
+        decayed_de_dw = decayed_learn.layer(0).de_dw
+        expect( decayed_de_dw[0...11, true] ).to be_narray_like de_dw[0...11, true] + orig_weights[0...11, true] * 0.01, 1e-6
+        expect( decayed_de_dw[11, true] ).to be_narray_like de_dw[11, true], 1e-6
+        expect( decayed_nn.layer(0).weights ).to be_narray_like orig_weights - decayed_de_dw * 0.5, 1e-5
+      end
+
+      [:sgd, :nag, :rmsprop].each do |accel_type|
+        it "keeps each row of weights within max_norm, using gradient_descent_type '#{accel_type}'" do
+          nn = RuNeNe::NNModel.new( [ RuNeNe::Layer::FeedForward.new( 11, 3, :sigmoid ) ] )
+          learn = RuNeNe::Learn::MBGD.from_nn_model( nn, :learning_rate => 2.0, :weight_decay => 0.01,
+                :max_norm => 0.5, :gradient_descent_type => accel_type, :objective => :logloss )
+          data = RuNeNe::DataSet.new( NArray.sfloat( 11, 8 ).random( 2.0 ) - 1.0, NArray.sfloat( 3, 8 ).random( 1.0 ) )
+
+          20.times { learn.train_one_batch( nn, data, 8 ) }
+          weights = nn.layer(0).weights
+          3.times do |j|
+            row = weights[0...11, j]
+            expect( Math.sqrt( ( row * row ).sum ) ).to be <= 0.50001
+          end
+        end
+      end
+
+      it "refuses to train with incompatible objective and output layer, before changing weights" do
+        nn = RuNeNe::NNModel.new( [ in_layer_nn, { :num_outputs => 1, :transfer => :linear } ] )
+        learn = RuNeNe::Learn::MBGD.from_nn_model( nn, :objective => :logloss )
+        orig_weights = nn.layer(1).weights.clone
+
+        expect { learn.train_one_batch( nn, @data, 4 ) }.to raise_error RuntimeError, /Cannot combine/
+        expect( nn.layer(1).weights ).to be_narray_like orig_weights
+      end
+
+      it "refuses to train with batch size less than 1" do
+        learn = RuNeNe::Learn::MBGD.from_nn_model( @nn )
+        expect { learn.train_one_batch( @nn, @data, 0 ) }.to raise_error ArgumentError
+      end
+
+      it "accumulates the same gradients as per-item backprop, for batches larger than one chunk" do
+        nn = RuNeNe::NNModel.new( [
+          RuNeNe::Layer::FeedForward.new( 5, 7, :tanh ),
+          { :num_outputs => 6, :transfer => :relu },
+          { :num_outputs => 3, :transfer => :softmax } ] )
+        learn = RuNeNe::Learn::MBGD.from_nn_model( nn, :learning_rate => 0.0, :objective => :mlogloss )
+        inputs = NArray.cast( 300.times.map { |i| 5.times.map { |k| Math.sin( i * 5 + k ) } }, 'sfloat' )
+        targets = NArray.cast( 300.times.map { |i| t = [0.0, 0.0, 0.0]; t[i % 3] = 1.0; t }, 'sfloat' )
+
+        RuNeNe.srand( 3_000_000 )
+        loss = learn.train_one_batch( nn, RuNeNe::DataSet.new( inputs, targets ), 300 )
+
+        # Same items in same order, one at a time
+        RuNeNe.srand( 3_000_000 )
+        data = RuNeNe::DataSet.new( inputs, targets )
+        layers = 3.times.map { |l| learn.layer(l).clone }
+        layers.each_with_index { |layer, l| layer.start_batch( nn.layer(l) ) }
+        expected_loss = 0.0
+        300.times do
+          input, target = data.current_input_item, data.current_output_item
+          data.next_item
+          nn.run( input )
+          expected_loss -= Math.log( ( nn.activations(2) * target ).sum )
+          layers[2].backprop_for_output_layer( nn.layer(2), nn.activations(1), nn.activations(2), target, :mlogloss )
+          layers[1].backprop_for_mid_layer( nn.layer(1), nn.activations(0), nn.activations(1), layers[2].de_da )
+          layers[0].backprop_for_mid_layer( nn.layer(0), input, nn.activations(0), layers[1].de_da )
+        end
+
+        expect( loss ).to be_within( 1e-4 ).of( expected_loss / 300 )
+        3.times do |l|
+          expect( learn.layer(l).de_dw ).to be_narray_like layers[l].de_dw, 1e-4
+        end
+      end
+
+      it "does not calculate de_da for the first layer by default" do
+        learn = RuNeNe::Learn::MBGD.from_nn_model( @nn )
+        learn.train_one_batch( @nn, @data, 4 )
+        expect( learn.layer(0).de_da ).to be_narray_like NArray[ 0.0, 0.0 ]
+        expect( learn.layer(1).de_da ).to_not be_narray_like NArray[ 0.0, 0.0 ]
+      end
+
+      it "calculates de_da for the first layer with option :input_de_da" do
+        learn = RuNeNe::Learn::MBGD.from_nn_model( @nn, :learning_rate => 0.0 )
+        input, target = @data.current_input_item, @data.current_output_item
+        learn.train_one_batch( @nn, @data, 1, :input_de_da => true )
+
+        layers = 2.times.map { |l| learn.layer(l).clone }
+        @nn.run( input )
+        layers[1].backprop_for_output_layer( @nn.layer(1), @nn.activations(0), @nn.activations(1), target, :mse )
+        layers[0].backprop_for_mid_layer( @nn.layer(0), input, @nn.activations(0), layers[1].de_da )
+
+        expect( learn.layer(0).de_da ).to be_narray_like layers[0].de_da, 1e-6
+        expect( learn.layer(0).de_da ).to_not be_narray_like NArray[ 0.0, 0.0 ]
+      end
+
+      describe "with option :threads" do
+        before :each do
+          @learn_subject = RuNeNe::Learn::MBGD.from_nn_model( @nn,
+                :learning_rate => 0.1, :gradient_descent_type => :rmsprop )
+        end
+
+        def train_from_seed( nn, learn, opts = {} )
+          nn = nn.clone
+          learn = learn.clone
+          RuNeNe.srand( 2_000_000 )
+          data = RuNeNe::DataSet.new( @xor_inputs, @xor_targets )
+          losses = 20.times.map { learn.train_one_batch( nn, data, 4, opts ) }
+          [ losses, nn.layer(0).weights ]
+        end
+
+        it "returns same loss as single-threaded training" do
+          losses, weights = train_from_seed( @nn, @learn_subject, :threads => 3 )
+          single_losses, single_weights = train_from_seed( @nn, @learn_subject )
+
+          losses.zip( single_losses ).each do |loss, single_loss|
+            expect( loss ).to be_within( 1e-5 ).of single_loss
+          end
+          expect( weights ).to be_narray_like single_weights, 1e-5
+        end
+
+        it "gives repeatable results" do
+          losses, weights = train_from_seed( @nn, @learn_subject, :threads => 2 )
+          repeat_losses, repeat_weights = train_from_seed( @nn, @learn_subject, :threads => 2 )
+
+          expect( losses ).to eql repeat_losses
+          expect( weights.to_a ).to eql repeat_weights.to_a
+        end
+
+        it "eventually learns xor" do
+          3000.times do
+            @learn_subject.train_one_batch( @nn, @data, 4, :threads => 2 )
+          end
+
+          this_loss = @learn_subject.train_one_batch( @nn, @data, 4, :threads => 2 )
+          expect( this_loss ).to be_within(0.001).of 0.0
+        end
+
+        it "refuses invalid number of threads" do
+          expect { @learn_subject.train_one_batch( @nn, @data, 4, :threads => 0 ) }.to raise_error ArgumentError
+          expect { @learn_subject.train_one_batch( @nn, @data, 4, :threads => 1000 ) }.to raise_error ArgumentError
+        end
+
+        it "trains the same when Network#train gathers the next batch in the background" do
+          original_threads = RuNeNe.threads
+          begin
+            # Batches of 1024 items of 64 floats are large enough to be double-buffered
+            RuNeNe.threads = 2
+            NArray.srand( 600 )
+            nn = RuNeNe::NNModel.new( [ RuNeNe::Layer::FeedForward.new( 60, 8 ), RuNeNe::Layer::FeedForward.new( 8, 4 ) ] )
+            inputs = NArray.sfloat( 60, 4096 ).random( 1.0 )
+            targets = NArray.sfloat( 4, 4096 ).random( 1.0 )
+            learn = RuNeNe::Learn::MBGD.from_nn_model( nn, :learning_rate => 0.1, :gradient_descent_type => :rmsprop )
+            nn_copy, learn_copy = nn.clone, learn.clone
+
+            RuNeNe.srand( 700 )
+            result = RuNeNe::Network.new( nn, learn ).train( RuNeNe::DataSet.new( inputs, targets ),
+                :epochs => 2, :batch_size => 1024, :threads => 2 )
+
+            RuNeNe.srand( 700 )
+            data = RuNeNe::DataSet.new( inputs, targets )
+            losses = 8.times.map { learn_copy.train_one_batch( nn_copy, data, 1024, :threads => 2 ) }
+
+            expect( result[:train_loss] ).to be_within( 1e-6 ).of( losses[4..7].inject(:+) / 4 )
+            [0, 1].each do |layer_id|
+              expect( nn.layer(layer_id).weights ).to be_narray_like nn_copy.layer(layer_id).weights, 1e-6
+            end
+          ensure
+            RuNeNe.threads = original_threads
+          end
+        end
+      end
+
+      describe "with sparse inputs" do
+        before :each do
+          RuNeNe.srand( 3_000_000 )
+          # 300 items, each with 3 of 40 inputs set, so more than two chunks per batch
+          @dense_inputs = NArray.sfloat( 40, 300 )
+          @targets = NArray.sfloat( 2, 300 )
+          row_ptr = [ 0 ]
+          col_idx = []
+          values = []
+          300.times do |i|
+            [ i % 40, ( i * 7 + 3 ) % 40, ( i * 13 + 5 ) % 40 ].uniq.sort.each do |c|
+              v = ( ( i * 31 + c ) % 17 ) / 8.0 - 1.0
+              @dense_inputs[ c + 40 * i ] = v
+              col_idx << c
+              values << v
+            end
+            row_ptr << col_idx.size
+            @targets[ 2 * i ] = i % 2
+            @targets[ 2 * i + 1 ] = ( i / 2 ) % 2
+          end
+          @sparse_data = RuNeNe::DataSet.from_csr( NArray.cast( row_ptr, 'int' ), NArray.cast( col_idx, 'int' ),
+              NArray.cast( values, 'sfloat' ), 40, @targets )
+          @dense_data = RuNeNe::DataSet.new( @dense_inputs, @targets )
+          @sparse_nn = RuNeNe::NNModel.new( [ RuNeNe::Layer::FeedForward.new( 40, 8 ),
+              RuNeNe::Layer::FeedForward.new( 8, 2, :sigmoid ) ] )
+          @sparse_nn.init_weights
+          @sparse_learn = RuNeNe::Learn::MBGD.from_nn_model( @sparse_nn, :learning_rate => 0.1,
+              :gradient_descent_type => :adam, :weight_decay => 0.001 )
+        end
+
+        def train_sparse_and_dense opts = {}
+          results = [ @sparse_data, @dense_data ].map do |data|
+            nn = @sparse_nn.clone
+            learn = @sparse_learn.clone
+            RuNeNe.srand( 3_000_001 )
+            losses = 10.times.map { learn.train_one_batch( nn, data, 250, opts ) }
+            [ losses, nn.layer(0).weights, nn.layer(1).weights ]
+          end
+          results[0].zip( results[1] ).each do |sparse, dense|
+            if sparse.is_a?( Array )
+              sparse.zip( dense ).each { |a, b| expect( a ).to be_within( 1e-5 ).of b }
+            else
+              expect( sparse ).to be_narray_like dense, 1e-10
+            end
+          end
+        end
+
+        it "trains the same as dense inputs" do
+          train_sparse_and_dense
+        end
+
+        it "trains the same as dense inputs with option :threads" do
+          train_sparse_and_dense( :threads => 3 )
+        end
+
+        it "trains the same as dense inputs from a view" do
+          RuNeNe.srand( 3_000_002 )
+          sparse_view, dense_view = [ @sparse_data, @dense_data ].map { |data| data.subset( (0...300).step( 3 ).to_a ) }
+          losses = [ sparse_view, dense_view ].map do |data|
+            nn = @sparse_nn.clone
+            learn = @sparse_learn.clone
+            RuNeNe.srand( 3_000_001 )
+            5.times.map { learn.train_one_batch( nn, data, 20 ) }
+          end
+          losses[0].zip( losses[1] ).each { |a, b| expect( a ).to be_within( 1e-5 ).of b }
+        end
+
+        it "refuses option :input_de_da" do
+          expect { @sparse_learn.train_one_batch( @sparse_nn, @sparse_data, 10, :input_de_da => true ) }.to raise_error ArgumentError
+        end
+      end
+
+      describe "with an embedding first layer" do
+        before :each do
+          RuNeNe.srand( 4_000_000 )
+          # 200 items, each with 2 ids from a table of 50 rows, only ids below 40 are used
+          @ids = NArray.sfloat( 2, 200 )
+          @targets = NArray.sfloat( 1, 200 )
+          200.times do |i|
+            a, b = ( i * 7 ) % 40, ( i * 11 + 3 ) % 40
+            @ids[ 2 * i ] = a
+            @ids[ 2 * i + 1 ] = b
+            @targets[ i ] = ( a + b ) % 3 == 0 ? 1.0 : 0.0
+          end
+          @ids_data = RuNeNe::DataSet.new( @ids, @targets )
+          @embed_nn = RuNeNe::NNModel.new( [ RuNeNe::Layer::Embedding.new( 2, 50, 4 ),
+              RuNeNe::Layer::FeedForward.new( 8, 6 ), RuNeNe::Layer::FeedForward.new( 6, 1, :sigmoid ) ] )
+        end
+
+        [:sgd, :nag, :rmsprop, :adagrad, :adam].each do |accel_type|
+          it "reduces loss over time, using gradient_descent_type '#{accel_type}'" do
+            lr = { :sgd => 0.5, :adagrad => 0.4 }.fetch( accel_type, 0.05 )
+            learn = RuNeNe::Learn::MBGD.from_nn_model( @embed_nn, :learning_rate => lr,
+                :gradient_descent_type => accel_type, :objective => :logloss, :weight_decay => 0.0001 )
+            expect( learn.layer(0).vocab_size ).to eql 50
+            first_loss = learn.train_one_batch( @embed_nn, @ids_data, 200 )
+            300.times { learn.train_one_batch( @embed_nn, @ids_data, 50 ) }
+            expect( learn.train_one_batch( @embed_nn, @ids_data, 200 ) ).to be < 0.8 * first_loss
+          end
+
+          it "only changes rows of the table that are used, using gradient_descent_type '#{accel_type}'" do
+            learn = RuNeNe::Learn::MBGD.from_nn_model( @embed_nn, :learning_rate => 0.1,
+                :gradient_descent_type => accel_type, :weight_decay => 0.001, :max_norm => 1.0 )
+            before = @embed_nn.layer(0).weights.clone
+            20.times { learn.train_one_batch( @embed_nn, @ids_data, 30 ) }
+            after = @embed_nn.layer(0).weights
+            expect( after[true, 0...40] ).to_not be_narray_like before[true, 0...40]
+            expect( after[true, 40...50].to_a ).to eql before[true, 40...50].to_a
+          end
+        end
+
+        it "can train a model with only an embedding layer, validating on views and compact inputs" do
+          nn = RuNeNe::NNModel.new( [ RuNeNe::Layer::Embedding.new( 64, 50, 1 ) ] )
+          ids = NArray.sfloat( 64, 40 )
+          2560.times { |i| ids[i] = ( i * 13 ) % 50 }
+          targets = NArray.sfloat( 64, 40 ).random( 1.0 )
+          data = RuNeNe::DataSet.new( ids, targets )
+          byte_data = RuNeNe::DataSet.new( NArray.cast( ids.to_a, 'byte' ), targets, :input_scale => 1.0 )
+          half16_data = RuNeNe::DataSet.new( ids, targets, :input_type => :float16 )
+
+          [ data.split( [ 0.5, 0.5 ] )[1], byte_data, half16_data ].each do |validation|
+            learn = RuNeNe::Learn::MBGD.from_nn_model( nn, :learning_rate => 0.1 )
+            network = RuNeNe::Network.new( nn, learn )
+            result = network.train( data, :epochs => 3, :batch_size => 10, :validation => validation )
+            expect( result[:validation_loss] ).to be_a Float
+          end
+        end
+
+        it "returns same loss as single-threaded training" do
+          learn = RuNeNe::Learn::MBGD.from_nn_model( @embed_nn, :learning_rate => 0.05, :gradient_descent_type => :adam )
+          results = [ {}, { :threads => 3 } ].map do |opts|
+            nn = @embed_nn.clone
+            l = learn.clone
+            RuNeNe.srand( 4_000_001 )
+            data = RuNeNe::DataSet.new( @ids, @targets )
+            losses = 10.times.map { l.train_one_batch( nn, data, 150, opts ) }
+            [ losses, nn.layer(0).weights ]
+          end
+          results[0][0].zip( results[1][0] ).each { |a, b| expect( a ).to be_within( 1e-5 ).of b }
+          expect( results[0][1] ).to be_narray_like results[1][1], 1e-5
+        end
+
+        it "gives zero output, and no update, for ids not in the table" do
+          learn = RuNeNe::Learn::MBGD.from_nn_model( @embed_nn, :learning_rate => 0.1 )
+          before = @embed_nn.layer(0).weights.clone
+          bad_data = RuNeNe::DataSet.new( NArray.cast( [ [-1.0, 50.0], [1000.0, -3.0] ], 'sfloat' ),
+              NArray.cast( [ [1.0], [0.0] ], 'sfloat' ) )
+          learn.train_one_batch( @embed_nn, bad_data, 2 )
+          expect( @embed_nn.layer(0).weights.to_a ).to eql before.to_a
+        end
+
+        it "can be saved and restored with Marshal while training" do
+          learn = RuNeNe::Learn::MBGD.from_nn_model( @embed_nn, :learning_rate => 0.05, :gradient_descent_type => :adam )
+          5.times { learn.train_one_batch( @embed_nn, @ids_data, 50 ) }
+          nn_copy = Marshal.load( Marshal.dump( @embed_nn ) )
+          learn_copy = Marshal.load( Marshal.dump( learn ) )
+          expect( learn_copy.layer(0).vocab_size ).to eql 50
+          losses = [ [learn, @embed_nn], [learn_copy, nn_copy] ].map do |l, nn|
+            RuNeNe.srand( 4_000_002 )
+            data = RuNeNe::DataSet.new( @ids, @targets )
+            3.times.map { l.train_one_batch( nn, data, 50 ) }
+          end
+          expect( losses[1] ).to eql losses[0]
+        end
+
+        it "refuses option :input_de_da" do
+          learn = RuNeNe::Learn::MBGD.from_nn_model( @embed_nn )
+          expect { learn.train_one_batch( @embed_nn, @ids_data, 10, :input_de_da => true ) }.to raise_error ArgumentError
+        end
+
+        it "refuses sparse inputs" do
+          learn = RuNeNe::Learn::MBGD.from_nn_model( @embed_nn )
+          csr_data = RuNeNe::DataSet.from_csr( NArray.cast( [0, 1], 'int' ), NArray.cast( [0], 'int' ),
+              NArray.cast( [3.0], 'sfloat' ), 2, NArray.cast( [ [1.0] ], 'sfloat' ) )
+          expect { learn.train_one_batch( @embed_nn, csr_data, 1 ) }.to raise_error ArgumentError
+        end
+
+        it "refuses to train a model with a different kind of first layer" do
+          ff_nn = RuNeNe::NNModel.new( [ RuNeNe::Layer::FeedForward.new( 2, 8 ), @embed_nn.layer(1), @embed_nn.layer(2) ] )
+          learn = RuNeNe::Learn::MBGD.from_nn_model( ff_nn )
+          expect { learn.train_one_batch( @embed_nn, @ids_data, 10 ) }.to raise_error ArgumentError
+          learn = RuNeNe::Learn::MBGD.from_nn_model( @embed_nn )
+          expect { learn.train_one_batch( ff_nn, @ids_data, 10 ) }.to raise_error ArgumentError
+        end
+
+        it "refuses per-item training methods" do
+          learn = RuNeNe::Learn::MBGD.from_nn_model( @embed_nn )
+          expect { learn.layer(0).start_batch( @embed_nn.layer(0) ) }.to raise_error ArgumentError
+        end
+      end
+
+      it "can train separate models in parallel threads" do
+        threads = 2.times.map do
+          nn = @nn.clone
+          data = RuNeNe::DataSet.new( @xor_inputs, @xor_targets )
+          learn = RuNeNe::Learn::MBGD.from_nn_model( nn, :learning_rate => 0.1, :gradient_descent_type => :rmsprop )
+          Thread.new do
+            3000.times { learn.train_one_batch( nn, data, 4 ) }
+            learn.train_one_batch( nn, data, 4 )
+          end
+        end
+
+        threads.map(&:value).each do |loss|
+          expect( loss ).to be_within(0.001).of 0.0
+        end
+      end
+
+      it "refuses to train with one learner from two threads at once" do
+        nn = @nn.clone
+        learn = RuNeNe::Learn::MBGD.from_nn_model( nn, :learning_rate => 0.1 )
+        inputs = NArray.sfloat( @xor_inputs.shape[0], 200_000 ).random( 1.0 )
+        targets = NArray.sfloat( @xor_targets.shape[0], 200_000 ).random( 1.0 )
+        large_data = RuNeNe::DataSet.new( inputs, targets )
+        small_data = RuNeNe::DataSet.new( @xor_inputs, @xor_targets )
+        errors = Queue.new
+
+        thread = Thread.new do
+          begin
+            learn.train_one_batch( nn, large_data, 200_000 )
+          rescue RuntimeError => e
+            errors << e
+          end
+        end
+
+        begin
+          learn.train_one_batch( nn, small_data, 4 ) while thread.alive?
+        rescue RuntimeError => e
+          errors << e
+        end
+        thread.join
+
+        expect( errors.size ).to be >= 1
+        expect( errors.pop.message ).to include "already in use"
+        expect( learn.train_one_batch( nn, small_data, 4 ) ).to be_a Float
+      end
+
+      it "refuses to move through a dataset from another thread while it trains" do
+        nn = @nn.clone
+        learn = RuNeNe::Learn::MBGD.from_nn_model( nn, :learning_rate => 0.1 )
+        inputs = NArray.sfloat( @xor_inputs.shape[0], 200_000 ).random( 1.0 )
+        targets = NArray.sfloat( @xor_targets.shape[0], 200_000 ).random( 1.0 )
+        large_data = RuNeNe::DataSet.new( inputs, targets )
+        errors = Queue.new
+
+        thread = Thread.new do
+          learn.train_one_batch( nn, large_data, 200_000 )
+        end
+
+        begin
+          large_data.next_item while thread.alive?
+        rescue RuntimeError => e
+          errors << e
+        end
+        thread.join
+
+        expect( errors.size ).to eql 1
+        expect( errors.pop.message ).to include "already in use"
+        expect( large_data.next_item ).to be large_data
+      end
+
+      it "refuses to replace gradient descent of a layer while it trains" do
+        nn = @nn.clone
+        learn = RuNeNe::Learn::MBGD.from_nn_model( nn, :learning_rate => 0.1 )
+        inputs = NArray.sfloat( @xor_inputs.shape[0], 200_000 ).random( 1.0 )
+        targets = NArray.sfloat( @xor_targets.shape[0], 200_000 ).random( 1.0 )
+        large_data = RuNeNe::DataSet.new( inputs, targets )
+        layer = learn.layer(0)
+        gd = layer.gradient_descent.clone
+        errors = Queue.new
+
+        thread = Thread.new do
+          learn.train_one_batch( nn, large_data, 200_000 )
+        end
+
+        [ lambda { layer.gradient_descent_type = :adam }, lambda { layer.gradient_descent = gd } ].each do |change|
+          begin
+            change.call while thread.alive?
+          rescue RuntimeError => e
+            errors << e
+          end
+        end
+        thread.join
+
+        expect( errors.size ).to be >= 1
+        expect( errors.pop.message ).to include "in use"
+        layer.gradient_descent_type = :adam
+        expect( layer.gradient_descent ).to be_a RuNeNe::GradientDescent::Adam
+      end
     end
   end
 end
@@ -1,4 +1,5 @@
 require 'helpers'
+require 'timeout'
 
 describe RuNeNe::Network do
   let( :in_layer_xor ) { RuNeNe::Layer::FeedForward.new( 2, 2 ) }
@@ -70,5 +71,131 @@ describe RuNeNe::Network do
         end
       end
     end
+
+    describe "#train" do
+      before :each do
+        NArray.srand( 3_000_000 )
+        RuNeNe.srand( 3_000_000 )
+        @nn = RuNeNe::NNModel.new( [
+            RuNeNe::Layer::FeedForward.new( 2, 4 ),
+            RuNeNe::Layer::FeedForward.new( 4, 1 ) ] )
+        @nn.init_weights
+        @learn = RuNeNe::Learn::MBGD.from_nn_model( @nn, :learning_rate => 1.0 )
+        @network = RuNeNe::Network.new( @nn, @learn )
+        @xor_inputs = NArray.cast( [ [-1.0, -1.0], [1.0, -1.0], [-1.0, 1.0], [1.0, 1.0] ], 'sfloat' )
+        @xor_targets = NArray.cast( [ [0.0], [1.0], [1.0], [0.0] ], 'sfloat' )
+        @not_xor_targets = NArray.cast( [ [1.0], [0.0], [0.0], [1.0] ], 'sfloat' )
+        @data = RuNeNe::DataSet.new( @xor_inputs, @xor_targets )
+      end
+
+      def mse_loss_of nn, inputs, targets
+        4.times.map { |i| 0.5 * ( nn.run( inputs[true,i] )[0] - targets[0,i] ) ** 2 }.inject(:+) / 4
+      end
+
+      it "trains the network for a number of epochs" do
+        result = @network.train( @data, :epochs => 50, :batch_size => 4 )
+        expect( result[:epochs] ).to eql 50
+        expect( result[:stopped_early] ).to be false
+        expect( result[:validation_loss] ).to be_nil
+
+        later = @network.train( @data, :epochs => 500, :batch_size => 4 )
+        expect( later[:train_loss] ).to be < result[:train_loss]
+      end
+
+      it "makes the same changes as calling train_one_batch in a loop" do
+        network_copy = @network.clone
+        data_copy = @data.clone
+
+        RuNeNe.srand( 200 )
+        result = @network.train( @data, :epochs => 20, :batch_size => 2 )
+
+        RuNeNe.srand( 200 )
+        losses = 40.times.map { network_copy.learn.train_one_batch( network_copy.nn_model, data_copy, 2 ) }
+
+        expect( result[:train_loss] ).to be_within( 1e-5 ).of( ( losses[-1] + losses[-2] ) / 2 )
+        [0,1].each do |layer_id|
+          expect( @nn.layer(layer_id).weights ).to be_narray_like network_copy.nn_model.layer(layer_id).weights
+        end
+      end
+
+      it "stops early when validation loss does not improve" do
+        validation = RuNeNe::DataSet.new( @xor_inputs, @not_xor_targets )
+        result = @network.train( @data, :epochs => 1000, :batch_size => 4,
+            :validation => validation, :patience => 10 )
+        expect( result[:stopped_early] ).to be true
+        expect( result[:epochs] ).to be < 1000
+        expect( result[:epochs] - result[:best_epoch] ).to eql 10
+      end
+
+      it "restores the weights with best validation loss" do
+        validation = RuNeNe::DataSet.new( @xor_inputs, @not_xor_targets )
+        result = @network.train( @data, :epochs => 100, :batch_size => 4, :validation => validation )
+        expect( result[:epochs] ).to eql 100
+        expect( result[:best_epoch] ).to be < 100
+        expect( mse_loss_of( @nn, @xor_inputs, @not_xor_targets ) ).to be_within( 1e-5 ).of result[:validation_loss]
+      end
+
+      it "reports progress to a block" do
+        reports = []
+        validation = RuNeNe::DataSet.new( @xor_inputs, @xor_targets )
+        @network.train( @data, :epochs => 10, :batch_size => 4, :validation => validation, :report_every => 3 ) do |progress|
+          reports << progress
+        end
+        expect( reports.map { |r| r[:epoch] } ).to eq [3, 6, 9, 10]
+        expect( reports.last[:train_loss] ).to be_a Float
+        expect( reports.last[:validation_loss] ).to be_a Float
+      end
+
+      it "restores the weights with best validation loss when the block breaks out" do
+        validation = RuNeNe::DataSet.new( @xor_inputs, @not_xor_targets )
+        losses = []
+        @network.train( @data, :epochs => 100, :batch_size => 4, :validation => validation ) do |progress|
+          losses << progress[:validation_loss]
+          break if progress[:epoch] == 50
+        end
+        expect( losses.size ).to eql 50
+        expect( mse_loss_of( @nn, @xor_inputs, @not_xor_targets ) ).to be_within( 1e-5 ).of losses.min
+      end
+
+      it "can be interrupted, and restores the weights with best validation loss" do
+        validation = RuNeNe::DataSet.new( @xor_inputs, @not_xor_targets )
+        network_copy = @network.clone
+        RuNeNe.srand( 300 )
+        network_copy.train( @data.clone, :epochs => 1, :batch_size => 1 )
+        first_epoch_loss = mse_loss_of( network_copy.nn_model, @xor_inputs, @not_xor_targets )
+
+        RuNeNe.srand( 300 )
+        started = Time.now
+        expect {
+          Timeout.timeout( 0.2 ) do
+            @network.train( @data, :epochs => 100_000_000, :batch_size => 1, :validation => validation )
+          end
+        }.to raise_error Timeout::Error
+        expect( Time.now - started ).to be < 5.0
+        expect( mse_loss_of( @nn, @xor_inputs, @not_xor_targets ) ).to be <= first_epoch_loss + 1e-5
+
+        # The learner is free to use again
+        expect( @network.train( @data, :epochs => 1, :batch_size => 4 )[:epochs] ).to eql 1
+      end
+
+      it "trains from sparse inputs, with sparse or dense validation" do
+        # xor_inputs as sparse rows, with the -1.0 values left out
+        sparse = RuNeNe::DataSet.from_csr( NArray.cast( [ 0, 0, 1, 2, 4 ], 'int' ), NArray.cast( [ 0, 1, 0, 1 ], 'int' ),
+            NArray.cast( [ 1.0, 1.0, 1.0, 1.0 ], 'sfloat' ), 2, @xor_targets )
+        [ sparse, @data ].each do |validation|
+          result = @network.train( sparse, :epochs => 20, :batch_size => 4, :validation => validation )
+          expect( result[:validation_loss] ).to be_a Float
+        end
+      end
+
+      it "refuses bad options" do
+        expect { @network.train( @data, :epochs => 0 ) }.to raise_error ArgumentError
+        expect { @network.train( @data, :batch_size => 0 ) }.to raise_error ArgumentError
+        expect { @network.train( @data, :patience => -1 ) }.to raise_error ArgumentError
+        expect { @network.train( @data, :threads => 1000 ) }.to raise_error ArgumentError
+        expect { @network.train( @data, :validation => @xor_inputs ) }.to raise_error TypeError
+        expect { @network.train( @xor_inputs ) }.to raise_error TypeError
+      end
+    end
   end
 end
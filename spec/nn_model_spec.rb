@@ -45,6 +45,40 @@ describe RuNeNe::NNModel do
         expect( nn.layers[0].transfer ).to be RuNeNe::Transfer::Softmax
         expect( nn.layers[1].transfer ).to be RuNeNe::Transfer::TanH
       end
+
+      it "accepts an embedding as the first layer only" do
+        embedding = RuNeNe::Layer::Embedding.new( 2, 10, 3 )
+        nn = RuNeNe::NNModel.new( [ embedding, { :num_outputs => 1 } ] )
+        expect( nn.num_inputs ).to eql 2
+        expect( nn.layers[1].num_inputs ).to eql 6
+        expect {
+          RuNeNe::NNModel.new( [ RuNeNe::Layer::FeedForward.new( 2, 2 ), embedding ] )
+        }.to raise_error ArgumentError
+      end
+    end
+
+    describe "with an embedding first layer" do
+      before :each do
+        RuNeNe.srand(700)
+        @nn = RuNeNe::NNModel.new( [ RuNeNe::Layer::Embedding.new( 2, 10, 3 ), { :num_outputs => 2 } ] )
+      end
+
+      it "runs single items and batches the same way" do
+        inputs = NArray.cast( [ [1.0, 9.0], [4.0, 4.0], [0.0, 7.0] ], 'sfloat' )
+        results = @nn.run_batch( inputs )
+        3.times do |i|
+          expect( results[true, i] ).to be_narray_like @nn.run( inputs[true, i] )
+        end
+      end
+
+      it "keeps outputs the same with #pack_arena and Marshal" do
+        output = @nn.run( NArray.cast( [3.0, 5.0], 'sfloat' ) ).to_a
+        @nn.pack_arena
+        expect( @nn.run( NArray.cast( [3.0, 5.0], 'sfloat' ) ).to_a ).to eql output
+        copy = Marshal.load( Marshal.dump( @nn ) )
+        expect( copy.layer(0) ).to be_a RuNeNe::Layer::Embedding
+        expect( copy.run( NArray.cast( [3.0, 5.0], 'sfloat' ) ).to_a ).to eql output
+      end
     end
 
     describe "with Marshal" do
@@ -160,11 +194,150 @@ describe RuNeNe::NNModel do
         expect( @nn.activations(1) ).to be_narray_like NArray[ 0.483497 ]
       end
 
+      it "gives the same results when many threads run one model at once" do
+        RuNeNe.srand(850)
+        nn = RuNeNe::NNModel.new( [ { :num_inputs => 64, :num_outputs => 256 },
+            { :num_outputs => 256 }, { :num_outputs => 4 } ] )
+        NArray.srand(850)
+        inputs = 4.times.map { |t| NArray.sfloat( 64 ).random( 2.0 ) - 1.0 }
+        expected = inputs.map { |input| nn.run( input ).to_a }
+
+        threads = 4.times.map do |t|
+          Thread.new { 50.times.map { nn.run( inputs[t] ).to_a } }
+        end
+        threads.each_with_index do |thread, t|
+          thread.value.each { |result| expect( result ).to eql expected[t] }
+        end
+      end
+
       it "should refuse to run for bad inputs" do
         expect { @nn.run( NArray.cast( [-0.5 ], 'sfloat' ) ) }.to raise_error ArgumentError
         expect { @nn.run( NArray.cast( [-0.5,-0.5,-0.5 ], 'sfloat' ) ) }.to raise_error ArgumentError
         expect { @nn.run( :hello ) }.to raise_error TypeError
       end
     end
+
+    describe "#run_batch" do
+      before :each do
+        RuNeNe.srand(800)
+        @nn.init_weights
+      end
+
+      it "should produce an expected output" do
+        result = @nn.run_batch( NArray.cast( [ [-0.5, 0.7], [0.5, -0.7] ], 'sfloat' ) )
+        expect( result ).to be_narray_like NArray[ [ 0.491116 ], [ 0.483497 ] ]
+      end
+
+      it "should match results from #run for larger layers and batches" do
+        RuNeNe.srand(900)
+        nn = RuNeNe::NNModel.new( [
+            { :num_inputs => 131, :num_outputs => 69, :transfer => :relu },
+            { :num_outputs => 7, :transfer => :softmax } ] )
+        nn.init_weights
+
+        NArray.srand(900)
+        inputs = NArray.sfloat( 131, 300 ).random( 2.0 ) - 1.0
+        results = nn.run_batch( inputs )
+        expect( results.shape ).to eql [ 7, 300 ]
+
+        [0, 1, 255, 256, 299].each do |i|
+          expect( results[true, i] ).to be_narray_like nn.run( inputs[true, i] )
+        end
+      end
+
+      it "gives the same results when many threads run one model at once" do
+        RuNeNe.srand(860)
+        nn = RuNeNe::NNModel.new( [ { :num_inputs => 64, :num_outputs => 128 }, { :num_outputs => 4 } ] )
+        NArray.srand(860)
+        inputs = 4.times.map { |t| NArray.sfloat( 64, 300 ).random( 2.0 ) - 1.0 }
+        expected = inputs.map { |input| nn.run_batch( input ).to_a }
+
+        threads = 4.times.map do |t|
+          Thread.new { 5.times.map { nn.run_batch( inputs[t] ).to_a } }
+        end
+        threads.each_with_index do |thread, t|
+          thread.value.each { |result| expect( result ).to eql expected[t] }
+        end
+      end
+
+      it "should not alter activations" do
+        @nn.run( NArray.cast( [-0.5, 0.7], 'sfloat' ) )
+        @nn.run_batch( NArray.cast( [ [0.5, -0.7] ], 'sfloat' ) )
+        expect( @nn.activations(1) ).to be_narray_like NArray[ 0.491116 ]
+      end
+
+      it "should refuse to run for bad inputs" do
+        expect { @nn.run_batch( NArray.cast( [-0.5, 0.7 ], 'sfloat' ) ) }.to raise_error ArgumentError
+        expect { @nn.run_batch( NArray.cast( [ [-0.5,-0.5,-0.5 ] ], 'sfloat' ) ) }.to raise_error ArgumentError
+        expect { @nn.run_batch( :hello ) }.to raise_error TypeError
+      end
+
+    describe "#pack_arena" do
+      before :each do
+        RuNeNe.srand(800)
+        @nn.init_weights
+      end
+
+      it "keeps weights and outputs the same" do
+        weights = @nn.layers.map { |layer| layer.weights.to_a }
+        output = @nn.run( NArray.cast( [-0.5, 0.7], 'sfloat' ) ).to_a
+
+        expect( @nn.arena? ).to be false
+        expect( @nn.pack_arena ).to be @nn
+        expect( @nn.arena? ).to be true
+
+        expect( @nn.layers.map { |layer| layer.weights.to_a } ).to eql weights
+        expect( @nn.run( NArray.cast( [-0.5, 0.7], 'sfloat' ) ).to_a ).to eql output
+      end
+
+      it "replaces layer weights with arrays that share memory with the model" do
+        @nn.pack_arena
+        weights = @nn.layer(1).weights
+        orig_weights = weights.to_a
+        @nn.init_weights
+        expect( weights.to_a ).to_not eql orig_weights
+        expect( weights.to_a ).to eql @nn.layer(1).weights.to_a
+      end
+
+      it "keeps weights after model is garbage collected" do
+        nn = RuNeNe::NNModel.new( [ { :num_inputs => 20, :num_outputs => 20 }, { :num_outputs => 3 } ] ).pack_arena
+        weights = nn.layer(1).weights
+        expected = weights.to_a
+        nn = nil
+        GC.start
+        100.times { RuNeNe::NNModel.new( [ { :num_inputs => 20, :num_outputs => 20 } ] ).pack_arena }
+        GC.start
+        expect( weights.to_a ).to eql expected
+      end
+
+      it "is preserved by clone, as a separate arena" do
+        @nn.pack_arena
+        copy = @nn.clone
+        expect( copy.arena? ).to be true
+        expect( copy.layer(0).weights ).to be_narray_like @nn.layer(0).weights
+
+        copy.layer(0).init_weights
+        expect( copy.layer(0).weights ).to_not be_narray_like @nn.layer(0).weights
+      end
+
+      it "refuses to pack while another thread is running the model" do
+        inputs = NArray.sfloat( 2, 500_000 ).random( 1.0 )
+        errors = Queue.new
+
+        thread = Thread.new { @nn.run_batch( inputs ) }
+
+        begin
+          @nn.pack_arena while thread.alive?
+        rescue RuntimeError => e
+          errors << e
+        end
+        thread.join
+
+        expect( errors.size ).to eql 1
+        expect( errors.pop.message ).to include "in use"
+        expect( @nn.pack_arena ).to be @nn
+      end
+    end
+    end
   end
 end
@@ -0,0 +1,38 @@
+require 'helpers'
+
+describe RuNeNe do
+  describe "#simd_level" do
+    it "reports which vector instructions are in use" do
+      expect( [ :sse2, :avx2, :avx512 ] ).to include RuNeNe.simd_level
+    end
+
+    it "can be capped using environment variable RU_NE_NE_SIMD" do
+      script_output = `RU_NE_NE_SIMD=sse2 ruby -Ilib -e "require 'ru_ne_ne'; puts RuNeNe.simd_level"`
+      expect( script_output.chomp ).to eql 'sse2'
+    end
+  end
+
+  describe "vector maths kernels" do
+    before :each do
+      NArray.srand(700)
+    end
+
+    it "calculate linear layer outputs correctly for all vector tail sizes" do
+      [1, 3, 4, 7, 8, 15, 16, 17, 31, 33].each do |num_inputs|
+        [1, 3, 4, 5, 9].each do |num_outputs|
+          weights = NArray.sfloat( num_inputs + 1, num_outputs ).random( 2.0 ) - 1.0
+          input = NArray.sfloat( num_inputs ).random( 2.0 ) - 1.0
+          layer = RuNeNe::Layer::FeedForward.from_weights( weights, :linear )
+
+          expected = NArray.sfloat( num_outputs )
+          num_outputs.times do |j|
+            expected[j] = weights[num_inputs + j * ( num_inputs + 1 )] +
+                (0...num_inputs).inject(0.0) { |t, i| t + input[i] * weights[i + j * ( num_inputs + 1 )] }
+          end
+
+          expect( layer.run( input ) ).to be_narray_like expected
+        end
+      end
+    end
+  end
+end
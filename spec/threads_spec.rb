@@ -0,0 +1,100 @@
+require 'helpers'
+
+describe RuNeNe do
+  before :all do
+    @original_threads = RuNeNe.threads
+  end
+
+  after :each do
+    RuNeNe.threads = @original_threads
+  end
+
+  describe "#threads" do
+    it "is the size of the thread pool, defaulting to at least 1" do
+      expect( RuNeNe.threads ).to be_a Integer
+      expect( RuNeNe.threads ).to be >= 1
+    end
+
+    it "can be set" do
+      RuNeNe.threads = 3
+      expect( RuNeNe.threads ).to eql 3
+      RuNeNe.threads = 1
+      expect( RuNeNe.threads ).to eql 1
+    end
+
+    it "refuses invalid number of threads" do
+      expect { RuNeNe.threads = 0 }.to raise_error ArgumentError
+      expect { RuNeNe.threads = 1000 }.to raise_error ArgumentError
+    end
+  end
+
+  describe "thread pool" do
+    before :each do
+      NArray.srand(800)
+    end
+
+    def with_threads( num_threads )
+      RuNeNe.threads = num_threads
+      yield
+    end
+
+    it "does not change results of #convolve" do
+      signal = NArray.sfloat( 203, 151 ).random( 1.0 )
+      kernel = NArray.sfloat( 7, 5 ).random( 1.0 )
+      single = with_threads( 1 ) { RuNeNe.convolve( signal, kernel ) }
+      pooled = with_threads( 3 ) { RuNeNe.convolve( signal, kernel ) }
+      expect( pooled.to_a ).to eql single.to_a
+    end
+
+    it "does not change results of #max_pool" do
+      input = NArray.sfloat( 301, 257 ).random( 1.0 )
+      single = with_threads( 1 ) { RuNeNe.max_pool( input, 2, 3 ) }
+      pooled = with_threads( 3 ) { RuNeNe.max_pool( input, 2, 3 ) }
+      expect( pooled.to_a ).to eql single.to_a
+    end
+
+    it "does not change results of #convolve or #max_pool for 1D and 3D arrays" do
+      long_signal = NArray.sfloat( 100_003 ).random( 1.0 )
+      long_kernel = NArray.sfloat( 9 ).random( 1.0 )
+      volume = NArray.sfloat( 61, 47, 13 ).random( 1.0 )
+      volume_kernel = NArray.sfloat( 3, 4, 2 ).random( 1.0 )
+
+      results = [ 1, 3 ].map do |num_threads|
+        with_threads( num_threads ) do
+          [ RuNeNe.convolve( long_signal, long_kernel ), RuNeNe.max_pool( long_signal, 3, 4 ),
+            RuNeNe.convolve( volume, volume_kernel ), RuNeNe.max_pool( volume, 2, 3 ) ].map( &:to_a )
+        end
+      end
+
+      expect( results[1] ).to eql results[0]
+    end
+
+    it "does not change results of NNModel#run_batch" do
+      nn = RuNeNe::NNModel.new( [ RuNeNe::Layer::FeedForward.new( 6, 10 ), RuNeNe::Layer::FeedForward.new( 10, 3 ) ] )
+      inputs = NArray.sfloat( 6, 1000 ).random( 1.0 )
+      single = with_threads( 1 ) { nn.run_batch( inputs ) }
+      pooled = with_threads( 3 ) { nn.run_batch( inputs ) }
+      expect( pooled.to_a ).to eql single.to_a
+    end
+
+    it "does not change results of training with option :threads" do
+      nn = RuNeNe::NNModel.new( [ RuNeNe::Layer::FeedForward.new( 4, 8 ), RuNeNe::Layer::FeedForward.new( 8, 2 ) ] )
+      inputs = NArray.sfloat( 4, 500 ).random( 1.0 )
+      targets = NArray.sfloat( 2, 500 ).random( 1.0 )
+
+      results = [ 1, 3 ].map do |num_threads|
+        with_threads( num_threads ) do
+          model = nn.clone
+          learn = RuNeNe::Learn::MBGD.from_nn_model( model, :learning_rate => 0.1 )
+          network = RuNeNe::Network.new( model, learn )
+          RuNeNe.srand( 3_000_000 )
+          data = RuNeNe::DataSet.new( inputs, targets )
+          result = network.train( data, :epochs => 3, :batch_size => 50, :threads => 2, :validation => data )
+          [ result[:validation_loss], model.layer(0).weights.to_a ]
+        end
+      end
+
+      expect( results[1] ).to eql results[0]
+    end
+  end
+end